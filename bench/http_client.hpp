@@ -0,0 +1,207 @@
+#pragma once
+
+// Minimal blocking HTTP/1.1 keep-alive client for the benchmark tools.
+// Speaks just enough HTTP for castor-rt: Content-Length bodies, no chunking.
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace castor::bench {
+
+struct HttpResponse {
+    int status = 0;
+    std::unordered_map<std::string, std::string> headers; // lower-cased names
+    std::string body;
+};
+
+/**
+ * @brief One persistent connection over TCP or a Unix domain socket
+ */
+class HttpConnection {
+public:
+    ~HttpConnection() { close_fd(); }
+
+    HttpConnection(const HttpConnection&) = delete;
+    HttpConnection& operator=(const HttpConnection&) = delete;
+
+    static std::unique_ptr<HttpConnection> tcp(const std::string& host, int port) {
+        auto conn = std::unique_ptr<HttpConnection>(new HttpConnection());
+        conn->host_ = host;
+        conn->port_ = port;
+        return conn->connect() ? std::move(conn) : nullptr;
+    }
+
+    static std::unique_ptr<HttpConnection> unix_socket(const std::string& path) {
+        auto conn = std::unique_ptr<HttpConnection>(new HttpConnection());
+        conn->unix_path_ = path;
+        return conn->connect() ? std::move(conn) : nullptr;
+    }
+
+    /**
+     * @brief Send one request and read the full response
+     *
+     * Reconnects once if the server closed the idle connection.
+     */
+    bool request(const std::string& method, const std::string& path, const std::string& body, HttpResponse& out) {
+        for (int attempt = 0; attempt < 2; ++attempt) {
+            if (fd_ < 0 && !connect()) {
+                return false;
+            }
+            if (send_request(method, path, body) && read_response(out)) {
+                return true;
+            }
+            close_fd();
+        }
+        return false;
+    }
+
+private:
+    HttpConnection() = default;
+
+    bool connect() {
+        close_fd();
+        buffer_.clear();
+        if (!unix_path_.empty()) {
+            fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd_ < 0) return false;
+            sockaddr_un addr{};
+            addr.sun_family = AF_UNIX;
+            std::strncpy(addr.sun_path, unix_path_.c_str(), sizeof(addr.sun_path) - 1);
+            if (::connect(fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0) {
+                close_fd();
+                return false;
+            }
+            return true;
+        }
+
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* res = nullptr;
+        if (::getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &res) != 0 || !res) {
+            return false;
+        }
+        fd_ = ::socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+        const bool ok = fd_ >= 0 && ::connect(fd_, res->ai_addr, res->ai_addrlen) == 0;
+        ::freeaddrinfo(res);
+        if (!ok) {
+            close_fd();
+            return false;
+        }
+        int one = 1;
+        ::setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        return true;
+    }
+
+    void close_fd() {
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool send_all(const std::string& data) {
+        size_t sent = 0;
+        while (sent < data.size()) {
+            ssize_t n = ::send(fd_, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            sent += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    bool send_request(const std::string& method, const std::string& path, const std::string& body) {
+        std::string req;
+        req.reserve(128 + body.size());
+        req += method + " " + path + " HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n";
+        if (!body.empty()) {
+            req += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.size()) + "\r\n";
+        }
+        req += "\r\n";
+        req += body;
+        return send_all(req);
+    }
+
+    bool fill() {
+        char chunk[16384];
+        for (;;) {
+            ssize_t n = ::recv(fd_, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return false;
+            buffer_.append(chunk, static_cast<size_t>(n));
+            return true;
+        }
+    }
+
+    bool read_response(HttpResponse& out) {
+        size_t header_end;
+        while ((header_end = buffer_.find("\r\n\r\n")) == std::string::npos) {
+            if (!fill()) return false;
+        }
+
+        out = HttpResponse();
+        const std::string head = buffer_.substr(0, header_end);
+        size_t line_end = head.find("\r\n");
+        const std::string status_line = head.substr(0, line_end);
+        const size_t sp = status_line.find(' ');
+        if (sp == std::string::npos) return false;
+        out.status = std::atoi(status_line.c_str() + sp + 1);
+
+        size_t pos = line_end == std::string::npos ? head.size() : line_end + 2;
+        while (pos < head.size()) {
+            size_t eol = head.find("\r\n", pos);
+            if (eol == std::string::npos) eol = head.size();
+            const std::string line = head.substr(pos, eol - pos);
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                std::string name = line.substr(0, colon);
+                std::transform(name.begin(), name.end(), name.begin(),
+                               [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+                size_t v = colon + 1;
+                while (v < line.size() && line[v] == ' ') ++v;
+                out.headers[name] = line.substr(v);
+            }
+            pos = eol + 2;
+        }
+
+        size_t content_length = 0;
+        auto it = out.headers.find("content-length");
+        if (it != out.headers.end()) {
+            content_length = static_cast<size_t>(std::strtoull(it->second.c_str(), nullptr, 10));
+        }
+
+        const size_t body_start = header_end + 4;
+        while (buffer_.size() < body_start + content_length) {
+            if (!fill()) return false;
+        }
+        out.body = buffer_.substr(body_start, content_length);
+        buffer_.erase(0, body_start + content_length);
+
+        auto conn = out.headers.find("connection");
+        if (conn != out.headers.end() && conn->second == "close") {
+            close_fd();
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+    std::string host_;
+    int port_ = 0;
+    std::string unix_path_;
+    std::string buffer_;
+};
+
+} // namespace castor::bench
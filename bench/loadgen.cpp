@@ -0,0 +1,342 @@
+// Open-loop load generator: replays a JSONL workload against castor-rt.
+//
+//   ./bin/castor-loadgen --workload prompts.jsonl --qps 200 --connections 64
+//                        --requests 20000 --json results.json
+//
+// Each workload line is either an /infer body ({"prompt": ..., "max_tokens": ...})
+// or any object with a string "body" field, which is sent as the prompt. Lines
+// are replayed round-robin until --requests (or --duration x --qps) is reached.
+//
+// Arrival times are fixed up front (Poisson or constant spacing) and latency
+// is measured from the scheduled send time, not the actual one, so a stalled
+// server shows up as queueing delay instead of silently lowering the offered
+// load (coordinated omission).
+//
+// The server does not stream, so TTFT is the dispatch lag plus the server's own
+// arrival-to-first-token time ("time_to_first_token_ms" in the response). The
+// network round trip before the request reaches the handler is not included.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "http_client.hpp"
+#include "stats.hpp"
+
+using json = nlohmann::json;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string unix_socket_path;
+    std::string workload_path;
+    double qps = 50.0;
+    bool poisson = true;
+    size_t connections = 32;
+    size_t requests = 0;  // 0 = one pass over the workload
+    double duration = 0.0; // Seconds; overrides --requests when set
+    int max_tokens = -1;   // -1 = keep the workload's value
+    uint64_t seed = 42;
+    std::string json_path;
+    std::string baseline_path;
+};
+
+struct Sample {
+    bool ok = false;
+    double latency = 0.0; // Scheduled send -> response
+    double ttft = 0.0;
+    double lag = 0.0;     // Scheduled send -> actual send
+    size_t output_tokens = 0;
+};
+
+bool load_workload(const Options& options, std::vector<std::string>& bodies) {
+    std::ifstream file(options.workload_path);
+    if (!file.is_open()) {
+        std::cerr << "[LoadGen] Failed to open workload: " << options.workload_path << "\n";
+        return false;
+    }
+
+    std::string line;
+    size_t skipped = 0;
+    while (std::getline(file, line)) {
+        if (line.empty()) continue;
+        json request;
+        try {
+            const json entry = json::parse(line);
+            if (entry.contains("prompt")) {
+                request = entry;
+            } else if (entry.contains("body") && entry["body"].is_string()) {
+                request["prompt"] = entry["body"];
+                request["max_tokens"] = 16;
+            } else {
+                ++skipped;
+                continue;
+            }
+        } catch (const json::exception&) {
+            ++skipped;
+            continue;
+        }
+        if (options.max_tokens >= 0) {
+            request["max_tokens"] = options.max_tokens;
+        }
+        bodies.push_back(request.dump());
+    }
+    if (skipped > 0) {
+        std::cerr << "[LoadGen] Skipped " << skipped << " lines without a prompt\n";
+    }
+    if (bodies.empty()) {
+        std::cerr << "[LoadGen] Workload has no usable requests\n";
+        return false;
+    }
+    return true;
+}
+
+// Offsets (seconds from start) at which each request is due
+std::vector<double> schedule(const Options& options, size_t count) {
+    std::vector<double> offsets(count);
+    std::mt19937_64 rng(options.seed);
+    std::exponential_distribution<double> gap(options.qps);
+    double t = 0.0;
+    for (size_t i = 0; i < count; ++i) {
+        offsets[i] = t;
+        t += options.poisson ? gap(rng) : 1.0 / options.qps;
+    }
+    return offsets;
+}
+
+std::unique_ptr<castor::bench::HttpConnection> connect(const Options& options) {
+    return options.unix_socket_path.empty() ? castor::bench::HttpConnection::tcp(options.host, options.port)
+                                            : castor::bench::HttpConnection::unix_socket(options.unix_socket_path);
+}
+
+void worker(const Options& options, const std::vector<std::string>& bodies, const std::vector<double>& offsets,
+            Clock::time_point start, std::atomic<size_t>& next, std::vector<Sample>& samples) {
+    std::unique_ptr<castor::bench::HttpConnection> conn;
+    castor::bench::HttpResponse response;
+    for (;;) {
+        const size_t i = next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= offsets.size()) return;
+
+        const auto due = start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offsets[i]));
+        std::this_thread::sleep_until(due);
+        const auto sent = Clock::now();
+
+        Sample& sample = samples[i];
+        sample.lag = std::chrono::duration<double>(sent - due).count();
+        // (Re)connect lazily: the server may not be up yet, or may have closed
+        // an idle keep-alive connection. A request on a reused connection that
+        // fails is retried once on a fresh one.
+        const std::string& body = bodies[i % bodies.size()];
+        bool sent_ok = false;
+        for (int attempt = 0; attempt < 2 && !sent_ok; ++attempt) {
+            const bool reused = conn != nullptr;
+            if (!conn) {
+                conn = connect(options);
+            }
+            sent_ok = conn && conn->request("POST", "/infer", body, response);
+            if (!sent_ok) {
+                conn.reset();
+                if (!reused) {
+                    break;
+                }
+            }
+        }
+        if (!sent_ok || response.status != 200) {
+            continue;
+        }
+        const auto done = Clock::now();
+
+        sample.ok = true;
+        sample.latency = std::chrono::duration<double>(done - due).count();
+        sample.ttft = sample.latency;
+        try {
+            const json result = json::parse(response.body);
+            sample.output_tokens = result.value("output_tokens", size_t{0});
+            if (result.contains("time_to_first_token_ms")) {
+                sample.ttft = std::min(sample.latency,
+                                       sample.lag + result["time_to_first_token_ms"].get<double>() / 1e3);
+            }
+        } catch (const json::exception&) {
+        }
+    }
+}
+
+json summary_json(const castor::bench::Summary& s, double scale) {
+    return json{{"mean", s.mean * scale}, {"p50", s.p50 * scale},   {"p90", s.p90 * scale},
+                {"p99", s.p99 * scale},   {"p999", s.p999 * scale}, {"max", s.max * scale}};
+}
+
+void compare_baseline(const std::string& path, const json& current) {
+    std::ifstream file(path);
+    json baseline;
+    try {
+        baseline = json::parse(file);
+    } catch (const json::exception& e) {
+        std::cerr << "[LoadGen] Cannot read baseline " << path << ": " << e.what() << "\n";
+        return;
+    }
+    std::cout << "[LoadGen] vs baseline " << path << "\n";
+    auto delta = [&](const char* group, const char* key) {
+        if (!baseline.contains(group) || !baseline[group].contains(key)) return;
+        const double before = baseline[group][key].get<double>();
+        const double after = current[group][key].get<double>();
+        const double pct = before > 0.0 ? (after - before) / before * 100.0 : 0.0;
+        std::cout << "  " << group << "." << key << ": " << before << " -> " << after << " (" << (pct >= 0 ? "+" : "")
+                  << pct << "%)\n";
+    };
+    for (const char* key : {"p50", "p90", "p99", "p999"}) delta("latency_ms", key);
+    for (const char* key : {"p50", "p99"}) delta("ttft_ms", key);
+    if (baseline.contains("output_tokens_per_second")) {
+        std::cout << "  output_tokens_per_second: " << baseline["output_tokens_per_second"] << " -> "
+                  << current["output_tokens_per_second"] << "\n";
+    }
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--host" && has_value) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && has_value) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--unix-socket" && has_value) {
+            options.unix_socket_path = argv[++i];
+        } else if (arg == "--workload" && has_value) {
+            options.workload_path = argv[++i];
+        } else if (arg == "--qps" && has_value) {
+            options.qps = std::atof(argv[++i]);
+        } else if (arg == "--arrival" && has_value) {
+            const std::string mode = argv[++i];
+            options.poisson = mode != "constant";
+        } else if (arg == "--connections" && has_value) {
+            options.connections = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--requests" && has_value) {
+            options.requests = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--duration" && has_value) {
+            options.duration = std::atof(argv[++i]);
+        } else if (arg == "--max-tokens" && has_value) {
+            options.max_tokens = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            options.baseline_path = argv[++i];
+        } else {
+            std::cerr << "Usage: castor-loadgen --workload FILE [--qps N] [--arrival poisson|constant]\n"
+                         "                      [--connections N] [--requests N | --duration S] [--max-tokens N]\n"
+                         "                      [--host H] [--port N] [--unix-socket PATH] [--seed N]\n"
+                         "                      [--json OUT] [--baseline PREV.json]\n";
+            return 1;
+        }
+    }
+    if (options.workload_path.empty() || options.qps <= 0.0 || options.connections == 0) {
+        std::cerr << "[LoadGen] --workload is required; --qps and --connections must be positive\n";
+        return 1;
+    }
+
+    std::vector<std::string> bodies;
+    if (!load_workload(options, bodies)) {
+        return 1;
+    }
+    size_t count = options.requests > 0 ? options.requests : bodies.size();
+    if (options.duration > 0.0) {
+        count = static_cast<size_t>(options.duration * options.qps);
+    }
+
+    const std::vector<double> offsets = schedule(options, count);
+    std::vector<Sample> samples(count);
+    std::atomic<size_t> next{0};
+
+    std::cout << "[LoadGen] " << count << " requests at " << options.qps << " req/s ("
+              << (options.poisson ? "poisson" : "constant") << "), " << options.connections << " connections\n";
+
+    // Small head start so every connection is open before the first arrival
+    const auto start = Clock::now() + std::chrono::milliseconds(100);
+    std::vector<std::thread> threads;
+    threads.reserve(options.connections);
+    for (size_t c = 0; c < options.connections; ++c) {
+        threads.emplace_back(worker, std::cref(options), std::cref(bodies), std::cref(offsets), start, std::ref(next),
+                             std::ref(samples));
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double wall = std::chrono::duration<double>(Clock::now() - start).count();
+
+    std::vector<double> latency, ttft, lag, per_request_tps;
+    size_t errors = 0;
+    size_t total_tokens = 0;
+    for (const Sample& s : samples) {
+        if (!s.ok) {
+            ++errors;
+            continue;
+        }
+        latency.push_back(s.latency);
+        ttft.push_back(s.ttft);
+        lag.push_back(s.lag);
+        total_tokens += s.output_tokens;
+        if (s.output_tokens > 0 && s.latency > 0.0) {
+            per_request_tps.push_back(static_cast<double>(s.output_tokens) / s.latency);
+        }
+    }
+
+    const auto latency_summary = castor::bench::summarize(latency);
+    const auto ttft_summary = castor::bench::summarize(ttft);
+    const auto lag_summary = castor::bench::summarize(lag);
+    const auto tps_summary = castor::bench::summarize(per_request_tps);
+
+    json result;
+    result["config"] = {{"workload", options.workload_path},
+                        {"qps", options.qps},
+                        {"arrival", options.poisson ? "poisson" : "constant"},
+                        {"connections", options.connections},
+                        {"requests", count},
+                        {"max_tokens", options.max_tokens},
+                        {"seed", options.seed},
+                        {"transport", options.unix_socket_path.empty() ? "tcp" : "unix"}};
+    result["completed"] = latency.size();
+    result["errors"] = errors;
+    result["wall_seconds"] = wall;
+    result["achieved_qps"] = wall > 0.0 ? static_cast<double>(latency.size()) / wall : 0.0;
+    result["latency_ms"] = summary_json(latency_summary, 1e3);
+    result["ttft_ms"] = summary_json(ttft_summary, 1e3);
+    result["dispatch_lag_ms"] = summary_json(lag_summary, 1e3);
+    result["output_tokens"] = total_tokens;
+    result["output_tokens_per_second"] = wall > 0.0 ? static_cast<double>(total_tokens) / wall : 0.0;
+    result["request_tokens_per_second"] = summary_json(tps_summary, 1.0);
+
+    std::cout << "[LoadGen] completed " << latency.size() << ", errors " << errors << ", achieved "
+              << result["achieved_qps"].get<double>() << " req/s\n";
+    std::cout << "[LoadGen] latency ms: p50 " << latency_summary.p50 * 1e3 << ", p90 " << latency_summary.p90 * 1e3
+              << ", p99 " << latency_summary.p99 * 1e3 << ", p999 " << latency_summary.p999 * 1e3 << "\n";
+    std::cout << "[LoadGen] ttft ms:    p50 " << ttft_summary.p50 * 1e3 << ", p99 " << ttft_summary.p99 * 1e3 << "\n";
+    std::cout << "[LoadGen] throughput: " << result["output_tokens_per_second"].get<double>() << " output tokens/s\n";
+    if (lag_summary.p99 > 0.010) {
+        std::cout << "[LoadGen] warning: p99 dispatch lag " << lag_summary.p99 * 1e3
+                  << " ms; add --connections to keep the load open-loop\n";
+    }
+
+    if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path);
+        out << result.dump(2) << "\n";
+    }
+    if (!options.baseline_path.empty()) {
+        compare_baseline(options.baseline_path, result);
+    }
+    return errors == count ? 1 : 0;
+}
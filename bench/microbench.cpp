@@ -0,0 +1,711 @@
+// Microbenchmarks for the tokenizer, engine, CPU kernels, session resume, sampler,
+// grammar masks, stop sequences and the /infer and /embeddings handlers.
+//
+//   ./bin/castor-bench                                  # run everything
+//   ./bin/castor-bench --filter tokenizer --json out.json
+//   ./bin/castor-bench --baseline bench/baseline.json --threshold 0.10
+//
+// Inputs are generated from fixed seeds and word lists, so two runs on the same
+// build see byte-identical corpora. Each benchmark is calibrated to run for at
+// least --min-time seconds per repetition; the median of --repetitions is
+// reported. With --baseline, any benchmark slower than baseline by more than
+// --threshold makes the process exit non-zero.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "engine.hpp"
+#include "grammar.hpp"
+#include "kernels.hpp"
+#include "sampler.hpp"
+#include "server.hpp"
+#include "session_store.hpp"
+#include "stop_sequences.hpp"
+#include "tokenizer.hpp"
+
+using json = nlohmann::json;
+
+namespace {
+
+struct Options {
+    std::string filter;
+    std::string json_path;
+    std::string baseline_path;
+    double threshold = 0.10;
+    double min_time = 0.2;
+    size_t repetitions = 5;
+};
+
+struct Result {
+    std::string name;
+    double ns_per_op = 0.0;
+    uint64_t iterations = 0;
+    double items_per_op = 0.0; // Bytes or tokens processed per op (0 = n/a)
+    std::string item_unit;
+};
+
+volatile uint64_t g_sink = 0;
+
+// ============ Fixed corpora ============
+
+inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t x = (state += 0x9E3779B97F4A7C15ULL);
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+const std::vector<std::string> kEnglishWords = {
+    "the", "of", "and", "to", "in", "is", "that", "for", "it", "as", "was", "with", "be", "by", "on", "not",
+    "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had", "they", "you", "were",
+    "their", "one", "all", "we", "can", "her", "has", "there", "been", "model", "token", "inference", "latency",
+    "request", "server", "memory", "cache", "batch", "sequence", "throughput", "kernel", "tensor", "engine"};
+
+const std::vector<std::string> kCodeWords = {
+    "int", "const", "auto", "return", "if", "else", "for", "while", "{", "}", "(", ")", ";", "=", "==", "+=",
+    "std::vector<int32_t>", "size_t", "i", "j", "++i", "nullptr", "true", "false", "0", "1", "->", "::",
+    "template", "<typename", "T>", "void", "bool", "static", "struct", "class", "public:", "private:"};
+
+const std::vector<std::string> kUnicodeWords = {
+    "naïve", "café", "Zürich", "東京", "日本語", "모델", "данные", "λόγος", "emoji🙂", "ﬁnancial", "résumé",
+    "São", "Paulo", "北京", "مرحبا", "שלום", "हिन्दी", "ไทย", "Ελλάδα", "Ωmega"};
+
+std::string make_text(const std::vector<std::string>& words, size_t target_bytes, uint64_t seed) {
+    std::string text;
+    text.reserve(target_bytes + 32);
+    uint64_t state = seed;
+    while (text.size() < target_bytes) {
+        text += words[splitmix64(state) % words.size()];
+        text += (splitmix64(state) % 12 == 0) ? '\n' : ' ';
+    }
+    return text;
+}
+
+// HF-style tokenizer.json: every printable ASCII char, the corpus words, then
+// filler entries up to vocab_size. With added_tokens, also Llama-3 style
+// special tokens: chat markers and 250 reserved ones, all starting with '<'.
+std::string write_tokenizer(size_t vocab_size, bool added_tokens = false) {
+    json vocab = json::object();
+    size_t next_id = 0;
+    auto add = [&](const std::string& token) {
+        if (next_id < vocab_size && !vocab.contains(token)) {
+            vocab[token] = std::to_string(next_id++);
+        }
+    };
+    for (char c = 32; c < 127; ++c) add(std::string(1, c));
+    for (const auto* list : {&kEnglishWords, &kCodeWords, &kUnicodeWords}) {
+        for (const auto& word : *list) add(word);
+    }
+    while (next_id < vocab_size) add("tok" + std::to_string(next_id));
+
+    json added = json::array();
+    if (added_tokens) {
+        std::vector<std::string> specials = {"<|begin_of_text|>", "<|end_of_text|>", "<|start_header_id|>",
+                                             "<|end_header_id|>", "<|eot_id|>", "<s>"};
+        for (int i = 0; i < 250; ++i) specials.push_back("<|reserved_special_token_" + std::to_string(i) + "|>");
+        for (const auto& content : specials) {
+            added.push_back({{"id", next_id++}, {"content", content}, {"special", true}, {"normalized", false}});
+        }
+    }
+
+    const std::string path = "/tmp/castor-bench-tokenizer-" + std::to_string(vocab_size) + "-" +
+                             std::to_string(::getpid()) + (added_tokens ? "-added" : "") + ".json";
+    std::ofstream file(path);
+    file << json{{"model", {{"vocab", vocab}}}, {"added_tokens", added}}.dump();
+    return path;
+}
+
+// ============ Harness ============
+
+template <typename F>
+Result measure(const std::string& name, const Options& options, F&& op) {
+    using Clock = std::chrono::steady_clock;
+    op(); // Warm caches and lazy state
+
+    // Calibrate so one repetition lasts at least min_time
+    uint64_t iterations = 1;
+    for (;;) {
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) op();
+        const double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (elapsed >= options.min_time || iterations >= (uint64_t{1} << 40)) break;
+        const double scale = elapsed > 0.0 ? options.min_time / elapsed * 1.2 : 10.0;
+        iterations = std::max<uint64_t>(iterations + 1, static_cast<uint64_t>(iterations * std::min(scale, 10.0)));
+    }
+
+    std::vector<double> samples;
+    for (size_t r = 0; r < options.repetitions; ++r) {
+        const auto start = Clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) op();
+        samples.push_back(std::chrono::duration<double, std::nano>(Clock::now() - start).count() /
+                          static_cast<double>(iterations));
+    }
+    std::sort(samples.begin(), samples.end());
+
+    Result result;
+    result.name = name;
+    result.ns_per_op = samples[samples.size() / 2];
+    result.iterations = iterations;
+    return result;
+}
+
+class Suite {
+public:
+    explicit Suite(const Options& options) : options_(options) {}
+
+    bool selected(const std::string& name) const {
+        return options_.filter.empty() || name.find(options_.filter) != std::string::npos;
+    }
+
+    template <typename F>
+    void add(const std::string& name, F&& op, double items_per_op = 0.0, const std::string& unit = "") {
+        if (!selected(name)) return;
+        Result result = measure(name, options_, std::forward<F>(op));
+        result.items_per_op = items_per_op;
+        result.item_unit = unit;
+        std::cout << "[Bench] " << name << ": " << result.ns_per_op << " ns/op";
+        if (items_per_op > 0.0) {
+            std::cout << " (" << items_per_op / result.ns_per_op * 1e3 << " M" << unit << "/s)";
+        }
+        std::cout << "\n";
+        results_.push_back(std::move(result));
+    }
+
+    const std::vector<Result>& results() const { return results_; }
+
+private:
+    Options options_;
+    std::vector<Result> results_;
+};
+
+// ============ Benchmarks ============
+
+void bench_tokenizer(Suite& suite) {
+    struct Corpus {
+        const char* name;
+        const std::vector<std::string>* words;
+    };
+    const Corpus corpora[] = {{"english", &kEnglishWords}, {"code", &kCodeWords}, {"unicode", &kUnicodeWords}};
+
+    for (size_t vocab_size : {1000, 32000, 128000}) {
+        const std::string prefix = "tokenizer/vocab=" + std::to_string(vocab_size / 1000) + "k/";
+        if (!suite.selected(prefix)) continue;
+
+        const std::string path = write_tokenizer(vocab_size);
+        castor::Tokenizer tokenizer;
+        const bool loaded = tokenizer.load(path);
+        std::remove(path.c_str());
+        if (!loaded) {
+            std::cerr << "[Bench] Failed to load synthetic tokenizer (vocab " << vocab_size << ")\n";
+            continue;
+        }
+
+        for (const auto& corpus : corpora) {
+            const std::string text = make_text(*corpus.words, 16 * 1024, 0xC0FFEE);
+            const std::vector<int32_t> ids = tokenizer.encode(text);
+            suite.add(
+                prefix + "encode/" + corpus.name, [&] { g_sink = g_sink + tokenizer.encode(text).size(); },
+                static_cast<double>(text.size()), "B");
+            suite.add(
+                prefix + "decode/" + corpus.name, [&] { g_sink = g_sink + tokenizer.decode(ids).size(); },
+                static_cast<double>(ids.size()), "tok");
+        }
+
+        // Special-token matching: its cost on plain text (compare with encode/english), and on a
+        // chat-templated conversation where the markers are carved out before word encoding
+        const std::string added_path = write_tokenizer(vocab_size, true);
+        castor::Tokenizer templated;
+        const bool added_loaded = templated.load(added_path);
+        std::remove(added_path.c_str());
+        if (!added_loaded) {
+            continue;
+        }
+        const std::string english = make_text(kEnglishWords, 16 * 1024, 0xC0FFEE);
+        std::string chat = "<|begin_of_text|>";
+        for (uint64_t turn = 0; chat.size() < 16 * 1024; ++turn) {
+            chat += "<|start_header_id|>" + std::string(turn % 2 ? "assistant" : "user") + "<|end_header_id|>\n\n";
+            chat += make_text(kEnglishWords, 200, turn) + "<|eot_id|>";
+        }
+        suite.add(
+            prefix + "encode/english+added_tokens", [&] { g_sink = g_sink + templated.encode(english).size(); },
+            static_cast<double>(english.size()), "B");
+        suite.add(
+            prefix + "encode/chat_template", [&] { g_sink = g_sink + templated.encode(chat).size(); },
+            static_cast<double>(chat.size()), "B");
+    }
+}
+
+void bench_engine(Suite& suite) {
+    castor::Engine engine;
+    castor::ModelConfig config;
+    config.vocab_size = 32000;
+    config.max_seq_length = 4096;
+    engine.initialize("bench.plan", config);
+
+    std::vector<float> logits;
+    for (size_t length : {16, 128, 512, 2048}) {
+        std::vector<int32_t> ids(length);
+        uint64_t state = length;
+        for (auto& id : ids) id = static_cast<int32_t>(splitmix64(state) % config.vocab_size);
+        suite.add(
+            "engine/infer/seq=" + std::to_string(length),
+            [&] {
+                engine.infer(ids, logits);
+                g_sink = g_sink + logits.size();
+            },
+            static_cast<double>(length), "tok");
+    }
+
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 32;
+    castor::GenerationResult result;
+    const std::vector<int32_t> prompt(64, 7);
+    suite.add(
+        "engine/generate/greedy/prompt=64/new=32",
+        [&] {
+            engine.generate(prompt, params, result);
+            g_sink = g_sink + result.output_ids.size();
+        },
+        32.0, "tok");
+
+    // 64 short inputs in one ragged batch
+    uint64_t state = 64;
+    std::vector<std::vector<int32_t>> inputs(64);
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        inputs[i].resize(8 + i % 24);
+        for (auto& id : inputs[i]) id = static_cast<int32_t>(splitmix64(state) % config.vocab_size);
+    }
+    size_t input_tokens = 0;
+    for (const auto& input : inputs) input_tokens += input.size();
+    std::vector<float> embeddings;
+    suite.add(
+        "engine/embed/inputs=64/mean",
+        [&] {
+            engine.embed(inputs, castor::EmbeddingOptions(), embeddings);
+            g_sink = g_sink + embeddings.size();
+        },
+        static_cast<double>(input_tokens), "tok");
+}
+
+// Each kernel at deployed shapes: portable, any-size ISA and shape-specialized
+// instances. Weight slices are sized to stay in L2, so compute is measured
+// rather than DRAM bandwidth.
+void bench_kernels(Suite& suite) {
+    if (!suite.selected("kernels/")) return;
+
+    struct Variant {
+        std::string name;
+        castor::Isa isa;
+        bool specialize;
+    };
+    std::vector<Variant> variants = {{"generic", castor::Isa::Generic, false}};
+    for (castor::Isa isa : {castor::Isa::Avx2, castor::Isa::Avx512}) {
+        if (isa <= castor::Kernels::detect_isa()) {
+            variants.push_back({castor::Kernels::isa_name(isa), isa, false});
+            variants.push_back({std::string(castor::Kernels::isa_name(isa)) + "-fixed", isa, true});
+        }
+    }
+    auto random = [](size_t count, uint64_t seed) {
+        std::vector<float> values(count);
+        for (auto& v : values) v = static_cast<float>(splitmix64(seed) % 2001) / 1000.0f - 1.0f;
+        return values;
+    };
+
+    constexpr size_t kRows = 32;
+    constexpr size_t kBatch = 8;
+    for (uint32_t cols : {4096u, 5120u, 11008u, 14336u}) {
+        castor::ModelConfig config;
+        config.hidden_dim = cols;
+        const std::vector<float> w = random(kRows * cols, cols);
+        const std::vector<float> x = random(kBatch * cols, cols + 1);
+        std::vector<float> y(kBatch * kRows);
+        for (const auto& variant : variants) {
+            const castor::KernelSet kernels = castor::Kernels::select(config, variant.isa, variant.specialize);
+            const std::string shape = std::to_string(kRows) + "x" + std::to_string(cols) + "/";
+            suite.add(
+                "kernels/gemv/" + shape + variant.name,
+                [&] {
+                    kernels.gemv_hidden(w.data(), x.data(), y.data(), kRows, cols);
+                    g_sink = g_sink + static_cast<uint64_t>(y[0] != 0.0f);
+                },
+                2.0 * kRows * cols, "flop");
+            if (cols != 4096) continue;
+            suite.add(
+                "kernels/gemm/batch=" + std::to_string(kBatch) + "/" + shape + variant.name,
+                [&] {
+                    kernels.gemm_hidden(w.data(), x.data(), y.data(), kBatch, kRows, cols);
+                    g_sink = g_sink + static_cast<uint64_t>(y[0] != 0.0f);
+                },
+                2.0 * kBatch * kRows * cols, "flop");
+        }
+    }
+
+    for (uint32_t dim : {4096u, 5120u, 8192u}) {
+        castor::ModelConfig config;
+        config.hidden_dim = dim;
+        const std::vector<float> x = random(dim, dim);
+        const std::vector<float> gamma = random(dim, dim + 1);
+        std::vector<float> out(dim);
+        for (const auto& variant : variants) {
+            const castor::KernelSet kernels = castor::Kernels::select(config, variant.isa, variant.specialize);
+            suite.add(
+                "kernels/rms_norm/" + std::to_string(dim) + "/" + variant.name,
+                [&] {
+                    kernels.rms_norm(x.data(), gamma.data(), out.data(), dim, 1e-5f);
+                    g_sink = g_sink + static_cast<uint64_t>(out[0] != 0.0f);
+                },
+                static_cast<double>(dim), "elem");
+        }
+    }
+
+    for (uint32_t vocab : {32000u, 128256u}) {
+        castor::ModelConfig config;
+        config.vocab_size = vocab;
+        const std::vector<float> logits = random(vocab, vocab);
+        std::vector<float> probs(vocab);
+        for (const auto& variant : variants) {
+            const castor::KernelSet kernels = castor::Kernels::select(config, variant.isa, variant.specialize);
+            suite.add(
+                "kernels/softmax/" + std::to_string(vocab) + "/" + variant.name,
+                [&] {
+                    std::copy(logits.begin(), logits.end(), probs.begin());
+                    kernels.softmax(probs.data(), vocab);
+                    g_sink = g_sink + static_cast<uint64_t>(probs[0] != 0.0f);
+                },
+                static_cast<double>(vocab), "elem");
+        }
+    }
+}
+
+// Next turn of a chat session: resume its snapshot from RAM or from a mapped
+// file and prefill 16 new tokens, against re-prefilling the whole history.
+// The stand-in engine prefills at hashing speed, so the re-prefill cost is the
+// projection FLOPs of a hidden=512, 8-layer model on the CPU kernels
+// (attention excluded, so it understates the real cost).
+void bench_sessions(Suite& suite) {
+    if (!suite.selected("sessions/")) return;
+
+    castor::ModelConfig config;
+    config.vocab_size = 32000;
+    config.hidden_dim = 512;
+    config.num_layers = 8;
+    config.max_seq_length = 4096;
+    castor::Engine engine;
+    engine.initialize("bench.plan", config);
+    const std::string dir = "/tmp/castor-bench-sessions-" + std::to_string(::getpid());
+    castor::SessionStore::Options options;
+    options.directory = dir;
+    castor::SessionStore store(options);
+
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 0;
+    constexpr size_t kNewTokens = 16;
+    for (size_t history : {256, 1024}) {
+        std::vector<int32_t> prompt(history + kNewTokens);
+        uint64_t seed = history;
+        for (auto& id : prompt) id = static_cast<int32_t>(splitmix64(seed) % config.vocab_size);
+        castor::SequenceState state;
+        engine.extend(state, prompt.data(), history);
+        std::vector<uint8_t> kv;
+        engine.save_kv(state, kv);
+        const std::string id = "bench-" + std::to_string(history);
+        store.put(id, castor::SessionSnapshot::make(std::vector<int32_t>(prompt.begin(), prompt.begin() + history),
+                                                    state, std::move(kv)));
+        store.spill_idle(std::chrono::seconds(0));
+        store.flush();
+
+        auto resume = [&] {
+            auto snapshot = store.get(id);
+            engine.restore_kv(snapshot->state, snapshot->kv, snapshot->kv_bytes);
+            castor::GenerationStream stream(engine, prompt, params);
+            stream.resume_from(snapshot->state, snapshot->tokens.size());
+            stream.prefill();
+            g_sink = g_sink + stream.state().length;
+        };
+        const std::string suffix = "/tokens=" + std::to_string(history);
+        suite.add("sessions/resume/ram" + suffix, resume, static_cast<double>(history), "tok");
+        suite.add(
+            "sessions/resume/disk" + suffix,
+            [&] {
+                store.spill_idle(std::chrono::seconds(0)); // Already on disk: just leaves RAM
+                resume();
+            },
+            static_cast<double>(history), "tok");
+
+        // Q/K/V/O plus gate/up/down, as one gemm over a stacked weight per layer
+        const castor::KernelSet kernels = castor::Kernels::select(config);
+        const size_t hidden = config.hidden_dim;
+        const size_t rows = 4 * hidden + 3 * castor::Kernels::ffn_dim(config);
+        constexpr size_t kChunk = 64;
+        std::vector<float> w(rows * hidden, 0.01f);
+        std::vector<float> x(kChunk * hidden, 0.5f);
+        std::vector<float> y(kChunk * rows);
+        suite.add(
+            "sessions/reprefill_projections" + suffix,
+            [&] {
+                for (size_t layer = 0; layer < config.num_layers; ++layer) {
+                    for (size_t done = 0; done < prompt.size(); done += kChunk) {
+                        const size_t batch = std::min(kChunk, prompt.size() - done);
+                        kernels.gemm_hidden(w.data(), x.data(), y.data(), batch, rows, hidden);
+                    }
+                }
+                g_sink = g_sink + static_cast<uint64_t>(y[0] != 0.0f);
+            },
+            static_cast<double>(history), "tok");
+    }
+    std::filesystem::remove_all(dir);
+}
+
+void bench_sampler(Suite& suite) {
+    std::vector<float> logits(32000);
+    uint64_t state = 42;
+    for (auto& v : logits) {
+        const double u = static_cast<double>(splitmix64(state) >> 11) * 0x1.0p-53;
+        v = static_cast<float>(16.0 * u * u * u - 4.0);
+    }
+
+    struct Mode {
+        const char* name;
+        float temperature;
+        int32_t top_k;
+        float top_p;
+    };
+    const Mode modes[] = {{"greedy", 0.0f, 0, 1.0f},
+                          {"temperature", 0.8f, 0, 1.0f},
+                          {"top_k=40", 0.8f, 40, 1.0f},
+                          {"top_p=0.9", 0.8f, 0, 0.9f}};
+    castor::Sampler sampler(1234);
+    for (const auto& mode : modes) {
+        castor::SamplingParams params;
+        params.temperature = mode.temperature;
+        params.top_k = mode.top_k;
+        params.top_p = mode.top_p;
+        suite.add(std::string("sampler/vocab=32k/") + mode.name,
+                  [&] { g_sink = g_sink + static_cast<uint64_t>(sampler.sample(logits, params)); });
+    }
+}
+
+void bench_grammar(Suite& suite) {
+    if (!suite.selected("grammar/")) return;
+
+    const std::string path = write_tokenizer(32000);
+    castor::Tokenizer tokenizer;
+    tokenizer.load(path);
+    std::remove(path.c_str());
+    const auto vocabulary = tokenizer.token_table();
+
+    const std::string schema = R"({"type": "object", "properties": {"id": {"type": "integer"},
+        "name": {"type": "string"}, "tags": {"type": "array", "items": {"type": "string"}}},
+        "required": ["id", "name"]})";
+    std::string error;
+    const int32_t eos = 31999; // Id 2 is '"' in the synthetic vocab
+    const auto masks = castor::TokenMasks::compile("json_schema", schema, vocabulary, 32000, eos, error);
+    if (!masks) {
+        std::cerr << "[Bench] Failed to compile schema: " << error << "\n";
+        return;
+    }
+
+    // At the start only '{' is allowed; inside a string nearly every token is.
+    // write_tokenizer gives printable character c the id c - 32.
+    int32_t in_string = masks->start();
+    for (char c : std::string(R"({"id":1,"name":")")) {
+        in_string = masks->advance(in_string, c - 32);
+    }
+    std::vector<float> logits(32000, 0.5f);
+    for (const auto& [name, state] : {std::pair<const char*, int32_t>{"sparse", masks->start()},
+                                      std::pair<const char*, int32_t>{"dense", in_string}}) {
+        if (state == castor::Grammar::kDead) continue;
+        suite.add(std::string("grammar/apply_mask/vocab=32k/") + name, [&, state = state] {
+            masks->apply(state, logits);
+            g_sink = g_sink + static_cast<uint64_t>(logits[0] < 0.0f);
+        });
+    }
+    suite.add("grammar/compile_and_first_mask/vocab=32k", [&] {
+        castor::TokenMasks cold(castor::Grammar::from_json_schema(json::parse(schema), error), vocabulary, 32000, eos);
+        g_sink = g_sink + cold.allowed(cold.start()).size();
+    });
+}
+
+void bench_stop(Suite& suite) {
+    if (!suite.selected("stop/")) return;
+
+    const std::string path = write_tokenizer(32000);
+    castor::Tokenizer tokenizer;
+    tokenizer.load(path);
+    std::remove(path.c_str());
+
+    // 16 stop strings that never occur, so every token is checked to the end
+    const std::vector<int32_t> tokens = tokenizer.encode(make_text(kEnglishWords, 4 * 1024, 0x570B));
+    std::vector<std::string> strings;
+    for (size_t i = 0; i < 16; ++i) {
+        strings.push_back("\n\n" + kEnglishWords[i % kEnglishWords.size()] + std::to_string(i));
+    }
+    std::string error;
+    const auto stop = castor::StopSequences::compile(strings, {}, tokenizer.token_table(), error);
+    std::string text;
+    text.reserve(16 * 1024);
+    const std::string tag = "/stops=16/tokens=" + std::to_string(tokens.size());
+    suite.add("stop/aho_corasick" + tag, [&] {
+        text.clear();
+        int32_t state = stop->start();
+        for (int32_t token : tokens) {
+            stop->append(state, token, text);
+        }
+        g_sink = g_sink + text.size();
+    });
+    // What it replaces: search the whole output for every stop after each token
+    suite.add("stop/naive_find" + tag, [&] {
+        text.clear();
+        for (int32_t token : tokens) {
+            text += stop->token_text(token);
+            for (const auto& s : strings) {
+                g_sink = g_sink + (text.find(s) != std::string::npos);
+            }
+        }
+    });
+}
+
+void bench_server(Suite& suite) {
+    if (!suite.selected("server/")) return;
+
+    auto engine = std::make_shared<castor::Engine>();
+    castor::ModelConfig config;
+    config.vocab_size = 32000;
+    engine->initialize("bench.plan", config);
+
+    const std::string path = write_tokenizer(32000);
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    tokenizer->load(path);
+    std::remove(path.c_str());
+
+    // No response cache: every call runs the full handler
+    castor::Server server;
+    server.initialize(engine, tokenizer);
+
+    const std::string prompt = make_text(kEnglishWords, 512, 0xBEEF);
+    const std::string prefill_only = json{{"prompt", prompt}, {"max_tokens", 0}}.dump();
+    const std::string generate = json{{"prompt", prompt}, {"max_tokens", 16}, {"temperature", 0}}.dump();
+    suite.add("server/infer/parse_to_serialize/max_tokens=0",
+              [&] { g_sink = g_sink + server.handle_infer(prefill_only).body.size(); });
+    suite.add("server/infer/parse_to_serialize/max_tokens=16",
+              [&] { g_sink = g_sink + server.handle_infer(generate).body.size(); });
+
+    std::vector<std::string> texts;
+    for (uint64_t i = 0; i < 32; ++i) {
+        texts.push_back(make_text(kEnglishWords, 64, 0xE111 + i));
+    }
+    for (const char* format : {"float", "fp16", "int8"}) {
+        const std::string body = json{{"input", texts}, {"encoding_format", format}}.dump();
+        suite.add(std::string("server/embeddings/inputs=32/") + format,
+                  [&, body] { g_sink = g_sink + server.handle_embeddings(body).body.size(); });
+    }
+}
+
+// ============ Output ============
+
+json to_json(const std::vector<Result>& results) {
+    json out;
+    out["context"] = {{"hardware_concurrency", std::thread::hardware_concurrency()},
+#ifdef NDEBUG
+                      {"build", "release"},
+#else
+                      {"build", "debug"},
+#endif
+                      {"compiler", __VERSION__}};
+    json list = json::array();
+    for (const auto& r : results) {
+        json entry = {{"name", r.name}, {"ns_per_op", r.ns_per_op}, {"iterations", r.iterations}};
+        if (r.items_per_op > 0.0) {
+            entry[r.item_unit + "_per_second"] = r.items_per_op / r.ns_per_op * 1e9;
+        }
+        list.push_back(entry);
+    }
+    out["benchmarks"] = list;
+    return out;
+}
+
+// Returns the number of benchmarks slower than baseline by more than threshold
+size_t compare(const std::string& path, const std::vector<Result>& results, double threshold) {
+    std::ifstream file(path);
+    json baseline;
+    try {
+        baseline = json::parse(file);
+    } catch (const json::exception& e) {
+        std::cerr << "[Bench] Cannot read baseline " << path << ": " << e.what() << "\n";
+        return 0;
+    }
+
+    size_t regressions = 0;
+    std::cout << "\n[Bench] Comparison against " << path << " (threshold " << threshold * 100.0 << "%)\n";
+    for (const auto& r : results) {
+        for (const auto& b : baseline["benchmarks"]) {
+            if (b["name"] != r.name) continue;
+            const double before = b["ns_per_op"].get<double>();
+            const double change = before > 0.0 ? (r.ns_per_op - before) / before : 0.0;
+            const bool regressed = change > threshold;
+            regressions += regressed ? 1 : 0;
+            std::cout << "  " << (regressed ? "REGRESSED " : "          ") << r.name << ": " << before << " -> "
+                      << r.ns_per_op << " ns/op (" << (change >= 0 ? "+" : "") << change * 100.0 << "%)\n";
+        }
+    }
+    return regressions;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--filter" && has_value) {
+            options.filter = argv[++i];
+        } else if (arg == "--json" && has_value) {
+            options.json_path = argv[++i];
+        } else if (arg == "--baseline" && has_value) {
+            options.baseline_path = argv[++i];
+        } else if (arg == "--threshold" && has_value) {
+            options.threshold = std::atof(argv[++i]);
+        } else if (arg == "--min-time" && has_value) {
+            options.min_time = std::atof(argv[++i]);
+        } else if (arg == "--repetitions" && has_value) {
+            options.repetitions = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+        } else {
+            std::cerr << "Usage: castor-bench [--filter SUBSTR] [--json OUT] [--baseline PREV.json]\n"
+                         "                    [--threshold FRACTION] [--min-time SECONDS] [--repetitions N]\n";
+            return 1;
+        }
+    }
+
+    Suite suite(options);
+    bench_tokenizer(suite);
+    bench_engine(suite);
+    bench_kernels(suite);
+    bench_sessions(suite);
+    bench_sampler(suite);
+    bench_grammar(suite);
+    bench_stop(suite);
+    bench_server(suite);
+
+    if (!options.json_path.empty()) {
+        std::ofstream out(options.json_path);
+        out << to_json(suite.results()).dump(2) << "\n";
+    }
+    if (!options.baseline_path.empty() && compare(options.baseline_path, suite.results(), options.threshold) > 0) {
+        return 2;
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+// Latency summary helpers shared by the benchmark tools.
+
+#include <algorithm>
+#include <vector>
+
+namespace castor::bench {
+
+/**
+ * @brief Nearest-rank percentile of an ascending-sorted sample (p in [0, 1])
+ */
+inline double percentile(const std::vector<double>& sorted, double p) {
+    if (sorted.empty()) return 0.0;
+    const size_t index = static_cast<size_t>(p * static_cast<double>(sorted.size() - 1) + 0.5);
+    return sorted[std::min(index, sorted.size() - 1)];
+}
+
+struct Summary {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p99 = 0.0;
+    double p999 = 0.0;
+    double max = 0.0;
+};
+
+/**
+ * @brief Sort @p values in place and summarize them
+ */
+inline Summary summarize(std::vector<double>& values) {
+    Summary s;
+    if (values.empty()) return s;
+    std::sort(values.begin(), values.end());
+    double sum = 0.0;
+    for (double v : values) sum += v;
+    s.mean = sum / static_cast<double>(values.size());
+    s.p50 = percentile(values, 0.50);
+    s.p90 = percentile(values, 0.90);
+    s.p99 = percentile(values, 0.99);
+    s.p999 = percentile(values, 0.999);
+    s.max = values.back();
+    return s;
+}
+
+} // namespace castor::bench
@@ -0,0 +1,73 @@
+// Measures the cost of CASTOR_TRACE_SCOPE in its three runtime states.
+//
+//   ./bin/castor-trace-bench [iterations]
+//
+// "disabled" is the configuration production runs in by default and must stay
+// within a few nanoseconds of the untraced baseline.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "trace.hpp"
+
+namespace {
+
+volatile uint64_t g_sink = 0;
+
+__attribute__((noinline)) void untraced_work(uint64_t i) {
+    g_sink = g_sink + i;
+}
+
+__attribute__((noinline)) void traced_work(uint64_t i) {
+    CASTOR_TRACE_SCOPE("bench.span");
+    g_sink = g_sink + i;
+}
+
+template <typename F>
+double ns_per_op(uint64_t iterations, F&& fn) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        fn(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::nano>(end - start).count() / static_cast<double>(iterations);
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    const uint64_t iterations = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 20000000ULL;
+
+#ifndef CASTOR_ENABLE_TRACING
+    std::cout << "[TraceBench] Built with CASTOR_ENABLE_TRACING=OFF: spans compile to nothing\n";
+#endif
+
+    // Warm up the TSC calibration and the thread's ring outside the timed loops
+    castor::Tracer::ticks_per_ns();
+    castor::Tracer::set_enabled(true);
+    traced_work(0);
+    castor::Tracer::set_enabled(false);
+
+    const double baseline = ns_per_op(iterations, untraced_work);
+    const double disabled = ns_per_op(iterations, traced_work);
+
+    double scoped = 0.0;
+    {
+        castor::PhaseTimings timings;
+        castor::RequestTraceScope scope(timings);
+        scoped = ns_per_op(iterations, traced_work);
+    }
+
+    castor::Tracer::set_enabled(true);
+    const double enabled = ns_per_op(iterations, traced_work);
+    castor::Tracer::set_enabled(false);
+
+    std::cout << "[TraceBench] iterations:          " << iterations << "\n";
+    std::cout << "[TraceBench] untraced baseline:   " << baseline << " ns/op\n";
+    std::cout << "[TraceBench] span, disabled:      " << disabled << " ns/op (+" << disabled - baseline << ")\n";
+    std::cout << "[TraceBench] span, request scope: " << scoped << " ns/op (+" << scoped - baseline << ")\n";
+    std::cout << "[TraceBench] span, ring enabled:  " << enabled << " ns/op (+" << enabled - baseline << ")\n";
+    return 0;
+}
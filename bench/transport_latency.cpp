@@ -0,0 +1,104 @@
+// Compares request latency over loopback TCP and a Unix domain socket.
+//
+//   ./bin/castor-rt --unix-socket /tmp/castor.sock &
+//   ./bin/castor-transport-bench --port 8080 --unix-socket /tmp/castor.sock
+//
+// Requests are sent back-to-back on one keep-alive connection per transport,
+// so the numbers isolate per-request transport + HTTP overhead.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "http_client.hpp"
+#include "stats.hpp"
+
+namespace {
+
+struct Options {
+    std::string host = "127.0.0.1";
+    int port = 8080;
+    std::string unix_socket_path = "/tmp/castor.sock";
+    size_t requests = 5000;
+    size_t warmup = 200;
+    bool infer = false;
+};
+
+using castor::bench::percentile;
+
+bool measure(castor::bench::HttpConnection& conn, const Options& options, std::vector<double>& latencies_us) {
+    const std::string method = options.infer ? "POST" : "GET";
+    const std::string path = options.infer ? "/infer" : "/health";
+    const std::string body = options.infer ? R"({"prompt": "hello world"})" : "";
+
+    castor::bench::HttpResponse response;
+    for (size_t i = 0; i < options.warmup + options.requests; ++i) {
+        const auto start = std::chrono::steady_clock::now();
+        if (!conn.request(method, path, body, response) || response.status != 200) {
+            std::cerr << "[TransportBench] Request failed (status " << response.status << ")\n";
+            return false;
+        }
+        const auto end = std::chrono::steady_clock::now();
+        if (i >= options.warmup) {
+            latencies_us.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+        }
+    }
+    std::sort(latencies_us.begin(), latencies_us.end());
+    return true;
+}
+
+void report(const char* name, std::vector<double>& latencies_us) {
+    double sum = 0.0;
+    for (double v : latencies_us) sum += v;
+    std::cout << "[TransportBench] " << name << ": mean " << sum / static_cast<double>(latencies_us.size())
+              << " us, p50 " << percentile(latencies_us, 0.50) << " us, p90 " << percentile(latencies_us, 0.90)
+              << " us, p99 " << percentile(latencies_us, 0.99) << " us\n";
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--host" && i + 1 < argc) {
+            options.host = argv[++i];
+        } else if (arg == "--port" && i + 1 < argc) {
+            options.port = std::atoi(argv[++i]);
+        } else if (arg == "--unix-socket" && i + 1 < argc) {
+            options.unix_socket_path = argv[++i];
+        } else if (arg == "--requests" && i + 1 < argc) {
+            options.requests = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--infer") {
+            options.infer = true;
+        } else {
+            std::cerr << "Usage: castor-transport-bench [--host H] [--port N] [--unix-socket PATH] "
+                         "[--requests N] [--infer]\n";
+            return 1;
+        }
+    }
+
+    auto tcp = castor::bench::HttpConnection::tcp(options.host, options.port);
+    auto uds = castor::bench::HttpConnection::unix_socket(options.unix_socket_path);
+    if (!tcp || !uds) {
+        std::cerr << "[TransportBench] Could not connect to " << (tcp ? "unix:" + options.unix_socket_path : "tcp")
+                  << "\n";
+        return 1;
+    }
+
+    std::vector<double> tcp_us;
+    std::vector<double> uds_us;
+    if (!measure(*tcp, options, tcp_us) || !measure(*uds, options, uds_us)) {
+        return 1;
+    }
+
+    std::cout << "[TransportBench] " << options.requests << " sequential " << (options.infer ? "POST /infer" : "GET /health")
+              << " requests per transport\n";
+    report("tcp ", tcp_us);
+    report("unix", uds_us);
+    const double speedup = percentile(tcp_us, 0.50) / std::max(1e-9, percentile(uds_us, 0.50));
+    std::cout << "[TransportBench] unix p50 speedup: " << speedup << "x\n";
+    return 0;
+}
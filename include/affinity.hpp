@@ -0,0 +1,66 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace castor {
+
+/**
+ * @brief CPU affinity and NUMA placement helpers (Linux; no-ops elsewhere)
+ */
+class Affinity {
+public:
+    /**
+     * @brief Parse a CPU list such as "0-3,8,10-11"
+     * @param list CPU list in the kernel's cpulist format
+     * @param cpus Parsed CPU ids (sorted, unique)
+     * @return false on malformed input
+     */
+    static bool parse_cpu_list(const std::string& list, std::vector<int>& cpus);
+
+    /**
+     * @brief Format CPU ids back into cpulist form
+     */
+    static std::string format_cpu_list(const std::vector<int>& cpus);
+
+    /**
+     * @brief Restrict the calling thread to @p cpus
+     *
+     * Threads created afterwards inherit the mask, which is how Crow's I/O
+     * threads get pinned without hooks into Crow itself.
+     */
+    static bool pin_current_thread(const std::vector<int>& cpus);
+
+    /**
+     * @brief NUMA node owning @p cpu, or -1 if unknown
+     */
+    static int numa_node_of_cpu(int cpu);
+
+    /**
+     * @brief Number of NUMA nodes visible to the process (at least 1)
+     */
+    static int numa_node_count();
+
+    /**
+     * @brief CPUs of NUMA node @p node that this process may run on
+     *
+     * Empty if the node is unknown or none of its CPUs are in the process
+     * affinity mask (e.g. a container restricted to the other socket).
+     */
+    static std::vector<int> node_cpus(int node);
+
+    /**
+     * @brief Prefer allocating the calling thread's memory on @p node
+     *
+     * Uses set_mempolicy(MPOL_PREFERRED) so allocations stay node-local even
+     * if the first touch happens before the scheduler settles the thread.
+     */
+    static bool prefer_local_memory(int node);
+
+    /**
+     * @brief Node shared by all @p cpus, or -1 if they span several nodes
+     */
+    static int common_numa_node(const std::vector<int>& cpus);
+};
+
+} // namespace castor
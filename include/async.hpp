@@ -0,0 +1,321 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <coroutine>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace castor {
+
+/**
+ * @brief Runs a continuation somewhere: inline, on a worker pool, or posted
+ * to an event loop (e.g. asio::post onto Crow's io_context)
+ */
+using Executor = std::function<void(std::function<void()>)>;
+
+/**
+ * @brief Shared cancellation flag; copies observe the same flag
+ */
+class CancellationToken {
+public:
+    CancellationToken() : flag_(std::make_shared<std::atomic<bool>>(false)) {}
+
+    void cancel() const { flag_->store(true, std::memory_order_relaxed); }
+    bool cancelled() const { return flag_->load(std::memory_order_relaxed); }
+
+private:
+    std::shared_ptr<std::atomic<bool>> flag_;
+};
+
+/**
+ * @brief Single-assignment result that can be waited on, observed or co_awaited
+ *
+ * Like a std::shared_future, except that completion can also run callbacks
+ * and resume coroutines, so nothing has to block a thread while it waits.
+ * Callbacks run on the completing thread unless an Executor is given.
+ * Copies share one state; a default-constructed result has none (valid() is
+ * false), use create().
+ */
+template <typename T>
+class AsyncResult {
+    struct State {
+        std::mutex mutex;
+        std::condition_variable cv;
+        std::optional<T> value;
+        std::exception_ptr error;
+        bool done = false;
+        std::vector<std::function<void()>> callbacks;
+    };
+
+public:
+    AsyncResult() = default;
+    static AsyncResult create() {
+        AsyncResult result;
+        result.state_ = std::make_shared<State>();
+        return result;
+    }
+
+    bool valid() const { return state_ != nullptr; }
+
+    void set_value(T value) const {
+        complete([&](State& s) { s.value.emplace(std::move(value)); });
+    }
+    void set_exception(std::exception_ptr error) const {
+        complete([&](State& s) { s.error = std::move(error); });
+    }
+
+    bool ready() const {
+        std::lock_guard<std::mutex> lock(state_->mutex);
+        return state_->done;
+    }
+
+    /**
+     * @brief Block until complete; rethrows a stored exception
+     */
+    const T& get() const {
+        std::unique_lock<std::mutex> lock(state_->mutex);
+        state_->cv.wait(lock, [this] { return state_->done; });
+        if (state_->error) {
+            std::rethrow_exception(state_->error);
+        }
+        return *state_->value;
+    }
+
+    /**
+     * @brief Run @p callback once complete: now if already complete, else on
+     * the completing thread (or through @p executor when given)
+     */
+    void on_ready(std::function<void()> callback, Executor executor = nullptr) const {
+        if (executor) {
+            callback = [executor = std::move(executor), callback = std::move(callback)]() { executor(callback); };
+        }
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (!state_->done) {
+                state_->callbacks.push_back(std::move(callback));
+                return;
+            }
+        }
+        callback();
+    }
+
+    class Awaiter {
+    public:
+        Awaiter(std::shared_ptr<State> state, Executor executor)
+            : state_(std::move(state)), executor_(std::move(executor)) {}
+
+        bool await_ready() const {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            return state_->done;
+        }
+        bool await_suspend(std::coroutine_handle<> waiter) {
+            std::function<void()> resume = [waiter]() { waiter.resume(); };
+            if (executor_) {
+                resume = [executor = executor_, resume]() { executor(resume); };
+            }
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (state_->done) {
+                return false; // Completed meanwhile: continue inline
+            }
+            state_->callbacks.push_back(std::move(resume));
+            return true;
+        }
+        const T& await_resume() const {
+            if (state_->error) {
+                std::rethrow_exception(state_->error);
+            }
+            return *state_->value;
+        }
+
+    private:
+        std::shared_ptr<State> state_;
+        Executor executor_;
+    };
+
+    /**
+     * @brief co_await resumes the coroutine on the completing thread
+     */
+    Awaiter operator co_await() const { return Awaiter(state_, nullptr); }
+
+    /**
+     * @brief co_await result.via(executor) resumes through @p executor instead
+     */
+    Awaiter via(Executor executor) const { return Awaiter(state_, std::move(executor)); }
+
+private:
+    template <typename F>
+    void complete(F&& store) const {
+        std::vector<std::function<void()>> callbacks;
+        {
+            std::lock_guard<std::mutex> lock(state_->mutex);
+            if (state_->done) {
+                return;
+            }
+            store(*state_);
+            state_->done = true;
+            callbacks.swap(state_->callbacks);
+        }
+        state_->cv.notify_all();
+        for (auto& callback : callbacks) {
+            callback();
+        }
+    }
+
+    std::shared_ptr<State> state_;
+};
+
+template <typename T>
+class Task;
+
+namespace detail {
+
+// Resumes whoever co_awaited the task once it finishes (symmetric transfer)
+struct TaskFinal {
+    bool await_ready() const noexcept { return false; }
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> done) noexcept {
+        auto continuation = done.promise().continuation;
+        return continuation ? continuation : std::noop_coroutine();
+    }
+    void await_resume() const noexcept {}
+};
+
+struct TaskPromiseBase {
+    std::coroutine_handle<> continuation;
+    std::exception_ptr error;
+
+    std::suspend_always initial_suspend() const noexcept { return {}; }
+    TaskFinal final_suspend() const noexcept { return {}; }
+    void unhandled_exception() { error = std::current_exception(); }
+};
+
+template <typename T>
+struct TaskPromise : TaskPromiseBase {
+    std::optional<T> value;
+
+    Task<T> get_return_object();
+    void return_value(T result) { value.emplace(std::move(result)); }
+    T take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskPromise<void> : TaskPromiseBase {
+    Task<void> get_return_object();
+    void return_void() {}
+    void take() {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Fire-and-forget frame used by start(); frees itself when done
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() const noexcept { return {}; }
+        std::suspend_never initial_suspend() const noexcept { return {}; }
+        std::suspend_never final_suspend() const noexcept { return {}; }
+        void return_void() const noexcept {}
+        void unhandled_exception() const noexcept { std::terminate(); }
+    };
+};
+
+} // namespace detail
+
+/**
+ * @brief Lazily started coroutine returning T
+ *
+ * Nothing runs until the task is co_awaited (from another coroutine) or
+ * handed to start(). When it finishes, the awaiting coroutine continues
+ * directly on the same thread.
+ */
+template <typename T = void>
+class Task {
+public:
+    using promise_type = detail::TaskPromise<T>;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : handle_(handle) {}
+    Task(Task&& other) noexcept : handle_(std::exchange(other.handle_, nullptr)) {}
+    Task& operator=(Task&& other) noexcept {
+        if (this != &other) {
+            if (handle_) {
+                handle_.destroy();
+            }
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    ~Task() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+
+    auto operator co_await() && noexcept {
+        struct Awaiter {
+            std::coroutine_handle<promise_type> handle;
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+                handle.promise().continuation = waiter;
+                return handle;
+            }
+            T await_resume() { return handle.promise().take(); }
+        };
+        return Awaiter{handle_};
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+};
+
+namespace detail {
+
+template <typename T>
+Task<T> TaskPromise<T>::get_return_object() {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+}
+
+inline Task<void> TaskPromise<void>::get_return_object() {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+}
+
+template <typename T>
+Detached drive(Task<T> task, AsyncResult<T> result) {
+    try {
+        result.set_value(co_await std::move(task));
+    } catch (...) {
+        result.set_exception(std::current_exception());
+    }
+}
+
+} // namespace detail
+
+/**
+ * @brief Start @p task now, on this thread, and return its eventual result
+ *
+ * The bridge from plain code into coroutines: the caller can block on
+ * get(), or register on_ready() and return to its event loop.
+ */
+template <typename T>
+AsyncResult<T> start(Task<T> task) {
+    static_assert(!std::is_void_v<T>, "start() needs a value to deliver; return a status instead of void");
+    AsyncResult<T> result = AsyncResult<T>::create();
+    detail::drive(std::move(task), result);
+    return result;
+}
+
+} // namespace castor
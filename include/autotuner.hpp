@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "model_config.hpp"
+
+namespace castor {
+
+/**
+ * @brief Picks batch size, worker threads, prefill chunk and sampler window for this host
+ *
+ * Runs short synthetic workloads through a real Scheduler and WorkerPool:
+ * a fixed number of concurrent requests per batch slot, each with a
+ * prompt_tokens prompt and output_tokens of top-p sampled output. A trial
+ * meets the SLO when its p95 inter-token latency (and p95 time to first
+ * token, if set) stay within bounds; among those the highest token
+ * throughput wins, and if none meet it the lowest inter-token latency does.
+ *
+ * The sweep is coordinate descent rather than a full grid: threads first,
+ * then batch size, then prefill chunk, each holding the best values found so
+ * far. The nucleus window does not interact with the others and is timed on
+ * its own against logits from the model's vocabulary.
+ *
+ * Results are kept in a JSON file keyed by a fingerprint of the host (CPU
+ * model, core count, memory), the model shape and the SLO, so a later start
+ * on the same kind of host reuses them instead of tuning again.
+ */
+class Autotuner {
+public:
+    struct Settings {
+        size_t max_batch = 8;
+        size_t threads = 0; // Inference workers; 0 = none (run on the scheduler thread)
+        size_t prefill_chunk = 512;
+        size_t nucleus_window = 0; // Sampler::set_nucleus_window
+    };
+
+    struct Trial {
+        Settings settings;
+        double tokens_per_second = 0.0;
+        double p95_itl_ms = 0.0;  // Inter-token latency
+        double p95_ttft_ms = 0.0; // Submit to first token
+        bool meets_slo = false;
+    };
+
+    struct Options {
+        std::string cache_path = "models/autotune.json";
+        double itl_slo_ms = 100.0; // p95 inter-token latency bound
+        double ttft_slo_ms = 0.0;  // p95 time-to-first-token bound; 0 = unbounded
+        size_t prompt_tokens = 128;
+        size_t output_tokens = 32;
+        size_t requests_per_slot = 2;  // Requests per trial = requests_per_slot * max_batch
+        std::vector<size_t> batches = {1, 2, 4, 8, 16};
+        std::vector<size_t> threads;   // Empty = powers of two up to the core count, plus the core count
+        std::vector<size_t> prefill_chunks = {128, 256, 512, 1024};
+        std::vector<size_t> nucleus_windows = {0, 64, 256, 1024};
+    };
+
+    struct Host {
+        std::string cpu_model;
+        size_t cores = 0;
+        size_t memory_gb = 0;
+
+        static Host detect();
+        std::string describe() const;
+    };
+
+    Autotuner();
+    explicit Autotuner(const Options& options);
+
+    /**
+     * @brief Settings for @p config on this host: cached, or tuned and cached
+     *
+     * Tuning runs on a separate engine initialized from @p engine_path with
+     * max_batch_size raised to the largest batch candidate.
+     * @param force Tune even if the cache has an entry
+     * @return false if the tuning engine cannot be initialized
+     */
+    bool run(const std::string& engine_path, const ModelConfig& config, bool force, Settings& settings);
+
+    /**
+     * @brief Cached settings for @p config on this host, if any
+     */
+    bool lookup(const ModelConfig& config, Settings& settings) const;
+
+    /**
+     * @brief Record @p best for @p config on this host (written atomically)
+     */
+    bool store(const ModelConfig& config, const Trial& best) const;
+
+    /**
+     * @brief Sweep every knob on @p engine and return the best trial
+     */
+    Trial tune(const std::shared_ptr<Engine>& engine);
+
+    /**
+     * @brief Run one synthetic workload with @p settings
+     */
+    Trial measure(const std::shared_ptr<Engine>& engine, const Settings& settings) const;
+
+    /**
+     * @brief Fastest nucleus window for top-p sampling over @p vocab_size logits
+     */
+    size_t tune_nucleus_window(uint32_t vocab_size) const;
+
+    /**
+     * @brief Cache key: host, model shape and SLO
+     */
+    std::string fingerprint(const ModelConfig& config) const;
+
+    const std::vector<Trial>& trials() const { return trials_; }
+    const Options& options() const { return options_; }
+
+private:
+    bool better(const Trial& a, const Trial& b) const; // Is a preferable to b?
+
+    Options options_;
+    Host host_;
+    std::vector<Trial> trials_; // Every measurement of the last tune()
+};
+
+} // namespace castor
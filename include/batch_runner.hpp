@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include "engine.hpp"
+#include "tokenizer.hpp"
+
+namespace castor {
+
+/**
+ * @brief Offline JSONL-in/JSONL-out inference without the HTTP server
+ *
+ * Runs a four-stage pipeline connected by bounded queues:
+ *   1. reader    - walks the mmap'd input and parses one JSON request per line
+ *   2. tokenizer - N threads encode prompts in parallel
+ *   3. engine    - gathers up to batch_size ready requests per Engine::generate_batch
+ *   4. writer    - restores input order and appends result lines
+ *
+ * Input lines take the /infer body shape ({"prompt": ..., "max_tokens": ...})
+ * plus an optional "id" that is echoed back. Output lines carry the absolute
+ * input line number, so partial outputs can be joined back to the input.
+ *
+ * The writer checkpoints the input byte offset and output size to
+ * <out>.progress; a resumed run truncates the output to the last checkpoint
+ * and continues from that offset, so no line is lost or duplicated.
+ */
+class BatchRunner {
+public:
+    struct Options {
+        std::string input_path;
+        std::string output_path;
+        size_t batch_size = 16;
+        size_t tokenize_threads = 4;
+        size_t queue_capacity = 256;   // Per inter-stage queue
+        size_t checkpoint_lines = 1000;
+        bool resume = false;           // Continue from <out>.progress
+        uint64_t start_offset = 0;     // Byte offset of the first line (fresh runs)
+    };
+
+    struct Report {
+        uint64_t lines = 0;
+        uint64_t errors = 0;
+        uint64_t prompt_tokens = 0;
+        uint64_t output_tokens = 0;
+        uint64_t start_offset = 0;
+        uint64_t end_offset = 0;
+        double wall_seconds = 0.0;
+        double reader_busy_seconds = 0.0;
+        double tokenize_busy_seconds = 0.0; // Summed over tokenizer threads
+        double engine_busy_seconds = 0.0;
+        double writer_busy_seconds = 0.0;
+
+        double output_tokens_per_second() const { return wall_seconds > 0.0 ? output_tokens / wall_seconds : 0.0; }
+    };
+
+    BatchRunner(std::shared_ptr<Engine> engine, std::shared_ptr<Tokenizer> tokenizer, const Options& options);
+
+    /**
+     * @brief Process the input file to completion
+     * @return false if the input/output cannot be opened or the engine fails
+     */
+    bool run(Report& report);
+
+    /**
+     * @brief Path of the checkpoint file kept next to @p output_path
+     */
+    static std::string progress_path(const std::string& output_path) { return output_path + ".progress"; }
+
+private:
+    std::shared_ptr<Engine> engine_;
+    std::shared_ptr<Tokenizer> tokenizer_;
+    Options options_;
+};
+
+} // namespace castor
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace castor {
+
+/**
+ * @brief How per-token hidden states are reduced to one embedding
+ */
+enum class Pooling : uint32_t {
+    Mean, // Average over every position
+    Last, // Final position (decoder-style embedding models)
+    Cls   // First position (BERT-style [CLS] token)
+};
+
+/**
+ * @brief Wire format of embedding vectors in responses
+ */
+enum class EmbeddingEncoding : uint32_t {
+    Float, // JSON array of numbers
+    Fp16,  // Base64 of little-endian IEEE half floats (4x smaller than JSON)
+    Int8   // Base64 of int8 values times a per-vector scale (8x smaller than JSON)
+};
+
+/**
+ * @brief Options for Engine::embed
+ */
+struct EmbeddingOptions {
+    Pooling pooling = Pooling::Mean;
+    bool normalize = true;          // Scale each vector to unit L2 norm
+    size_t max_batch_tokens = 8192; // Tokens packed into one ragged forward pass
+};
+
+/**
+ * @brief Helpers shared by the embeddings route, its tests and benchmarks
+ */
+namespace embedding {
+
+/**
+ * @brief Parse "mean", "last" or "cls"
+ */
+bool parse_pooling(const std::string& text, Pooling& out);
+
+/**
+ * @brief Parse "float", "fp16" or "int8"
+ */
+bool parse_encoding(const std::string& text, EmbeddingEncoding& out);
+
+/**
+ * @brief Round a float to the nearest IEEE 754 binary16 (ties to even)
+ */
+uint16_t float_to_half(float value);
+float half_to_float(uint16_t half);
+
+/**
+ * @brief Symmetric int8 quantization: values[i] ~= out[i] * scale
+ * @return The scale (max |value| / 127), 0 for an all-zero vector
+ */
+float quantize_int8(const float* values, size_t count, int8_t* out);
+
+/**
+ * @brief Standard base64 (RFC 4648) with padding
+ */
+std::string base64_encode(const void* data, size_t size);
+
+} // namespace embedding
+
+} // namespace castor
@@ -1,14 +1,190 @@
 #pragma once
 
+#include <chrono>
 #include <vector>
 #include <string>
 #include <memory>
+#include "embedding.hpp"
+#include "kernels.hpp"
+#include "memory_arena.hpp"
 #include "model_config.hpp"
+#include "sampler.hpp"
 
 namespace castor {
 
 class Tokenizer; // Forward declaration
 
+/**
+ * @brief Incremental per-sequence decoder state
+ *
+ * Stands in for the KV cache: the CPU reference path folds every processed
+ * token into a running context hash, so a sequence can be extended one token
+ * at a time without reprocessing its prefix.
+ *
+ * Copying a state forks the sequence: both copies continue independently from
+ * the shared prefix. A paged KV backend shares the prefix blocks copy-on-write,
+ * so a fork costs no prefix memory or recomputation.
+ */
+struct SequenceState {
+    uint64_t context_hash = 0;
+    uint32_t length = 0;
+};
+
+/**
+ * @brief Output of Engine::generate
+ */
+struct GenerationResult {
+    std::vector<int32_t> output_ids;
+    std::vector<float> logprobs;
+    double cumulative_logprob = 0.0; // Sum of logprobs
+    std::string finish_reason;       // "length", "stop" or "constraint" (grammar allowed no token)
+    std::string output_text;         // With params.stop: detokenized output, cut before the stop string
+    std::string stop_sequence;       // Stop string that ended generation, if any
+    double prefill_seconds = 0.0;
+    double first_token_seconds = 0.0; // generate() entry to first sampled token
+    double decode_seconds = 0.0;
+    uint32_t draft_tokens = 0;          // Speculative decoding: tokens proposed by the draft
+    uint32_t accepted_draft_tokens = 0; // ... of which the target accepted
+    uint32_t target_forwards = 0;       // ... target forward passes spent decoding
+};
+
+/**
+ * @brief Tuning for speculative decoding with a draft model
+ */
+struct SpeculativeOptions {
+    uint32_t k = 4;       // Initial draft tokens per round
+    uint32_t min_k = 1;
+    uint32_t max_k = 8;
+    bool adaptive = true; // Re-pick k from measured acceptance and draft cost
+};
+
+/**
+ * @brief Several completions of one prompt (Engine::generate_candidates)
+ */
+struct CandidateOptions {
+    uint32_t n = 1;           // Candidates returned
+    uint32_t best_of = 0;     // Candidates generated, >= n; 0 = n
+    bool beam_search = false; // Deterministic beam search of width best_of instead of sampling
+
+    uint32_t width() const { return best_of > n ? best_of : n; }
+};
+
+class Engine;
+
+/**
+ * @brief One in-progress generation, advanced one step at a time
+ *
+ * Engine::generate() drives a single stream to completion; schedulers hold
+ * many and interleave their steps. A stream owns its sequence state (the KV
+ * cache stand-in) and sampler, so it can be paused between steps and resumed
+ * later without recomputation.
+ */
+class GenerationStream {
+public:
+    GenerationStream(Engine& engine, std::vector<int32_t> prompt_ids, const SamplingParams& params);
+
+    /**
+     * @brief Process the whole remaining prompt
+     */
+    bool prefill() { return prefill_chunk(prompt_.size()); }
+
+    /**
+     * @brief Process up to @p max_tokens more prompt tokens
+     *
+     * Only the chunk that completes the prompt computes logits, so splitting a
+     * prompt costs nothing beyond the extra calls and the result is identical.
+     */
+    bool prefill_chunk(size_t max_tokens);
+
+    /**
+     * @brief Sample one token and, unless that finishes the stream, feed it back
+     *
+     * With a draft model attached to the engine, one step is a speculative
+     * round instead and may emit several tokens. With params.grammar set,
+     * disallowed tokens are masked out before sampling and the stream stops
+     * once the grammar cannot be extended further. With params.stop set, the
+     * output is detokenized as it grows and the stream stops on a stop token
+     * or as soon as a stop string appears.
+     */
+    bool decode_step();
+
+    /**
+     * @brief Run prefill and decode until finished
+     */
+    bool run_to_completion();
+
+    /**
+     * @brief Start from a restored sequence that already holds the first @p tokens prompt tokens
+     *
+     * Call before the first prefill step; only the rest of the prompt is
+     * prefilled (a draft model, if attached, still prefills all of it).
+     * @return false if @p state does not hold exactly @p tokens tokens, or no prompt token is left
+     */
+    bool resume_from(const SequenceState& state, size_t tokens);
+
+    /**
+     * @brief Copy of this stream that continues with its own sampler seed
+     *
+     * Forking after prefill shares the prompt work: the copy starts from the
+     * same sequence state and next-token logits.
+     */
+    GenerationStream fork(uint64_t seed) const;
+
+    /**
+     * @brief Output text that is final and not yet taken (streaming with params.stop)
+     *
+     * Trailing bytes that could still begin a stop string, and an incomplete
+     * UTF-8 character, are held back until later tokens decide them; once the
+     * stream finishes everything left is released. The pieces concatenate to
+     * result().output_text, which never includes the stop string.
+     */
+    std::string take_text();
+
+    bool prefilled() const { return prefilled_; }
+    bool finished() const { return finished_; }
+    const std::vector<int32_t>& prompt() const { return prompt_; }
+    size_t prompt_remaining() const { return prompt_.size() - prompt_done_; }
+    const SequenceState& state() const { return state_; } // Prompt and the output tokens fed back so far
+    const SamplingParams& params() const { return params_; }
+    uint32_t tokens_generated() const { return static_cast<uint32_t>(result_.output_ids.size()); }
+
+    GenerationResult& result() { return result_; }
+
+private:
+    bool speculative_step();
+    bool emit(int32_t token, float logprob); // Returns false once the stream is finished
+    void adapt_k(size_t proposed, size_t accepted, double draft_seconds, double target_seconds);
+
+    Engine& engine_;
+    std::vector<int32_t> prompt_;
+    SamplingParams params_;
+    SequenceState state_;
+    std::vector<float> logits_;
+    Sampler sampler_;
+    GenerationResult result_;
+    std::chrono::steady_clock::time_point start_;
+    std::chrono::steady_clock::time_point decode_start_;
+    int32_t grammar_state_ = 0; // Automaton state when params_.grammar is set
+    int32_t stop_state_ = 0;    // Automaton state when params_.stop is set
+    size_t text_taken_ = 0;     // Bytes of result_.output_text returned by take_text()
+    size_t prompt_done_ = 0;    // Prompt tokens already in state_
+    bool prefilled_ = false;
+    bool finished_ = false;
+
+    // Speculative decoding (only used when the engine has a draft model)
+    std::shared_ptr<Engine> draft_;
+    SequenceState draft_state_;
+    std::vector<float> draft_logits_;
+    int32_t pending_ = -1; // Emitted token not yet fed to target and draft
+    uint32_t k_ = 0;
+    double acceptance_ = -1.0; // EWMA per-token acceptance; < 0 until measured
+    double draft_cost_ = -1.0; // EWMA draft pass time / target verify time
+    std::vector<int32_t> proposals_;
+    std::vector<std::vector<float>> draft_probs_;
+    std::vector<std::vector<float>> verify_logits_;
+    std::vector<float> target_probs_;
+};
+
 /**
  * @brief Main inference engine for LLM models using TensorRT
  * 
@@ -24,9 +200,21 @@ public:
      * @brief Initialize the engine with a TensorRT engine plan
      * @param engine_path Path to .plan or .engine file
      * @param config Model configuration
+     * @param kernels Kernels already chosen for @p config, or nullptr to select them here
      * @return true if initialization successful
      */
-    bool initialize(const std::string& engine_path, const ModelConfig& config);
+    bool initialize(const std::string& engine_path, const ModelConfig& config, const KernelSet* kernels = nullptr);
+
+    /**
+     * @brief Read an engine plan into the page cache ahead of initialize()
+     *
+     * Maps the file read-only with MAP_POPULATE, so the kernel reads it in
+     * with large sequential I/O and a later load (by this engine or a
+     * replica) is served from memory. Safe to call concurrently with
+     * tokenizer loading and kernel selection.
+     * @return Bytes read, or 0 if the file cannot be mapped
+     */
+    static size_t prefault_weights(const std::string& engine_path);
 
     /**
      * @brief Shutdown and cleanup resources
@@ -41,6 +229,103 @@ public:
      */
     bool infer(const std::vector<int32_t>& input_ids, std::vector<float>& output_logits);
 
+    /**
+     * @brief Autoregressively generate up to params.max_tokens tokens
+     * @param prompt_ids Prompt token IDs (prefilled once)
+     * @param params Sampling parameters
+     * @param result Generated ids, per-token logprobs and phase timings
+     * @return true if generation ran (possibly producing zero tokens)
+     */
+    bool generate(const std::vector<int32_t>& prompt_ids, const SamplingParams& params, GenerationResult& result);
+
+    /**
+     * @brief Generate for several sequences in lock-step
+     *
+     * All prompts are prefilled, then each decode step advances every sequence
+     * that has not finished, i.e. one batched forward per step. Each result is
+     * identical to what generate() returns for that prompt alone.
+     * @param prompts Prompt token IDs, one entry per sequence
+     * @param params Sampling parameters, one entry per sequence
+     * @param results Resized to prompts.size()
+     * @return false if the sizes differ or any forward pass fails
+     */
+    bool generate_batch(const std::vector<std::vector<int32_t>>& prompts, const std::vector<SamplingParams>& params,
+                        std::vector<GenerationResult>& results);
+
+    /**
+     * @brief Generate several completions of one prompt
+     *
+     * The prompt is prefilled once and the sequence forked into
+     * options.width() branches that decode together in lock-step. Sampled
+     * branches use seeds params.seed + i; beam search keeps the width
+     * highest-scoring hypotheses at each step. The n best by cumulative
+     * logprob are returned, highest first.
+     * @return false if n is zero or a forward pass fails
+     */
+    bool generate_candidates(const std::vector<int32_t>& prompt_ids, const SamplingParams& params,
+                             const CandidateOptions& options, std::vector<GenerationResult>& results);
+
+    /**
+     * @brief Embed several inputs (retrieval embeddings)
+     *
+     * Inputs are packed back to back into ragged batches of up to
+     * options.max_batch_tokens tokens, addressed by per-sequence offsets, so
+     * short inputs waste no padding. Each batch is one forward pass that stops
+     * at the final hidden state; pooling and normalization are fused into it,
+     * so per-token hidden states are never stored.
+     * @param embeddings Resized to inputs.size() * hidden_dim, one row per input
+     * @return false if any input is empty or a forward pass fails
+     */
+    bool embed(const std::vector<std::vector<int32_t>>& inputs, const EmbeddingOptions& options,
+               std::vector<float>& embeddings);
+
+    /**
+     * @brief Extend a sequence with new tokens and compute next-token logits
+     * @param state Sequence state, advanced by input_ids.size()
+     * @param input_ids Tokens appended to the sequence
+     * @param output_logits Logits for the position after the last input token
+     * @return true if successful
+     */
+    bool forward(SequenceState& state, const std::vector<int32_t>& input_ids, std::vector<float>& output_logits);
+
+    /**
+     * @brief Extend a sequence without computing logits (non-final prefill chunks)
+     * @param state Sequence state, advanced by count
+     * @param input_ids First of @p count tokens appended to the sequence
+     * @return true if successful
+     */
+    bool extend(SequenceState& state, const int32_t* input_ids, size_t count);
+
+    /**
+     * @brief Extend a sequence and return the logits after every appended token
+     *
+     * One target forward pass when verifying speculative drafts.
+     * @param output_logits Resized to input_ids.size(); entry i follows input_ids[i]
+     */
+    bool forward_all(SequenceState& state, const std::vector<int32_t>& input_ids,
+                     std::vector<std::vector<float>>& output_logits);
+
+    /**
+     * @brief Copy the KV cache behind @p state out of the engine (session snapshots)
+     * @param kv Resized to the cache size of state.length tokens
+     */
+    bool save_kv(const SequenceState& state, std::vector<uint8_t>& kv) const;
+
+    /**
+     * @brief Load bytes written by save_kv back into the KV cache so @p state can be extended
+     * @return false if @p kv was not saved from @p state by this model
+     */
+    bool restore_kv(const SequenceState& state, const uint8_t* kv, size_t size);
+
+    /**
+     * @brief Attach a smaller model whose proposals this engine verifies
+     * @param draft Initialized engine with the same vocab size, or nullptr to disable
+     * @return false if the draft is uninitialized, this engine, or has another vocab
+     */
+    bool set_draft(std::shared_ptr<Engine> draft, const SpeculativeOptions& options = SpeculativeOptions());
+    std::shared_ptr<Engine> get_draft() const { return draft_; }
+    const SpeculativeOptions& speculative_options() const { return speculative_; }
+
     /**
      * @brief Get current model configuration
      */
@@ -57,14 +342,86 @@ public:
     std::shared_ptr<Tokenizer> get_tokenizer() const { return tokenizer_; }
 
     /**
-     * @brief Set associated tokenizer
+     * @brief Set associated tokenizer; its tables are charged to this engine's memory
      */
-    void set_tokenizer(std::shared_ptr<Tokenizer> tokenizer) { tokenizer_ = tokenizer; }
+    void set_tokenizer(std::shared_ptr<Tokenizer> tokenizer);
+
+    /**
+     * @brief Weights, KV cache, scratch and tokenizer tables charged so far
+     *
+     * Everything is accounted; with config.memory_budget_bytes set, initialize()
+     * also reserves scratch and a KV block arena sized to what the budget has
+     * left, and fails if weights and scratch alone do not fit.
+     */
+    const MemoryAccountant& memory() const { return *memory_; }
+
+    /**
+     * @brief KV-cache blocks for admission control; nullptr without a memory budget
+     */
+    BlockArena* kv_arena() const { return kv_arena_.get(); }
+
+    /**
+     * @brief KV blocks a sequence of @p tokens occupies (at least one)
+     */
+    size_t kv_blocks_for(size_t tokens) const;
+
+    /**
+     * @brief Whether @p sequences sequences of @p tokens each can ever hold their KV blocks at once
+     */
+    bool kv_fits(size_t tokens, size_t sequences = 1) const;
+
+    /**
+     * @brief KV blocks for work that runs outside a Scheduler
+     *
+     * Always succeeds, holding nothing, without a KV arena.
+     * @return false (and @p lease empty) if the blocks are not free now
+     */
+    bool lease_kv(size_t tokens, size_t sequences, BlockArena::Lease& lease);
+
+    MemoryReport memory_report() const;
+
+    /**
+     * @brief CPU kernels bound to this model's shapes and the host ISA at initialize()
+     */
+    const KernelSet& kernels() const { return kernels_; }
 
 private:
+    /**
+     * @brief Deterministic CPU stand-in for the model until TensorRT is wired
+     */
+    void reference_logits(const SequenceState& state, std::vector<float>& output_logits) const;
+
+    /**
+     * @brief Add the stand-in final hidden state at the sequence's last position to @p row
+     */
+    void reference_hidden(const SequenceState& state, float* row) const;
+
+    /**
+     * @brief Seed of the stand-in KV bytes: word i is splitmix64(seed + i)
+     */
+    uint64_t reference_kv_seed(const SequenceState& state) const;
+
+    /**
+     * @brief One ragged forward pass: sequence i is tokens[offsets[i], offsets[i + 1])
+     * @param out Pooled rows, hidden_dim floats per sequence
+     */
+    bool embed_packed(const std::vector<int32_t>& tokens, const std::vector<uint32_t>& offsets,
+                      const EmbeddingOptions& options, float* out);
+
+    bool beam_search(const std::vector<int32_t>& prompt_ids, const SamplingParams& params,
+                     const CandidateOptions& options, std::vector<GenerationResult>& results);
+
     ModelConfig config_;
     bool initialized_ = false;
+    uint64_t logit_seed_ = 0; // Distinguishes models in the reference logits
     std::shared_ptr<Tokenizer> tokenizer_;
+    std::shared_ptr<Engine> draft_;
+    std::shared_ptr<MemoryAccountant> memory_ = std::make_shared<MemoryAccountant>();
+    size_t tokenizer_bytes_ = 0; // Charged for tokenizer_
+    HugePageRegion scratch_;
+    std::unique_ptr<BlockArena> kv_arena_;
+    KernelSet kernels_;
+    SpeculativeOptions speculative_;
     
     // TensorRT runtime and engine will be held here
     // Placeholder for actual TensorRT integration
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "model_config.hpp"
+#include "scheduler.hpp"
+#include "tokenizer.hpp"
+#include "worker_pool.hpp"
+
+namespace castor {
+
+/**
+ * @brief One model replicated per NUMA node, with requests routed between replicas
+ *
+ * On a multi-socket host a single Engine spreads its memory traffic across
+ * sockets, and decode is bound by exactly that traffic. The pool instead
+ * builds one replica per node: each replica's engine is initialized on a
+ * thread pinned to the node's CPUs with a node-preferred memory policy, so
+ * weights, scratch and KV blocks are first-touched on local DRAM, and its
+ * workers and scheduler thread stay on the same node. Tokenizers are shared;
+ * they are small and read-mostly.
+ *
+ * Routing is load- and cache-affinity-aware: a request's affinity key (its
+ * session id, or a hash of its first affinity_tokens prompt tokens) selects a
+ * preferred replica by rendezvous hashing, so requests sharing a prefix or a
+ * session keep landing where that context is warm. The preferred replica is
+ * used unless it has more than affinity_slack requests in flight beyond the
+ * least-loaded replica, in which case the least-loaded one takes the request.
+ *
+ * With more replicas than nodes, replicas share nodes round-robin and split
+ * each node's CPUs between them; without NUMA information (no sysfs, or a
+ * single node) replicas run unpinned.
+ */
+class EnginePool {
+public:
+    struct Options {
+        size_t replicas = 0;            // 0 = one per NUMA node
+        size_t threads_per_replica = 0; // Workers per replica; 0 = one per CPU of the replica
+        bool numa_local = true;         // Pin replicas to their node and prefer its memory
+        bool scheduler_enabled = true;  // Give each replica its own Scheduler
+        Scheduler::Options scheduler;
+        size_t affinity_tokens = 64; // Prompt prefix hashed into the affinity key; 0 = route by load only
+        size_t affinity_slack = 2;   // In-flight requests the preferred replica may carry over the least loaded
+    };
+
+    struct Replica {
+        size_t index = 0;
+        int node = -1;         // -1 = unpinned
+        std::vector<int> cpus; // Empty = inherit the process affinity mask
+        std::shared_ptr<Engine> engine;
+        std::shared_ptr<WorkerPool> workers;
+        std::shared_ptr<Scheduler> scheduler; // nullptr when scheduling is disabled
+    };
+
+    /**
+     * @brief A replica chosen for one request; counts as in flight until destroyed
+     */
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        explicit operator bool() const { return replica_ != nullptr; }
+        const Replica* operator->() const { return replica_; }
+        const Replica& operator*() const { return *replica_; }
+
+    private:
+        friend class EnginePool;
+        Lease(EnginePool* pool, const Replica* replica) : pool_(pool), replica_(replica) {}
+        void release();
+
+        EnginePool* pool_ = nullptr;
+        const Replica* replica_ = nullptr;
+    };
+
+    struct ReplicaStatus {
+        size_t index = 0;
+        int node = -1;
+        std::vector<int> cpus;
+        size_t in_flight = 0;
+        uint64_t requests = 0;
+        uint64_t affinity_routes = 0; // Requests that went to their preferred replica
+        double busy_seconds = 0.0;    // Wall time with at least one request in flight
+        double utilization = 0.0;     // Busy fraction, decayed over the last ~utilization_window
+        size_t worker_queue = 0;      // Tasks waiting for one of the replica's workers
+        MemoryReport memory;
+    };
+
+    explicit EnginePool(const Options& options);
+    ~EnginePool();
+
+    EnginePool(const EnginePool&) = delete;
+    EnginePool& operator=(const EnginePool&) = delete;
+
+    /**
+     * @brief Build every replica; replicas initialize in parallel, each on its own node
+     * @param kernels Kernels already chosen for @p config, or nullptr to select them per replica
+     * @return false if any replica fails to initialize (the pool is then empty)
+     */
+    bool initialize(const std::string& engine_path, const ModelConfig& config,
+                    const std::shared_ptr<Tokenizer>& tokenizer, const KernelSet* kernels = nullptr);
+
+    /**
+     * @brief Pick a replica for a request with affinity key @p key
+     * @param key affinity_key() of the request, or 0 to route by load alone
+     * @return Empty lease if the pool is not initialized
+     */
+    Lease acquire(uint64_t key);
+
+    /**
+     * @brief Affinity key of a prompt: hash of its first affinity_tokens tokens
+     */
+    uint64_t affinity_key(const std::vector<int32_t>& tokens) const;
+
+    /**
+     * @brief Affinity key of a session id (never 0)
+     */
+    static uint64_t affinity_key(const std::string& session);
+
+    size_t size() const { return replicas_.size(); }
+    const Replica& replica(size_t index) const { return *replicas_[index]; }
+    const Options& options() const { return options_; }
+    std::vector<ReplicaStatus> status() const;
+
+    /**
+     * @brief Time constant of ReplicaStatus::utilization
+     */
+    static constexpr std::chrono::seconds utilization_window{10};
+
+    /**
+     * @brief Node and CPUs of each of @p replicas replicas on this host
+     *
+     * Nodes without usable CPUs are skipped; if none are left every replica
+     * is unpinned.
+     */
+    static std::vector<std::pair<int, std::vector<int>>> plan_placement(size_t replicas);
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Load {
+        size_t in_flight = 0;
+        uint64_t requests = 0;
+        uint64_t affinity_routes = 0;
+        double busy_seconds = 0.0;
+        double utilization = 0.0; // Decayed busy fraction as of updated
+        Clock::time_point updated;
+    };
+
+    // Advance a replica's busy time and utilization to @p now; caller holds mutex_
+    static void advance(Load& load, Clock::time_point now);
+    void release(const Replica* replica);
+
+    Options options_;
+    std::vector<std::unique_ptr<Replica>> replicas_;
+
+    mutable std::mutex mutex_;
+    std::vector<Load> loads_; // Indexed like replicas_
+};
+
+} // namespace castor
@@ -0,0 +1,148 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+namespace castor {
+
+/**
+ * @brief Deterministic byte-level automaton for constrained decoding
+ *
+ * Compiled from a regular expression (full match) or from a JSON schema,
+ * which is first lowered to a regular expression. States from which no
+ * accepting state is reachable are removed, so any live state can still be
+ * completed to a valid output.
+ *
+ * Supported regex syntax: literals, `.`, classes (`[a-z]`, `[^"]`), the
+ * escapes `\d \w \s` (and negations), `\n \t \r \xHH`, groups, `|`, and the
+ * quantifiers `* + ? {m} {m,} {m,n}`.
+ */
+class Grammar {
+public:
+    static constexpr int32_t kDead = -1;
+
+    /**
+     * @brief Compile a regular expression
+     * @return nullptr with @p error set if the pattern is invalid or too large
+     */
+    static std::shared_ptr<const Grammar> from_regex(const std::string& pattern, std::string& error);
+
+    /**
+     * @brief Compile a JSON schema (see json_schema_regex for the supported subset)
+     */
+    static std::shared_ptr<const Grammar> from_json_schema(const nlohmann::json& schema, std::string& error);
+
+    /**
+     * @brief Lower a JSON schema to a regex matching its compact serializations
+     *
+     * Supports type (string, integer, number, boolean, null, array, object, or
+     * a list of these), enum, const, anyOf/oneOf, properties/required,
+     * items/minItems/maxItems and minLength/maxLength/pattern on strings.
+     * Object keys are emitted in schema order without whitespace.
+     * @return false with @p error set on unsupported schemas
+     */
+    static bool json_schema_regex(const nlohmann::json& schema, std::string& regex, std::string& error);
+
+    int32_t start() const { return 0; }
+    int32_t next(int32_t state, uint8_t byte) const { return transitions_[static_cast<size_t>(state) * 256 + byte]; }
+    bool accepting(int32_t state) const { return accepting_[state] != 0; }
+    bool has_exits(int32_t state) const { return has_exits_[state] != 0; }
+    size_t state_count() const { return accepting_.size(); }
+
+private:
+    std::vector<int32_t> transitions_; // state * 256 + byte -> state or kDead
+    std::vector<uint8_t> accepting_;
+    std::vector<uint8_t> has_exits_;
+};
+
+/**
+ * @brief A Grammar bound to a vocabulary: which tokens each state allows
+ *
+ * The allowed-token bitset of a state is built the first time a sequence
+ * reaches it (one walk over a sorted token table, sharing work between tokens
+ * with common prefixes) and cached for every later step and request. EOS is
+ * allowed exactly in accepting states. Thread-safe; share one instance across
+ * requests with the same constraint.
+ */
+class TokenMasks {
+public:
+    using Vocabulary = std::vector<std::string>; // Token id -> bytes
+
+    /**
+     * @param vocab_size Model vocabulary (logits size); ids beyond @p vocabulary are never allowed
+     */
+    TokenMasks(std::shared_ptr<const Grammar> grammar, std::shared_ptr<const Vocabulary> vocabulary,
+               uint32_t vocab_size, int32_t eos_token_id);
+    ~TokenMasks();
+
+    TokenMasks(const TokenMasks&) = delete;
+    TokenMasks& operator=(const TokenMasks&) = delete;
+
+    /**
+     * @brief Compile a "regex" or "json_schema" constraint, reusing a cached one when possible
+     * @param kind "regex" or "json_schema"
+     * @param spec The pattern, or the schema serialized as JSON
+     * @return nullptr with @p error set if the constraint does not compile
+     */
+    static std::shared_ptr<const TokenMasks> compile(const std::string& kind, const std::string& spec,
+                                                     std::shared_ptr<const Vocabulary> vocabulary, uint32_t vocab_size,
+                                                     int32_t eos_token_id, std::string& error);
+
+    int32_t start() const { return grammar_->start(); }
+
+    /**
+     * @brief State after emitting @p token, or Grammar::kDead if the token is not allowed
+     */
+    int32_t advance(int32_t state, int32_t token) const;
+
+    /**
+     * @brief True if the output so far is valid and nothing more may follow
+     */
+    bool complete(int32_t state) const { return grammar_->accepting(state) && !grammar_->has_exits(state); }
+
+    /**
+     * @brief True if at least one token (or EOS) is allowed in @p state
+     */
+    bool any_allowed(int32_t state) const { return mask(state).any; }
+
+    /**
+     * @brief Set the logits of disallowed tokens to -inf
+     */
+    void apply(int32_t state, std::vector<float>& logits) const;
+
+    /**
+     * @brief Bitset of allowed token ids in @p state (bit i of word i / 64)
+     */
+    const std::vector<uint64_t>& allowed(int32_t state) const { return mask(state).bits; }
+
+    /**
+     * @brief Set logits[i] to -inf wherever bit i of @p bits is clear
+     */
+    static void apply_mask(const uint64_t* bits, float* logits, size_t count);
+
+private:
+    struct Mask {
+        std::vector<uint64_t> bits;
+        bool any = false;
+    };
+
+    const Mask& mask(int32_t state) const;
+    void build(int32_t state, Mask& out) const;
+
+    std::shared_ptr<const Grammar> grammar_;
+    std::shared_ptr<const Vocabulary> vocabulary_;
+    uint32_t vocab_size_;
+    int32_t eos_token_id_;
+    std::vector<int32_t> sorted_ids_; // Token ids ordered by their bytes, for prefix sharing
+
+    std::unique_ptr<std::atomic<const Mask*>[]> masks_; // Indexed by state; built lazily
+    mutable std::mutex build_mutex_;
+    mutable std::vector<std::unique_ptr<Mask>> owned_;
+};
+
+} // namespace castor
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "model_config.hpp"
+
+namespace castor {
+
+/**
+ * @brief Instruction sets the CPU kernels are built for
+ */
+enum class Isa : uint8_t {
+    Generic, // Portable C++, any CPU
+    Avx2,    // AVX2 + FMA
+    Avx512   // AVX-512F
+};
+
+/**
+ * @brief fp32 CPU kernels bound to one model's shapes
+ *
+ * Chosen once by Kernels::select (at Engine::initialize) and then called
+ * through plain function pointers. All matrices are row-major.
+ */
+struct KernelSet {
+    // y[rows] = W[rows x cols] . x[cols]
+    using Gemv = void (*)(const float* w, const float* x, float* y, size_t rows, size_t cols);
+    // y[batch x rows] = x[batch x cols] . W^T
+    using Gemm = void (*)(const float* w, const float* x, float* y, size_t batch, size_t rows, size_t cols);
+    // out = x / sqrt(mean(x^2) + eps) * weight
+    using RmsNorm = void (*)(const float* x, const float* weight, float* out, size_t dim, float eps);
+    // values = softmax(values), in place
+    using Softmax = void (*)(float* values, size_t n);
+
+    // Bits of @ref specialized
+    static constexpr uint32_t kGemvHidden = 1u << 0;
+    static constexpr uint32_t kGemvFfn = 1u << 1;
+    static constexpr uint32_t kGemmHidden = 1u << 2;
+    static constexpr uint32_t kRmsNorm = 1u << 3;
+    static constexpr uint32_t kSoftmax = 1u << 4;
+
+    Isa isa = Isa::Generic;
+    Gemv gemv_hidden = nullptr; // cols = hidden_dim: attention projections, FFN up/gate, LM head
+    Gemv gemv_ffn = nullptr;    // cols = ffn_dim: FFN down projection
+    Gemm gemm_hidden = nullptr; // Batched gemv_hidden, for prefill
+    RmsNorm rms_norm = nullptr; // dim = hidden_dim
+    Softmax softmax = nullptr;  // n = vocab_size
+    uint32_t specialized = 0;   // Kernels bound to a shape-specialized instance
+
+    /**
+     * @brief e.g. "avx512 gemv_hidden=4096 gemv_ffn=11008 gemm_hidden=4096 rms_norm=4096 softmax=32000";
+     * kernels without a specialized instance are listed as "=generic"
+     */
+    std::string describe(const ModelConfig& config) const;
+};
+
+/**
+ * @brief Registry of shape-specialized kernels
+ *
+ * Each kernel is a template over the length of the dimension it loops over.
+ * Besides the any-size instance, it is instantiated at compile time for the
+ * shapes we deploy (hidden 2048/4096/5120/8192, FFN 5632/11008/13824/14336/
+ * 28672, vocab 32000/128256/151936). A constant trip count lets the compiler
+ * drop remainder handling and fully unroll the inner loop. Every instance is
+ * compiled for AVX2 and AVX-512 through target attributes, so one binary
+ * serves any x86-64 host. select() takes the widest ISA that CPUID reports,
+ * then the specialized instance for each dimension, and falls back to that
+ * ISA's any-size kernel for shapes outside the list.
+ */
+class Kernels {
+public:
+    /**
+     * @brief Widest ISA the host CPU (and OS) supports
+     */
+    static Isa detect_isa();
+
+    static const char* isa_name(Isa isa);
+
+    /**
+     * @brief FFN intermediate size: config.ffn_dim, or the Llama rule (8/3 hidden, rounded up to 256)
+     */
+    static uint32_t ffn_dim(const ModelConfig& config);
+
+    /**
+     * @brief Bind kernels for @p config's shapes
+     * @param max_isa Widest ISA to use; clamped to what the host supports
+     * @param specialize false binds only any-size kernels (for comparison)
+     */
+    static KernelSet select(const ModelConfig& config, Isa max_isa = detect_isa(), bool specialize = true);
+};
+
+} // namespace castor
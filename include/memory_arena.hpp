@@ -0,0 +1,207 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "model_config.hpp"
+
+namespace castor {
+
+/**
+ * @brief What a block of memory is spent on
+ */
+enum class MemoryUse : uint8_t {
+    Weights,
+    KvCache,
+    Scratch,   // Activations and logits for one forward pass
+    Tokenizer, // Vocabulary and token tables
+    Count
+};
+
+/**
+ * @brief Charges memory by use against a byte budget
+ *
+ * Lock-free: try_charge() is a compare-and-swap on the running total, so the
+ * budget is never exceeded by concurrent callers. charge() books memory that
+ * is needed regardless (it may push the total past the budget).
+ */
+class MemoryAccountant {
+public:
+    static constexpr size_t kUses = static_cast<size_t>(MemoryUse::Count);
+
+    explicit MemoryAccountant(size_t budget_bytes = 0) : budget_(budget_bytes) {}
+
+    MemoryAccountant(const MemoryAccountant&) = delete;
+    MemoryAccountant& operator=(const MemoryAccountant&) = delete;
+
+    /**
+     * @return false (and nothing charged) if @p bytes would exceed the budget
+     */
+    bool try_charge(MemoryUse use, size_t bytes);
+    void charge(MemoryUse use, size_t bytes);
+    void release(MemoryUse use, size_t bytes);
+
+    size_t budget() const { return budget_; } // 0 = unlimited
+    size_t used(MemoryUse use) const { return used_[static_cast<size_t>(use)].load(std::memory_order_relaxed); }
+    size_t total() const { return total_.load(std::memory_order_relaxed); }
+    size_t available() const; // SIZE_MAX when unlimited
+
+    static const char* use_name(MemoryUse use);
+
+    /**
+     * @brief fp16 weight footprint: embedding, LM head and ~12 h^2 per layer
+     */
+    static size_t estimate_weight_bytes(const ModelConfig& config);
+
+    /**
+     * @brief fp16 K and V for one token across all layers
+     */
+    static size_t estimate_kv_bytes_per_token(const ModelConfig& config);
+
+    /**
+     * @brief Activations for one max_seq_length prefill plus a batch of fp32 logits
+     */
+    static size_t estimate_scratch_bytes(const ModelConfig& config);
+
+private:
+    size_t budget_;
+    std::atomic<size_t> total_{0};
+    std::atomic<size_t> used_[kUses] = {};
+};
+
+/**
+ * @brief Anonymous memory reserved up front, in 2 MB pages where possible
+ *
+ * Tries explicit huge pages (MAP_HUGETLB) first; if none are configured it
+ * maps 2 MB-aligned memory and asks for transparent huge pages with madvise,
+ * and failing that keeps standard pages. With prefault every page is touched
+ * on construction, so the memory is committed at startup instead of faulting
+ * in (or failing) under load.
+ */
+class HugePageRegion {
+public:
+    static constexpr size_t kHugePageBytes = size_t{2} << 20;
+
+    enum class Backing { None, Standard, TransparentHuge, HugeTlb };
+
+    HugePageRegion() = default;
+    explicit HugePageRegion(size_t bytes, bool huge_pages = true, bool prefault = true);
+    ~HugePageRegion();
+
+    HugePageRegion(HugePageRegion&& other) noexcept;
+    HugePageRegion& operator=(HugePageRegion&& other) noexcept;
+    HugePageRegion(const HugePageRegion&) = delete;
+    HugePageRegion& operator=(const HugePageRegion&) = delete;
+
+    void* data() const { return data_; }
+    size_t size() const { return size_; }
+    Backing backing() const { return backing_; }
+    bool valid() const { return data_ != nullptr; }
+
+    static const char* backing_name(Backing backing);
+
+private:
+    void reset();
+
+    void* data_ = nullptr;
+    size_t size_ = 0; // Mapped bytes, a multiple of kHugePageBytes
+    Backing backing_ = Backing::None;
+};
+
+/**
+ * @brief Fixed-size blocks carved from one HugePageRegion
+ *
+ * allocate() and free() pop and push a Treiber stack of block indices; the
+ * head carries a version tag so a block freed and reallocated between a
+ * load and its compare-and-swap cannot corrupt the list (ABA). Each block
+ * in use is charged to the accountant, so other uses of the same budget
+ * (e.g. a tokenizer loaded later) can also make allocation fail.
+ */
+class BlockArena {
+public:
+    static constexpr uint32_t kNoBlock = UINT32_MAX;
+
+    /**
+     * @brief A set of blocks returned to the arena when released or destroyed
+     */
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { release(); }
+
+        void release();
+        size_t size() const { return blocks_.size(); }
+        bool empty() const { return blocks_.empty(); }
+        const std::vector<uint32_t>& blocks() const { return blocks_; }
+
+    private:
+        friend class BlockArena;
+        BlockArena* arena_ = nullptr;
+        std::vector<uint32_t> blocks_;
+    };
+
+    BlockArena(size_t block_bytes, size_t blocks, std::shared_ptr<MemoryAccountant> accountant = nullptr,
+               MemoryUse use = MemoryUse::KvCache, bool huge_pages = true);
+
+    BlockArena(const BlockArena&) = delete;
+    BlockArena& operator=(const BlockArena&) = delete;
+
+    /**
+     * @return A free block, or kNoBlock if none is free or the budget refuses
+     */
+    uint32_t allocate();
+    void free(uint32_t block);
+
+    /**
+     * @brief All @p count blocks, or an empty lease (and nothing held) if they are not available
+     */
+    Lease lease(size_t count);
+
+    void* block(uint32_t index) const { return static_cast<char*>(region_.data()) + index * block_bytes_; }
+    size_t block_bytes() const { return block_bytes_; }
+    size_t capacity() const { return capacity_; }
+    size_t free_blocks() const { return free_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Most blocks one lease could get once every lease is returned
+     *
+     * Capacity, less whatever other uses of the accountant's budget hold.
+     */
+    size_t max_lease() const;
+    HugePageRegion::Backing backing() const { return region_.backing(); }
+
+private:
+    static uint64_t pack(uint64_t tag, uint32_t index) { return (tag << 32) | index; }
+
+    size_t block_bytes_;
+    size_t capacity_;
+    std::shared_ptr<MemoryAccountant> accountant_;
+    MemoryUse use_;
+    HugePageRegion region_;
+    std::unique_ptr<std::atomic<uint32_t>[]> next_; // Free-list links, by block index
+    std::atomic<uint64_t> head_;                    // Version tag << 32 | top block index
+    std::atomic<size_t> free_;
+};
+
+/**
+ * @brief Point-in-time view of one engine's memory, for /model
+ */
+struct MemoryReport {
+    size_t budget_bytes = 0; // 0 = unlimited
+    size_t used_bytes[MemoryAccountant::kUses] = {};
+    size_t total_bytes = 0;
+    size_t kv_block_bytes = 0; // KV arena; zeros without a budget
+    size_t kv_block_tokens = 0;
+    size_t kv_blocks = 0;
+    size_t kv_blocks_free = 0;
+    HugePageRegion::Backing kv_backing = HugePageRegion::Backing::None;
+    HugePageRegion::Backing scratch_backing = HugePageRegion::Backing::None;
+};
+
+} // namespace castor
@@ -0,0 +1,194 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "resource_accounting.hpp"
+
+namespace castor {
+
+/**
+ * @brief HTTP endpoints that get per-route request, byte and resource counters
+ */
+enum class Endpoint : uint32_t {
+    Health,
+    Model,
+    Infer,
+    Metrics,
+    Embeddings,
+    Ready,
+    Count
+};
+
+/**
+ * @brief Monotonic counters (exported as Prometheus counters)
+ */
+enum class Counter : uint32_t {
+    PromptTokens,
+    GeneratedTokens,
+    InferErrors,
+    CacheHits,
+    CacheMisses,
+    CacheCoalesced,
+    CacheEvictions,
+    SchedulerPreemptions,
+    SchedulerDeadlineDrops,
+    SchedulerCancellations,
+    ModelLoads,
+    ModelEvictions,
+    SpeculativeDraftTokens,
+    SpeculativeAcceptedTokens,
+    SpeculativeEmittedTokens,
+    SpeculativeTargetForwards,
+    SequenceForks,
+    GrammarMaskBuilds,
+    EmbeddingTokens,
+    SessionResumes,
+    SessionResumedTokens,
+    SessionSpills,
+    SessionRestores,
+    ReplicaAffinityRoutes,
+    ReplicaRebalancedRoutes,
+    Count
+};
+
+/**
+ * @brief Up/down values (exported as Prometheus gauges)
+ */
+enum class Gauge : uint32_t {
+    QueueDepth,
+    CacheBytes,
+    WorkerQueueDepth,
+    SchedulerPending,
+    ModelResidentBytes,
+    SessionResidentBytes,
+    SessionDiskBytes,
+    Count
+};
+
+/**
+ * @brief Log-linear histograms (exported as Prometheus histograms)
+ */
+enum class Histogram : uint32_t {
+    RequestSeconds,
+    TokenizeSeconds,
+    PrefillSeconds,
+    DecodeTokenSeconds,
+    TimeToFirstTokenSeconds,
+    TokensPerSecond,
+    InteractiveRequestSeconds, // Scheduler latency, one per priority class
+    DefaultRequestSeconds,
+    BatchRequestSeconds,
+    SchedulerIterationSeconds, // One scheduler step = inter-token latency of running streams
+    EmbeddingSeconds,          // One packed embedding batch (Engine::embed_packed)
+    Count
+};
+
+/**
+ * @brief Process-wide metrics registry
+ *
+ * Every thread writes into its own cache-line aligned shard, so recording a
+ * sample is a couple of relaxed loads/stores with no shared atomics or locks
+ * on the hot path. Shards are only summed when /metrics is scraped. Shards of
+ * exited threads are folded into a retired accumulator so no samples are lost.
+ *
+ * Histograms are log-linear: four linear sub-buckets per power of two, which
+ * bounds the relative bucket error at 25% over the full uint64 range.
+ */
+class Metrics {
+public:
+    /**
+     * @brief Count one request served by an endpoint
+     */
+    static void count_request(Endpoint endpoint);
+
+    /**
+     * @brief Account bytes serialized into a response body
+     */
+    static void add_response_bytes(Endpoint endpoint, uint64_t bytes);
+
+    /**
+     * @brief Account CPU time and allocations charged to one request
+     */
+    static void add_request_resources(Endpoint endpoint, const ResourceUsage& usage);
+
+    /**
+     * @brief Increment a counter
+     */
+    static void add(Counter counter, uint64_t value = 1);
+
+    /**
+     * @brief Apply a signed delta to a gauge
+     */
+    static void gauge_add(Gauge gauge, int64_t delta);
+
+    /**
+     * @brief Record one histogram sample (seconds for *Seconds histograms)
+     */
+    static void observe(Histogram histogram, double value);
+
+    /**
+     * @brief Merge all thread shards and render Prometheus text format (v0.0.4)
+     */
+    static std::string render_prometheus();
+
+    /**
+     * @brief Read the merged value of a counter (intended for tests and tools)
+     */
+    static uint64_t counter_value(Counter counter);
+
+    /**
+     * @brief Read the merged sample count of a histogram
+     */
+    static uint64_t histogram_count(Histogram histogram);
+
+    /**
+     * @brief Log-linear bucket index for a scaled integer sample
+     */
+    static size_t bucket_index(uint64_t value);
+
+    /**
+     * @brief Exclusive upper bound (scaled integer) of a bucket
+     */
+    static uint64_t bucket_upper_bound(size_t index);
+};
+
+/**
+ * @brief RAII helper that observes elapsed wall time into a histogram
+ */
+class ScopedTimer {
+public:
+    explicit ScopedTimer(Histogram histogram)
+        : histogram_(histogram), start_(std::chrono::steady_clock::now()) {}
+
+    ~ScopedTimer() { Metrics::observe(histogram_, elapsed_seconds()); }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    double elapsed_seconds() const {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+    }
+
+private:
+    Histogram histogram_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+/**
+ * @brief RAII helper that holds a gauge at +1 for its lifetime
+ */
+class GaugeGuard {
+public:
+    explicit GaugeGuard(Gauge gauge) : gauge_(gauge) { Metrics::gauge_add(gauge_, 1); }
+    ~GaugeGuard() { Metrics::gauge_add(gauge_, -1); }
+
+    GaugeGuard(const GaugeGuard&) = delete;
+    GaugeGuard& operator=(const GaugeGuard&) = delete;
+
+private:
+    Gauge gauge_;
+};
+
+} // namespace castor
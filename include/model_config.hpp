@@ -7,6 +7,9 @@
 
 namespace castor {
 
+class TokenMasks;    // grammar.hpp
+class StopSequences; // stop_sequences.hpp
+
 /**
  * @brief Model configuration and metadata
  */
@@ -17,7 +20,27 @@ struct ModelConfig {
     uint32_t vocab_size = 32000;
     uint32_t hidden_dim = 4096;
     uint32_t num_layers = 32;
+    uint32_t ffn_dim = 0;           // FFN intermediate size; 0 = Llama rule from hidden_dim (4096 -> 11008)
+    int32_t eos_token_id = 2;
     float precision_threshold = 1e-6f;
+    size_t memory_budget_bytes = 0; // Weights + KV cache + scratch + tokenizer; 0 = unlimited, no KV arena
+    uint32_t kv_block_tokens = 16;  // Tokens per KV-cache block
+    bool huge_pages = true;         // Back the KV arena and scratch with 2 MB pages when available
+};
+
+/**
+ * @brief Per-request decoding parameters
+ */
+struct SamplingParams {
+    uint32_t max_tokens = 0;    // 0 = process the prompt only, no decode
+    float temperature = 1.0f;   // <= 0 selects greedy (argmax) decoding
+    uint32_t top_k = 0;         // 0 = disabled
+    float top_p = 1.0f;         // 1 = disabled
+    uint64_t seed = 0;
+    std::shared_ptr<const TokenMasks> grammar; // Constrained decoding; nullptr = unconstrained
+    std::shared_ptr<const StopSequences> stop; // Stop strings and token ids; nullptr = EOS only
+
+    bool is_greedy() const { return temperature <= 0.0f; }
 };
 
 /**
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "model_config.hpp"
+#include "scheduler.hpp"
+#include "tokenizer.hpp"
+#include "worker_pool.hpp"
+
+namespace castor {
+
+/**
+ * @brief Where to find one servable model
+ */
+struct ModelSpec {
+    std::string name;           // Routing key for the request "model" field
+    std::string engine_path;    // TensorRT plan
+    std::string tokenizer_path; // Models with the same path share one Tokenizer
+    ModelConfig config;         // config.model_name is forced to name
+    size_t memory_bytes = 0;    // Resident size; 0 = estimate from config
+    std::string draft;          // Registered model used for speculative decoding, if any
+    SpeculativeOptions speculative;
+};
+
+/**
+ * @brief Named models loaded on first use and kept within a memory budget
+ *
+ * Requests are routed by name; an empty name selects the default model (the
+ * first one added). A model is loaded the first time it is acquired; loading
+ * happens outside the registry lock and concurrent first requests for the
+ * same model wait for a single load.
+ *
+ * When loading would exceed the budget, idle models (no request currently
+ * holding them) are evicted least-recently-used first, before the new model
+ * is initialized, so their memory is free by then. Models in use are
+ * never evicted; if nothing idle is left the load proceeds over budget and a
+ * warning is logged rather than failing the request.
+ *
+ * A model whose spec names a draft loads that draft first and keeps it
+ * resident for as long as it is itself resident (speculative decoding).
+ */
+class ModelRegistry {
+public:
+    struct Options {
+        size_t memory_budget_bytes = 0; // 0 = unlimited
+        bool scheduler_enabled = true;  // Give each loaded model its own Scheduler
+        Scheduler::Options scheduler;
+    };
+
+    /**
+     * @brief A resident model; holding the pointer pins it in memory
+     */
+    struct Model {
+        ModelSpec spec;
+        std::shared_ptr<Engine> engine;
+        std::shared_ptr<Tokenizer> tokenizer;
+        std::shared_ptr<Scheduler> scheduler; // nullptr when scheduling is disabled
+        std::shared_ptr<Model> draft;         // Pinned while this model is resident
+        size_t bytes = 0;
+    };
+
+    struct Status {
+        std::string name;
+        bool loaded = false;
+        size_t bytes = 0;
+        MemoryReport memory; // Loaded models only
+    };
+
+    explicit ModelRegistry(const Options& options, std::shared_ptr<WorkerPool> workers = nullptr);
+    ~ModelRegistry();
+
+    ModelRegistry(const ModelRegistry&) = delete;
+    ModelRegistry& operator=(const ModelRegistry&) = delete;
+
+    /**
+     * @brief Register a model without loading it
+     * @return false if the name is empty or already registered
+     */
+    bool add(const ModelSpec& spec);
+
+    /**
+     * @brief Resolve a model by name, loading it if needed
+     * @param name Registered name, or empty for the default model
+     * @return nullptr if the name is unknown or loading failed
+     */
+    std::shared_ptr<Model> acquire(const std::string& name);
+
+    /**
+     * @brief Load models ahead of traffic (warm start)
+     * @return false if any name is unknown or fails to load
+     */
+    bool preload(const std::vector<std::string>& names);
+
+    bool contains(const std::string& name) const;
+    std::string default_model() const;
+    const ModelSpec* spec(const std::string& name) const;
+    std::vector<Status> status() const;
+    size_t resident_bytes() const;
+
+    /**
+     * @brief Approximate fp16 weight footprint for a model configuration
+     */
+    static size_t estimate_bytes(const ModelConfig& config);
+
+private:
+    struct Entry {
+        ModelSpec spec;
+        std::mutex load_mutex; // Serializes loads of this model
+        std::shared_ptr<Model> model;
+        uint64_t last_used = 0;
+    };
+
+    std::shared_ptr<Model> load(const ModelSpec& spec);
+    std::shared_ptr<Tokenizer> shared_tokenizer(const std::string& path);
+    bool draft_cycle(const std::string& name) const; // Would loading name's drafts recurse forever?
+
+    // Caller holds mutex_; victims are destroyed by the caller after unlocking
+    void make_room(size_t bytes, const Entry* loading, std::vector<std::shared_ptr<Model>>& victims);
+
+    Options options_;
+    std::shared_ptr<WorkerPool> workers_;
+
+    mutable std::mutex mutex_;
+    std::map<std::string, std::unique_ptr<Entry>> entries_;
+    std::string default_name_;
+    size_t resident_bytes_ = 0;
+    uint64_t clock_ = 0;
+
+    std::mutex tokenizer_mutex_;
+    std::map<std::string, std::weak_ptr<Tokenizer>> tokenizers_; // Keyed by canonical path
+};
+
+} // namespace castor
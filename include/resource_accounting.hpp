@@ -0,0 +1,81 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace castor {
+
+/**
+ * @brief CPU time and heap allocations charged to a request or phase
+ */
+struct ResourceUsage {
+    uint64_t cpu_ns = 0;          // Thread CPU time (CLOCK_THREAD_CPUTIME_ID)
+    uint64_t allocations = 0;     // Calls to operator new
+    uint64_t allocated_bytes = 0; // Bytes requested from operator new
+
+    ResourceUsage& operator+=(const ResourceUsage& other) {
+        cpu_ns += other.cpu_ns;
+        allocations += other.allocations;
+        allocated_bytes += other.allocated_bytes;
+        return *this;
+    }
+
+    ResourceUsage operator-(const ResourceUsage& other) const {
+        return ResourceUsage{cpu_ns - other.cpu_ns, allocations - other.allocations,
+                             allocated_bytes - other.allocated_bytes};
+    }
+};
+
+/**
+ * @brief Opt-in per-thread CPU time and allocation counters
+ *
+ * Allocations are counted by global operator new replacements, compiled in
+ * with -DCASTOR_ALLOC_ACCOUNTING=ON (always for castor-tests). They bump
+ * plain thread-local counters: no atomics, no locks. CPU time is read from
+ * the thread CPU clock on demand.
+ *
+ * Attribution is off until set_enabled(true): every RequestTraceScope, and
+ * every span inside one, then snapshots the thread's usage, so requests and
+ * their phases are charged for what ran on their behalf on any thread.
+ */
+class ResourceAccounting {
+public:
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief Whether this binary has the operator new hooks (allocations read 0 otherwise)
+     */
+    static constexpr bool counts_allocations() {
+#ifdef CASTOR_ALLOC_ACCOUNTING
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /**
+     * @brief Usage of the calling thread since it started
+     */
+    static ResourceUsage thread_usage() {
+        return ResourceUsage{thread_cpu_ns(), allocations_, allocated_bytes_};
+    }
+
+    static uint64_t thread_cpu_ns();
+
+    /**
+     * @brief Called by the operator new hooks
+     */
+    static void on_allocation(size_t bytes) {
+        ++allocations_;
+        allocated_bytes_ += bytes;
+    }
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+    static inline thread_local uint64_t allocations_ = 0;
+    static inline thread_local uint64_t allocated_bytes_ = 0;
+};
+
+} // namespace castor
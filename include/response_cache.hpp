@@ -0,0 +1,152 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+#include "async.hpp"
+#include "engine.hpp"
+#include "model_config.hpp"
+
+namespace castor {
+
+/**
+ * @brief In-memory cache of deterministic (greedy) generation results
+ *
+ * Keys are the canonical bytes of (model id, prompt token ids, sampling
+ * params); lookups hash them with XXH64 to pick a shard and bucket, and the
+ * full key is compared so hash collisions can never serve a wrong answer.
+ *
+ * Each shard has its own mutex, LRU list and byte budget. Entries expire after
+ * a TTL. Concurrent misses on the same key are coalesced: the first caller
+ * runs the computation, later callers wait on its result (single-flight).
+ */
+class ResponseCache {
+public:
+    struct Options {
+        size_t max_bytes = 64ull << 20;
+        std::chrono::milliseconds ttl = std::chrono::minutes(5);
+        size_t num_shards = 16;
+    };
+
+    enum class Outcome {
+        Hit,
+        Miss,
+        Coalesced
+    };
+
+    struct Stats {
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t coalesced = 0;
+        uint64_t evictions = 0;
+        uint64_t entries = 0;
+        uint64_t bytes = 0;
+    };
+
+    using Value = std::shared_ptr<const GenerationResult>;
+    using Compute = std::function<Value()>;
+
+    /**
+     * @brief Result of claim(): a hit, a coalesced wait, or leadership of a miss
+     */
+    struct Claim {
+        Outcome outcome = Outcome::Miss;
+        Value value;                // Hit: the cached value
+        AsyncResult<Value> pending; // Coalesced: the leader's result, to co_await
+    };
+
+    ResponseCache();
+    explicit ResponseCache(const Options& options);
+
+    /**
+     * @brief Build the canonical cache key for a request
+     *
+     * Greedy decoding ignores seed/top_k/top_p, so those are normalized away
+     * to let equivalent requests share an entry. Stop strings and stop token
+     * ids are part of the key.
+     */
+    static std::string make_key(const std::string& model_id, const std::vector<int32_t>& tokens,
+                                const SamplingParams& params);
+
+    /**
+     * @brief Look up a live entry (nullptr on miss or expiry)
+     */
+    Value lookup(const std::string& key);
+
+    /**
+     * @brief Insert or replace an entry, evicting LRU entries to fit
+     */
+    void insert(const std::string& key, Value value);
+
+    /**
+     * @brief Return the cached value or compute it exactly once per key
+     *
+     * A nullptr from @p compute is handed to all waiters but not cached.
+     * Exceptions thrown by @p compute propagate to all waiters.
+     */
+    Value get_or_compute(const std::string& key, const Compute& compute, Outcome* outcome = nullptr);
+
+    /**
+     * @brief Non-blocking single-flight: look up @p key, or join or lead its computation
+     *
+     * On Outcome::Miss the caller leads and must finish with publish() or
+     * fail(), from any thread; waiters are resumed then. get_or_compute() is
+     * claim() plus a blocking wait.
+     */
+    Claim claim(const std::string& key);
+    void publish(const std::string& key, Value value);
+    void fail(const std::string& key, std::exception_ptr error);
+
+    Stats stats() const;
+    void clear();
+
+    /**
+     * @brief Approximate resident size of one entry (key + payload + bookkeeping)
+     */
+    static size_t entry_bytes(const std::string& key, const GenerationResult& value);
+
+private:
+    struct Entry {
+        std::string key;
+        Value value;
+        size_t bytes = 0;
+        std::chrono::steady_clock::time_point expires;
+    };
+
+    struct KeyHash {
+        size_t operator()(std::string_view key) const;
+    };
+
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        std::list<Entry> lru; // front = most recently used
+        std::unordered_map<std::string_view, std::list<Entry>::iterator, KeyHash> index;
+        std::unordered_map<std::string, AsyncResult<Value>, KeyHash> in_flight;
+        size_t bytes = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t coalesced = 0;
+        uint64_t evictions = 0;
+    };
+
+    Shard& shard_for(const std::string& key);
+    Value lookup_locked(Shard& shard, const std::string& key);
+    void insert_locked(Shard& shard, const std::string& key, Value value);
+    void erase_locked(Shard& shard, std::list<Entry>::iterator it);
+    AsyncResult<Value> take_in_flight(Shard& shard, const std::string& key);
+
+    Options options_;
+    size_t shard_budget_;
+    std::vector<std::unique_ptr<Shard>> shards_;
+};
+
+} // namespace castor
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "autotuner.hpp"
+#include "batch_runner.hpp"
+#include "engine_pool.hpp"
+#include "model_registry.hpp"
+#include "response_cache.hpp"
+#include "scheduler.hpp"
+#include "server.hpp"
+#include "session_store.hpp"
+#include "worker_pool.hpp"
+
+namespace castor {
+
+/**
+ * @brief Process-level settings for castor-rt, from a JSON file and/or CLI
+ *
+ * Precedence: built-in defaults < --config file < other command-line flags.
+ *
+ * File layout (every key optional):
+ * @code
+ * {
+ *   "server":  {"port": 8080, "bind": "0.0.0.0", "unix_socket": "", "tcp": true},
+ *   "threads": {"http": 4, "http_cpus": "0-3",
+ *               "inference": 8, "inference_cpus": "4-11", "numa_local": true},
+ *   "cache":   {"enabled": true, "max_mb": 64, "ttl_seconds": 300},
+ *   "batch":   {"batch_size": 16, "tokenize_threads": 4},
+ *   "scheduler": {"enabled": true, "max_batch": 8, "prefill_chunk": 512, "target_iteration_ms": 0},
+ *   "sessions": {"enabled": false, "dir": "/var/lib/castor/sessions", "ram_mb": 256, "idle_seconds": 300,
+ *                "compress": false},
+ *   "replicas": {"enabled": false, "count": 0, "threads": 0, "affinity_tokens": 64, "affinity_slack": 2},
+ *   "autotune": {"enabled": false, "file": "models/autotune.json", "itl_slo_ms": 100, "ttft_slo_ms": 0},
+ *   "models":  {"budget_mb": 16384, "preload": ["chat"],
+ *               "list": [{"name": "chat", "engine": "models/chat.plan", "tokenizer": "models/tokenizer.json",
+ *                         "vocab_size": 32000, "hidden_dim": 4096, "num_layers": 32, "memory_mb": 0,
+ *                         "memory_budget_mb": 0, "kv_block_tokens": 16, "huge_pages": true}]}
+ * }
+ * @endcode
+ */
+struct RuntimeConfig {
+    ServerOptions server;
+    WorkerPool::Options inference;
+    bool cache_enabled = true;
+    ResponseCache::Options cache;
+    bool scheduler_enabled = true;
+    Scheduler::Options scheduler;
+    bool sessions_enabled = false;
+    SessionStore::Options sessions;
+    bool replicas_enabled = false; // One engine replica per NUMA node (single built-in model only)
+    EnginePool::Options replicas;  // scheduler and numa_local are taken from the settings above
+    bool autotune = false;         // Tune (or reuse tuned) batch, threads and chunk for the built-in model
+    bool retune = false;           // Tune even if this host already has cached settings
+    Autotuner::Options autotuner;
+    BatchRunner::Options batch; // Offline mode when batch.input_path is set
+    std::vector<ModelSpec> models; // Empty = the single built-in model
+    size_t model_budget_bytes = 0;  // 0 = unlimited
+    std::vector<std::string> preload_models;
+    bool self_test = false;     // Run the built-in smoke tests and exit
+
+    bool batch_mode() const { return !batch.input_path.empty(); }
+
+    /**
+     * @brief Merge settings from a JSON config file into @p config
+     * @return false if the file cannot be read or has invalid values
+     */
+    static bool load_file(const std::string& path, RuntimeConfig& config);
+
+    /**
+     * @brief Apply command-line flags (loading --config first if present)
+     * @return false on unknown or malformed arguments
+     */
+    static bool parse_args(int argc, char* argv[], RuntimeConfig& config);
+
+    static const char* usage();
+};
+
+} // namespace castor
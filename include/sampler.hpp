@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <utility>
+#include <vector>
+#include "model_config.hpp"
+
+namespace castor {
+
+/**
+ * @brief Picks the next token from a logits vector
+ *
+ * Supports greedy, temperature, top-k and top-p (nucleus) sampling. A Sampler
+ * owns its RNG and scratch buffers, so use one instance per sequence.
+ */
+class Sampler {
+public:
+    explicit Sampler(uint64_t seed = 0);
+
+    /**
+     * @brief Sample one token id
+     * @param logits Unnormalized scores, one per vocab entry
+     * @param params Decoding parameters
+     * @param logprob Optional out: log-probability of the chosen token under
+     *        the temperature-scaled distribution (T = 1 for greedy)
+     * @return Token id, or -1 if logits is empty
+     */
+    int32_t sample(const std::vector<float>& logits, const SamplingParams& params, float* logprob = nullptr);
+
+    /**
+     * @brief Dense next-token distribution under @p params (one-hot for greedy)
+     *
+     * Applies the same temperature, top-k and top-p rules as sample(), so
+     * drawing from @p probs is equivalent to calling sample().
+     */
+    void distribution(const std::vector<float>& logits, const SamplingParams& params, std::vector<float>& probs);
+
+    /**
+     * @brief Draw a token id from a dense, not necessarily normalized distribution
+     * @return Token id, or -1 if every entry is zero
+     */
+    int32_t sample_from(const std::vector<float>& probs);
+
+    /**
+     * @brief Uniform draw in [0, 1) from this sampler's RNG
+     */
+    double uniform();
+
+    /**
+     * @brief Log-probability of @p id under the temperature-scaled softmax (T = 1 for greedy)
+     */
+    static float logprob(const std::vector<float>& logits, const SamplingParams& params, int32_t id);
+
+    /**
+     * @brief Candidates partially sorted before a top-p scan (process-wide; 0 = sort the whole vocab)
+     *
+     * The nucleus of a peaked distribution usually fits in the first few
+     * hundred candidates, so sorting only those is much cheaper than a full
+     * sort; the rest is sorted only if the scan runs past them. The sampled
+     * distribution is the same either way. Set by the autotuner.
+     */
+    static void set_nucleus_window(size_t candidates);
+    static size_t nucleus_window();
+
+private:
+    // Fill candidates_ with unnormalized probabilities of the kept tokens; returns their sum
+    double prepare_candidates(const std::vector<float>& logits, const SamplingParams& params, float max_logit,
+                              size_t& keep);
+
+    std::mt19937_64 rng_;
+    std::vector<std::pair<float, int32_t>> candidates_;
+};
+
+} // namespace castor
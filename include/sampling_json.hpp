@@ -0,0 +1,68 @@
+#pragma once
+
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include "model_config.hpp"
+#include "stop_sequences.hpp"
+
+namespace castor {
+
+/**
+ * @brief Read the optional decoding fields of a request object
+ *
+ * Shared by the /infer handler and the offline batch runner so both accept
+ * the same body. Throws nlohmann::json::exception on mistyped fields.
+ */
+inline SamplingParams parse_sampling_params(const nlohmann::json& data) {
+    SamplingParams params;
+    params.max_tokens = data.value("max_tokens", params.max_tokens);
+    params.temperature = data.value("temperature", params.temperature);
+    params.top_k = data.value("top_k", params.top_k);
+    params.top_p = data.value("top_p", params.top_p);
+    params.seed = data.value("seed", params.seed);
+    return params;
+}
+
+/**
+ * @brief Read the optional "stop" (a string or list of strings) and
+ * "stop_token_ids" fields into params.stop
+ * @param vocabulary Token texts the stop strings are matched against
+ * @return false with @p error set on mistyped fields or invalid stop strings
+ */
+inline bool parse_stop_sequences(const nlohmann::json& data, std::shared_ptr<const StopSequences::Vocabulary> vocabulary,
+                                 SamplingParams& params, std::string& error) {
+    std::vector<std::string> strings;
+    std::vector<int32_t> token_ids;
+    if (data.contains("stop")) {
+        const nlohmann::json& value = data["stop"];
+        if (value.is_string()) {
+            strings.push_back(value.get<std::string>());
+        } else if (value.is_array() &&
+                   std::all_of(value.begin(), value.end(), [](const nlohmann::json& s) { return s.is_string(); })) {
+            strings = value.get<std::vector<std::string>>();
+        } else {
+            error = "Invalid 'stop': expected a string or an array of strings";
+            return false;
+        }
+    }
+    if (data.contains("stop_token_ids")) {
+        const nlohmann::json& value = data["stop_token_ids"];
+        if (!value.is_array() ||
+            !std::all_of(value.begin(), value.end(), [](const nlohmann::json& id) { return id.is_number_integer(); })) {
+            error = "Invalid 'stop_token_ids': expected an array of integers";
+            return false;
+        }
+        token_ids = value.get<std::vector<int32_t>>();
+    }
+    if (strings.empty() && token_ids.empty()) {
+        return true;
+    }
+    params.stop = StopSequences::compile(strings, token_ids, std::move(vocabulary), error);
+    if (!params.stop) {
+        error = "Invalid 'stop': " + error;
+        return false;
+    }
+    return true;
+}
+
+} // namespace castor
@@ -0,0 +1,205 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "async.hpp"
+#include "engine.hpp"
+#include "trace.hpp"
+#include "worker_pool.hpp"
+
+namespace castor {
+
+/**
+ * @brief Request classes, most latency-sensitive first
+ */
+enum class Priority : uint8_t {
+    Interactive,
+    Default,
+    Batch,
+    Count
+};
+
+/**
+ * @brief Iteration-level scheduler for generation requests
+ *
+ * Owns every in-flight GenerationStream and advances up to max_batch of them
+ * by one step per iteration. Pending work is ordered by priority class, then
+ * earliest deadline, then arrival. When a higher-class request is waiting and
+ * all slots are busy, the lowest-ranked running stream of a lower class is
+ * paused (its sequence state is kept, so resuming costs nothing) and the
+ * waiting request takes its slot.
+ *
+ * Long prompts are prefilled in chunks: each iteration spends at most one
+ * chunk of prompt tokens (shared by the highest-ranked prefilling streams)
+ * next to the decode steps, so a 4k-token prompt no longer stalls every other
+ * stream for its whole prefill. With target_iteration_ms set, the chunk is
+ * sized from the measured per-token prefill cost instead.
+ *
+ * Before a waiting request is (re)admitted, its remaining work is estimated
+ * from measured prefill-per-token and per-step costs and the output length
+ * completed requests reached (capped by max_tokens); if it cannot finish
+ * before its deadline it is dropped without spending compute on it.
+ *
+ * When the engine has a KV arena (a memory budget), a request is admitted
+ * only once KV blocks for its prompt plus max_tokens are reserved; it keeps
+ * them while paused and returns them when it finishes. A request that waits
+ * for blocks stays at the head of its class; paused streams that already
+ * hold their blocks can still resume around it. A request larger than the
+ * arena could ever lease (BlockArena::max_lease) fails at once. While every
+ * waiting request is blocked on blocks leased outside the scheduler, the
+ * loop sleeps and rechecks on a short interval instead of spinning.
+ *
+ * Requests can be cancelled at any time through their CancellationToken; the
+ * stream is released at the next iteration and the tokens generated so far
+ * are returned. An on_token callback sees every newly generated token as soon
+ * as the iteration that produced it ends.
+ */
+class Scheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Options {
+        size_t max_batch = 8;              // Streams advanced per iteration
+        size_t prefill_chunk_tokens = 512; // Prompt tokens per iteration; 0 = whole prompts
+        double target_iteration_ms = 0.0;  // > 0: size chunks from measured cost to fit this
+    };
+
+    enum class Status {
+        Completed,
+        DeadlineExceeded,
+        Failed,
+        ShuttingDown,
+        Cancelled // result holds the tokens generated before the cancel
+    };
+
+    /**
+     * @brief Tokens produced by one iteration for one request
+     */
+    struct TokenUpdate {
+        const int32_t* ids = nullptr;
+        const float* logprobs = nullptr;
+        size_t count = 0;
+        std::string text; // With params.stop: newly final text (GenerationStream::take_text)
+        bool finished = false;
+    };
+
+    /**
+     * @brief Per-token callback; runs on the scheduler thread, so it must not block
+     */
+    using TokenCallback = std::function<void(const TokenUpdate&)>;
+
+    struct Request {
+        std::vector<int32_t> prompt_ids;
+        SamplingParams params;
+        Priority priority = Priority::Default;
+        Clock::time_point deadline = Clock::time_point::max();
+        PhaseTimings* timings = nullptr; // Engine spans are added here if set
+        TokenCallback on_token;          // Optional streaming hook
+        CancellationToken cancel;
+        SequenceState resume_state; // Restored session state holding the first resume_tokens prompt tokens
+        size_t resume_tokens = 0;   // 0 = prefill the whole prompt
+    };
+
+    struct Outcome {
+        Status status = Status::Failed;
+        GenerationResult result;
+        SequenceState state;        // Prompt and the output tokens fed back (for session snapshots)
+        size_t resumed_tokens = 0;  // Prompt tokens taken from resume_state (0 if it was not usable)
+        double queue_seconds = 0.0; // Submit to first admission
+        uint32_t preemptions = 0;
+    };
+
+    Scheduler(std::shared_ptr<Engine> engine, const Options& options, std::shared_ptr<WorkerPool> workers = nullptr);
+    ~Scheduler();
+
+    Scheduler(const Scheduler&) = delete;
+    Scheduler& operator=(const Scheduler&) = delete;
+
+    /**
+     * @brief Queue a generation; the future resolves when it finishes or is dropped
+     */
+    std::future<Outcome> submit(Request request);
+
+    /**
+     * @brief Queue a generation without tying up a thread to wait for it
+     *
+     * The result can be co_awaited or observed with on_ready(); completion
+     * runs on the scheduler thread, so continuations that do real work should
+     * resume elsewhere (AsyncResult::via).
+     */
+    AsyncResult<Outcome> submit_async(Request request);
+
+    const Options& options() const { return options_; }
+
+    /**
+     * @brief Parse "interactive"/"default"/"batch" (or "high"/"normal"/"low", or "0"-"2")
+     */
+    static bool parse_priority(const std::string& text, Priority& priority);
+    static const char* priority_name(Priority priority);
+
+private:
+    struct Sequence {
+        Request request;
+        std::unique_ptr<GenerationStream> stream;
+        AsyncResult<Outcome> result;
+        Clock::time_point arrival;
+        Clock::time_point admitted;
+        uint64_t order = 0; // Arrival sequence number, final tie-break
+        uint32_t preemptions = 0;
+        size_t chunk = 0;    // Prompt tokens to prefill this iteration
+        size_t reported = 0; // Output tokens already passed to on_token
+        BlockArena::Lease kv;  // Held from first admission until finished
+        bool ever_admitted = false;
+        bool failed = false;
+    };
+    using SequencePtr = std::unique_ptr<Sequence>;
+
+    // True if a should be scheduled ahead of b
+    static bool ahead_of(const Sequence& a, const Sequence& b);
+
+    void loop();
+    void drop_cancelled();
+    void drop_infeasible(Clock::time_point now);
+    size_t kv_blocks_needed(const Sequence& sequence) const;
+    bool reserve_kv(Sequence& sequence);
+    void admit_and_preempt(Clock::time_point now);
+    void step_running();
+    void report_tokens();
+    void retire_finished();
+    void finish(SequencePtr sequence, Status status);
+    double estimate_remaining_seconds(const Sequence& sequence) const;
+    size_t prefill_budget() const;
+
+    template <typename F>
+    void for_each_parallel(const std::vector<Sequence*>& sequences, F&& fn);
+
+    std::shared_ptr<Engine> engine_;
+    Options options_;
+    std::shared_ptr<WorkerPool> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::vector<SequencePtr> incoming_;
+    uint64_t next_order_ = 0;
+    bool stopping_ = false;
+
+    // Owned by the scheduler thread
+    std::vector<SequencePtr> waiting_; // Sorted by ahead_of
+    std::vector<SequencePtr> running_;
+    double prefill_seconds_per_token_ = 0.0; // EWMA
+    double step_seconds_ = 0.0;              // EWMA of one decode iteration
+    double output_tokens_ = 0.0;             // EWMA of tokens generated by completed requests
+    int64_t reported_pending_ = 0;
+
+    std::thread thread_;
+};
+
+} // namespace castor
@@ -2,22 +2,62 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 #include "engine.hpp"
+#include "engine_pool.hpp"
+#include "model_registry.hpp"
+#include "resource_accounting.hpp"
+#include "response_cache.hpp"
+#include "scheduler.hpp"
+#include "session_store.hpp"
+#include "startup.hpp"
 #include "tokenizer.hpp"
+#include "worker_pool.hpp"
 
 namespace castor {
 
+/**
+ * @brief Listener configuration for Server
+ */
+struct ServerOptions {
+    int port = 8080;
+    std::string bind_address = "0.0.0.0";
+    bool enable_tcp = true;
+    std::string unix_socket_path; // Empty = no Unix domain socket listener
+    size_t http_threads = 0;      // Crow I/O threads per listener; 0 = Crow default
+    std::vector<int> http_cpus;   // Empty = inherit the process affinity mask
+    bool numa_local = true;       // Prefer memory on the node of http_cpus
+};
+
+/**
+ * @brief Result of processing one /infer body, independent of the transport
+ */
+struct InferResponse {
+    int status = 200;
+    std::string body;          // JSON
+    std::string server_timing; // Server-Timing header value, empty if no spans
+    std::string resource_usage; // X-Castor-Resources header value, empty unless accounting is enabled
+    ResourceUsage resources;    // Measured so far when the response was built
+    uint64_t request_id = 0;
+};
+
 /**
  * @brief REST API server for LLM inference using Crow framework
  * 
  * Provides HTTP endpoints for:
  * - GET  /health - Server health status
+ * - GET  /ready  - 200 once startup has finished, 503 with per-phase progress before
  * - GET  /model  - Model configuration and info
  * - POST /infer  - Run inference on input text
+ * - POST /embeddings - Pooled embedding vectors for a batch of inputs
+ * - GET  /metrics - Prometheus metrics (text exposition format)
+ * - GET  /admin/trace?seconds=N - Recent trace spans as Chrome trace JSON
+ * - POST /admin/trace - Enable/disable span recording
  */
 class Server {
 public:
     Server(int port = 8080);
+    explicit Server(const ServerOptions& options);
     ~Server();
 
     /**
@@ -25,10 +65,93 @@ public:
      */
     bool initialize(const std::shared_ptr<Engine>& engine, const std::shared_ptr<Tokenizer>& tokenizer);
 
+    /**
+     * @brief Serve repeated greedy /infer requests from a response cache
+     * @param cache Cache instance, or nullptr to disable caching
+     */
+    void set_response_cache(const std::shared_ptr<ResponseCache>& cache);
+
+    /**
+     * @brief Run engine work for /infer on a dedicated worker pool
+     * @param workers Pool instance, or nullptr to run on the HTTP thread
+     */
+    void set_worker_pool(const std::shared_ptr<WorkerPool>& workers);
+
+    /**
+     * @brief Route /infer generations through a priority/deadline scheduler
+     * @param scheduler Scheduler instance, or nullptr to generate per request
+     */
+    void set_scheduler(const std::shared_ptr<Scheduler>& scheduler);
+
+    /**
+     * @brief Keep multi-turn session state between /infer turns
+     *
+     * A request with a "session" id continues from that session's snapshot
+     * when its prompt extends the previous turn's prompt and output, so only
+     * the new tokens are prefilled; the turn's final state replaces the
+     * snapshot. Session turns bypass the response cache.
+     * @param sessions Store instance, or nullptr to disable sessions
+     */
+    void set_session_store(const std::shared_ptr<SessionStore>& sessions);
+
+    /**
+     * @brief Serve several models, routed by the request "model" field
+     *
+     * Replaces the engine/tokenizer/scheduler given to initialize() and
+     * set_scheduler() for /infer, /health and /model.
+     * @param registry Registry instance, or nullptr to serve the single model
+     */
+    void set_model_registry(const std::shared_ptr<ModelRegistry>& registry);
+
+    /**
+     * @brief Spread the single model's requests over per-NUMA-node replicas
+     *
+     * Each request is routed after tokenization (by session id, else prompt
+     * prefix) and runs on its replica's engine, workers and scheduler in
+     * place of those given to initialize(), set_worker_pool() and
+     * set_scheduler(). /model reports per-replica load. Ignored for /infer
+     * when a model registry is set.
+     * @param pool Initialized pool, or nullptr to serve from the single engine
+     */
+    void set_engine_pool(const std::shared_ptr<EnginePool>& pool);
+
+    /**
+     * @brief Gate serving on startup having finished
+     *
+     * Lets the listener start before the model is loaded. Until set_ready(true),
+     * /ready answers 503 with the startup phases, /health reports "ready":
+     * false, and /infer, /embeddings and /model answer 503 without touching
+     * the engine. Call initialize() and the other setters before marking the
+     * server ready. A new server is ready.
+     */
+    void set_ready(bool ready);
+
+    bool is_ready() const;
+
+    /**
+     * @brief Startup graph whose phases /ready reports
+     * @param startup Graph, or nullptr to report readiness only
+     */
+    void set_startup(const std::shared_ptr<const StartupGraph>& startup);
+
+    /**
+     * @brief Run the /infer pipeline (parse, tokenize, generate, serialize) on a raw body
+     *
+     * The HTTP route is a thin wrapper around this; benchmarks call it directly
+     * to measure handler cost without sockets.
+     */
+    InferResponse handle_infer(const std::string& body) const;
+
+    /**
+     * @brief Run the /embeddings pipeline on a raw body (see handle_infer)
+     */
+    InferResponse handle_embeddings(const std::string& body) const;
+
     /**
      * @brief Start the HTTP server (blocking)
      * 
-     * Starts Crow app and listens for incoming requests.
+     * Starts Crow app and listens for incoming requests on TCP, a Unix
+     * domain socket, or both (the same routes are served on each).
      * This call blocks until shutdown() is called.
      */
     void run();
@@ -43,11 +166,28 @@ public:
      */
     bool is_running() const { return running_; }
 
+    /**
+     * @brief Make @p path free for a new Unix domain socket listener
+     *
+     * A missing path is free. A stale socket file left by an earlier run is
+     * removed. Anything else is left alone: a file that is not a socket (a
+     * mistyped path), or a socket a running server still accepts on.
+     * @return true if the path can be bound
+     */
+    static bool claim_unix_socket(const std::string& path);
+
 private:
     int port_;
+    ServerOptions options_;
     bool running_ = false;
     std::shared_ptr<Engine> engine_;
     std::shared_ptr<Tokenizer> tokenizer_;
+    std::shared_ptr<ResponseCache> cache_;
+    std::shared_ptr<WorkerPool> workers_;
+    std::shared_ptr<Scheduler> scheduler_;
+    std::shared_ptr<ModelRegistry> registry_;
+    std::shared_ptr<SessionStore> sessions_;
+    std::shared_ptr<EnginePool> pool_;
 };
 
 } // namespace castor
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "engine.hpp"
+
+namespace castor {
+
+/**
+ * @brief Engine state of one chat session after its last turn
+ *
+ * tokens are exactly the tokens folded into state (and held in the KV
+ * bytes), so a next turn whose prompt extends them only prefills the suffix.
+ */
+struct SessionSnapshot {
+    std::vector<int32_t> tokens;
+    SequenceState state;
+    const uint8_t* kv = nullptr; // Engine::save_kv output; valid while the snapshot lives
+    size_t kv_bytes = 0;
+    std::shared_ptr<const void> kv_owner; // Heap copy, or the file mapping after a restore from disk
+
+    /**
+     * @brief Snapshot that owns @p kv in RAM
+     */
+    static std::shared_ptr<const SessionSnapshot> make(std::vector<int32_t> tokens, const SequenceState& state,
+                                                       std::vector<uint8_t> kv);
+
+    /**
+     * @brief True if @p prompt starts with every snapshot token and adds at least one
+     */
+    bool extended_by(const std::vector<int32_t>& prompt) const;
+
+    size_t memory_bytes() const { return kv_bytes + tokens.size() * sizeof(int32_t); }
+};
+
+/**
+ * @brief Two-tier store of idle session snapshots: RAM, then disk
+ *
+ * Snapshots live in RAM under an LRU byte budget. Sessions pushed past the
+ * budget, or idle longer than idle_spill, are written to one file each by a
+ * background writer thread and leave RAM once the write lands; requests never
+ * wait on that I/O. A later get() maps the file back (zero-copy for the KV
+ * bytes unless compressed) and makes the session resident again. Files are
+ * written to a temporary name and renamed, so a crash never leaves a torn
+ * snapshot behind; a file whose header, id or token checksum does not match
+ * is ignored and removed.
+ *
+ * File layout (native byte order):
+ * @code
+ *   Header (64 bytes) | session id | tokens (int32 x token_count) | KV bytes
+ * @endcode
+ * The KV section is zlib-compressed when Options::compress is set and the
+ * build has zlib (compression_available()).
+ *
+ * Without a directory, sessions pushed out of RAM are dropped and the next
+ * turn re-prefills.
+ */
+class SessionStore {
+public:
+    struct Options {
+        std::string directory;                    // Spill files go here; empty = RAM only
+        size_t max_resident_bytes = 256ull << 20; // RAM budget for snapshot bytes
+        std::chrono::seconds idle_spill{300};     // Spill sessions idle this long; 0 = only past the budget
+        std::chrono::seconds idle_check{5};       // How often the writer looks for idle sessions
+        bool compress = false;                    // zlib the KV section
+    };
+
+    struct Stats {
+        uint64_t sessions = 0;
+        uint64_t resident = 0; // Sessions with a copy in RAM
+        uint64_t resident_bytes = 0;
+        uint64_t disk_bytes = 0; // Snapshot files, as stored
+        uint64_t spills = 0;     // Files written
+        uint64_t restores = 0;   // Snapshots mapped back in from disk
+        uint64_t drops = 0;      // Sessions lost: no directory, a failed write or an unreadable file
+    };
+
+    SessionStore();
+    explicit SessionStore(const Options& options);
+    ~SessionStore();
+
+    SessionStore(const SessionStore&) = delete;
+    SessionStore& operator=(const SessionStore&) = delete;
+
+    /**
+     * @brief Insert or replace a session's snapshot; it becomes the most recently used
+     */
+    void put(const std::string& id, std::shared_ptr<const SessionSnapshot> snapshot);
+
+    /**
+     * @brief Resident snapshot, or one mapped back from disk; nullptr if unknown
+     */
+    std::shared_ptr<const SessionSnapshot> get(const std::string& id);
+
+    void erase(const std::string& id);
+
+    /**
+     * @brief Move sessions idle for at least @p idle to disk (0 = every session)
+     *
+     * Runs every idle_check on the writer thread with Options::idle_spill.
+     */
+    void spill_idle(std::chrono::seconds idle);
+
+    /**
+     * @brief Wait until every queued write has landed
+     */
+    void flush();
+
+    Stats stats() const;
+    const Options& options() const { return options_; }
+
+    /**
+     * @brief True if the build can compress snapshot files (zlib)
+     */
+    static bool compression_available();
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::string id;
+        std::shared_ptr<const SessionSnapshot> snapshot; // nullptr while only on disk
+        std::list<Entry*>::iterator lru;                  // Valid while resident
+        Clock::time_point last_used;
+        uint64_t generation = 0; // New on every put(); a write for an older one is discarded
+        size_t bytes = 0;        // snapshot->memory_bytes()
+        size_t file_bytes = 0;   // Nonzero once the current generation is on disk
+        bool writing = false;
+        bool release = false; // Leave RAM once the pending write lands
+    };
+
+    struct Write {
+        std::string id;
+        uint64_t generation = 0;
+        std::shared_ptr<const SessionSnapshot> snapshot;
+    };
+
+    std::string path_for(const std::string& id) const;
+    void touch_locked(Entry& entry);
+    void make_resident_locked(Entry& entry, std::shared_ptr<const SessionSnapshot> snapshot);
+    void release_locked(Entry& entry);     // Drop the RAM copy
+    void forget_file_locked(Entry& entry); // Delete the file of an outdated snapshot
+    void spill_locked(Entry& entry);       // Queue a write, or release if already on disk
+    void enforce_budget_locked();
+    void spill_idle_locked(std::chrono::seconds idle);
+    void remove_locked(std::unordered_map<std::string, Entry>::iterator it);
+    void writer_loop();
+    void finish_write_locked(const Write& write, size_t bytes);
+    size_t write_file(const Write& write) const; // Bytes written, 0 on failure
+    std::shared_ptr<const SessionSnapshot> read_file(const std::string& id) const;
+
+    Options options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;      // Writer: work queued or stopping
+    std::condition_variable idle_cv_; // flush(): queue drained
+    std::unordered_map<std::string, Entry> entries_;
+    std::list<Entry*> lru_; // Resident entries, front = most recently used
+    std::deque<Write> queue_;
+    size_t writes_in_progress_ = 0;
+    uint64_t next_generation_ = 0;
+    size_t resident_bytes_ = 0;
+    size_t disk_bytes_ = 0;
+    uint64_t spills_ = 0;
+    uint64_t restores_ = 0;
+    uint64_t drops_ = 0;
+    bool stopping_ = false;
+    std::thread writer_;
+};
+
+} // namespace castor
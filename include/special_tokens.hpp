@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace castor {
+
+/**
+ * @brief One entry of tokenizer.json "added_tokens"
+ */
+struct AddedToken {
+    std::string content;
+    int32_t id = 0;
+    bool single_word = false; // Only match when not inside a word
+    bool lstrip = false;      // Whitespace before the token is part of it
+    bool rstrip = false;      // Whitespace after the token is part of it
+    bool normalized = false;  // Matched against normalized text instead of the raw input
+    bool special = false;     // Control token (<s>, </s>, chat-template markers)
+};
+
+/**
+ * @brief Finds added tokens in text so they can be carved out before BPE
+ *
+ * Matches are leftmost-longest, as in HuggingFace tokenizers: the earliest
+ * position where any token starts wins, and the longest token starting
+ * there. Positions are screened by a first-byte filter: a byte that starts
+ * no token is skipped with one table lookup, or with memchr when every token
+ * starts with the same byte (`<` for most chat templates). So text without
+ * special tokens costs a single scan. Candidate positions are then checked
+ * against a byte trie of all tokens, touching at most the longest token's
+ * length. Immutable after construction.
+ */
+class SpecialTokenMatcher {
+public:
+    struct Match {
+        size_t begin = 0; // Text consumed by the token, including stripped whitespace
+        size_t end = 0;
+        int32_t id = 0;
+    };
+
+    SpecialTokenMatcher() = default;
+    explicit SpecialTokenMatcher(const std::vector<AddedToken>& tokens);
+
+    /**
+     * @brief First match in @p text at or after @p from
+     *
+     * lstrip extends the match left over whitespace, but never before
+     * @p from; rstrip extends it right. A single_word token next to a word
+     * character is not a match, and the search moves on.
+     * @return false if no token occurs
+     */
+    bool find(std::string_view text, size_t from, Match& match) const;
+
+    bool empty() const { return tokens_.empty(); }
+    size_t size() const { return tokens_.size(); }
+    size_t memory_bytes() const;
+
+private:
+    struct Node {
+        int32_t token = -1; // Index into tokens_ of the token ending here
+        uint32_t first_edge = 0;
+        uint32_t edge_count = 0;
+    };
+
+    size_t next_candidate(std::string_view text, size_t from) const;
+    int32_t child(int32_t node, uint8_t byte) const;
+
+    std::vector<AddedToken> tokens_;
+    std::vector<Node> nodes_;          // Byte trie; node 0 is the root
+    std::vector<uint8_t> edge_bytes_;  // Children of a node are contiguous and sorted by byte
+    std::vector<int32_t> edge_targets_;
+    std::array<int32_t, 256> root_{};  // Root children, dense; -1 = no token starts with this byte
+    int single_first_byte_ = -1;       // The only first byte, if all tokens share one
+};
+
+} // namespace castor
@@ -0,0 +1,179 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "engine.hpp"
+#include "engine_pool.hpp"
+#include "kernels.hpp"
+#include "model_config.hpp"
+#include "tokenizer.hpp"
+
+namespace castor {
+
+/**
+ * @brief Startup work as a dependency graph of named phases
+ *
+ * Each phase runs on its own thread as soon as every phase it depends on
+ * has finished, so independent work (tokenizer load, reading weights,
+ * kernel selection) overlaps instead of running back to back. A phase that
+ * fails, or throws, skips everything that depends on it; the rest still
+ * runs so the report shows how far startup got.
+ *
+ * Phases are added before run()/start() and may only depend on phases
+ * added earlier, which keeps the graph acyclic.
+ */
+class StartupGraph {
+public:
+    enum class State { Pending, Running, Done, Failed, Skipped };
+
+    struct Phase {
+        std::string name;
+        State state = State::Pending;
+        double start_ms = 0.0; // Since run() began
+        double end_ms = 0.0;
+
+        double ms() const { return end_ms - start_ms; }
+    };
+
+    using Task = std::function<bool()>;
+
+    StartupGraph() = default;
+    ~StartupGraph();
+
+    StartupGraph(const StartupGraph&) = delete;
+    StartupGraph& operator=(const StartupGraph&) = delete;
+
+    /**
+     * @brief Add a phase that runs @p task once every phase in @p after is done
+     * @return Phase id, for use in later phases' @p after
+     */
+    size_t add(const std::string& name, Task task, const std::vector<size_t>& after = {});
+
+    /**
+     * @brief Run every phase and wait for all of them
+     * @return true if every phase succeeded
+     */
+    bool run();
+
+    /**
+     * @brief Run in the background; @p on_done gets run()'s result on the graph's thread
+     */
+    void start(std::function<void(bool)> on_done = nullptr);
+
+    /**
+     * @brief Wait for a graph started with start()
+     * @return true if every phase succeeded
+     */
+    bool wait();
+
+    bool finished() const;
+
+    /**
+     * @brief Snapshot of every phase, in the order they were added
+     */
+    std::vector<Phase> status() const;
+
+    /**
+     * @brief Milliseconds from run() to the last phase finishing (or to now, while running)
+     */
+    double elapsed_ms() const;
+
+    /**
+     * @brief Per-phase timing breakdown: when each phase started and ended, and wall vs summed time
+     */
+    std::string report() const;
+
+    static const char* state_name(State state);
+
+private:
+    struct Node {
+        Phase phase;
+        Task task;
+        std::vector<size_t> after;
+    };
+
+    void run_phase(size_t id);
+    double now_ms() const;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<Node> nodes_;
+    std::chrono::steady_clock::time_point started_;
+    bool running_ = false;
+    bool finished_ = false;
+    bool ok_ = false;
+    double elapsed_ms_ = 0.0;
+    std::thread thread_; // start()
+};
+
+/**
+ * @brief Loads one model through a StartupGraph and warms it up
+ *
+ * Adds these phases:
+ *   tokenizer  load tokenizer_path
+ *   weights    read engine_path into the page cache (Engine::prefault_weights)
+ *   kernels    pick CPU kernels for config's shapes
+ *   autotune   optional: measure settings once the three loads above are
+ *              done, so its timings do not compete with them
+ *   engine     initialize the engine, or the replica pool, with those kernels
+ *   warmup     attach the tokenizer and run warmup_passes short generations
+ *              on every engine, so first requests do not pay for cold
+ *              caches, lazily built tables or first-touch page faults
+ *
+ * Only autotune, engine and warmup wait on anything; the model is ready once
+ * warmup is done. The engine phase reads config and replica_options when it
+ * starts, so autotune may still adjust them.
+ */
+struct ModelStartup {
+    std::string engine_path;
+    std::string tokenizer_path;
+    ModelConfig config;
+    bool replicas = false; // Build an EnginePool instead of a single engine
+    EnginePool::Options replica_options;
+    size_t warmup_passes = 2;
+    uint32_t warmup_tokens = 4; // Generated per pass
+
+    // Filled in by the phases
+    std::shared_ptr<Tokenizer> tokenizer = std::make_shared<Tokenizer>();
+    std::shared_ptr<Engine> engine;   // With replicas, replica 0's engine
+    std::shared_ptr<EnginePool> pool; // With replicas
+    KernelSet kernels;
+    size_t prefaulted_bytes = 0;
+
+    struct Phases {
+        size_t tokenizer = 0;
+        size_t weights = 0;
+        size_t kernels = 0;
+        size_t autotune = SIZE_MAX; // Only with an autotune task
+        size_t engine = 0;
+        size_t warmup = 0;
+    };
+
+    /**
+     * @brief The model served when no models list is configured (llama-2-7b under models/)
+     */
+    static ModelStartup builtin();
+
+    /**
+     * @brief Add this model's phases to @p graph
+     *
+     * The phases refer to this object, which must outlive the graph's run.
+     * @param autotune Optional task run between the loads and the engine phase
+     */
+    Phases add_to(StartupGraph& graph, StartupGraph::Task autotune = nullptr);
+
+    /**
+     * @brief Run the warm-up generations on @p engine
+     */
+    bool warm_up(Engine& engine) const;
+};
+
+} // namespace castor
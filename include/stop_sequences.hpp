@@ -0,0 +1,79 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace castor {
+
+/**
+ * @brief Stop strings and stop token ids compiled into one Aho-Corasick automaton
+ *
+ * Generated text is fed byte by byte as tokens are emitted. Every byte is a
+ * single transition-table lookup, so detection costs O(1) per byte no matter
+ * how many stop strings there are or how long the output grows. The state
+ * also records how many trailing bytes are still a prefix of some stop string:
+ * exactly the text a streaming client has to withhold until the next token
+ * decides it. Immutable; share one instance across streams.
+ */
+class StopSequences {
+public:
+    using Vocabulary = std::vector<std::string>; // Token id -> bytes
+
+    static constexpr size_t kMaxBytes = 4096; // Total over all stop strings
+
+    /**
+     * @brief Build the automaton
+     * @param vocabulary Token texts (Tokenizer::token_table); may be null when
+     *                   only stop token ids are used
+     * @return nullptr with @p error set on empty or oversized stop strings
+     */
+    static std::shared_ptr<const StopSequences> compile(const std::vector<std::string>& strings,
+                                                        const std::vector<int32_t>& token_ids,
+                                                        std::shared_ptr<const Vocabulary> vocabulary,
+                                                        std::string& error);
+
+    int32_t start() const { return 0; }
+    int32_t next(int32_t state, uint8_t byte) const { return transitions_[static_cast<size_t>(state) * 256 + byte]; }
+
+    /**
+     * @brief Index into strings() of the longest stop string ending in @p state, or -1
+     */
+    int32_t matched(int32_t state) const { return match_[state]; }
+
+    /**
+     * @brief Trailing bytes that may still become a stop string (the state's trie depth)
+     */
+    uint32_t pending_bytes(int32_t state) const { return depth_[state]; }
+
+    bool is_stop_token(int32_t token) const;
+
+    /**
+     * @brief Text of @p token as generation appends it (empty if unknown)
+     */
+    const std::string& token_text(int32_t token) const;
+
+    /**
+     * @brief Append the text of @p token to @p text, advancing @p state
+     *
+     * @return true if generation must stop: @p token is a stop token (its text
+     *         is not appended) or completes a stop string, which is cut from
+     *         @p text along with anything after it and stored in @p matched
+     */
+    bool append(int32_t& state, int32_t token, std::string& text, std::string* matched = nullptr) const;
+
+    const std::vector<std::string>& strings() const { return strings_; }
+    const std::vector<int32_t>& token_ids() const { return token_ids_; }
+    size_t state_count() const { return depth_.size(); }
+
+private:
+    std::vector<std::string> strings_;
+    std::vector<int32_t> token_ids_; // Sorted
+    std::shared_ptr<const Vocabulary> vocabulary_;
+    std::vector<int32_t> transitions_; // state * 256 + byte -> state (goto and failure links folded together)
+    std::vector<int32_t> match_;
+    std::vector<uint32_t> depth_;
+};
+
+} // namespace castor
@@ -3,6 +3,7 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <mutex>
 
 namespace castor {
 
@@ -70,6 +71,20 @@ public:
      */
     std::string decode(const std::vector<int32_t>& tokens);
 
+    /**
+     * @brief Text of every token id, as decode() renders it on its own
+     *
+     * Built on first use and shared; constrained decoding matches grammars
+     * against these strings. The placeholder tokenizer maps ids 0-255 to
+     * single bytes, mirroring its encode().
+     */
+    std::shared_ptr<const std::vector<std::string>> token_table();
+
+    /**
+     * @brief Approximate heap footprint of the vocabulary tables (memory accounting)
+     */
+    size_t memory_bytes() const;
+
     /**
      * @brief Get vocabulary size
      */
@@ -92,6 +107,9 @@ private:
     
     // Tokenizer instance (SimpleBPETokenizer)
     std::unique_ptr<SimpleBPETokenizer> tokenizer_;
+
+    std::mutex token_table_mutex_;
+    std::shared_ptr<const std::vector<std::string>> token_table_;
 };
 
 } // namespace castor
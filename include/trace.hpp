@@ -0,0 +1,200 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "resource_accounting.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#define CASTOR_HAVE_TSC 1
+#else
+#include <chrono>
+#endif
+
+namespace castor {
+
+/**
+ * @brief Per-request phase accumulator used to build the Server-Timing header
+ *
+ * Spans that close while a RequestTraceScope is active on the current thread
+ * add their duration here, keyed by span name. With ResourceAccounting
+ * enabled, spans also add the CPU time and allocations they covered, and the
+ * scopes bound to this accumulator charge @ref resources for the whole request.
+ */
+struct PhaseTimings {
+    static constexpr size_t kMaxPhases = 12;
+
+    struct Phase {
+        const char* name = nullptr;
+        uint64_t ticks = 0;
+        ResourceUsage usage;
+    };
+
+    uint64_t request_id = 0;
+    Phase phases[kMaxPhases];
+    size_t count = 0;
+    ResourceUsage resources;        // Charged by RequestTraceScope, on every thread that served the request
+    bool resources_measured = false;
+
+    void add(const char* name, uint64_t ticks, const ResourceUsage& usage = {});
+
+    /**
+     * @brief Render as a Server-Timing header value (durations in ms)
+     */
+    std::string to_server_timing() const;
+
+    /**
+     * @brief Render as an X-Castor-Resources header value, empty if nothing was measured
+     *
+     * "total;cpu=0.812;allocs=143;bytes=20480, tokenize;cpu=0.050;allocs=12;bytes=800"
+     * (cpu in ms); phase entries are inclusive of nested spans.
+     */
+    std::string to_resource_header() const;
+};
+
+/**
+ * @brief Low-overhead span tracer
+ *
+ * Timestamps come from the TSC (assumed invariant, as on every x86 server CPU
+ * of the last decade) and fall back to steady_clock elsewhere. Each thread
+ * owns a fixed-size ring of completed spans; the ring is only read when a
+ * trace is exported, so recording never takes a lock.
+ *
+ * When tracing is disabled, a span outside a request scope costs one relaxed
+ * load and a branch.
+ */
+class Tracer {
+public:
+    static constexpr size_t kRingCapacity = 16384;
+
+    static bool enabled() { return enabled_.load(std::memory_order_relaxed); }
+    static void set_enabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+
+    /**
+     * @brief Read the raw timestamp counter
+     */
+    static uint64_t now() {
+#ifdef CASTOR_HAVE_TSC
+        return __rdtsc();
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    /**
+     * @brief Timestamp counter frequency (calibrated once on first call)
+     */
+    static double ticks_per_ns();
+
+    /**
+     * @brief Append a completed span to the calling thread's ring
+     */
+    static void record(const char* name, uint64_t start, uint64_t end, uint64_t request_id);
+
+    /**
+     * @brief Export spans that ended within the last @p seconds as Chrome trace JSON
+     *
+     * The output loads in chrome://tracing and ui.perfetto.dev.
+     */
+    static std::string export_chrome_json(double seconds);
+
+    /**
+     * @brief Allocate a process-unique request id
+     */
+    static uint64_t next_request_id();
+
+private:
+    static inline std::atomic<bool> enabled_{false};
+};
+
+/**
+ * @brief Binds a PhaseTimings to the current thread for the scope's lifetime
+ *
+ * While ResourceAccounting is enabled, the thread's CPU time and allocations
+ * are charged to the innermost scope: opening a nested scope pauses the outer
+ * request's meter, so work done on behalf of another request is never
+ * counted twice.
+ */
+class RequestTraceScope {
+public:
+    explicit RequestTraceScope(PhaseTimings& timings);
+    ~RequestTraceScope();
+
+    RequestTraceScope(const RequestTraceScope&) = delete;
+    RequestTraceScope& operator=(const RequestTraceScope&) = delete;
+
+    /**
+     * @brief Phase accumulator active on this thread, or nullptr
+     */
+    static PhaseTimings* current() { return current_; }
+
+    /**
+     * @brief Charge the innermost scope for usage up to now (before reading its totals)
+     */
+    static void flush();
+
+private:
+    static inline thread_local PhaseTimings* current_ = nullptr;
+    static inline thread_local bool measuring_ = false;   // current_ is being charged
+    static inline thread_local ResourceUsage charged_to_; // Thread usage when current_ was last charged
+    PhaseTimings* timings_;
+    PhaseTimings* previous_;
+    bool previous_measuring_;
+    bool measure_;
+};
+
+/**
+ * @brief RAII span; use through CASTOR_TRACE_SCOPE
+ */
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name) : name_(name), phases_(RequestTraceScope::current()) {
+        active_ = phases_ != nullptr || Tracer::enabled();
+        if (active_) {
+            measure_ = phases_ != nullptr && ResourceAccounting::enabled();
+            if (measure_) {
+                usage_ = ResourceAccounting::thread_usage();
+            }
+            start_ = Tracer::now();
+        }
+    }
+
+    ~TraceSpan() {
+        if (!active_) {
+            return;
+        }
+        const uint64_t end = Tracer::now();
+        if (phases_) {
+            phases_->add(name_, end - start_,
+                         measure_ ? ResourceAccounting::thread_usage() - usage_ : ResourceUsage{});
+        }
+        if (Tracer::enabled()) {
+            Tracer::record(name_, start_, end, phases_ ? phases_->request_id : 0);
+        }
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_;
+    PhaseTimings* phases_;
+    uint64_t start_ = 0;
+    bool active_ = false;
+    bool measure_ = false;
+    ResourceUsage usage_;
+};
+
+} // namespace castor
+
+#define CASTOR_TRACE_CONCAT_INNER(a, b) a##b
+#define CASTOR_TRACE_CONCAT(a, b) CASTOR_TRACE_CONCAT_INNER(a, b)
+
+#ifdef CASTOR_ENABLE_TRACING
+#define CASTOR_TRACE_SCOPE(name) ::castor::TraceSpan CASTOR_TRACE_CONCAT(castor_trace_span_, __LINE__)(name)
+#else
+#define CASTOR_TRACE_SCOPE(name) ((void)0)
+#endif
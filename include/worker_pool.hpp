@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace castor {
+
+/**
+ * @brief Fixed pool of inference threads with optional core pinning
+ *
+ * Keeps engine compute off the HTTP I/O threads. When a CPU list is given,
+ * worker i is pinned to cpus[i % cpus.size()], and with numa_local each worker
+ * prefers memory from its own node, so buffers it allocates (logits, decode
+ * state) are first-touched on local DRAM.
+ */
+class WorkerPool {
+public:
+    struct Options {
+        size_t threads = 0;    // 0 = no pool; work runs on the calling thread
+        std::vector<int> cpus; // Empty = inherit the process affinity mask
+        bool numa_local = true;
+    };
+
+    explicit WorkerPool(const Options& options);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    /**
+     * @brief Queue @p fn on a worker and return its future
+     */
+    template <typename F>
+    auto submit(F&& fn) -> std::future<std::invoke_result_t<F&>> {
+        using R = std::invoke_result_t<F&>;
+        auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(fn));
+        std::future<R> result = task->get_future();
+        enqueue([task]() { (*task)(); });
+        return result;
+    }
+
+    /**
+     * @brief Queue @p fn on a worker without a future (fire and forget)
+     *
+     * Usable as an Executor for resuming coroutines. Runs inline if the pool
+     * has no threads.
+     */
+    void post(std::function<void()> fn);
+
+    /**
+     * @brief Run @p fn on a worker and wait for it
+     *
+     * Runs inline when called from a worker thread (or if the pool has no
+     * threads) so nested calls cannot deadlock the pool.
+     */
+    template <typename F>
+    auto run(F&& fn) -> std::invoke_result_t<F&> {
+        if (threads_.empty() || on_worker_thread()) {
+            return fn();
+        }
+        return submit(std::forward<F>(fn)).get();
+    }
+
+    size_t size() const { return threads_.size(); }
+    const Options& options() const { return options_; }
+
+    /**
+     * @brief Tasks queued and not yet picked up by a worker
+     */
+    size_t pending() const;
+
+    /**
+     * @brief True if the calling thread belongs to any WorkerPool
+     */
+    static bool on_worker_thread();
+
+private:
+    void enqueue(std::function<void()> task);
+    void worker_loop(size_t index);
+
+    Options options_;
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+    std::deque<std::function<void()>> queue_;
+    bool stopping_ = false;
+    std::vector<std::thread> threads_;
+};
+
+} // namespace castor
@@ -0,0 +1,171 @@
+#include "affinity.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace castor {
+
+bool Affinity::parse_cpu_list(const std::string& list, std::vector<int>& cpus) {
+    cpus.clear();
+    std::stringstream ss(list);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        range.erase(std::remove_if(range.begin(), range.end(), ::isspace), range.end());
+        if (range.empty()) {
+            continue;
+        }
+        const size_t dash = range.find('-');
+        char* end = nullptr;
+        const long first = std::strtol(range.c_str(), &end, 10);
+        if (end == range.c_str() || first < 0) {
+            return false;
+        }
+        long last = first;
+        if (dash != std::string::npos) {
+            const char* hi = range.c_str() + dash + 1;
+            last = std::strtol(hi, &end, 10);
+            if (end == hi || last < first) {
+                return false;
+            }
+        }
+        if (*end != '\0') {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+    }
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return true;
+}
+
+std::string Affinity::format_cpu_list(const std::vector<int>& cpus) {
+    std::ostringstream out;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+            ++j;
+        }
+        if (i > 0) {
+            out << ",";
+        }
+        out << cpus[i];
+        if (j > i) {
+            out << "-" << cpus[j];
+        }
+        i = j + 1;
+    }
+    return out.str();
+}
+
+bool Affinity::pin_current_thread(const std::vector<int>& cpus) {
+#ifdef __linux__
+    if (cpus.empty()) {
+        return true;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    const int rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (rc != 0) {
+        std::cerr << "[Affinity] Failed to pin thread to CPUs " << format_cpu_list(cpus) << " (error " << rc << ")\n";
+        return false;
+    }
+    return true;
+#else
+    (void)cpus;
+    return false;
+#endif
+}
+
+int Affinity::numa_node_of_cpu(int cpu) {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    const fs::path dir = "/sys/devices/system/cpu/cpu" + std::to_string(cpu);
+    for (const auto& entry : fs::directory_iterator(dir, ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4) {
+            return std::atoi(name.c_str() + 4);
+        }
+    }
+    return -1;
+}
+
+int Affinity::numa_node_count() {
+    namespace fs = std::filesystem;
+    std::error_code ec;
+    int count = 0;
+    for (const auto& entry : fs::directory_iterator("/sys/devices/system/node", ec)) {
+        const std::string name = entry.path().filename().string();
+        if (name.rfind("node", 0) == 0 && name.size() > 4 && std::isdigit(static_cast<unsigned char>(name[4]))) {
+            ++count;
+        }
+    }
+    return std::max(count, 1);
+}
+
+std::vector<int> Affinity::node_cpus(int node) {
+    std::vector<int> cpus;
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    std::string list;
+    if (node < 0 || !std::getline(file, list) || !parse_cpu_list(list, cpus)) {
+        return {};
+    }
+#ifdef __linux__
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        cpus.erase(std::remove_if(cpus.begin(), cpus.end(),
+                                  [&allowed](int cpu) { return cpu >= CPU_SETSIZE || !CPU_ISSET(cpu, &allowed); }),
+                   cpus.end());
+    }
+#endif
+    return cpus;
+}
+
+int Affinity::common_numa_node(const std::vector<int>& cpus) {
+    int node = -1;
+    for (int cpu : cpus) {
+        const int n = numa_node_of_cpu(cpu);
+        if (n < 0 || (node >= 0 && n != node)) {
+            return -1;
+        }
+        node = n;
+    }
+    return node;
+}
+
+bool Affinity::prefer_local_memory(int node) {
+#if defined(__linux__) && defined(SYS_set_mempolicy)
+    if (node < 0 || node >= 64) {
+        return false;
+    }
+    constexpr int kMpolPreferred = 1;
+    unsigned long mask = 1UL << node;
+    if (syscall(SYS_set_mempolicy, kMpolPreferred, &mask, sizeof(mask) * 8) != 0) {
+        std::cerr << "[Affinity] set_mempolicy(node " << node << ") failed\n";
+        return false;
+    }
+    return true;
+#else
+    (void)node;
+    return false;
+#endif
+}
+
+} // namespace castor
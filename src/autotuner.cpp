@@ -0,0 +1,392 @@
+#include "autotuner.hpp"
+#include "hash.hpp"
+#include "sampler.hpp"
+#include "scheduler.hpp"
+#include "worker_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <future>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <sstream>
+#include <thread>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace castor {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+constexpr int kCacheVersion = 1;
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) {
+        return 0.0;
+    }
+    const size_t index = std::min(values.size() - 1, static_cast<size_t>(p * values.size()));
+    std::nth_element(values.begin(), values.begin() + index, values.end());
+    return values[index];
+}
+
+// Deterministic prompt ids in [3, vocab); each request gets its own prefix
+std::vector<int32_t> synthetic_prompt(size_t length, uint32_t vocab_size, uint64_t seed) {
+    std::vector<int32_t> ids(length);
+    const uint32_t range = std::max<uint32_t>(vocab_size, 4) - 3;
+    for (auto& id : ids) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        id = 3 + static_cast<int32_t>((seed >> 33) % range);
+    }
+    return ids;
+}
+
+json read_cache(const std::string& path) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return json::object();
+    }
+    try {
+        json data = json::parse(file);
+        if (data.value("version", 0) == kCacheVersion && data.contains("entries") && data["entries"].is_object()) {
+            return data;
+        }
+        std::cerr << "[Autotune] Ignoring " << path << ": unknown format\n";
+    } catch (const json::exception& e) {
+        std::cerr << "[Autotune] Ignoring unreadable " << path << ": " << e.what() << "\n";
+    }
+    return json::object();
+}
+
+std::string describe_settings(const Autotuner::Settings& settings) {
+    std::ostringstream out;
+    out << "batch=" << settings.max_batch << " threads=" << settings.threads << " chunk=" << settings.prefill_chunk;
+    return out.str();
+}
+
+} // namespace
+
+Autotuner::Host Autotuner::Host::detect() {
+    Host host;
+    std::ifstream cpuinfo("/proc/cpuinfo");
+    std::string line;
+    while (std::getline(cpuinfo, line)) {
+        if (line.rfind("model name", 0) == 0) {
+            const size_t colon = line.find(':');
+            if (colon != std::string::npos) {
+                host.cpu_model = line.substr(line.find_first_not_of(" \t", colon + 1));
+            }
+            break;
+        }
+    }
+    if (host.cpu_model.empty()) {
+        host.cpu_model = "unknown";
+    }
+    host.cores = std::max(1u, std::thread::hardware_concurrency());
+    std::ifstream meminfo("/proc/meminfo");
+    std::string key;
+    size_t kb = 0;
+    while (meminfo >> key >> kb) {
+        if (key == "MemTotal:") {
+            host.memory_gb = (kb + (1u << 19)) >> 20; // Rounded, so a few MB of firmware reservations don't matter
+            break;
+        }
+        meminfo.ignore(256, '\n');
+    }
+    return host;
+}
+
+std::string Autotuner::Host::describe() const {
+    return "cpu=" + cpu_model + ";cores=" + std::to_string(cores) + ";memory_gb=" + std::to_string(memory_gb);
+}
+
+Autotuner::Autotuner() : Autotuner(Options()) {}
+
+Autotuner::Autotuner(const Options& options) : options_(options), host_(Host::detect()) {}
+
+std::string Autotuner::fingerprint(const ModelConfig& config) const {
+    std::ostringstream key;
+    key << host_.describe() << "|model=" << config.model_name << ";vocab=" << config.vocab_size
+        << ";hidden=" << config.hidden_dim << ";layers=" << config.num_layers << ";ffn=" << config.ffn_dim
+        << "|itl_slo_ms=" << options_.itl_slo_ms << ";ttft_slo_ms=" << options_.ttft_slo_ms;
+    const std::string text = key.str();
+    char hex[17];
+    std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(XXH64::hash(text.data(), text.size())));
+    return hex;
+}
+
+bool Autotuner::lookup(const ModelConfig& config, Settings& settings) const {
+    const json data = read_cache(options_.cache_path);
+    const std::string key = fingerprint(config);
+    if (!data.contains("entries") || !data["entries"].contains(key)) {
+        return false;
+    }
+    try {
+        const json& entry = data["entries"][key];
+        settings.max_batch = entry.at("max_batch").get<size_t>();
+        settings.threads = entry.at("threads").get<size_t>();
+        settings.prefill_chunk = entry.at("prefill_chunk").get<size_t>();
+        settings.nucleus_window = entry.at("nucleus_window").get<size_t>();
+    } catch (const json::exception& e) {
+        std::cerr << "[Autotune] Ignoring malformed entry " << key << ": " << e.what() << "\n";
+        return false;
+    }
+    return settings.max_batch > 0;
+}
+
+bool Autotuner::store(const ModelConfig& config, const Trial& best) const {
+    json data = read_cache(options_.cache_path);
+    data["version"] = kCacheVersion;
+    json entry;
+    entry["host"] = host_.describe();
+    entry["model"] = config.model_name;
+    entry["max_batch"] = best.settings.max_batch;
+    entry["threads"] = best.settings.threads;
+    entry["prefill_chunk"] = best.settings.prefill_chunk;
+    entry["nucleus_window"] = best.settings.nucleus_window;
+    entry["tokens_per_second"] = best.tokens_per_second;
+    entry["p95_itl_ms"] = best.p95_itl_ms;
+    entry["p95_ttft_ms"] = best.p95_ttft_ms;
+    entry["meets_slo"] = best.meets_slo;
+    data["entries"][fingerprint(config)] = std::move(entry);
+
+    // Written under a temporary name and renamed, so a crash never leaves a torn cache
+    const std::string temp = options_.cache_path + ".tmp";
+    {
+        std::ofstream file(temp, std::ios::trunc);
+        if (!(file << data.dump(2) << "\n")) {
+            std::cerr << "[Autotune] Failed to write " << temp << "\n";
+            return false;
+        }
+    }
+    if (std::rename(temp.c_str(), options_.cache_path.c_str()) != 0) {
+        std::cerr << "[Autotune] Failed to replace " << options_.cache_path << "\n";
+        std::remove(temp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool Autotuner::better(const Trial& a, const Trial& b) const {
+    if (a.meets_slo != b.meets_slo) {
+        return a.meets_slo;
+    }
+    return a.meets_slo ? a.tokens_per_second > b.tokens_per_second : a.p95_itl_ms < b.p95_itl_ms;
+}
+
+Autotuner::Trial Autotuner::measure(const std::shared_ptr<Engine>& engine, const Settings& settings) const {
+    // Per-request token timestamps; written by the scheduler thread, read once every future is done
+    struct Timeline {
+        Clock::time_point submitted;
+        Clock::time_point last;
+        bool started = false;
+        std::vector<double> gaps_ms;
+        double ttft_ms = 0.0;
+    };
+
+    std::shared_ptr<WorkerPool> workers;
+    if (settings.threads > 0) {
+        WorkerPool::Options pool;
+        pool.threads = settings.threads;
+        workers = std::make_shared<WorkerPool>(pool);
+    }
+    Scheduler::Options scheduling;
+    scheduling.max_batch = settings.max_batch;
+    scheduling.prefill_chunk_tokens = settings.prefill_chunk;
+    Scheduler scheduler(engine, scheduling, workers);
+    const size_t previous_window = Sampler::nucleus_window();
+    Sampler::set_nucleus_window(settings.nucleus_window);
+
+    const size_t count = std::max<size_t>(1, options_.requests_per_slot * settings.max_batch);
+    const uint32_t vocab = engine->get_config().vocab_size;
+    std::vector<Timeline> timelines(count);
+    std::vector<std::future<Scheduler::Outcome>> pending;
+    pending.reserve(count);
+    const Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < count; ++i) {
+        Scheduler::Request request;
+        request.prompt_ids = synthetic_prompt(options_.prompt_tokens, vocab, i + 1);
+        request.params.max_tokens = static_cast<uint32_t>(options_.output_tokens);
+        request.params.temperature = 0.8f;
+        request.params.top_p = 0.9f;
+        request.params.seed = i;
+        Timeline& timeline = timelines[i];
+        request.on_token = [&timeline](const Scheduler::TokenUpdate& update) {
+            const Clock::time_point now = Clock::now();
+            if (update.count == 0) {
+                return;
+            }
+            if (!timeline.started) {
+                timeline.ttft_ms = std::chrono::duration<double, std::milli>(now - timeline.submitted).count();
+                timeline.started = true;
+            } else {
+                const double gap = std::chrono::duration<double, std::milli>(now - timeline.last).count();
+                timeline.gaps_ms.insert(timeline.gaps_ms.end(), update.count, gap / update.count);
+            }
+            timeline.last = now;
+        };
+        timeline.submitted = Clock::now();
+        pending.push_back(scheduler.submit(std::move(request)));
+    }
+
+    size_t tokens = 0;
+    for (auto& future : pending) {
+        const Scheduler::Outcome outcome = future.get();
+        tokens += outcome.result.output_ids.size();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    Sampler::set_nucleus_window(previous_window);
+
+    std::vector<double> gaps;
+    std::vector<double> ttfts;
+    for (const auto& timeline : timelines) {
+        gaps.insert(gaps.end(), timeline.gaps_ms.begin(), timeline.gaps_ms.end());
+        ttfts.push_back(timeline.ttft_ms);
+    }
+    Trial trial;
+    trial.settings = settings;
+    trial.tokens_per_second = seconds > 0.0 ? tokens / seconds : 0.0;
+    trial.p95_itl_ms = percentile(std::move(gaps), 0.95);
+    trial.p95_ttft_ms = percentile(std::move(ttfts), 0.95);
+    trial.meets_slo = trial.p95_itl_ms <= options_.itl_slo_ms &&
+                      (options_.ttft_slo_ms <= 0.0 || trial.p95_ttft_ms <= options_.ttft_slo_ms);
+    return trial;
+}
+
+size_t Autotuner::tune_nucleus_window(uint32_t vocab_size) const {
+    if (options_.nucleus_windows.empty() || vocab_size == 0) {
+        return 0;
+    }
+    // Zipf-shaped logits (exponent 1.5) at shuffled positions: a rough stand-in for a
+    // language model's next-token distribution, whose 0.9 nucleus is a few dozen tokens
+    std::vector<float> logits(vocab_size);
+    std::vector<uint32_t> rank(vocab_size);
+    std::iota(rank.begin(), rank.end(), 1u);
+    uint64_t seed = 0x5A49504632ULL;
+    for (size_t i = vocab_size; i > 1; --i) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        std::swap(rank[i - 1], rank[(seed >> 33) % i]);
+    }
+    for (size_t i = 0; i < vocab_size; ++i) {
+        logits[i] = -1.5f * std::log(static_cast<float>(rank[i]));
+    }
+
+    SamplingParams params;
+    params.temperature = 1.0f;
+    params.top_p = 0.9f;
+    const size_t previous_window = Sampler::nucleus_window();
+    size_t best_window = options_.nucleus_windows.front();
+    double best_seconds = 0.0;
+    for (size_t window : options_.nucleus_windows) {
+        Sampler::set_nucleus_window(window);
+        Sampler sampler(1);
+        double fastest = 0.0;
+        for (int repetition = 0; repetition < 3; ++repetition) {
+            constexpr int kSamples = 32;
+            const Clock::time_point start = Clock::now();
+            for (int i = 0; i < kSamples; ++i) {
+                sampler.sample(logits, params);
+            }
+            const double seconds = std::chrono::duration<double>(Clock::now() - start).count() / kSamples;
+            fastest = repetition == 0 ? seconds : std::min(fastest, seconds);
+        }
+        if (best_seconds == 0.0 || fastest < best_seconds) {
+            best_window = window;
+            best_seconds = fastest;
+        }
+    }
+    Sampler::set_nucleus_window(previous_window);
+    return best_window;
+}
+
+Autotuner::Trial Autotuner::tune(const std::shared_ptr<Engine>& engine) {
+    trials_.clear();
+    std::vector<size_t> threads = options_.threads;
+    if (threads.empty()) {
+        for (size_t t = 1; t < host_.cores; t *= 2) {
+            threads.push_back(t);
+        }
+        threads.push_back(host_.cores);
+    }
+
+    // Start from the defaults (or the nearest candidates) and improve one knob at a time
+    Settings current;
+    current.threads = threads.back();
+    if (!options_.batches.empty() &&
+        std::find(options_.batches.begin(), options_.batches.end(), current.max_batch) == options_.batches.end()) {
+        current.max_batch = options_.batches.back();
+    }
+    if (!options_.prefill_chunks.empty() &&
+        std::find(options_.prefill_chunks.begin(), options_.prefill_chunks.end(), current.prefill_chunk) ==
+            options_.prefill_chunks.end()) {
+        current.prefill_chunk = options_.prefill_chunks.back();
+    }
+
+    Trial best;
+    bool measured = false;
+    auto sweep = [&](const std::vector<size_t>& values, size_t Settings::*knob) {
+        for (size_t value : values) {
+            Settings settings = current;
+            settings.*knob = value;
+            const Trial trial = measure(engine, settings);
+            trials_.push_back(trial);
+            std::cout << "[Autotune] " << describe_settings(settings) << ": " << std::fixed << std::setprecision(1)
+                      << trial.tokens_per_second << " tokens/s, p95 inter-token " << trial.p95_itl_ms
+                      << " ms, p95 first token " << trial.p95_ttft_ms << " ms"
+                      << (trial.meets_slo ? "" : " (misses SLO)") << std::defaultfloat << "\n";
+            if (!measured || better(trial, best)) {
+                best = trial;
+                measured = true;
+            }
+        }
+        current = best.settings;
+    };
+    sweep(threads, &Settings::threads);
+    sweep(options_.batches, &Settings::max_batch);
+    sweep(options_.prefill_chunks, &Settings::prefill_chunk);
+    if (!measured) {
+        best = measure(engine, current);
+        trials_.push_back(best);
+    }
+
+    best.settings.nucleus_window = tune_nucleus_window(engine->get_config().vocab_size);
+    return best;
+}
+
+bool Autotuner::run(const std::string& engine_path, const ModelConfig& config, bool force, Settings& settings) {
+    trials_.clear();
+    if (!force && lookup(config, settings)) {
+        std::cout << "[Autotune] Reusing tuned settings for " << host_.describe() << ": " << describe_settings(settings)
+                  << " nucleus_window=" << settings.nucleus_window << "\n";
+        return true;
+    }
+
+    std::cout << "[Autotune] Tuning for " << host_.describe() << " (p95 inter-token SLO " << options_.itl_slo_ms
+              << " ms)\n";
+    ModelConfig tuning = config;
+    if (!options_.batches.empty()) {
+        const size_t largest = *std::max_element(options_.batches.begin(), options_.batches.end());
+        tuning.max_batch_size = static_cast<uint32_t>(std::max<size_t>(tuning.max_batch_size, largest));
+    }
+    auto engine = std::make_shared<Engine>();
+    if (!engine->initialize(engine_path, tuning)) {
+        std::cerr << "[Autotune] Tuning engine failed to initialize\n";
+        return false;
+    }
+    const Trial best = tune(engine);
+    if (!best.meets_slo) {
+        std::cerr << "[Autotune] No setting meets the SLO; using the lowest inter-token latency\n";
+    }
+    settings = best.settings;
+    std::cout << "[Autotune] Chose " << describe_settings(settings) << " nucleus_window=" << settings.nucleus_window
+              << " (" << trials_.size() << " trials)\n";
+    store(config, best);
+    return true;
+}
+
+} // namespace castor
@@ -0,0 +1,399 @@
+#include "batch_runner.hpp"
+#include "bounded_queue.hpp"
+#include "sampling_json.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace castor {
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Item {
+    uint64_t seq = 0;        // Position within this run (writer ordering)
+    uint64_t line = 0;       // Absolute 0-based line number in the input
+    uint64_t end_offset = 0; // Input byte offset just past this line
+    json id;                 // Echoed back when the request has one
+    std::string prompt;
+    SamplingParams params;
+    std::vector<int32_t> tokens;
+    GenerationResult result;
+    std::string error;
+};
+
+double seconds_between(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/**
+ * @brief Read-only mapping of the whole input file
+ */
+class MappedFile {
+public:
+    ~MappedFile() {
+        if (data_) ::munmap(const_cast<char*>(data_), size_);
+        if (fd_ >= 0) ::close(fd_);
+    }
+
+    bool open(const std::string& path) {
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        if (fd_ < 0) {
+            return false;
+        }
+        struct stat st{};
+        if (::fstat(fd_, &st) != 0) {
+            return false;
+        }
+        size_ = static_cast<size_t>(st.st_size);
+        if (size_ == 0) {
+            return true;
+        }
+        void* mapped = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd_, 0);
+        if (mapped == MAP_FAILED) {
+            return false;
+        }
+        ::madvise(mapped, size_, MADV_SEQUENTIAL);
+        data_ = static_cast<const char*>(mapped);
+        return true;
+    }
+
+    const char* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    int fd_ = -1;
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+struct Progress {
+    uint64_t input_offset = 0;
+    uint64_t output_bytes = 0;
+};
+
+bool read_progress(const std::string& path, Progress& progress) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        return false;
+    }
+    try {
+        const json data = json::parse(file);
+        progress.input_offset = data.at("input_offset").get<uint64_t>();
+        progress.output_bytes = data.at("output_bytes").get<uint64_t>();
+    } catch (const json::exception& e) {
+        std::cerr << "[Batch] Ignoring unreadable checkpoint " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+// Write to a temp file and rename so a crash never leaves a torn checkpoint
+void write_progress(const std::string& path, const std::string& input_path, const Progress& progress,
+                    uint64_t lines) {
+    const std::string tmp = path + ".tmp";
+    {
+        std::ofstream file(tmp, std::ios::trunc);
+        json data;
+        data["input"] = input_path;
+        data["input_offset"] = progress.input_offset;
+        data["output_bytes"] = progress.output_bytes;
+        data["lines_written"] = lines;
+        file << data.dump() << "\n";
+    }
+    std::rename(tmp.c_str(), path.c_str());
+}
+
+} // namespace
+
+BatchRunner::BatchRunner(std::shared_ptr<Engine> engine, std::shared_ptr<Tokenizer> tokenizer, const Options& options)
+    : engine_(std::move(engine)), tokenizer_(std::move(tokenizer)), options_(options) {
+    options_.batch_size = std::max<size_t>(1, options_.batch_size);
+    options_.tokenize_threads = std::max<size_t>(1, options_.tokenize_threads);
+    options_.checkpoint_lines = std::max<size_t>(1, options_.checkpoint_lines);
+}
+
+bool BatchRunner::run(Report& report) {
+    report = Report();
+    if (!engine_ || !tokenizer_) {
+        std::cerr << "[Batch] Engine or Tokenizer not initialized\n";
+        return false;
+    }
+
+    MappedFile input;
+    if (!input.open(options_.input_path)) {
+        std::cerr << "[Batch] Failed to open input: " << options_.input_path << "\n";
+        return false;
+    }
+
+    // Work out where to start and make the output consistent with it
+    const std::string progress_file = progress_path(options_.output_path);
+    Progress progress;
+    progress.input_offset = options_.start_offset;
+    bool append = false;
+    if (options_.resume && read_progress(progress_file, progress)) {
+        std::error_code ec;
+        std::filesystem::resize_file(options_.output_path, progress.output_bytes, ec);
+        if (ec) {
+            std::cerr << "[Batch] Cannot truncate " << options_.output_path << " to checkpoint: " << ec.message() << "\n";
+            return false;
+        }
+        append = true;
+        std::cout << "[Batch] Resuming at input byte " << progress.input_offset << "\n";
+    }
+    if (progress.input_offset > input.size() ||
+        (progress.input_offset > 0 && input.data()[progress.input_offset - 1] != '\n')) {
+        std::cerr << "[Batch] Start offset " << progress.input_offset << " is not the start of a line\n";
+        return false;
+    }
+
+    FILE* out = std::fopen(options_.output_path.c_str(), append ? "ab" : "wb");
+    if (!out) {
+        std::cerr << "[Batch] Failed to open output: " << options_.output_path << "\n";
+        return false;
+    }
+    progress.output_bytes = append ? progress.output_bytes : 0;
+    report.start_offset = progress.input_offset;
+
+    const uint64_t first_line =
+        input.size() ? std::count(input.data(), input.data() + progress.input_offset, '\n') : 0;
+
+    BoundedQueue<Item> parsed(options_.queue_capacity);
+    BoundedQueue<Item> tokenized(options_.queue_capacity);
+    BoundedQueue<Item> finished(options_.queue_capacity);
+    std::atomic<uint64_t> tokenize_busy_ns{0};
+    const auto start = Clock::now();
+
+    const auto vocabulary = tokenizer_->token_table(); // Stop strings match token texts
+
+    // Stage 1: split the mapping into lines and parse each request
+    std::thread reader([&]() {
+        const char* const base = input.data();
+        uint64_t offset = progress.input_offset;
+        uint64_t line = first_line;
+        uint64_t seq = 0;
+        double busy = 0.0;
+        while (offset < input.size()) {
+            const auto t0 = Clock::now();
+            const char* begin = base + offset;
+            const char* nl = static_cast<const char*>(std::memchr(begin, '\n', input.size() - offset));
+            const char* end = nl ? nl : base + input.size();
+            offset = static_cast<uint64_t>(end - base) + (nl ? 1 : 0);
+
+            Item item;
+            item.line = line++;
+            item.end_offset = offset;
+            if (begin == end || (end - begin == 1 && *begin == '\r')) {
+                busy += seconds_between(t0, Clock::now());
+                continue;
+            }
+            item.seq = seq++;
+            try {
+                const json request = json::parse(begin, end);
+                if (request.contains("id")) {
+                    item.id = request["id"];
+                }
+                if (!request.contains("prompt")) {
+                    item.error = "Missing 'prompt' field in request";
+                } else {
+                    item.prompt = request["prompt"].get<std::string>();
+                    item.params = parse_sampling_params(request);
+                    parse_stop_sequences(request, vocabulary, item.params, item.error);
+                }
+            } catch (const json::exception& e) {
+                item.error = std::string("JSON parse error: ") + e.what();
+            }
+            busy += seconds_between(t0, Clock::now());
+            if (!parsed.push(std::move(item))) {
+                break;
+            }
+        }
+        report.reader_busy_seconds = busy;
+        parsed.close();
+    });
+
+    // Stage 2: tokenize in parallel (output order is restored by the writer)
+    std::vector<std::thread> tokenizers;
+    std::atomic<size_t> tokenizers_left{options_.tokenize_threads};
+    for (size_t t = 0; t < options_.tokenize_threads; ++t) {
+        tokenizers.emplace_back([&]() {
+            while (auto item = parsed.pop()) {
+                const auto t0 = Clock::now();
+                if (item->error.empty()) {
+                    item->tokens = tokenizer_->encode(item->prompt);
+                }
+                tokenize_busy_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t0).count();
+                if (!tokenized.push(std::move(*item))) {
+                    break;
+                }
+            }
+            if (--tokenizers_left == 0) {
+                tokenized.close();
+            }
+        });
+    }
+
+    // Stage 3: batch whatever is ready, up to batch_size, per engine call
+    std::thread inference([&]() {
+        std::vector<Item> batch;
+        std::vector<std::vector<int32_t>> prompts;
+        std::vector<SamplingParams> params;
+        std::vector<GenerationResult> results;
+        std::vector<size_t> runnable;
+        std::vector<size_t> queued;
+        std::vector<BlockArena::Lease> leases;
+        double busy = 0.0;
+        while (auto first = tokenized.pop()) {
+            batch.clear();
+            batch.push_back(std::move(*first));
+            while (batch.size() < options_.batch_size) {
+                auto more = tokenized.try_pop();
+                if (!more) break;
+                batch.push_back(std::move(*more));
+            }
+
+            const auto t0 = Clock::now();
+            queued.clear();
+            for (size_t i = 0; i < batch.size(); ++i) {
+                if (!batch[i].error.empty()) {
+                    continue;
+                }
+                if (!engine_->kv_fits(batch[i].tokens.size() + batch[i].params.max_tokens)) {
+                    batch[i].error = "Request needs more KV cache than the memory budget can hold";
+                    continue;
+                }
+                queued.push_back(i);
+            }
+            // As many as have KV blocks per engine call; the rest go in the next
+            for (size_t next = 0; next < queued.size();) {
+                prompts.clear();
+                params.clear();
+                runnable.clear();
+                for (; next < queued.size(); ++next) {
+                    Item& item = batch[queued[next]];
+                    BlockArena::Lease lease;
+                    if (!engine_->lease_kv(item.tokens.size() + item.params.max_tokens, 1, lease)) {
+                        break;
+                    }
+                    leases.push_back(std::move(lease));
+                    runnable.push_back(queued[next]);
+                    prompts.push_back(std::move(item.tokens));
+                    params.push_back(item.params);
+                }
+                if (runnable.empty()) {
+                    // Blocks held outside this runner; it cannot wait for them
+                    batch[queued[next++]].error = "KV cache is full";
+                    continue;
+                }
+                const bool ok = engine_->generate_batch(prompts, params, results);
+                leases.clear();
+                for (size_t r = 0; r < runnable.size(); ++r) {
+                    Item& item = batch[runnable[r]];
+                    item.tokens = std::move(prompts[r]);
+                    if (ok) {
+                        item.result = std::move(results[r]);
+                    } else {
+                        item.error = "Inference failed";
+                    }
+                }
+            }
+            busy += seconds_between(t0, Clock::now());
+
+            for (auto& item : batch) {
+                finished.push(std::move(item));
+            }
+        }
+        report.engine_busy_seconds = busy;
+        finished.close();
+    });
+
+    // Stage 4 (this thread): reorder, format and append results
+    std::map<uint64_t, Item> pending;
+    uint64_t next_seq = 0;
+    uint64_t since_checkpoint = 0;
+    std::string buffer;
+    double writer_busy = 0.0;
+
+    auto checkpoint = [&]() {
+        std::fwrite(buffer.data(), 1, buffer.size(), out);
+        progress.output_bytes += buffer.size();
+        buffer.clear();
+        std::fflush(out);
+        ::fsync(::fileno(out));
+        write_progress(progress_file, options_.input_path, progress, report.lines);
+        since_checkpoint = 0;
+    };
+
+    while (auto item = finished.pop()) {
+        const auto t0 = Clock::now();
+        pending.emplace(item->seq, std::move(*item));
+        for (auto it = pending.find(next_seq); it != pending.end(); it = pending.find(next_seq)) {
+            Item& done = it->second;
+            json line;
+            line["line"] = done.line;
+            if (!done.id.is_null()) {
+                line["id"] = done.id;
+            }
+            if (!done.error.empty()) {
+                line["error"] = done.error;
+                ++report.errors;
+            } else {
+                line["input_tokens"] = done.tokens.size();
+                line["output_token_ids"] = done.result.output_ids;
+                line["output_text"] = done.params.stop ? done.result.output_text
+                                                       : tokenizer_->decode(done.result.output_ids);
+                line["output_tokens"] = done.result.output_ids.size();
+                line["finish_reason"] = done.result.finish_reason;
+                report.prompt_tokens += done.tokens.size();
+                report.output_tokens += done.result.output_ids.size();
+            }
+            buffer += line.dump();
+            buffer += '\n';
+            progress.input_offset = done.end_offset;
+            ++report.lines;
+            pending.erase(it);
+            ++next_seq;
+            if (++since_checkpoint >= options_.checkpoint_lines) {
+                checkpoint();
+            }
+        }
+        writer_busy += seconds_between(t0, Clock::now());
+    }
+
+    reader.join();
+    for (auto& thread : tokenizers) {
+        thread.join();
+    }
+    inference.join();
+
+    // Trailing blank lines never reach the writer; finish the checkpoint at EOF
+    if (pending.empty()) {
+        progress.input_offset = std::max<uint64_t>(progress.input_offset, input.size());
+    }
+    checkpoint();
+    std::fclose(out);
+
+    report.end_offset = progress.input_offset;
+    report.wall_seconds = seconds_between(start, Clock::now());
+    report.tokenize_busy_seconds = static_cast<double>(tokenize_busy_ns.load()) / 1e9;
+    report.writer_busy_seconds = writer_busy;
+    return true;
+}
+
+} // namespace castor
@@ -0,0 +1,133 @@
+#include "embedding.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace castor {
+namespace embedding {
+
+bool parse_pooling(const std::string& text, Pooling& out) {
+    if (text == "mean") {
+        out = Pooling::Mean;
+    } else if (text == "last") {
+        out = Pooling::Last;
+    } else if (text == "cls") {
+        out = Pooling::Cls;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parse_encoding(const std::string& text, EmbeddingEncoding& out) {
+    if (text == "float") {
+        out = EmbeddingEncoding::Float;
+    } else if (text == "fp16") {
+        out = EmbeddingEncoding::Fp16;
+    } else if (text == "int8") {
+        out = EmbeddingEncoding::Int8;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+uint16_t float_to_half(float value) {
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t exponent = (bits >> 23) & 0xFFu;
+    uint32_t mantissa = bits & 0x7FFFFFu;
+
+    if (exponent == 0xFF) { // Inf or NaN (keep NaN quiet)
+        return static_cast<uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+    }
+    const int32_t half_exponent = static_cast<int32_t>(exponent) - 127 + 15;
+    if (half_exponent >= 0x1F) {
+        return static_cast<uint16_t>(sign | 0x7C00u); // Overflow to inf
+    }
+    if (half_exponent <= 0) {
+        if (half_exponent < -10) {
+            return static_cast<uint16_t>(sign); // Underflow to zero
+        }
+        // Subnormal: shift in the implicit bit, round to nearest even
+        mantissa |= 0x800000u;
+        const uint32_t shift = static_cast<uint32_t>(14 - half_exponent);
+        uint32_t half = mantissa >> shift;
+        const uint32_t rest = mantissa & ((1u << shift) - 1);
+        const uint32_t halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1u))) {
+            ++half;
+        }
+        return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = (static_cast<uint32_t>(half_exponent) << 10) | (mantissa >> 13);
+    const uint32_t rest = mantissa & 0x1FFFu;
+    if (rest > 0x1000u || (rest == 0x1000u && (half & 1u))) {
+        ++half; // May carry into the exponent, up to inf: still correct
+    }
+    return static_cast<uint16_t>(sign | half);
+}
+
+float half_to_float(uint16_t half) {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1Fu;
+    const uint32_t mantissa = half & 0x3FFu;
+    uint32_t bits;
+    if (exponent == 0x1F) {
+        bits = sign | 0x7F800000u | (mantissa << 13);
+    } else if (exponent != 0) {
+        bits = sign | ((exponent - 15 + 127) << 23) | (mantissa << 13);
+    } else if (mantissa == 0) {
+        bits = sign;
+    } else {
+        const float magnitude = std::ldexp(static_cast<float>(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+float quantize_int8(const float* values, size_t count, int8_t* out) {
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < count; ++i) {
+        max_abs = std::max(max_abs, std::fabs(values[i]));
+    }
+    if (max_abs == 0.0f) {
+        std::fill(out, out + count, int8_t{0});
+        return 0.0f;
+    }
+    const float scale = max_abs / 127.0f;
+    const float inv_scale = 127.0f / max_abs;
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = static_cast<int8_t>(std::lrint(std::clamp(values[i] * inv_scale, -127.0f, 127.0f)));
+    }
+    return scale;
+}
+
+std::string base64_encode(const void* data, size_t size) {
+    static const char kAlphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    std::string out;
+    out.reserve((size + 2) / 3 * 4);
+    size_t i = 0;
+    for (; i + 3 <= size; i += 3) {
+        const uint32_t v = (uint32_t{bytes[i]} << 16) | (uint32_t{bytes[i + 1]} << 8) | bytes[i + 2];
+        out += kAlphabet[v >> 18];
+        out += kAlphabet[(v >> 12) & 63];
+        out += kAlphabet[(v >> 6) & 63];
+        out += kAlphabet[v & 63];
+    }
+    if (i < size) {
+        const uint32_t v = (uint32_t{bytes[i]} << 16) | (i + 1 < size ? uint32_t{bytes[i + 1]} << 8 : 0u);
+        out += kAlphabet[v >> 18];
+        out += kAlphabet[(v >> 12) & 63];
+        out += i + 1 < size ? kAlphabet[(v >> 6) & 63] : '=';
+        out += '=';
+    }
+    return out;
+}
+
+} // namespace embedding
+} // namespace castor
@@ -1,8 +1,68 @@
 #include "engine.hpp"
+#include "grammar.hpp"
+#include "stop_sequences.hpp"
 #include "tokenizer.hpp"
+#include "metrics.hpp"
+#include "sampler.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace castor {
 
+namespace {
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+double seconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+uint64_t fnv1a(const std::string& text) {
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (unsigned char c : text) {
+        hash = (hash ^ c) * 0x100000001B3ULL;
+    }
+    return hash;
+}
+
+constexpr double kSpeculativeEwma = 0.1;
+
+// Advance every unfinished stream once per step until all are done
+bool decode_together(std::vector<GenerationStream>& streams) {
+    for (bool active = true; active;) {
+        active = false;
+        for (auto& stream : streams) {
+            if (stream.finished()) {
+                continue;
+            }
+            if (!stream.decode_step()) {
+                return false;
+            }
+            active = active || !stream.finished();
+        }
+    }
+    return true;
+}
+
+bool by_cumulative_logprob(const GenerationResult& a, const GenerationResult& b) {
+    return a.cumulative_logprob > b.cumulative_logprob;
+}
+
+} // namespace
+
 Engine::Engine() {}
 
 Engine::~Engine() {
@@ -11,21 +71,75 @@ Engine::~Engine() {
     }
 }
 
-bool Engine::initialize(const std::string& engine_path, const ModelConfig& config) {
+bool Engine::initialize(const std::string& engine_path, const ModelConfig& config, const KernelSet* kernels) {
     if (initialized_) {
         return false; // Already initialized
     }
 
     config_ = config;
+    config_.kv_block_tokens = std::max<uint32_t>(1, config_.kv_block_tokens);
+    logit_seed_ = config.model_name.empty() ? 0 : fnv1a(config.model_name);
 
     // TODO: Load TensorRT engine from engine_path
     // TODO: Create CUDA context and allocate buffers
     // TODO: Initialize runtime and execution context
 
+    // Tokenizer tables set before initialize() move to the budgeted accountant
+    auto memory = std::make_shared<MemoryAccountant>(config_.memory_budget_bytes);
+    memory->charge(MemoryUse::Tokenizer, tokenizer_bytes_);
+    const size_t weight_bytes = MemoryAccountant::estimate_weight_bytes(config_);
+    const size_t scratch_bytes = MemoryAccountant::estimate_scratch_bytes(config_);
+    if (!memory->try_charge(MemoryUse::Weights, weight_bytes) ||
+        !memory->try_charge(MemoryUse::Scratch, scratch_bytes)) {
+        std::cerr << "[Engine] Memory budget of " << (config_.memory_budget_bytes >> 20) << " MB cannot hold "
+                  << ((weight_bytes + scratch_bytes) >> 20) << " MB of weights and scratch\n";
+        return false;
+    }
+    if (config_.memory_budget_bytes > 0) {
+        // KV cache gets whatever the budget has left, reserved now rather than on demand
+        scratch_ = HugePageRegion(scratch_bytes, config_.huge_pages);
+        const size_t block_bytes = config_.kv_block_tokens * MemoryAccountant::estimate_kv_bytes_per_token(config_);
+        kv_arena_ = std::make_unique<BlockArena>(block_bytes, memory->available() / block_bytes, memory,
+                                                 MemoryUse::KvCache, config_.huge_pages);
+        if (!scratch_.valid() || kv_arena_->capacity() == 0) {
+            std::cerr << "[Engine] Cannot reserve scratch plus one " << block_bytes
+                      << "-byte KV block within the memory budget\n";
+            scratch_ = HugePageRegion();
+            kv_arena_.reset();
+            return false;
+        }
+        std::cout << "[Engine] Reserved " << kv_arena_->capacity() << " KV blocks of " << config_.kv_block_tokens
+                  << " tokens (" << HugePageRegion::backing_name(kv_arena_->backing()) << " pages)\n";
+    }
+    memory_ = std::move(memory);
+    kernels_ = kernels ? *kernels : Kernels::select(config_);
+    std::cout << "[Engine] CPU kernels: " << kernels_.describe(config_) << "\n";
+
     initialized_ = true;
     return true;
 }
 
+size_t Engine::prefault_weights(const std::string& engine_path) {
+    const int fd = ::open(engine_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    struct stat info;
+    size_t bytes = 0;
+    if (::fstat(fd, &info) == 0 && info.st_size > 0) {
+        bytes = static_cast<size_t>(info.st_size);
+        void* data = ::mmap(nullptr, bytes, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data == MAP_FAILED) {
+            bytes = 0;
+        } else {
+            // Pages stay in the page cache after the mapping is gone
+            ::munmap(data, bytes);
+        }
+    }
+    ::close(fd);
+    return bytes;
+}
+
 void Engine::shutdown() {
     if (!initialized_) {
         return;
@@ -34,20 +148,811 @@ void Engine::shutdown() {
     // TODO: Free CUDA memory
     // TODO: Destroy TensorRT objects
 
+    // The KV arena stays until destruction: a scheduler may still hold leases
+    memory_->release(MemoryUse::Weights, MemoryAccountant::estimate_weight_bytes(config_));
+    memory_->release(MemoryUse::Scratch, MemoryAccountant::estimate_scratch_bytes(config_));
+    scratch_ = HugePageRegion();
     initialized_ = false;
 }
 
+void Engine::set_tokenizer(std::shared_ptr<Tokenizer> tokenizer) {
+    // Needed whatever the budget says, so charged unconditionally; KV allocation absorbs it
+    memory_->release(MemoryUse::Tokenizer, tokenizer_bytes_);
+    tokenizer_bytes_ = tokenizer ? tokenizer->memory_bytes() : 0;
+    memory_->charge(MemoryUse::Tokenizer, tokenizer_bytes_);
+    tokenizer_ = std::move(tokenizer);
+}
+
+size_t Engine::kv_blocks_for(size_t tokens) const {
+    return std::max<size_t>(1, (tokens + config_.kv_block_tokens - 1) / config_.kv_block_tokens);
+}
+
+bool Engine::kv_fits(size_t tokens, size_t sequences) const {
+    return !kv_arena_ || kv_blocks_for(tokens) * sequences <= kv_arena_->max_lease();
+}
+
+bool Engine::lease_kv(size_t tokens, size_t sequences, BlockArena::Lease& lease) {
+    lease.release();
+    if (!kv_arena_ || sequences == 0) {
+        return true;
+    }
+    lease = kv_arena_->lease(kv_blocks_for(tokens) * sequences);
+    return !lease.empty();
+}
+
+MemoryReport Engine::memory_report() const {
+    MemoryReport report;
+    report.budget_bytes = memory_->budget();
+    for (size_t i = 0; i < MemoryAccountant::kUses; ++i) {
+        report.used_bytes[i] = memory_->used(static_cast<MemoryUse>(i));
+    }
+    report.total_bytes = memory_->total();
+    report.scratch_backing = scratch_.backing();
+    if (kv_arena_) {
+        report.kv_block_bytes = kv_arena_->block_bytes();
+        report.kv_block_tokens = config_.kv_block_tokens;
+        report.kv_blocks = kv_arena_->capacity();
+        report.kv_blocks_free = kv_arena_->free_blocks();
+        report.kv_backing = kv_arena_->backing();
+    }
+    return report;
+}
+
 bool Engine::infer(const std::vector<int32_t>& input_ids, std::vector<float>& output_logits) {
+    CASTOR_TRACE_SCOPE("infer");
     if (!initialized_) {
         return false;
     }
 
+    ScopedTimer timer(Histogram::PrefillSeconds);
+    SequenceState state;
+    return forward(state, input_ids, output_logits);
+}
+
+bool Engine::forward(SequenceState& state, const std::vector<int32_t>& input_ids, std::vector<float>& output_logits) {
     // TODO: Prepare input tensors
     // TODO: Launch TensorRT inference
     // TODO: Copy output from GPU to CPU
     // TODO: Return results in output_logits
 
+    if (!extend(state, input_ids.data(), input_ids.size())) {
+        return false;
+    }
+    reference_logits(state, output_logits);
+    return true;
+}
+
+bool Engine::extend(SequenceState& state, const int32_t* input_ids, size_t count) {
+    if (!initialized_) {
+        return false;
+    }
+
+    // TODO: Run the chunk through the model to fill the KV cache, skipping the LM head
+
+    for (size_t i = 0; i < count; ++i) {
+        state.context_hash = splitmix64(state.context_hash ^ static_cast<uint64_t>(static_cast<uint32_t>(input_ids[i])));
+        ++state.length;
+    }
+    return true;
+}
+
+bool Engine::forward_all(SequenceState& state, const std::vector<int32_t>& input_ids,
+                         std::vector<std::vector<float>>& output_logits) {
+    if (!initialized_) {
+        return false;
+    }
+
+    // TODO: Single TensorRT pass with logits kept for every position
+
+    output_logits.resize(input_ids.size());
+    for (size_t i = 0; i < input_ids.size(); ++i) {
+        extend(state, &input_ids[i], 1);
+        reference_logits(state, output_logits[i]);
+    }
     return true;
 }
 
+bool Engine::save_kv(const SequenceState& state, std::vector<uint8_t>& kv) const {
+    if (!initialized_) {
+        return false;
+    }
+
+    // TODO: Copy the sequence's KV blocks from the device
+
+    kv.resize(state.length * MemoryAccountant::estimate_kv_bytes_per_token(config_));
+    const uint64_t seed = reference_kv_seed(state);
+    const size_t words = kv.size() / sizeof(uint64_t);
+    for (size_t i = 0; i < words; ++i) {
+        const uint64_t word = splitmix64(seed + i);
+        std::memcpy(kv.data() + i * sizeof(uint64_t), &word, sizeof(word));
+    }
+    return true;
+}
+
+bool Engine::restore_kv(const SequenceState& state, const uint8_t* kv, size_t size) {
+    if (!initialized_ || size != state.length * MemoryAccountant::estimate_kv_bytes_per_token(config_)) {
+        return false;
+    }
+
+    // TODO: Copy into freshly allocated KV blocks on the device
+
+    // The stand-in has no cache to fill; reading every word back costs what the copy would
+    const uint64_t seed = reference_kv_seed(state);
+    const size_t words = size / sizeof(uint64_t);
+    uint64_t mismatch = 0;
+    for (size_t i = 0; i < words; ++i) {
+        uint64_t word;
+        std::memcpy(&word, kv + i * sizeof(uint64_t), sizeof(word));
+        mismatch |= word ^ splitmix64(seed + i);
+    }
+    return mismatch == 0;
+}
+
+bool Engine::set_draft(std::shared_ptr<Engine> draft, const SpeculativeOptions& options) {
+    if (draft && (draft.get() == this || !draft->is_initialized() ||
+                  draft->get_config().vocab_size != config_.vocab_size)) {
+        return false;
+    }
+    draft_ = std::move(draft);
+    speculative_ = options;
+    speculative_.min_k = std::max<uint32_t>(1, speculative_.min_k);
+    speculative_.max_k = std::max(speculative_.min_k, speculative_.max_k);
+    speculative_.k = std::clamp(speculative_.k, speculative_.min_k, speculative_.max_k);
+    return true;
+}
+
+GenerationStream::GenerationStream(Engine& engine, std::vector<int32_t> prompt_ids, const SamplingParams& params)
+    : engine_(engine), prompt_(std::move(prompt_ids)), params_(params), sampler_(params.seed),
+      start_(std::chrono::steady_clock::now()), draft_(engine.get_draft()), k_(engine.speculative_options().k) {
+    if (params_.grammar) {
+        grammar_state_ = params_.grammar->start();
+        draft_.reset(); // Proposals would have to be masked per position; decode plainly instead
+    }
+    result_.output_ids.reserve(params_.max_tokens);
+    result_.logprobs.reserve(params_.max_tokens);
+    result_.finish_reason = "length";
+}
+
+bool GenerationStream::resume_from(const SequenceState& state, size_t tokens) {
+    if (prefilled_ || prompt_done_ != 0 || tokens == 0 || tokens >= prompt_.size() || state.length != tokens) {
+        return false;
+    }
+    if (draft_ && !draft_->extend(draft_state_, prompt_.data(), tokens)) {
+        return false;
+    }
+    state_ = state;
+    prompt_done_ = tokens;
+    return true;
+}
+
+bool GenerationStream::prefill_chunk(size_t max_tokens) {
+    if (prefilled_) {
+        return true;
+    }
+    CASTOR_TRACE_SCOPE("prefill");
+    const auto chunk_start = std::chrono::steady_clock::now();
+    const size_t count = std::min(max_tokens, prompt_remaining());
+    if (count < prompt_remaining()) {
+        if (!engine_.extend(state_, prompt_.data() + prompt_done_, count) ||
+            (draft_ && !draft_->extend(draft_state_, prompt_.data() + prompt_done_, count))) {
+            return false;
+        }
+        prompt_done_ += count;
+        result_.prefill_seconds += seconds_since(chunk_start);
+        return true;
+    }
+
+    // Final chunk: also produce the logits for the first generated token
+    bool ok = false;
+    if (prompt_done_ == 0) {
+        ok = engine_.forward(state_, prompt_, logits_) && (!draft_ || draft_->forward(draft_state_, prompt_, draft_logits_));
+    } else {
+        const std::vector<int32_t> tail(prompt_.begin() + prompt_done_, prompt_.end());
+        ok = engine_.forward(state_, tail, logits_) && (!draft_ || draft_->forward(draft_state_, tail, draft_logits_));
+    }
+    if (!ok) {
+        return false;
+    }
+    prompt_done_ = prompt_.size();
+    prefilled_ = true;
+    finished_ = params_.max_tokens == 0;
+    result_.prefill_seconds += seconds_since(chunk_start);
+    Metrics::observe(Histogram::PrefillSeconds, result_.prefill_seconds);
+    decode_start_ = std::chrono::steady_clock::now();
+    return true;
+}
+
+bool GenerationStream::decode_step() {
+    if (finished_) {
+        return true;
+    }
+    if (!prefilled_) {
+        return false;
+    }
+    if (draft_) {
+        return speculative_step();
+    }
+    const auto step_start = std::chrono::steady_clock::now();
+
+    if (params_.grammar) {
+        if (!params_.grammar->any_allowed(grammar_state_)) {
+            result_.finish_reason = "constraint";
+            finished_ = true;
+            result_.decode_seconds = seconds_since(decode_start_);
+            return true;
+        }
+        params_.grammar->apply(grammar_state_, logits_);
+    }
+    float logprob = 0.0f;
+    const int32_t token = sampler_.sample(logits_, params_, &logprob);
+    if (token < 0) {
+        return false;
+    }
+    if (!emit(token, logprob)) {
+        return true;
+    }
+
+    CASTOR_TRACE_SCOPE("decode");
+    const std::vector<int32_t> next{token};
+    if (!engine_.forward(state_, next, logits_)) {
+        return false;
+    }
+    Metrics::observe(Histogram::DecodeTokenSeconds, seconds_since(step_start));
+    return true;
+}
+
+bool GenerationStream::emit(int32_t token, float logprob) {
+    if (result_.output_ids.empty()) {
+        result_.first_token_seconds = seconds_since(start_);
+    }
+    result_.output_ids.push_back(token);
+    result_.logprobs.push_back(logprob);
+    result_.cumulative_logprob += logprob;
+    if (params_.grammar) {
+        grammar_state_ = params_.grammar->advance(grammar_state_, token);
+    }
+
+    const bool eos = token == engine_.get_config().eos_token_id;
+    if (eos || (params_.stop && params_.stop->append(stop_state_, token, result_.output_text, &result_.stop_sequence)) ||
+        (params_.grammar && params_.grammar->complete(grammar_state_))) {
+        result_.finish_reason = "stop";
+        finished_ = true;
+    } else if (result_.output_ids.size() >= params_.max_tokens) {
+        finished_ = true;
+    }
+    if (finished_) {
+        result_.decode_seconds = seconds_since(decode_start_);
+    }
+    return !finished_;
+}
+
+std::string GenerationStream::take_text() {
+    const std::string& text = result_.output_text;
+    size_t end = text.size();
+    if (!finished_) {
+        if (params_.stop) {
+            end -= params_.stop->pending_bytes(stop_state_);
+        }
+        // Back off to the lead byte of a UTF-8 character the text cuts short
+        for (size_t back = 1; back <= 4 && back <= end; ++back) {
+            const auto byte = static_cast<unsigned char>(text[end - back]);
+            if ((byte & 0xC0) == 0x80) {
+                continue; // Continuation byte
+            }
+            const size_t width = byte >= 0xF0 ? 4 : byte >= 0xE0 ? 3 : byte >= 0xC0 ? 2 : 1;
+            if (width > back) {
+                end -= back;
+            }
+            break;
+        }
+    }
+    if (end <= text_taken_) {
+        return std::string();
+    }
+    std::string piece = text.substr(text_taken_, end - text_taken_);
+    text_taken_ = end;
+    return piece;
+}
+
+// One round of speculative sampling (Leviathan et al. / Chen et al.):
+//   1. the draft proposes k tokens, keeping each proposal distribution q_i
+//   2. the target scores [pending, x_0..x_k-1] in one pass, giving p_0..p_k
+//   3. x_i is accepted with probability min(1, p_i(x_i) / q_i(x_i)); on the
+//      first rejection a replacement is drawn from norm(max(0, p_i - q_i)),
+//      and if all k are accepted a bonus token is drawn from p_k
+// Every emitted token is therefore distributed exactly as under the target.
+// The last emitted token becomes pending and is fed at the start of the next round.
+bool GenerationStream::speculative_step() {
+    CASTOR_TRACE_SCOPE("speculate");
+    const auto step_start = std::chrono::steady_clock::now();
+    const size_t remaining = params_.max_tokens - result_.output_ids.size();
+    const size_t k = std::min<size_t>(k_, remaining - 1);
+    const size_t emitted_before = result_.output_ids.size();
+
+    // 1. Draft proposals
+    const SequenceState draft_saved = draft_state_;
+    if (pending_ >= 0 && k > 0 && !draft_->forward(draft_state_, {pending_}, draft_logits_)) {
+        return false;
+    }
+    proposals_.resize(k);
+    draft_probs_.resize(k);
+    for (size_t i = 0; i < k; ++i) {
+        sampler_.distribution(draft_logits_, params_, draft_probs_[i]);
+        proposals_[i] = sampler_.sample_from(draft_probs_[i]);
+        if (proposals_[i] < 0 || (i + 1 < k && !draft_->forward(draft_state_, {proposals_[i]}, draft_logits_))) {
+            return false;
+        }
+    }
+    const double draft_seconds = seconds_since(step_start);
+
+    // 2. One target pass over the pending token and all proposals
+    const auto verify_start = std::chrono::steady_clock::now();
+    const SequenceState target_saved = state_;
+    std::vector<int32_t> input;
+    input.reserve(k + 1);
+    if (pending_ >= 0) {
+        input.push_back(pending_);
+    }
+    input.insert(input.end(), proposals_.begin(), proposals_.end());
+    if (!input.empty()) {
+        if (!engine_.forward_all(state_, input, verify_logits_)) {
+            return false;
+        }
+        ++result_.target_forwards;
+        Metrics::add(Counter::SpeculativeTargetForwards);
+    }
+    const double target_seconds = seconds_since(verify_start);
+    const size_t offset = pending_ >= 0 ? 0 : 1; // p_0 is logits_ when nothing was pending
+    auto target_logits = [&](size_t i) -> const std::vector<float>& {
+        return i < offset ? logits_ : verify_logits_[i - offset];
+    };
+
+    // 3. Accept or correct
+    size_t accepted = 0;
+    int32_t next = -1;
+    for (; accepted < k; ++accepted) {
+        const std::vector<float>& p_logits = target_logits(accepted);
+        sampler_.distribution(p_logits, params_, target_probs_);
+        const std::vector<float>& q = draft_probs_[accepted];
+        const int32_t x = proposals_[accepted];
+        if (q[x] > 0.0f && sampler_.uniform() * q[x] < target_probs_[x]) {
+            if (!emit(x, Sampler::logprob(p_logits, params_, x))) {
+                ++accepted;
+                break;
+            }
+            continue;
+        }
+        for (size_t v = 0; v < target_probs_.size(); ++v) {
+            target_probs_[v] = std::max(0.0f, target_probs_[v] - q[v]);
+        }
+        next = sampler_.sample_from(target_probs_);
+        if (next < 0) { // p == q up to rounding: fall back to the target itself
+            sampler_.distribution(p_logits, params_, target_probs_);
+            next = sampler_.sample_from(target_probs_);
+        }
+        break;
+    }
+    if (!finished_) {
+        const std::vector<float>& p_logits = target_logits(accepted);
+        if (accepted == k) {
+            sampler_.distribution(p_logits, params_, target_probs_);
+            next = sampler_.sample_from(target_probs_);
+        }
+        if (next < 0) {
+            return false;
+        }
+        emit(next, Sampler::logprob(p_logits, params_, next));
+    }
+
+    result_.draft_tokens += static_cast<uint32_t>(k);
+    result_.accepted_draft_tokens += static_cast<uint32_t>(accepted);
+    Metrics::add(Counter::SpeculativeDraftTokens, k);
+    Metrics::add(Counter::SpeculativeAcceptedTokens, accepted);
+    Metrics::add(Counter::SpeculativeEmittedTokens, result_.output_ids.size() - emitted_before);
+    adapt_k(k, accepted, draft_seconds, target_seconds);
+
+    // Roll both sequences back to what was emitted, minus the last token, which
+    // stays pending. A round that ends the stream on an accepted proposal must
+    // not leave the proposals after it in state_.
+    // TODO: a KV-cache backend truncates to the accepted length instead of re-extending
+    const size_t keep = (pending_ >= 0 ? 1 : 0) + (result_.output_ids.size() - emitted_before) - 1;
+    if (keep < input.size()) {
+        state_ = target_saved;
+        if (!engine_.extend(state_, input.data(), keep)) {
+            return false;
+        }
+    }
+    draft_state_ = draft_saved;
+    if (!draft_->extend(draft_state_, input.data(), keep)) {
+        return false;
+    }
+    if (finished_) {
+        return true;
+    }
+    pending_ = next;
+    Metrics::observe(Histogram::DecodeTokenSeconds, seconds_since(step_start) / static_cast<double>(accepted + 1));
+    return true;
+}
+
+void GenerationStream::adapt_k(size_t proposed, size_t accepted, double draft_seconds, double target_seconds) {
+    const SpeculativeOptions& options = engine_.speculative_options();
+    if (!options.adaptive || proposed == 0) {
+        return;
+    }
+    // Trials run until the first rejection, so the per-token estimate is accepted / trials
+    const double trials = static_cast<double>(accepted + (accepted < proposed ? 1 : 0));
+    const double rate = static_cast<double>(accepted) / trials;
+    acceptance_ = acceptance_ < 0.0 ? rate : acceptance_ + kSpeculativeEwma * (rate - acceptance_);
+    if (target_seconds > 0.0) {
+        const double cost = draft_seconds / static_cast<double>(proposed) / target_seconds;
+        draft_cost_ = draft_cost_ < 0.0 ? cost : draft_cost_ + kSpeculativeEwma * (cost - draft_cost_);
+    }
+
+    // Expected tokens per round (1 - a^(k+1)) / (1 - a) against cost 1 + c k
+    const double a = std::min(acceptance_, 0.999);
+    const double c = std::max(draft_cost_, 0.0);
+    double best = 0.0;
+    for (uint32_t k = options.min_k; k <= options.max_k; ++k) {
+        const double value = (1.0 - std::pow(a, k + 1)) / (1.0 - a) / (1.0 + c * k);
+        if (value > best) {
+            best = value;
+            k_ = k;
+        }
+    }
+}
+
+bool GenerationStream::run_to_completion() {
+    if (!prefill()) {
+        return false;
+    }
+    while (!finished_) {
+        if (!decode_step()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+GenerationStream GenerationStream::fork(uint64_t seed) const {
+    GenerationStream copy(*this);
+    copy.params_.seed = seed;
+    copy.sampler_ = Sampler(seed);
+    Metrics::add(Counter::SequenceForks);
+    return copy;
+}
+
+bool Engine::generate(const std::vector<int32_t>& prompt_ids, const SamplingParams& params, GenerationResult& result) {
+    CASTOR_TRACE_SCOPE("generate");
+    if (!initialized_) {
+        return false;
+    }
+
+    GenerationStream stream(*this, prompt_ids, params);
+    if (!stream.run_to_completion()) {
+        return false;
+    }
+    result = std::move(stream.result());
+    return true;
+}
+
+bool Engine::generate_batch(const std::vector<std::vector<int32_t>>& prompts, const std::vector<SamplingParams>& params,
+                            std::vector<GenerationResult>& results) {
+    CASTOR_TRACE_SCOPE("generate_batch");
+    if (!initialized_ || prompts.size() != params.size()) {
+        return false;
+    }
+
+    std::vector<GenerationStream> streams;
+    streams.reserve(prompts.size());
+    for (size_t i = 0; i < prompts.size(); ++i) {
+        streams.emplace_back(*this, prompts[i], params[i]);
+        if (!streams.back().prefill()) {
+            return false;
+        }
+    }
+
+    // Every step advances all unfinished sequences; finished ones drop out
+    if (!decode_together(streams)) {
+        return false;
+    }
+
+    results.clear();
+    results.reserve(streams.size());
+    for (auto& stream : streams) {
+        results.push_back(std::move(stream.result()));
+    }
+    return true;
+}
+
+bool Engine::generate_candidates(const std::vector<int32_t>& prompt_ids, const SamplingParams& params,
+                                 const CandidateOptions& options, std::vector<GenerationResult>& results) {
+    CASTOR_TRACE_SCOPE("generate_candidates");
+    if (!initialized_ || options.n == 0) {
+        return false;
+    }
+    if (options.beam_search) {
+        return beam_search(prompt_ids, params, options, results);
+    }
+
+    const uint32_t width = options.width();
+    std::vector<GenerationStream> streams;
+    streams.reserve(width);
+    streams.emplace_back(*this, prompt_ids, params);
+    if (!streams.front().prefill()) {
+        return false;
+    }
+    for (uint32_t i = 1; i < width; ++i) {
+        streams.push_back(streams.front().fork(params.seed + i));
+    }
+    if (!decode_together(streams)) {
+        return false;
+    }
+
+    results.clear();
+    results.reserve(width);
+    for (auto& stream : streams) {
+        results.push_back(std::move(stream.result()));
+    }
+    std::stable_sort(results.begin(), results.end(), by_cumulative_logprob);
+    results.resize(options.n);
+    return true;
+}
+
+// Beam search over log-probabilities under params.temperature (T = 1 for
+// greedy, as for reported logprobs). Each step expands every live hypothesis
+// by its top `width` tokens and keeps the `width` best children overall;
+// hypotheses ending in EOS or a stop sequence, or reaching max_tokens, move
+// to the finished set.
+// Scores only decrease, so the search stops once n hypotheses have finished
+// and no live one can still overtake the n-th best of them.
+bool Engine::beam_search(const std::vector<int32_t>& prompt_ids, const SamplingParams& params,
+                         const CandidateOptions& options, std::vector<GenerationResult>& results) {
+    struct Beam {
+        SequenceState state;
+        std::vector<float> logits;
+        GenerationResult result;
+        int32_t grammar_state = 0;
+        int32_t stop_state = 0;
+    };
+    struct Child {
+        size_t parent;
+        int32_t token;
+        float logprob;
+        double score;
+    };
+
+    const auto start = std::chrono::steady_clock::now();
+    const size_t width = options.width();
+    const TokenMasks* grammar = params.grammar.get();
+    const StopSequences* stop_sequences = params.stop.get();
+    std::vector<Beam> live(1);
+    if (!forward(live[0].state, prompt_ids, live[0].logits)) {
+        return false;
+    }
+    if (grammar) {
+        live[0].grammar_state = grammar->start();
+    }
+    const double prefill_seconds = seconds_since(start);
+    Metrics::observe(Histogram::PrefillSeconds, prefill_seconds);
+    const auto decode_start = std::chrono::steady_clock::now();
+    const double inv_temperature = params.is_greedy() ? 1.0 : 1.0 / params.temperature;
+
+    std::vector<GenerationResult> finished;
+    std::vector<Child> children;
+    std::vector<int32_t> order(config_.vocab_size);
+    std::vector<double> scaled(config_.vocab_size);
+    for (uint32_t step = 0; step < params.max_tokens && !live.empty(); ++step) {
+        children.clear();
+        for (size_t b = 0; b < live.size(); ++b) {
+            std::vector<float>& logits = live[b].logits;
+            if (grammar) {
+                if (!grammar->any_allowed(live[b].grammar_state)) {
+                    // Dead end, as in decode_step: the hypothesis ends here without children
+                    live[b].result.finish_reason = "constraint";
+                    finished.push_back(live[b].result);
+                    continue;
+                }
+                grammar->apply(live[b].grammar_state, logits);
+            }
+            double max_logit = -INFINITY;
+            for (size_t v = 0; v < logits.size(); ++v) {
+                scaled[v] = logits[v] * inv_temperature;
+                max_logit = std::max(max_logit, scaled[v]);
+            }
+            double sum = 0.0;
+            for (size_t v = 0; v < logits.size(); ++v) {
+                sum += std::exp(scaled[v] - max_logit);
+            }
+            const double log_norm = max_logit + std::log(sum);
+            const size_t top = std::min(width, logits.size());
+            for (size_t v = 0; v < logits.size(); ++v) {
+                order[v] = static_cast<int32_t>(v);
+            }
+            std::partial_sort(order.begin(), order.begin() + top, order.begin() + logits.size(),
+                              [&scaled](int32_t a, int32_t c) { return scaled[a] > scaled[c]; });
+            for (size_t i = 0; i < top && std::isfinite(scaled[order[i]]); ++i) {
+                const float logprob = static_cast<float>(scaled[order[i]] - log_norm);
+                children.push_back({b, order[i], logprob, live[b].result.cumulative_logprob + logprob});
+            }
+        }
+        const size_t keep = std::min(width, children.size());
+        std::partial_sort(children.begin(), children.begin() + keep, children.end(),
+                          [](const Child& a, const Child& c) { return a.score > c.score; });
+
+        std::vector<Beam> next;
+        next.reserve(keep);
+        for (size_t i = 0; i < keep; ++i) {
+            const Child& child = children[i];
+            Beam beam;
+            beam.state = live[child.parent].state; // Fork: shares the parent's prefix
+            beam.result.output_ids = live[child.parent].result.output_ids;
+            beam.result.logprobs = live[child.parent].result.logprobs;
+            beam.result.output_text = live[child.parent].result.output_text;
+            beam.result.output_ids.push_back(child.token);
+            beam.result.logprobs.push_back(child.logprob);
+            beam.result.cumulative_logprob = child.score;
+            beam.result.finish_reason = "length";
+            if (grammar) {
+                beam.grammar_state = grammar->advance(live[child.parent].grammar_state, child.token);
+            }
+            beam.stop_state = live[child.parent].stop_state;
+            const bool stop = child.token == config_.eos_token_id ||
+                              (stop_sequences && stop_sequences->append(beam.stop_state, child.token, beam.result.output_text,
+                                                                        &beam.result.stop_sequence)) ||
+                              (grammar && grammar->complete(beam.grammar_state));
+            if (stop || beam.result.output_ids.size() >= params.max_tokens) {
+                if (stop) {
+                    beam.result.finish_reason = "stop";
+                }
+                finished.push_back(std::move(beam.result));
+                continue;
+            }
+            if (!forward(beam.state, {child.token}, beam.logits)) {
+                return false;
+            }
+            next.push_back(std::move(beam));
+        }
+        Metrics::add(Counter::SequenceForks, next.size());
+        live = std::move(next);
+
+        if (finished.size() >= options.n && !live.empty()) {
+            std::partial_sort(finished.begin(), finished.begin() + options.n, finished.end(), by_cumulative_logprob);
+            double best_live = -INFINITY;
+            for (const auto& beam : live) {
+                best_live = std::max(best_live, beam.result.cumulative_logprob);
+            }
+            if (finished[options.n - 1].cumulative_logprob >= best_live) {
+                live.clear();
+            }
+        }
+    }
+
+    // max_tokens == 0 leaves the empty hypothesis
+    for (auto& beam : live) {
+        beam.result.finish_reason = "length";
+        finished.push_back(std::move(beam.result));
+    }
+    std::stable_sort(finished.begin(), finished.end(), by_cumulative_logprob);
+    finished.resize(std::min<size_t>(options.n, finished.size()));
+    const double decode_seconds = seconds_since(decode_start);
+    for (auto& result : finished) {
+        result.prefill_seconds = prefill_seconds;
+        result.first_token_seconds = prefill_seconds;
+        result.decode_seconds = decode_seconds;
+    }
+    results = std::move(finished);
+    return true;
+}
+
+bool Engine::embed(const std::vector<std::vector<int32_t>>& inputs, const EmbeddingOptions& options,
+                   std::vector<float>& embeddings) {
+    CASTOR_TRACE_SCOPE("embed");
+    if (!initialized_) {
+        return false;
+    }
+    size_t total = 0;
+    for (const auto& input : inputs) {
+        if (input.empty()) {
+            return false;
+        }
+        total += input.size();
+    }
+
+    // Pack inputs in order until the next one would overflow the token budget;
+    // an input longer than the budget gets a batch of its own
+    const size_t dim = config_.hidden_dim;
+    embeddings.resize(inputs.size() * dim);
+    std::vector<int32_t> tokens;
+    std::vector<uint32_t> offsets{0};
+    tokens.reserve(std::min(total, options.max_batch_tokens));
+    size_t batch_start = 0;
+    for (size_t i = 0; i <= inputs.size(); ++i) {
+        const bool flush = i == inputs.size() || tokens.size() + inputs[i].size() > options.max_batch_tokens;
+        if (flush && !tokens.empty()) {
+            if (!embed_packed(tokens, offsets, options, embeddings.data() + batch_start * dim)) {
+                return false;
+            }
+            tokens.clear();
+            offsets.assign(1, 0);
+            batch_start = i;
+        }
+        if (i < inputs.size()) {
+            tokens.insert(tokens.end(), inputs[i].begin(), inputs[i].end());
+            offsets.push_back(static_cast<uint32_t>(tokens.size()));
+        }
+    }
+    Metrics::add(Counter::EmbeddingTokens, total);
+    return true;
+}
+
+bool Engine::embed_packed(const std::vector<int32_t>& tokens, const std::vector<uint32_t>& offsets,
+                          const EmbeddingOptions& options, float* out) {
+    CASTOR_TRACE_SCOPE("embed_batch");
+    ScopedTimer timer(Histogram::EmbeddingSeconds);
+
+    // TODO: One TensorRT pass over the packed tokens with cu_seqlens = offsets,
+    // skipping the LM head; the pooling/normalize epilogue runs in the final norm kernel
+
+    const size_t dim = config_.hidden_dim;
+    for (size_t i = 0; i + 1 < offsets.size(); ++i) {
+        const uint32_t begin = offsets[i];
+        const uint32_t end = offsets[i + 1];
+        float* row = out + i * dim;
+        std::fill(row, row + dim, 0.0f);
+
+        // Every position is processed, but only those pooling reads emit a hidden state
+        const uint32_t first = options.pooling == Pooling::Last ? end - 1 : begin;
+        const uint32_t last = options.pooling == Pooling::Cls ? begin + 1 : end;
+        SequenceState state;
+        if (!extend(state, tokens.data() + begin, first - begin)) {
+            return false;
+        }
+        for (uint32_t t = first; t < last; ++t) {
+            if (!extend(state, &tokens[t], 1)) {
+                return false;
+            }
+            reference_hidden(state, row);
+        }
+
+        const float weight = 1.0f / static_cast<float>(last - first);
+        float norm2 = 0.0f;
+        for (size_t d = 0; d < dim; ++d) {
+            row[d] *= weight;
+            norm2 += row[d] * row[d];
+        }
+        if (options.normalize && norm2 > 0.0f) {
+            const float scale = 1.0f / std::sqrt(norm2);
+            for (size_t d = 0; d < dim; ++d) {
+                row[d] *= scale;
+            }
+        }
+    }
+    return true;
+}
+
+void Engine::reference_logits(const SequenceState& state, std::vector<float>& output_logits) const {
+    // Pseudo-random but deterministic in the full context: identical token
+    // histories always produce identical logits, like a real model would.
+    // Cubing the uniform sample keeps a few clear favourites per position.
+    output_logits.resize(config_.vocab_size);
+    const uint64_t base = splitmix64(state.context_hash + state.length) ^ logit_seed_;
+    for (uint32_t v = 0; v < config_.vocab_size; ++v) {
+        const double u = static_cast<double>(splitmix64(base ^ (uint64_t{v} << 32)) >> 11) * 0x1.0p-53;
+        output_logits[v] = static_cast<float>(16.0 * u * u * u - 4.0);
+    }
+}
+
+void Engine::reference_hidden(const SequenceState& state, float* row) const {
+    // Same construction as reference_logits, salted so hidden states and logits differ
+    const uint64_t base = splitmix64(state.context_hash + state.length) ^ logit_seed_ ^ 0x48494444454E5354ULL;
+    for (uint32_t d = 0; d < config_.hidden_dim; ++d) {
+        const double u = static_cast<double>(splitmix64(base ^ (uint64_t{d} << 32)) >> 11) * 0x1.0p-53;
+        row[d] += static_cast<float>(2.0 * u - 1.0);
+    }
+}
+
+uint64_t Engine::reference_kv_seed(const SequenceState& state) const {
+    return splitmix64(state.context_hash + state.length) ^ logit_seed_ ^ 0x4B56434143484521ULL;
+}
+
 } // namespace castor
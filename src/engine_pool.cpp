@@ -0,0 +1,275 @@
+#include "engine_pool.hpp"
+#include "affinity.hpp"
+#include "hash.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <thread>
+
+namespace castor {
+
+namespace {
+
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+} // namespace
+
+EnginePool::Lease::Lease(Lease&& other) noexcept : pool_(other.pool_), replica_(other.replica_) {
+    other.pool_ = nullptr;
+    other.replica_ = nullptr;
+}
+
+EnginePool::Lease& EnginePool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        pool_ = other.pool_;
+        replica_ = other.replica_;
+        other.pool_ = nullptr;
+        other.replica_ = nullptr;
+    }
+    return *this;
+}
+
+EnginePool::Lease::~Lease() {
+    release();
+}
+
+void EnginePool::Lease::release() {
+    if (pool_ && replica_) {
+        pool_->release(replica_);
+    }
+    pool_ = nullptr;
+    replica_ = nullptr;
+}
+
+EnginePool::EnginePool(const Options& options) : options_(options) {}
+
+EnginePool::~EnginePool() = default;
+
+std::vector<std::pair<int, std::vector<int>>> EnginePool::plan_placement(size_t replicas) {
+    std::vector<std::pair<int, std::vector<int>>> nodes;
+    const int node_count = Affinity::numa_node_count();
+    for (int node = 0; node < node_count; ++node) {
+        std::vector<int> cpus = Affinity::node_cpus(node);
+        if (!cpus.empty()) {
+            nodes.emplace_back(node, std::move(cpus));
+        }
+    }
+    if (replicas == 0) {
+        replicas = std::max<size_t>(1, nodes.size());
+    }
+    std::vector<std::pair<int, std::vector<int>>> placement(replicas, {-1, {}});
+    if (nodes.empty()) {
+        return placement;
+    }
+
+    // Replica i goes to node i % N; replicas sharing a node split its CPUs into contiguous slices
+    for (size_t i = 0; i < replicas; ++i) {
+        const auto& [node, cpus] = nodes[i % nodes.size()];
+        const size_t sharing = replicas / nodes.size() + (i % nodes.size() < replicas % nodes.size() ? 1 : 0);
+        const size_t slot = i / nodes.size();
+        const size_t slice = cpus.size() / sharing;
+        placement[i].first = node;
+        if (slice == 0) {
+            placement[i].second = cpus; // More replicas than CPUs: they overlap
+            continue;
+        }
+        const auto first = cpus.begin() + slot * slice;
+        const auto last = slot + 1 == sharing ? cpus.end() : first + slice;
+        placement[i].second.assign(first, last);
+    }
+    return placement;
+}
+
+bool EnginePool::initialize(const std::string& engine_path, const ModelConfig& config,
+                            const std::shared_ptr<Tokenizer>& tokenizer, const KernelSet* kernels) {
+    if (!replicas_.empty()) {
+        return false; // Already initialized
+    }
+    const auto placement = plan_placement(options_.replicas);
+    std::vector<std::unique_ptr<Replica>> replicas(placement.size());
+    std::vector<char> ok(placement.size(), 0);
+
+    // Each replica is built on a thread confined to its node: memory the engine touches lands on
+    // local DRAM, and the scheduler thread it starts inherits the CPU mask and memory policy
+    std::vector<std::thread> builders;
+    builders.reserve(placement.size());
+    for (size_t i = 0; i < placement.size(); ++i) {
+        builders.emplace_back([&, i]() {
+            auto replica = std::make_unique<Replica>();
+            replica->index = i;
+            if (options_.numa_local && placement[i].first >= 0 && Affinity::pin_current_thread(placement[i].second)) {
+                replica->node = placement[i].first;
+                replica->cpus = placement[i].second;
+                Affinity::prefer_local_memory(replica->node);
+            }
+            replica->engine = std::make_shared<Engine>();
+            if (tokenizer) {
+                replica->engine->set_tokenizer(tokenizer);
+            }
+            if (!replica->engine->initialize(engine_path, config, kernels)) {
+                return;
+            }
+            WorkerPool::Options workers;
+            workers.threads = options_.threads_per_replica;
+            if (workers.threads == 0) {
+                const size_t cpus = replica->cpus.empty() ? std::thread::hardware_concurrency() / placement.size()
+                                                          : replica->cpus.size();
+                workers.threads = std::max<size_t>(1, cpus);
+            }
+            workers.cpus = replica->cpus;
+            workers.numa_local = options_.numa_local;
+            replica->workers = std::make_shared<WorkerPool>(workers);
+            if (options_.scheduler_enabled) {
+                replica->scheduler = std::make_shared<Scheduler>(replica->engine, options_.scheduler, replica->workers);
+            }
+            replicas[i] = std::move(replica);
+            ok[i] = 1;
+        });
+    }
+    for (auto& builder : builders) {
+        builder.join();
+    }
+    for (size_t i = 0; i < ok.size(); ++i) {
+        if (!ok[i]) {
+            std::cerr << "[EnginePool] Replica " << i << " failed to initialize\n";
+            return false;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    replicas_ = std::move(replicas);
+    loads_.assign(replicas_.size(), Load());
+    const Clock::time_point now = Clock::now();
+    for (auto& load : loads_) {
+        load.updated = now;
+    }
+    for (const auto& replica : replicas_) {
+        std::cout << "[EnginePool] Replica " << replica->index << ": ";
+        if (replica->node >= 0) {
+            std::cout << "node " << replica->node << ", CPUs " << Affinity::format_cpu_list(replica->cpus);
+        } else {
+            std::cout << "unpinned";
+        }
+        std::cout << ", " << replica->workers->size() << " workers\n";
+    }
+    return true;
+}
+
+uint64_t EnginePool::affinity_key(const std::vector<int32_t>& tokens) const {
+    const size_t count = std::min(tokens.size(), options_.affinity_tokens);
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t key = XXH64::hash(tokens.data(), count * sizeof(int32_t));
+    return key != 0 ? key : 1;
+}
+
+uint64_t EnginePool::affinity_key(const std::string& session) {
+    const uint64_t key = XXH64::hash(session.data(), session.size(), 0x53455353494F4E53ULL);
+    return key != 0 ? key : 1;
+}
+
+void EnginePool::advance(Load& load, Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - load.updated).count();
+    if (elapsed <= 0.0) {
+        return;
+    }
+    const double busy = load.in_flight > 0 ? 1.0 : 0.0;
+    const double decay = std::exp(-elapsed / std::chrono::duration<double>(utilization_window).count());
+    load.busy_seconds += busy * elapsed;
+    load.utilization = load.utilization * decay + busy * (1.0 - decay);
+    load.updated = now;
+}
+
+EnginePool::Lease EnginePool::acquire(uint64_t key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (replicas_.empty()) {
+        return Lease();
+    }
+
+    // Least loaded by requests in flight, then by requests served
+    size_t least = 0;
+    for (size_t i = 1; i < loads_.size(); ++i) {
+        const Load& a = loads_[i];
+        const Load& b = loads_[least];
+        if (a.in_flight < b.in_flight || (a.in_flight == b.in_flight && a.requests < b.requests)) {
+            least = i;
+        }
+    }
+
+    size_t chosen = least;
+    bool preferred = false;
+    if (key != 0 && options_.affinity_tokens > 0) {
+        // Rendezvous hashing: adding or removing a replica only moves the keys that preferred it
+        size_t best = 0;
+        uint64_t best_score = 0;
+        for (size_t i = 0; i < replicas_.size(); ++i) {
+            const uint64_t score = splitmix64(key ^ splitmix64(i + 1));
+            if (i == 0 || score > best_score) {
+                best = i;
+                best_score = score;
+            }
+        }
+        if (loads_[best].in_flight <= loads_[least].in_flight + options_.affinity_slack) {
+            chosen = best;
+            preferred = true;
+            Metrics::add(Counter::ReplicaAffinityRoutes);
+        } else {
+            Metrics::add(Counter::ReplicaRebalancedRoutes);
+        }
+    }
+
+    Load& load = loads_[chosen];
+    advance(load, Clock::now());
+    ++load.in_flight;
+    ++load.requests;
+    if (preferred) {
+        ++load.affinity_routes;
+    }
+    return Lease(this, replicas_[chosen].get());
+}
+
+void EnginePool::release(const Replica* replica) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Load& load = loads_[replica->index];
+    advance(load, Clock::now());
+    --load.in_flight;
+}
+
+std::vector<EnginePool::ReplicaStatus> EnginePool::status() const {
+    std::vector<ReplicaStatus> out;
+    std::vector<Load> loads;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        loads = loads_;
+    }
+    const Clock::time_point now = Clock::now();
+    out.reserve(replicas_.size());
+    for (size_t i = 0; i < replicas_.size(); ++i) {
+        const Replica& replica = *replicas_[i];
+        Load& load = loads[i];
+        advance(load, now);
+        ReplicaStatus status;
+        status.index = replica.index;
+        status.node = replica.node;
+        status.cpus = replica.cpus;
+        status.in_flight = load.in_flight;
+        status.requests = load.requests;
+        status.affinity_routes = load.affinity_routes;
+        status.busy_seconds = load.busy_seconds;
+        status.utilization = load.utilization;
+        status.worker_queue = replica.workers->pending();
+        status.memory = replica.engine->memory_report();
+        out.push_back(std::move(status));
+    }
+    return out;
+}
+
+} // namespace castor
@@ -0,0 +1,955 @@
+#include "grammar.hpp"
+#include "kernels.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <deque>
+#include <list>
+#include <map>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define CASTOR_GRAMMAR_X86 1
+#define CASTOR_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace castor {
+
+namespace {
+
+constexpr size_t kMaxNfaStates = 200000;
+constexpr size_t kMaxDfaStates = 20000;
+constexpr int kMaxSchemaDepth = 32;
+constexpr size_t kCompiledCacheEntries = 64;
+
+using ByteSet = std::bitset<256>;
+
+// ============ Regex -> NFA (Thompson construction) ============
+
+struct NfaState {
+    ByteSet bytes;            // Consuming edge to `next` on any of these bytes
+    int32_t next = -1;
+    std::vector<int32_t> eps; // Epsilon edges
+};
+
+struct Fragment {
+    int32_t start;
+    int32_t end; // Has no outgoing edges yet
+};
+
+class RegexParser {
+public:
+    explicit RegexParser(const std::string& pattern) : pattern_(pattern) {}
+
+    bool parse(std::vector<NfaState>& states, int32_t& start, int32_t& accept, std::string& error) {
+        Fragment whole;
+        if (!parse_alternation(whole)) {
+            error = error_;
+            return false;
+        }
+        if (pos_ != pattern_.size()) {
+            error = "Unexpected '" + std::string(1, pattern_[pos_]) + "' at offset " + std::to_string(pos_);
+            return false;
+        }
+        states = std::move(states_);
+        start = whole.start;
+        accept = whole.end;
+        return true;
+    }
+
+private:
+    bool fail(const std::string& message) {
+        if (error_.empty()) {
+            error_ = message + " at offset " + std::to_string(pos_);
+        }
+        return false;
+    }
+
+    int32_t new_state() {
+        states_.emplace_back();
+        return static_cast<int32_t>(states_.size() - 1);
+    }
+
+    Fragment empty() {
+        const int32_t s = new_state();
+        const int32_t e = new_state();
+        states_[s].eps.push_back(e);
+        return {s, e};
+    }
+
+    Fragment bytes(const ByteSet& set) {
+        const int32_t s = new_state();
+        const int32_t e = new_state();
+        states_[s].bytes = set;
+        states_[s].next = e;
+        return {s, e};
+    }
+
+    Fragment concat(Fragment a, Fragment b) {
+        states_[a.end].eps.push_back(b.start);
+        return {a.start, b.end};
+    }
+
+    Fragment alternate(Fragment a, Fragment b) {
+        const int32_t s = new_state();
+        const int32_t e = new_state();
+        states_[s].eps = {a.start, b.start};
+        states_[a.end].eps.push_back(e);
+        states_[b.end].eps.push_back(e);
+        return {s, e};
+    }
+
+    // min = 0 or 1 repetitions, unbounded: a* or a+
+    Fragment loop(Fragment a, bool at_least_one) {
+        const int32_t s = new_state();
+        const int32_t e = new_state();
+        states_[s].eps.push_back(a.start);
+        if (!at_least_one) {
+            states_[s].eps.push_back(e);
+        }
+        states_[a.end].eps.push_back(a.start);
+        states_[a.end].eps.push_back(e);
+        return {s, e};
+    }
+
+    Fragment optional(Fragment a) {
+        const int32_t s = new_state();
+        const int32_t e = new_state();
+        states_[s].eps = {a.start, e};
+        states_[a.end].eps.push_back(e);
+        return {s, e};
+    }
+
+    bool parse_alternation(Fragment& out) {
+        if (!parse_sequence(out)) {
+            return false;
+        }
+        while (pos_ < pattern_.size() && pattern_[pos_] == '|') {
+            ++pos_;
+            Fragment rhs;
+            if (!parse_sequence(rhs)) {
+                return false;
+            }
+            out = alternate(out, rhs);
+        }
+        return true;
+    }
+
+    bool parse_sequence(Fragment& out) {
+        out = empty();
+        while (pos_ < pattern_.size() && pattern_[pos_] != '|' && pattern_[pos_] != ')') {
+            Fragment piece;
+            if (!parse_repeat(piece)) {
+                return false;
+            }
+            out = concat(out, piece);
+        }
+        return true;
+    }
+
+    // {m}, {m,}, {m,n}: the atom is re-parsed once per copy
+    bool parse_repeat(Fragment& out) {
+        const size_t atom_pos = pos_;
+        if (!parse_atom(out)) {
+            return false;
+        }
+        bool quantified = false;
+        while (pos_ < pattern_.size()) {
+            const char c = pattern_[pos_];
+            if (c == '*' || c == '+' || c == '?') {
+                ++pos_;
+                out = c == '?' ? optional(out) : loop(out, c == '+');
+                quantified = true;
+                continue;
+            }
+            if (c != '{') {
+                return true;
+            }
+            if (quantified) {
+                return fail("Counted repetition of a quantified atom; use a group");
+            }
+            quantified = true;
+            size_t min = 0;
+            size_t max = 0;
+            bool bounded = true;
+            if (!parse_bounds(min, max, bounded)) {
+                return false;
+            }
+            const size_t after = pos_;
+            const size_t copies = bounded ? max : min + 1; // {m,} is m copies then a star
+            if (copies * (states_.size() + 1) > kMaxNfaStates) {
+                return fail("Repetition too large");
+            }
+            Fragment result = empty();
+            for (size_t i = 0; i < copies; ++i) {
+                Fragment copy;
+                pos_ = atom_pos;
+                parse_atom(copy); // Parsed successfully once already
+                if (i < min) {
+                    result = concat(result, copy);
+                } else if (bounded) {
+                    result = concat(result, optional(copy));
+                } else {
+                    result = concat(result, loop(copy, false));
+                }
+            }
+            pos_ = after;
+            out = result;
+        }
+        return true;
+    }
+
+    bool parse_number(size_t& value) {
+        const size_t begin = pos_;
+        value = 0;
+        while (pos_ < pattern_.size() && pattern_[pos_] >= '0' && pattern_[pos_] <= '9') {
+            value = value * 10 + static_cast<size_t>(pattern_[pos_] - '0');
+            if (value > 100000) {
+                return fail("Repetition count too large");
+            }
+            ++pos_;
+        }
+        return pos_ > begin || fail("Expected a number");
+    }
+
+    bool parse_bounds(size_t& min, size_t& max, bool& bounded) {
+        ++pos_; // '{'
+        if (!parse_number(min)) {
+            return false;
+        }
+        max = min;
+        bounded = true;
+        if (pos_ < pattern_.size() && pattern_[pos_] == ',') {
+            ++pos_;
+            if (pos_ < pattern_.size() && pattern_[pos_] == '}') {
+                bounded = false;
+            } else if (!parse_number(max)) {
+                return false;
+            }
+        }
+        if (pos_ >= pattern_.size() || pattern_[pos_] != '}') {
+            return fail("Expected '}'");
+        }
+        ++pos_;
+        if (bounded && max < min) {
+            return fail("Repetition maximum below minimum");
+        }
+        return true;
+    }
+
+    bool parse_atom(Fragment& out) {
+        if (pos_ >= pattern_.size()) {
+            return fail("Unexpected end of pattern");
+        }
+        const char c = pattern_[pos_];
+        if (c == '(') {
+            ++pos_;
+            if (pattern_.compare(pos_, 2, "?:") == 0) {
+                pos_ += 2;
+            }
+            if (!parse_alternation(out)) {
+                return false;
+            }
+            if (pos_ >= pattern_.size() || pattern_[pos_] != ')') {
+                return fail("Expected ')'");
+            }
+            ++pos_;
+            return true;
+        }
+        ByteSet set;
+        if (c == '[') {
+            if (!parse_class(set)) {
+                return false;
+            }
+        } else if (c == '.') {
+            ++pos_;
+            set.set();
+            set.reset('\n');
+        } else if (c == '\\') {
+            ++pos_;
+            if (!parse_escape(set)) {
+                return false;
+            }
+        } else if (c == '*' || c == '+' || c == '?' || c == '{' || c == ')' || c == '^' || c == '$') {
+            return fail("Unsupported or misplaced '" + std::string(1, c) + "'");
+        } else {
+            ++pos_;
+            set.set(static_cast<uint8_t>(c));
+        }
+        out = bytes(set);
+        return true;
+    }
+
+    static int hex_value(char c) {
+        if (c >= '0' && c <= '9') return c - '0';
+        if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+        if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+        return -1;
+    }
+
+    // Called after the backslash
+    bool parse_escape(ByteSet& set) {
+        if (pos_ >= pattern_.size()) {
+            return fail("Dangling escape");
+        }
+        const char c = pattern_[pos_++];
+        ByteSet cls;
+        switch (c) {
+        case 'd':
+        case 'D':
+            for (int b = '0'; b <= '9'; ++b) cls.set(b);
+            break;
+        case 'w':
+        case 'W':
+            for (int b = '0'; b <= '9'; ++b) cls.set(b);
+            for (int b = 'a'; b <= 'z'; ++b) cls.set(b);
+            for (int b = 'A'; b <= 'Z'; ++b) cls.set(b);
+            cls.set('_');
+            break;
+        case 's':
+        case 'S':
+            for (char b : {' ', '\t', '\n', '\r', '\f', '\v'}) cls.set(static_cast<uint8_t>(b));
+            break;
+        case 'n':
+            set.set('\n');
+            return true;
+        case 't':
+            set.set('\t');
+            return true;
+        case 'r':
+            set.set('\r');
+            return true;
+        case 'f':
+            set.set('\f');
+            return true;
+        case 'v':
+            set.set('\v');
+            return true;
+        case 'x': {
+            const int hi = pos_ < pattern_.size() ? hex_value(pattern_[pos_]) : -1;
+            const int lo = pos_ + 1 < pattern_.size() ? hex_value(pattern_[pos_ + 1]) : -1;
+            if (hi < 0 || lo < 0) {
+                return fail("Expected two hex digits after \\x");
+            }
+            pos_ += 2;
+            set.set(static_cast<size_t>(hi * 16 + lo));
+            return true;
+        }
+        default:
+            if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')) {
+                return fail("Unsupported escape \\" + std::string(1, c));
+            }
+            set.set(static_cast<uint8_t>(c));
+            return true;
+        }
+        set |= (c >= 'A' && c <= 'Z') ? ~cls : cls;
+        return true;
+    }
+
+    bool parse_class(ByteSet& set) {
+        ++pos_; // '['
+        bool negate = false;
+        if (pos_ < pattern_.size() && pattern_[pos_] == '^') {
+            negate = true;
+            ++pos_;
+        }
+        bool first = true;
+        while (pos_ < pattern_.size() && (pattern_[pos_] != ']' || first)) {
+            first = false;
+            ByteSet item;
+            int lo = -1;
+            if (pattern_[pos_] == '\\') {
+                ++pos_;
+                if (!parse_escape(item)) {
+                    return false;
+                }
+                if (item.count() == 1) {
+                    for (int b = 0; b < 256; ++b) {
+                        if (item.test(b)) lo = b;
+                    }
+                }
+            } else {
+                lo = static_cast<uint8_t>(pattern_[pos_++]);
+                item.set(lo);
+            }
+            // Range a-z (a trailing '-' is literal)
+            if (lo >= 0 && pos_ + 1 < pattern_.size() && pattern_[pos_] == '-' && pattern_[pos_ + 1] != ']') {
+                ++pos_;
+                ByteSet upper;
+                int hi = -1;
+                if (pattern_[pos_] == '\\') {
+                    ++pos_;
+                    if (!parse_escape(upper) || upper.count() != 1) {
+                        return fail("Invalid class range");
+                    }
+                    for (int b = 0; b < 256; ++b) {
+                        if (upper.test(b)) hi = b;
+                    }
+                } else {
+                    hi = static_cast<uint8_t>(pattern_[pos_++]);
+                }
+                if (hi < lo) {
+                    return fail("Invalid class range");
+                }
+                for (int b = lo; b <= hi; ++b) item.set(b);
+            }
+            set |= item;
+        }
+        if (pos_ >= pattern_.size()) {
+            return fail("Expected ']'");
+        }
+        ++pos_;
+        if (negate) {
+            set.flip();
+        }
+        return true;
+    }
+
+    const std::string& pattern_;
+    size_t pos_ = 0;
+    std::vector<NfaState> states_;
+    std::string error_;
+};
+
+void epsilon_closure(const std::vector<NfaState>& nfa, std::vector<int32_t>& set, std::vector<uint32_t>& mark,
+                     uint32_t stamp) {
+    for (int32_t s : set) mark[s] = stamp;
+    for (size_t i = 0; i < set.size(); ++i) {
+        for (int32_t t : nfa[set[i]].eps) {
+            if (mark[t] != stamp) {
+                mark[t] = stamp;
+                set.push_back(t);
+            }
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+// ============ JSON schema -> regex ============
+
+const char* const kJsonStringChar = R"(([^"\\\x00-\x1f]|\\["\\/bfnrt]|\\u[0-9a-fA-F]{4}))";
+const char* const kJsonInteger = R"(-?(0|[1-9][0-9]*))";
+const char* const kJsonNumber = R"(-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?)";
+
+std::string escape_literal(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() * 2);
+    for (char c : text) {
+        if (std::string_view("\\.^$|?*+()[]{}").find(c) != std::string_view::npos) {
+            out += '\\';
+        }
+        out += c;
+    }
+    return out;
+}
+
+std::string repeat_bounds(size_t min, const nlohmann::json& max) {
+    return "{" + std::to_string(min) + "," + (max.is_number_unsigned() ? std::to_string(max.get<size_t>()) : "") +
+           "}";
+}
+
+bool schema_regex(const nlohmann::json& schema, int depth, std::string& out, std::string& error);
+
+bool alternatives_regex(const nlohmann::json& list, int depth, std::string& out, std::string& error) {
+    if (!list.is_array() || list.empty()) {
+        error = "anyOf/oneOf must be a non-empty array";
+        return false;
+    }
+    out = "(";
+    for (size_t i = 0; i < list.size(); ++i) {
+        std::string branch;
+        if (!schema_regex(list[i], depth + 1, branch, error)) {
+            return false;
+        }
+        out += (i ? "|" : "") + branch;
+    }
+    out += ")";
+    return true;
+}
+
+// Properties are emitted in order; optional ones may be skipped. Commas go
+// before every property except the first one present.
+bool object_regex(const nlohmann::json& schema, int depth, std::string& out, std::string& error) {
+    if (!schema.contains("properties") || !schema["properties"].is_object()) {
+        error = "Object schemas need 'properties'";
+        return false;
+    }
+    std::vector<std::string> members;
+    std::vector<bool> required;
+    const nlohmann::json required_list = schema.value("required", nlohmann::json::array());
+    for (const auto& [name, property] : schema["properties"].items()) {
+        std::string value;
+        if (!schema_regex(property, depth + 1, value, error)) {
+            return false;
+        }
+        members.push_back(escape_literal(nlohmann::json(name).dump()) + ":" + value);
+        required.push_back(std::find(required_list.begin(), required_list.end(), name) != required_list.end());
+    }
+
+    // tail[i]: members i.. each preceded by a comma, optional ones skippable
+    std::vector<std::string> tail(members.size() + 1);
+    for (size_t i = members.size(); i-- > 0;) {
+        tail[i] = (required[i] ? "," + members[i] : "(," + members[i] + ")?") + tail[i + 1];
+    }
+    std::string body;
+    bool any_required = false;
+    for (size_t i = 0; i < members.size(); ++i) {
+        body += (body.empty() ? "" : "|") + members[i] + tail[i + 1];
+        if (required[i]) {
+            any_required = true;
+            break; // A required member cannot be skipped, so it bounds the first one present
+        }
+    }
+    out = "\\{";
+    if (!body.empty()) {
+        out += "(" + body + ")" + (any_required ? "" : "?");
+    }
+    out += "\\}";
+    return true;
+}
+
+bool type_regex(const std::string& type, const nlohmann::json& schema, int depth, std::string& out,
+                std::string& error) {
+    if (type == "string") {
+        if (schema.contains("pattern")) {
+            out = "\"(" + schema["pattern"].get<std::string>() + ")\"";
+        } else if (schema.contains("minLength") || schema.contains("maxLength")) {
+            out = "\"" + std::string(kJsonStringChar) +
+                  repeat_bounds(schema.value("minLength", size_t{0}), schema.value("maxLength", nlohmann::json())) +
+                  "\"";
+        } else {
+            out = "\"" + std::string(kJsonStringChar) + "*\"";
+        }
+    } else if (type == "integer") {
+        out = kJsonInteger;
+    } else if (type == "number") {
+        out = kJsonNumber;
+    } else if (type == "boolean") {
+        out = "(true|false)";
+    } else if (type == "null") {
+        out = "null";
+    } else if (type == "array") {
+        std::string item;
+        if (!schema.contains("items") || !schema_regex(schema["items"], depth + 1, item, error)) {
+            if (error.empty()) error = "Array schemas need 'items'";
+            return false;
+        }
+        const size_t min = schema.value("minItems", size_t{0});
+        const nlohmann::json max = schema.value("maxItems", nlohmann::json());
+        if (max.is_number_unsigned() && max.get<size_t>() == 0) {
+            out = "\\[\\]";
+        } else if (min == 0) {
+            const nlohmann::json rest = max.is_number_unsigned() ? nlohmann::json(max.get<size_t>() - 1) : max;
+            out = "\\[(" + item + "(," + item + ")" + repeat_bounds(0, rest) + ")?\\]";
+        } else {
+            const nlohmann::json rest = max.is_number_unsigned() ? nlohmann::json(max.get<size_t>() - 1) : max;
+            out = "\\[" + item + "(," + item + ")" + repeat_bounds(min - 1, rest) + "\\]";
+        }
+    } else if (type == "object") {
+        return object_regex(schema, depth, out, error);
+    } else {
+        error = "Unsupported type '" + type + "'";
+        return false;
+    }
+    return true;
+}
+
+bool schema_regex(const nlohmann::json& schema, int depth, std::string& out, std::string& error) {
+    if (depth > kMaxSchemaDepth) {
+        error = "Schema nested too deeply";
+        return false;
+    }
+    if (!schema.is_object()) {
+        error = "Schema must be an object";
+        return false;
+    }
+    if (schema.contains("$ref")) {
+        error = "'$ref' is not supported";
+        return false;
+    }
+    if (schema.contains("const")) {
+        out = escape_literal(schema["const"].dump());
+        return true;
+    }
+    if (schema.contains("enum")) {
+        const nlohmann::json& values = schema["enum"];
+        if (!values.is_array() || values.empty()) {
+            error = "'enum' must be a non-empty array";
+            return false;
+        }
+        out = "(";
+        for (size_t i = 0; i < values.size(); ++i) {
+            out += (i ? "|" : "") + escape_literal(values[i].dump());
+        }
+        out += ")";
+        return true;
+    }
+    if (schema.contains("anyOf")) {
+        return alternatives_regex(schema["anyOf"], depth, out, error);
+    }
+    if (schema.contains("oneOf")) {
+        return alternatives_regex(schema["oneOf"], depth, out, error);
+    }
+    if (!schema.contains("type")) {
+        error = "Schema needs 'type', 'enum', 'const', 'anyOf' or 'oneOf'";
+        return false;
+    }
+    const nlohmann::json& type = schema["type"];
+    if (type.is_string()) {
+        return type_regex(type.get<std::string>(), schema, depth, out, error);
+    }
+    if (!type.is_array() || type.empty()) {
+        error = "'type' must be a string or a non-empty array";
+        return false;
+    }
+    out = "(";
+    for (size_t i = 0; i < type.size(); ++i) {
+        std::string branch;
+        if (!type[i].is_string() || !type_regex(type[i].get<std::string>(), schema, depth, branch, error)) {
+            if (error.empty()) error = "'type' entries must be strings";
+            return false;
+        }
+        out += (i ? "|" : "") + branch;
+    }
+    out += ")";
+    return true;
+}
+
+// ============ Compiled constraint cache ============
+
+struct CacheEntry {
+    std::string key;
+    std::shared_ptr<const TokenMasks> masks;
+    std::shared_ptr<const TokenMasks::Vocabulary> vocabulary; // Keeps the keyed pointer alive
+};
+
+std::mutex g_cache_mutex;
+std::list<CacheEntry> g_cache; // Most recently used first
+
+} // namespace
+
+std::shared_ptr<const Grammar> Grammar::from_regex(const std::string& pattern, std::string& error) {
+    std::vector<NfaState> nfa;
+    int32_t nfa_start = 0;
+    int32_t nfa_accept = 0;
+    RegexParser parser(pattern);
+    if (!parser.parse(nfa, nfa_start, nfa_accept, error)) {
+        return nullptr;
+    }
+    if (nfa.size() > kMaxNfaStates) {
+        error = "Pattern too large";
+        return nullptr;
+    }
+
+    // Subset construction
+    auto grammar = std::make_shared<Grammar>();
+    std::map<std::vector<int32_t>, int32_t> index;
+    std::vector<std::vector<int32_t>> subsets;
+    std::vector<uint32_t> mark(nfa.size(), 0);
+    uint32_t stamp = 0;
+
+    std::vector<int32_t> initial{nfa_start};
+    epsilon_closure(nfa, initial, mark, ++stamp);
+    index.emplace(initial, 0);
+    subsets.push_back(std::move(initial));
+
+    std::vector<int32_t> target;
+    for (size_t d = 0; d < subsets.size(); ++d) {
+        grammar->transitions_.resize((d + 1) * 256, kDead);
+        grammar->accepting_.push_back(std::binary_search(subsets[d].begin(), subsets[d].end(), nfa_accept));
+        for (int byte = 0; byte < 256; ++byte) {
+            target.clear();
+            ++stamp;
+            for (int32_t s : subsets[d]) {
+                if (nfa[s].next >= 0 && nfa[s].bytes.test(byte) && mark[nfa[s].next] != stamp) {
+                    mark[nfa[s].next] = stamp;
+                    target.push_back(nfa[s].next);
+                }
+            }
+            if (target.empty()) {
+                continue;
+            }
+            epsilon_closure(nfa, target, mark, ++stamp);
+            auto [it, inserted] = index.emplace(target, static_cast<int32_t>(subsets.size()));
+            if (inserted) {
+                if (subsets.size() >= kMaxDfaStates) {
+                    error = "Pattern needs more than " + std::to_string(kMaxDfaStates) + " automaton states";
+                    return nullptr;
+                }
+                subsets.push_back(target);
+            }
+            grammar->transitions_[d * 256 + byte] = it->second;
+        }
+    }
+
+    // Drop states that cannot reach acceptance
+    const size_t count = subsets.size();
+    std::vector<std::vector<int32_t>> reverse(count);
+    for (size_t d = 0; d < count; ++d) {
+        for (int byte = 0; byte < 256; ++byte) {
+            const int32_t t = grammar->transitions_[d * 256 + byte];
+            if (t != kDead) reverse[t].push_back(static_cast<int32_t>(d));
+        }
+    }
+    std::vector<uint8_t> live(count, 0);
+    std::deque<int32_t> queue;
+    for (size_t d = 0; d < count; ++d) {
+        if (grammar->accepting_[d]) {
+            live[d] = 1;
+            queue.push_back(static_cast<int32_t>(d));
+        }
+    }
+    while (!queue.empty()) {
+        const int32_t d = queue.front();
+        queue.pop_front();
+        for (int32_t p : reverse[d]) {
+            if (!live[p]) {
+                live[p] = 1;
+                queue.push_back(p);
+            }
+        }
+    }
+    if (!live[0]) {
+        error = "Pattern matches nothing";
+        return nullptr;
+    }
+    grammar->has_exits_.assign(count, 0);
+    for (size_t d = 0; d < count; ++d) {
+        for (int byte = 0; byte < 256; ++byte) {
+            int32_t& t = grammar->transitions_[d * 256 + byte];
+            if (t != kDead && !live[t]) {
+                t = kDead;
+            }
+            grammar->has_exits_[d] |= t != kDead;
+        }
+    }
+    return grammar;
+}
+
+bool Grammar::json_schema_regex(const nlohmann::json& schema, std::string& regex, std::string& error) {
+    return schema_regex(schema, 0, regex, error);
+}
+
+std::shared_ptr<const Grammar> Grammar::from_json_schema(const nlohmann::json& schema, std::string& error) {
+    std::string regex;
+    if (!json_schema_regex(schema, regex, error)) {
+        return nullptr;
+    }
+    return from_regex(regex, error);
+}
+
+TokenMasks::TokenMasks(std::shared_ptr<const Grammar> grammar, std::shared_ptr<const Vocabulary> vocabulary,
+                       uint32_t vocab_size, int32_t eos_token_id)
+    : grammar_(std::move(grammar)),
+      vocabulary_(std::move(vocabulary)),
+      vocab_size_(vocab_size),
+      eos_token_id_(eos_token_id),
+      masks_(new std::atomic<const Mask*>[grammar_->state_count()]) {
+    for (size_t s = 0; s < grammar_->state_count(); ++s) {
+        masks_[s].store(nullptr, std::memory_order_relaxed);
+    }
+    const size_t usable = std::min<size_t>(vocabulary_->size(), vocab_size_);
+    sorted_ids_.reserve(usable);
+    for (size_t id = 0; id < usable; ++id) {
+        if (!(*vocabulary_)[id].empty() && static_cast<int32_t>(id) != eos_token_id_) {
+            sorted_ids_.push_back(static_cast<int32_t>(id));
+        }
+    }
+    std::sort(sorted_ids_.begin(), sorted_ids_.end(),
+              [this](int32_t a, int32_t b) { return (*vocabulary_)[a] < (*vocabulary_)[b]; });
+}
+
+TokenMasks::~TokenMasks() = default;
+
+const TokenMasks::Mask& TokenMasks::mask(int32_t state) const {
+    const Mask* cached = masks_[state].load(std::memory_order_acquire);
+    if (cached) {
+        return *cached;
+    }
+    std::lock_guard<std::mutex> lock(build_mutex_);
+    cached = masks_[state].load(std::memory_order_relaxed);
+    if (!cached) {
+        auto built = std::make_unique<Mask>();
+        build(state, *built);
+        cached = built.get();
+        owned_.push_back(std::move(built));
+        masks_[state].store(cached, std::memory_order_release);
+        Metrics::add(Counter::GrammarMaskBuilds);
+    }
+    return *cached;
+}
+
+// Walk the tokens in byte order, reusing the automaton states of the prefix
+// shared with the previous token. Once a byte kills the walk, every following
+// token that shares the prefix up to that byte is skipped without walking.
+void TokenMasks::build(int32_t state, Mask& out) const {
+    out.bits.assign((vocab_size_ + 63) / 64, 0);
+    std::vector<int32_t> path{state}; // path[i]: state after the first i bytes of `previous`
+    std::string_view previous;
+    size_t dead_at = std::string_view::npos; // Byte index at which `previous` died
+    for (int32_t id : sorted_ids_) {
+        const std::string_view text = (*vocabulary_)[id];
+        size_t common = 0;
+        const size_t limit = std::min(text.size(), previous.size());
+        while (common < limit && text[common] == previous[common]) ++common;
+        previous = text;
+        if (dead_at != std::string_view::npos && common > dead_at) {
+            continue;
+        }
+        dead_at = std::string_view::npos;
+        path.resize(std::min(path.size(), common + 1));
+        for (size_t i = path.size() - 1; i < text.size(); ++i) {
+            const int32_t next = grammar_->next(path.back(), static_cast<uint8_t>(text[i]));
+            if (next == Grammar::kDead) {
+                dead_at = i;
+                break;
+            }
+            path.push_back(next);
+        }
+        if (dead_at == std::string_view::npos) {
+            out.bits[id >> 6] |= uint64_t{1} << (id & 63);
+            out.any = true;
+        }
+    }
+    if (grammar_->accepting(state) && eos_token_id_ >= 0 && static_cast<uint32_t>(eos_token_id_) < vocab_size_) {
+        out.bits[eos_token_id_ >> 6] |= uint64_t{1} << (eos_token_id_ & 63);
+        out.any = true;
+    }
+}
+
+int32_t TokenMasks::advance(int32_t state, int32_t token) const {
+    if (state == Grammar::kDead || token < 0 || static_cast<uint32_t>(token) >= vocab_size_) {
+        return Grammar::kDead;
+    }
+    if (token == eos_token_id_) {
+        return grammar_->accepting(state) ? state : Grammar::kDead;
+    }
+    if (static_cast<size_t>(token) >= vocabulary_->size() || (*vocabulary_)[token].empty()) {
+        return Grammar::kDead;
+    }
+    for (char c : (*vocabulary_)[token]) {
+        state = grammar_->next(state, static_cast<uint8_t>(c));
+        if (state == Grammar::kDead) {
+            break;
+        }
+    }
+    return state;
+}
+
+void TokenMasks::apply(int32_t state, std::vector<float>& logits) const {
+    const Mask& m = mask(state);
+    apply_mask(m.bits.data(), logits.data(), std::min<size_t>(logits.size(), vocab_size_));
+    std::fill(logits.begin() + std::min<size_t>(logits.size(), vocab_size_), logits.end(), -INFINITY);
+}
+
+namespace {
+
+// Sets block[i] to -inf for each clear bit i of a partially allowed word
+void mask_word_generic(uint64_t word, float* block) {
+    for (size_t i = 0; i < 64; ++i) {
+        if (!((word >> i) & 1)) {
+            block[i] = -INFINITY;
+        }
+    }
+}
+
+#ifdef CASTOR_GRAMMAR_X86
+// Eight logits per step: broadcast a byte of the word, test one bit per lane, blend
+CASTOR_AVX2 void mask_word_avx2(uint64_t word, float* block) {
+    const __m256i lane_bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    const __m256 masked = _mm256_set1_ps(-INFINITY);
+    for (size_t i = 0; i < 64; i += 8) {
+        const __m256i byte = _mm256_set1_epi32(static_cast<int>((word >> i) & 0xFF));
+        const __m256i keep = _mm256_cmpeq_epi32(_mm256_and_si256(byte, lane_bits), lane_bits);
+        const __m256 values = _mm256_loadu_ps(block + i);
+        _mm256_storeu_ps(block + i, _mm256_blendv_ps(masked, values, _mm256_castsi256_ps(keep)));
+    }
+}
+#endif
+
+using MaskWord = void (*)(uint64_t word, float* block);
+
+// Built for baseline x86-64; the AVX2 variant is picked at runtime like the CPU kernels
+MaskWord select_mask_word() {
+#ifdef CASTOR_GRAMMAR_X86
+    if (Kernels::detect_isa() >= Isa::Avx2) {
+        return mask_word_avx2;
+    }
+#endif
+    return mask_word_generic;
+}
+
+} // namespace
+
+// Fully allowed words are skipped and fully disallowed ones filled, so the
+// per-bit work is limited to words that straddle the boundary of an allowed
+// range. Constraint masks are mostly empty, which makes this a memset.
+void TokenMasks::apply_mask(const uint64_t* bits, float* logits, size_t count) {
+    static const MaskWord mask_word = select_mask_word();
+    const size_t words = count / 64;
+    for (size_t w = 0; w < words; ++w) {
+        const uint64_t word = bits[w];
+        float* block = logits + w * 64;
+        if (word == ~uint64_t{0}) {
+            continue;
+        }
+        if (word == 0) {
+            std::fill(block, block + 64, -INFINITY);
+            continue;
+        }
+        mask_word(word, block);
+    }
+    for (size_t i = words * 64; i < count; ++i) {
+        if (!((bits[i >> 6] >> (i & 63)) & 1)) {
+            logits[i] = -INFINITY;
+        }
+    }
+}
+
+std::shared_ptr<const TokenMasks> TokenMasks::compile(const std::string& kind, const std::string& spec,
+                                                      std::shared_ptr<const Vocabulary> vocabulary,
+                                                      uint32_t vocab_size, int32_t eos_token_id, std::string& error) {
+    std::string key = kind;
+    key += '\0';
+    key += spec;
+    key += '\0';
+    key += std::to_string(reinterpret_cast<uintptr_t>(vocabulary.get())) + ":" + std::to_string(vocab_size) + ":" +
+           std::to_string(eos_token_id);
+    {
+        std::lock_guard<std::mutex> lock(g_cache_mutex);
+        for (auto it = g_cache.begin(); it != g_cache.end(); ++it) {
+            if (it->key == key) {
+                g_cache.splice(g_cache.begin(), g_cache, it);
+                return it->masks;
+            }
+        }
+    }
+
+    std::shared_ptr<const Grammar> grammar;
+    if (kind == "regex") {
+        grammar = Grammar::from_regex(spec, error);
+    } else if (kind == "json_schema") {
+        try {
+            grammar = Grammar::from_json_schema(nlohmann::json::parse(spec), error);
+        } catch (const nlohmann::json::exception& e) {
+            error = std::string("Invalid JSON schema: ") + e.what();
+        }
+    } else {
+        error = "Unknown constraint kind '" + kind + "'";
+    }
+    if (!grammar) {
+        return nullptr;
+    }
+    auto masks = std::make_shared<const TokenMasks>(grammar, vocabulary, vocab_size, eos_token_id);
+
+    std::lock_guard<std::mutex> lock(g_cache_mutex);
+    g_cache.push_front({std::move(key), masks, std::move(vocabulary)});
+    if (g_cache.size() > kCompiledCacheEntries) {
+        g_cache.pop_back();
+    }
+    return masks;
+}
+
+} // namespace castor
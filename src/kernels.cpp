@@ -0,0 +1,577 @@
+#include "kernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <utility>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#if defined(__GNUC__) && !defined(__clang__)
+// GCC 12's _mm512_undefined_ps() self-initializes and warns inside target("avx512f") code (PR 105593)
+#pragma GCC diagnostic ignored "-Wuninitialized"
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+#include <immintrin.h>
+#define CASTOR_KERNELS_X86 1
+#define CASTOR_AVX2 __attribute__((target("avx2,fma")))
+#define CASTOR_AVX512 __attribute__((target("avx512f,avx2,fma")))
+#endif
+
+namespace castor {
+
+namespace {
+
+// Loop-length policies: Fixed<N> makes the trip count a compile-time constant
+template <size_t N>
+struct Fixed {
+    static constexpr size_t size(size_t) { return N; }
+};
+
+struct Dynamic {
+    static size_t size(size_t n) { return n; }
+};
+
+// ============ Generic ============
+
+namespace generic {
+
+template <class Cols>
+struct Gemm {
+    static void run(const float* w, const float* x, float* y, size_t batch, size_t rows, size_t cols_arg) {
+        const size_t cols = Cols::size(cols_arg);
+        for (size_t b = 0; b < batch; ++b) {
+            const float* in = x + b * cols;
+            for (size_t r = 0; r < rows; ++r) {
+                const float* row = w + r * cols;
+                float sum = 0.0f;
+                for (size_t k = 0; k < cols; ++k) {
+                    sum += row[k] * in[k];
+                }
+                y[b * rows + r] = sum;
+            }
+        }
+    }
+};
+
+template <class Cols>
+struct Gemv {
+    static void run(const float* w, const float* x, float* y, size_t rows, size_t cols) {
+        Gemm<Cols>::run(w, x, y, 1, rows, cols);
+    }
+};
+
+template <class Dim>
+struct RmsNorm {
+    static void run(const float* x, const float* weight, float* out, size_t dim_arg, float eps) {
+        const size_t dim = Dim::size(dim_arg);
+        float sum = 0.0f;
+        for (size_t i = 0; i < dim; ++i) {
+            sum += x[i] * x[i];
+        }
+        const float scale = 1.0f / std::sqrt(sum / static_cast<float>(dim) + eps);
+        for (size_t i = 0; i < dim; ++i) {
+            out[i] = x[i] * scale * weight[i];
+        }
+    }
+};
+
+template <class Len>
+struct Softmax {
+    static void run(float* values, size_t n_arg) {
+        const size_t n = Len::size(n_arg);
+        if (n == 0) {
+            return;
+        }
+        const float max = *std::max_element(values, values + n);
+        float sum = 0.0f;
+        for (size_t i = 0; i < n; ++i) {
+            values[i] = std::exp(values[i] - max);
+            sum += values[i];
+        }
+        const float inv = 1.0f / sum;
+        for (size_t i = 0; i < n; ++i) {
+            values[i] *= inv;
+        }
+    }
+};
+
+} // namespace generic
+
+#ifdef CASTOR_KERNELS_X86
+
+// ============ AVX2 + FMA ============
+
+namespace avx2 {
+
+CASTOR_AVX2 inline float hsum(__m256 v) {
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+CASTOR_AVX2 inline float hmax(__m256 v) {
+    __m128 m = _mm_max_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_movehdup_ps(m));
+    return _mm_cvtss_f32(m);
+}
+
+// e^x via Cody-Waite range reduction and the Cephes degree-5 polynomial
+// (max relative error ~2 ulp over the clamped range)
+CASTOR_AVX2 inline __m256 exp(__m256 x) {
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.3f)), _mm256_set1_ps(88.3f));
+    const __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)),
+                                     _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+    __m256 p = _mm256_set1_ps(1.9875691500e-4f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.3981999507e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(8.3334519073e-3f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(4.1665795894e-2f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.6666665459e-1f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(5.0000001201e-1f));
+    p = _mm256_fmadd_ps(p, _mm256_mul_ps(r, r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    const __m256i bits = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127)), 23);
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(bits));
+}
+
+// R weight rows against B inputs; every weight vector load feeds B FMAs
+template <size_t R, size_t B, class Cols>
+CASTOR_AVX2 inline void tile(const float* w, const float* x, float* y, size_t rows, size_t cols_arg) {
+    const size_t cols = Cols::size(cols_arg);
+    __m256 acc[R][B];
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t b = 0; b < B; ++b) {
+            acc[r][b] = _mm256_setzero_ps();
+        }
+    }
+    const size_t vec_end = cols / 8 * 8;
+    for (size_t k = 0; k < vec_end; k += 8) {
+        __m256 in[B];
+        for (size_t b = 0; b < B; ++b) {
+            in[b] = _mm256_loadu_ps(x + b * cols + k);
+        }
+        for (size_t r = 0; r < R; ++r) {
+            const __m256 weights = _mm256_loadu_ps(w + r * cols + k);
+            for (size_t b = 0; b < B; ++b) {
+                acc[r][b] = _mm256_fmadd_ps(weights, in[b], acc[r][b]);
+            }
+        }
+    }
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t b = 0; b < B; ++b) {
+            float sum = hsum(acc[r][b]);
+            for (size_t t = vec_end; t < cols; ++t) {
+                sum += w[r * cols + t] * x[b * cols + t];
+            }
+            y[b * rows + r] = sum;
+        }
+    }
+}
+
+template <size_t R, size_t B, class Cols>
+CASTOR_AVX2 inline void tile_rows(const float* w, const float* x, float* y, size_t rows, size_t cols) {
+    size_t r = 0;
+    for (; r + R <= rows; r += R) {
+        tile<R, B, Cols>(w + r * Cols::size(cols), x, y + r, rows, cols);
+    }
+    for (; r < rows; ++r) {
+        tile<1, B, Cols>(w + r * Cols::size(cols), x, y + r, rows, cols);
+    }
+}
+
+template <class Cols>
+struct Gemm {
+    CASTOR_AVX2 static void run(const float* w, const float* x, float* y, size_t batch, size_t rows, size_t cols) {
+        const size_t stride = Cols::size(cols);
+        size_t b = 0;
+        for (; b + 2 <= batch; b += 2) {
+            tile_rows<4, 2, Cols>(w, x + b * stride, y + b * rows, rows, cols);
+        }
+        for (; b < batch; ++b) {
+            tile_rows<8, 1, Cols>(w, x + b * stride, y + b * rows, rows, cols);
+        }
+    }
+};
+
+template <class Cols>
+struct Gemv {
+    CASTOR_AVX2 static void run(const float* w, const float* x, float* y, size_t rows, size_t cols) {
+        tile_rows<8, 1, Cols>(w, x, y, rows, cols);
+    }
+};
+
+template <class Dim>
+struct RmsNorm {
+    CASTOR_AVX2 static void run(const float* x, const float* weight, float* out, size_t dim_arg, float eps) {
+        const size_t dim = Dim::size(dim_arg);
+        __m256 acc0 = _mm256_setzero_ps();
+        __m256 acc1 = _mm256_setzero_ps();
+        const size_t pair_end = dim / 16 * 16;
+        for (size_t i = 0; i < pair_end; i += 16) {
+            const __m256 a = _mm256_loadu_ps(x + i);
+            const __m256 b = _mm256_loadu_ps(x + i + 8);
+            acc0 = _mm256_fmadd_ps(a, a, acc0);
+            acc1 = _mm256_fmadd_ps(b, b, acc1);
+        }
+        float sum = hsum(_mm256_add_ps(acc0, acc1));
+        for (size_t t = pair_end; t < dim; ++t) {
+            sum += x[t] * x[t];
+        }
+        const float scale = 1.0f / std::sqrt(sum / static_cast<float>(dim) + eps);
+        const __m256 vscale = _mm256_set1_ps(scale);
+        const size_t vec_end = dim / 8 * 8;
+        for (size_t i = 0; i < vec_end; i += 8) {
+            const __m256 scaled = _mm256_mul_ps(_mm256_loadu_ps(x + i), vscale);
+            _mm256_storeu_ps(out + i, _mm256_mul_ps(scaled, _mm256_loadu_ps(weight + i)));
+        }
+        for (size_t i = vec_end; i < dim; ++i) {
+            out[i] = x[i] * scale * weight[i];
+        }
+    }
+};
+
+template <class Len>
+struct Softmax {
+    CASTOR_AVX2 static void run(float* values, size_t n_arg) {
+        const size_t n = Len::size(n_arg);
+        if (n == 0) {
+            return;
+        }
+        const size_t vec_end = n / 8 * 8;
+        __m256 vmax = _mm256_set1_ps(-INFINITY);
+        for (size_t i = 0; i < vec_end; i += 8) {
+            vmax = _mm256_max_ps(vmax, _mm256_loadu_ps(values + i));
+        }
+        float max = hmax(vmax);
+        for (size_t i = vec_end; i < n; ++i) {
+            max = std::max(max, values[i]);
+        }
+        const __m256 vshift = _mm256_set1_ps(max);
+        __m256 vsum = _mm256_setzero_ps();
+        for (size_t i = 0; i < vec_end; i += 8) {
+            const __m256 e = exp(_mm256_sub_ps(_mm256_loadu_ps(values + i), vshift));
+            _mm256_storeu_ps(values + i, e);
+            vsum = _mm256_add_ps(vsum, e);
+        }
+        float sum = hsum(vsum);
+        for (size_t i = vec_end; i < n; ++i) {
+            values[i] = std::exp(values[i] - max);
+            sum += values[i];
+        }
+        const float inv = 1.0f / sum;
+        const __m256 vinv = _mm256_set1_ps(inv);
+        for (size_t i = 0; i < vec_end; i += 8) {
+            _mm256_storeu_ps(values + i, _mm256_mul_ps(_mm256_loadu_ps(values + i), vinv));
+        }
+        for (size_t i = vec_end; i < n; ++i) {
+            values[i] *= inv;
+        }
+    }
+};
+
+} // namespace avx2
+
+// ============ AVX-512F ============
+
+namespace avx512 {
+
+// Fold 512 -> 128 bits with in-register shuffles, then finish in SSE
+CASTOR_AVX512 inline float hsum(__m512 v) {
+    v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_add_ps(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128 s = _mm512_castps512_ps128(v);
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    s = _mm_add_ss(s, _mm_movehdup_ps(s));
+    return _mm_cvtss_f32(s);
+}
+
+CASTOR_AVX512 inline float hmax(__m512 v) {
+    v = _mm512_max_ps(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(1, 0, 3, 2)));
+    v = _mm512_max_ps(v, _mm512_shuffle_f32x4(v, v, _MM_SHUFFLE(2, 3, 0, 1)));
+    __m128 m = _mm512_castps512_ps128(v);
+    m = _mm_max_ps(m, _mm_movehl_ps(m, m));
+    m = _mm_max_ss(m, _mm_movehdup_ps(m));
+    return _mm_cvtss_f32(m);
+}
+
+CASTOR_AVX512 inline __m512 exp(__m512 x) {
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.3f)), _mm512_set1_ps(88.3f));
+    const __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504f)),
+                                          _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+    __m512 p = _mm512_set1_ps(1.9875691500e-4f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.3981999507e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(8.3334519073e-3f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(4.1665795894e-2f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.6666665459e-1f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(5.0000001201e-1f));
+    p = _mm512_fmadd_ps(p, _mm512_mul_ps(r, r), _mm512_add_ps(r, _mm512_set1_ps(1.0f)));
+    return _mm512_scalef_ps(p, n);
+}
+
+template <size_t R, size_t B, class Cols>
+CASTOR_AVX512 inline void tile(const float* w, const float* x, float* y, size_t rows, size_t cols_arg) {
+    const size_t cols = Cols::size(cols_arg);
+    __m512 acc[R][B];
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t b = 0; b < B; ++b) {
+            acc[r][b] = _mm512_setzero_ps();
+        }
+    }
+    const size_t vec_end = cols / 16 * 16;
+    for (size_t k = 0; k < vec_end; k += 16) {
+        __m512 in[B];
+        for (size_t b = 0; b < B; ++b) {
+            in[b] = _mm512_loadu_ps(x + b * cols + k);
+        }
+        for (size_t r = 0; r < R; ++r) {
+            const __m512 weights = _mm512_loadu_ps(w + r * cols + k);
+            for (size_t b = 0; b < B; ++b) {
+                acc[r][b] = _mm512_fmadd_ps(weights, in[b], acc[r][b]);
+            }
+        }
+    }
+    for (size_t r = 0; r < R; ++r) {
+        for (size_t b = 0; b < B; ++b) {
+            float sum = hsum(acc[r][b]);
+            for (size_t t = vec_end; t < cols; ++t) {
+                sum += w[r * cols + t] * x[b * cols + t];
+            }
+            y[b * rows + r] = sum;
+        }
+    }
+}
+
+template <size_t R, size_t B, class Cols>
+CASTOR_AVX512 inline void tile_rows(const float* w, const float* x, float* y, size_t rows, size_t cols) {
+    size_t r = 0;
+    for (; r + R <= rows; r += R) {
+        tile<R, B, Cols>(w + r * Cols::size(cols), x, y + r, rows, cols);
+    }
+    for (; r < rows; ++r) {
+        tile<1, B, Cols>(w + r * Cols::size(cols), x, y + r, rows, cols);
+    }
+}
+
+template <class Cols>
+struct Gemm {
+    CASTOR_AVX512 static void run(const float* w, const float* x, float* y, size_t batch, size_t rows, size_t cols) {
+        const size_t stride = Cols::size(cols);
+        size_t b = 0;
+        for (; b + 4 <= batch; b += 4) {
+            tile_rows<4, 4, Cols>(w, x + b * stride, y + b * rows, rows, cols);
+        }
+        for (; b < batch; ++b) {
+            tile_rows<8, 1, Cols>(w, x + b * stride, y + b * rows, rows, cols);
+        }
+    }
+};
+
+template <class Cols>
+struct Gemv {
+    CASTOR_AVX512 static void run(const float* w, const float* x, float* y, size_t rows, size_t cols) {
+        tile_rows<8, 1, Cols>(w, x, y, rows, cols);
+    }
+};
+
+template <class Dim>
+struct RmsNorm {
+    CASTOR_AVX512 static void run(const float* x, const float* weight, float* out, size_t dim_arg, float eps) {
+        const size_t dim = Dim::size(dim_arg);
+        __m512 acc0 = _mm512_setzero_ps();
+        __m512 acc1 = _mm512_setzero_ps();
+        const size_t pair_end = dim / 32 * 32;
+        for (size_t i = 0; i < pair_end; i += 32) {
+            const __m512 a = _mm512_loadu_ps(x + i);
+            const __m512 b = _mm512_loadu_ps(x + i + 16);
+            acc0 = _mm512_fmadd_ps(a, a, acc0);
+            acc1 = _mm512_fmadd_ps(b, b, acc1);
+        }
+        float sum = hsum(_mm512_add_ps(acc0, acc1));
+        for (size_t t = pair_end; t < dim; ++t) {
+            sum += x[t] * x[t];
+        }
+        const float scale = 1.0f / std::sqrt(sum / static_cast<float>(dim) + eps);
+        const __m512 vscale = _mm512_set1_ps(scale);
+        const size_t vec_end = dim / 16 * 16;
+        for (size_t i = 0; i < vec_end; i += 16) {
+            const __m512 scaled = _mm512_mul_ps(_mm512_loadu_ps(x + i), vscale);
+            _mm512_storeu_ps(out + i, _mm512_mul_ps(scaled, _mm512_loadu_ps(weight + i)));
+        }
+        for (size_t i = vec_end; i < dim; ++i) {
+            out[i] = x[i] * scale * weight[i];
+        }
+    }
+};
+
+template <class Len>
+struct Softmax {
+    CASTOR_AVX512 static void run(float* values, size_t n_arg) {
+        const size_t n = Len::size(n_arg);
+        if (n == 0) {
+            return;
+        }
+        const size_t vec_end = n / 16 * 16;
+        __m512 vmax = _mm512_set1_ps(-INFINITY);
+        for (size_t i = 0; i < vec_end; i += 16) {
+            vmax = _mm512_max_ps(vmax, _mm512_loadu_ps(values + i));
+        }
+        float max = hmax(vmax);
+        for (size_t i = vec_end; i < n; ++i) {
+            max = std::max(max, values[i]);
+        }
+        const __m512 vshift = _mm512_set1_ps(max);
+        __m512 vsum = _mm512_setzero_ps();
+        for (size_t i = 0; i < vec_end; i += 16) {
+            const __m512 e = exp(_mm512_sub_ps(_mm512_loadu_ps(values + i), vshift));
+            _mm512_storeu_ps(values + i, e);
+            vsum = _mm512_add_ps(vsum, e);
+        }
+        float sum = hsum(vsum);
+        for (size_t i = vec_end; i < n; ++i) {
+            values[i] = std::exp(values[i] - max);
+            sum += values[i];
+        }
+        const float inv = 1.0f / sum;
+        const __m512 vinv = _mm512_set1_ps(inv);
+        for (size_t i = 0; i < vec_end; i += 16) {
+            _mm512_storeu_ps(values + i, _mm512_mul_ps(_mm512_loadu_ps(values + i), vinv));
+        }
+        for (size_t i = vec_end; i < n; ++i) {
+            values[i] *= inv;
+        }
+    }
+};
+
+} // namespace avx512
+
+#endif // CASTOR_KERNELS_X86
+
+// ============ Registry ============
+
+// Compile-time shape lists; adding a shape here instantiates it for every ISA
+template <template <class> class K, typename Fn>
+Fn find_instance(size_t dim, Fn fallback, std::index_sequence<>) {
+    (void)dim;
+    return fallback;
+}
+
+template <template <class> class K, typename Fn, size_t First, size_t... Rest>
+Fn find_instance(size_t dim, Fn fallback, std::index_sequence<First, Rest...>) {
+    if (dim == First) {
+        return &K<Fixed<First>>::run;
+    }
+    return find_instance<K>(dim, fallback, std::index_sequence<Rest...>());
+}
+
+using ProjectionDims = std::index_sequence<2048, 4096, 5120, 5632, 8192, 11008, 13824, 14336, 28672>;
+using HiddenDims = std::index_sequence<2048, 4096, 5120, 8192>;
+using VocabDims = std::index_sequence<32000, 128256, 151936>;
+
+// Bind one kernel: the specialized instance when the shape has one, else the any-size kernel
+template <template <class> class K, typename Fn, typename Dims>
+Fn bind(size_t dim, bool specialize, uint32_t bit, uint32_t& specialized) {
+    Fn dynamic = &K<Dynamic>::run;
+    if (!specialize) {
+        return dynamic;
+    }
+    Fn fn = find_instance<K>(dim, dynamic, Dims());
+    if (fn != dynamic) {
+        specialized |= bit;
+    }
+    return fn;
+}
+
+template <template <class> class Gemv, template <class> class Gemm, template <class> class RmsNorm,
+          template <class> class Softmax>
+KernelSet bind_all(Isa isa, const ModelConfig& config, bool specialize) {
+    KernelSet set;
+    set.isa = isa;
+    set.gemv_hidden = bind<Gemv, KernelSet::Gemv, ProjectionDims>(config.hidden_dim, specialize,
+                                                                  KernelSet::kGemvHidden, set.specialized);
+    set.gemv_ffn = bind<Gemv, KernelSet::Gemv, ProjectionDims>(Kernels::ffn_dim(config), specialize,
+                                                               KernelSet::kGemvFfn, set.specialized);
+    set.gemm_hidden = bind<Gemm, KernelSet::Gemm, ProjectionDims>(config.hidden_dim, specialize,
+                                                                  KernelSet::kGemmHidden, set.specialized);
+    set.rms_norm = bind<RmsNorm, KernelSet::RmsNorm, HiddenDims>(config.hidden_dim, specialize, KernelSet::kRmsNorm,
+                                                                 set.specialized);
+    set.softmax = bind<Softmax, KernelSet::Softmax, VocabDims>(config.vocab_size, specialize, KernelSet::kSoftmax,
+                                                               set.specialized);
+    return set;
+}
+
+} // namespace
+
+std::string KernelSet::describe(const ModelConfig& config) const {
+    std::ostringstream out;
+    auto entry = [&](const char* name, uint32_t bit, uint32_t dim) {
+        out << " " << name << "=";
+        if (specialized & bit) {
+            out << dim;
+        } else {
+            out << "generic";
+        }
+    };
+    out << Kernels::isa_name(isa);
+    entry("gemv_hidden", kGemvHidden, config.hidden_dim);
+    entry("gemv_ffn", kGemvFfn, Kernels::ffn_dim(config));
+    entry("gemm_hidden", kGemmHidden, config.hidden_dim);
+    entry("rms_norm", kRmsNorm, config.hidden_dim);
+    entry("softmax", kSoftmax, config.vocab_size);
+    return out.str();
+}
+
+Isa Kernels::detect_isa() {
+#ifdef CASTOR_KERNELS_X86
+    static const Isa isa = [] {
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx512f")) {
+            return Isa::Avx512;
+        }
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+            return Isa::Avx2;
+        }
+        return Isa::Generic;
+    }();
+    return isa;
+#else
+    return Isa::Generic;
+#endif
+}
+
+const char* Kernels::isa_name(Isa isa) {
+    switch (isa) {
+    case Isa::Avx2:
+        return "avx2";
+    case Isa::Avx512:
+        return "avx512";
+    case Isa::Generic:
+        break;
+    }
+    return "generic";
+}
+
+uint32_t Kernels::ffn_dim(const ModelConfig& config) {
+    if (config.ffn_dim > 0) {
+        return config.ffn_dim;
+    }
+    const uint32_t llama = 8 * config.hidden_dim / 3;
+    return (llama + 255) / 256 * 256;
+}
+
+KernelSet Kernels::select(const ModelConfig& config, Isa max_isa, bool specialize) {
+    const Isa isa = std::min(max_isa, detect_isa());
+#ifdef CASTOR_KERNELS_X86
+    if (isa == Isa::Avx512) {
+        return bind_all<avx512::Gemv, avx512::Gemm, avx512::RmsNorm, avx512::Softmax>(isa, config, specialize);
+    }
+    if (isa == Isa::Avx2) {
+        return bind_all<avx2::Gemv, avx2::Gemm, avx2::RmsNorm, avx2::Softmax>(isa, config, specialize);
+    }
+#endif
+    return bind_all<generic::Gemv, generic::Gemm, generic::RmsNorm, generic::Softmax>(Isa::Generic, config, specialize);
+}
+
+} // namespace castor
@@ -2,92 +2,269 @@
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <cstdlib>
 #include "engine.hpp"
+#include "model_registry.hpp"
 #include "tokenizer.hpp"
+#include "affinity.hpp"
+#include "autotuner.hpp"
+#include "batch_runner.hpp"
+#include "engine_pool.hpp"
+#include "runtime_config.hpp"
+#include "sampler.hpp"
 #include "server.hpp"
+#include "startup.hpp"
+#include "trace.hpp"
 #include "../tests/test_runner.hpp"
 
-int main(int argc, char* argv[]) {
-    std::cout << "========================================\n";
-    std::cout << "Castor-RT: LLM Inference Engine (Ada)\n";
-    std::cout << "========================================\n";
+// Replace batch, thread, chunk and sampler settings with the ones tuned for this host
+static void apply_autotune(castor::RuntimeConfig& runtime, const std::string& engine_path,
+                           castor::ModelConfig& config) {
+    castor::Autotuner tuner(runtime.autotuner);
+    castor::Autotuner::Settings settings;
+    if (!tuner.run(engine_path, config, runtime.retune, settings)) {
+        std::cerr << "[Autotune] Keeping configured settings\n";
+        return;
+    }
+    config.max_batch_size = static_cast<uint32_t>(settings.max_batch);
+    runtime.scheduler.max_batch = settings.max_batch;
+    runtime.scheduler.prefill_chunk_tokens = settings.prefill_chunk;
+    runtime.inference.threads = settings.threads;
+    castor::Sampler::set_nucleus_window(settings.nucleus_window);
+    std::cout << "[Config] Max Batch: " << config.max_batch_size << " (autotuned)\n";
+}
+
+// Single built-in model, used when no "models" list is configured: adds its
+// load phases (and autotuning, if requested) to @p startup. With replicas
+// enabled it is loaded once per NUMA node.
+static void add_builtin_model(castor::RuntimeConfig& runtime, castor::ModelStartup& model,
+                              castor::StartupGraph& startup) {
+    std::cout << "\n[Config] Model: " << model.config.model_name << "\n";
+    std::cout << "[Config] Max Batch: " << model.config.max_batch_size << "\n";
+    std::cout << "[Config] Max Sequence: " << model.config.max_seq_length << "\n";
+    std::cout << "[Config] Vocab Size: " << model.config.vocab_size << "\n";
 
-    // Run unit tests
-    TestRunner::run_all();
-
-    // Initialize model configuration
-    castor::ModelConfig config;
-    config.model_name = "llama-2-7b";
-    config.max_batch_size = 1;
-    config.max_seq_length = 4096;
-    config.vocab_size = 32000;
-    config.hidden_dim = 4096;
-    config.num_layers = 32;
-
-    std::cout << "\n[Config] Model: " << config.model_name << "\n";
-    std::cout << "[Config] Max Batch: " << config.max_batch_size << "\n";
-    std::cout << "[Config] Max Sequence: " << config.max_seq_length << "\n";
-    std::cout << "[Config] Vocab Size: " << config.vocab_size << "\n";
-
-    // Create engine and tokenizer
-    auto engine = std::make_shared<castor::Engine>();
-    auto tokenizer = std::make_shared<castor::Tokenizer>();
-
-    // Initialize tokenizer
-    std::cout << "\n[Tokenizer] Loading...\n";
-    std::string tokenizer_path = "models/tokenizer.json";
-    
     // Create dummy tokenizer file if it doesn't exist
-    std::ifstream check(tokenizer_path);
+    std::ifstream check(model.tokenizer_path);
     if (!check.good()) {
         std::cout << "[Tokenizer] Creating dummy tokenizer...\n";
-        std::ofstream dummy(tokenizer_path);
+        std::ofstream dummy(model.tokenizer_path);
         dummy << R"({"model_type": "bpe", "vocab_size": 32000})";
         dummy.close();
     }
-    
-    if (tokenizer->load(tokenizer_path)) {
-        std::cout << "[Tokenizer] Loaded successfully (vocab: " << tokenizer->vocab_size() << ")\n";
-        engine->set_tokenizer(tokenizer);
-    } else {
-        std::cout << "[Tokenizer] Failed to load\n";
-    }
 
-    // Initialize engine
-    std::cout << "\n[Engine] Initializing...\n";
-    std::string engine_path = "models/llama-2-7b.plan";
-    
     // Create dummy engine file if it doesn't exist
-    std::ifstream check_engine(engine_path);
+    std::ifstream check_engine(model.engine_path);
     if (!check_engine.good()) {
         std::cout << "[Engine] Creating dummy engine file...\n";
-        std::ofstream dummy_engine(engine_path);
+        std::ofstream dummy_engine(model.engine_path);
         dummy_engine << "DUMMY_TENSORRT_ENGINE_PLACEHOLDER";
         dummy_engine.close();
     }
-    
-    if (engine->initialize(engine_path, config)) {
+
+    model.replicas = runtime.replicas_enabled;
+    model.replica_options = runtime.replicas;
+    model.replica_options.numa_local = runtime.inference.numa_local;
+    model.replica_options.scheduler_enabled = runtime.scheduler_enabled;
+    model.replica_options.scheduler = runtime.scheduler;
+
+    castor::StartupGraph::Task autotune;
+    if (runtime.autotune) {
+        autotune = [&runtime, &model]() {
+            apply_autotune(runtime, model.engine_path, model.config);
+            model.replica_options.scheduler = runtime.scheduler;
+            return true;
+        };
+    }
+    model.add_to(startup, std::move(autotune));
+}
+
+// Everything the server routes requests to, once startup has finished
+struct Serving {
+    std::shared_ptr<castor::WorkerPool> workers;
+    std::shared_ptr<castor::Engine> engine;
+    std::shared_ptr<castor::Tokenizer> tokenizer;
+    std::shared_ptr<castor::ModelRegistry> registry;
+    std::shared_ptr<castor::EnginePool> pool;
+};
+
+// Take the built-in model from its finished phases; workers are created only
+// now because autotuning may have changed the thread count
+static void take_builtin_model(const castor::RuntimeConfig& runtime, const castor::ModelStartup& model,
+                               Serving& serving) {
+    serving.engine = model.engine;
+    serving.tokenizer = model.tokenizer;
+    serving.pool = model.pool;
+    if (model.tokenizer->is_loaded()) {
+        std::cout << "[Tokenizer] Loaded successfully (vocab: " << model.tokenizer->vocab_size() << ")\n";
+    }
+    if (model.pool) {
+        std::cout << "[Engine] Initialized " << model.pool->size() << " replicas\n";
+    } else {
         std::cout << "[Engine] Initialized successfully\n";
+    }
+    if (runtime.inference.threads > 0) {
+        serving.workers = std::make_shared<castor::WorkerPool>(runtime.inference);
+    }
+}
+
+// Hand the loaded model, cache, sessions, workers and scheduler to the server
+static bool configure_server(castor::Server& server, const castor::RuntimeConfig& runtime, const Serving& serving) {
+    if (!serving.registry && !server.initialize(serving.engine, serving.tokenizer)) {
+        return false;
+    }
+    if (runtime.cache_enabled) {
+        server.set_response_cache(std::make_shared<castor::ResponseCache>(runtime.cache));
+    }
+    if (runtime.sessions_enabled) {
+        server.set_session_store(std::make_shared<castor::SessionStore>(runtime.sessions));
+        std::cout << "[Server] Sessions: " << (runtime.sessions.max_resident_bytes >> 20) << " MB in RAM, spilled to "
+                  << (runtime.sessions.directory.empty() ? "nowhere (RAM only)" : runtime.sessions.directory) << "\n";
+    }
+    if (serving.workers) {
+        server.set_worker_pool(serving.workers);
+        std::cout << "[Server] Inference workers: " << runtime.inference.threads;
+        if (!runtime.inference.cpus.empty()) {
+            std::cout << " on CPUs " << castor::Affinity::format_cpu_list(runtime.inference.cpus);
+        }
+        std::cout << "\n";
+    }
+    if (serving.registry) {
+        server.set_model_registry(serving.registry);
+    } else if (serving.pool) {
+        server.set_engine_pool(serving.pool);
+        std::cout << "[Server] Engine replicas: " << serving.pool->size() << ", routed by prompt prefix and load\n";
+    } else if (runtime.scheduler_enabled) {
+        server.set_scheduler(std::make_shared<castor::Scheduler>(serving.engine, runtime.scheduler, serving.workers));
+        std::cout << "[Server] Scheduler: up to " << runtime.scheduler.max_batch << " concurrent generations\n";
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "========================================\n";
+    std::cout << "Castor-RT: LLM Inference Engine (Ada)\n";
+    std::cout << "========================================\n";
+
+    // Listener, threading and cache settings from --config and flags
+    castor::RuntimeConfig runtime;
+    if (!castor::RuntimeConfig::parse_args(argc, argv, runtime)) {
+        std::cerr << castor::RuntimeConfig::usage();
+        return 1;
+    }
+
+    // Smoke tests run on request only, so cold start measures real initialization
+    if (runtime.self_test) {
+        TestRunner::run_all();
+        return 0;
+    }
+
+    // Span recording starts disabled; CASTOR_TRACE=1 turns it on from startup
+    if (const char* trace_env = std::getenv("CASTOR_TRACE")) {
+        castor::Tracer::set_enabled(std::string(trace_env) == "1");
+    }
+    // Per-request CPU time and allocation accounting (X-Castor-Resources, castor_http_cpu_seconds_total, ...)
+    if (const char* resources_env = std::getenv("CASTOR_ACCOUNT_RESOURCES")) {
+        castor::ResourceAccounting::set_enabled(std::string(resources_env) == "1");
+    }
+
+    // Cold start is a task graph: tokenizer load, weight reads, kernel
+    // selection and registry preloads run concurrently, then warm-up passes
+    Serving serving;
+    auto startup = std::make_shared<castor::StartupGraph>();
+    castor::ModelStartup builtin = castor::ModelStartup::builtin();
+    if (runtime.models.empty()) {
+        add_builtin_model(runtime, builtin, *startup);
     } else {
-        std::cout << "[Engine] Failed to initialize\n";
+        if (runtime.autotune) {
+            std::cerr << "[Autotune] Only the built-in model is tuned; ignoring --autotune with a models list\n";
+        }
+        if (runtime.inference.threads > 0) {
+            serving.workers = std::make_shared<castor::WorkerPool>(runtime.inference);
+        }
+        castor::ModelRegistry::Options registry_options;
+        registry_options.memory_budget_bytes = runtime.model_budget_bytes;
+        registry_options.scheduler_enabled = runtime.scheduler_enabled;
+        registry_options.scheduler = runtime.scheduler;
+        serving.registry = std::make_shared<castor::ModelRegistry>(registry_options, serving.workers);
+        for (const auto& spec : runtime.models) {
+            if (!serving.registry->add(spec)) {
+                return 1;
+            }
+        }
+        std::cout << "\n[Models] " << runtime.models.size() << " registered, default "
+                  << serving.registry->default_model() << "\n";
+        startup->add("preload", [&runtime, &serving]() {
+            if (!serving.registry->preload(runtime.preload_models)) {
+                std::cerr << "[Models] Preload failed\n";
+                return false;
+            }
+            return true;
+        });
     }
 
-    // Create server
-    std::cout << "\n[Server] Starting REST API...\n";
-    auto server = std::make_unique<castor::Server>(8080);
-    
-    if (server->initialize(engine, tokenizer)) {
-        std::cout << "[Server] Initialized\n";
-        std::cout << "[Server] Endpoints:\n";
-        std::cout << "  GET  http://localhost:8080/health\n";
-        std::cout << "  GET  http://localhost:8080/model\n";
-        std::cout << "  POST http://localhost:8080/infer (body: {\"prompt\": \"...\"})\n";
-        
-        // Start server (blocks main thread until shutdown)
-        server->run();
-        // Code after this point will only execute after server shutdown
+    // Offline mode: load synchronously, run the JSONL pipeline and exit without starting the server
+    if (runtime.batch_mode()) {
+        const bool loaded = startup->run();
+        std::cout << startup->report();
+        if (!loaded) {
+            return 1;
+        }
+        if (runtime.models.empty()) {
+            take_builtin_model(runtime, builtin, serving);
+        }
+        std::cout << "\n[Batch] " << runtime.batch.input_path << " -> " << runtime.batch.output_path << "\n";
+        if (serving.registry) {
+            auto model = serving.registry->acquire("");
+            if (!model) {
+                return 1;
+            }
+            serving.engine = model->engine;
+            serving.tokenizer = model->tokenizer;
+        }
+        castor::BatchRunner runner(serving.engine, serving.tokenizer, runtime.batch);
+        castor::BatchRunner::Report report;
+        if (!runner.run(report)) {
+            return 1;
+        }
+        std::cout << "[Batch] " << report.lines << " lines (" << report.errors << " errors) in " << report.wall_seconds
+                  << " s, input bytes " << report.start_offset << "-" << report.end_offset << "\n";
+        std::cout << "[Batch] Tokens: " << report.prompt_tokens << " prompt, " << report.output_tokens
+                  << " generated, " << report.output_tokens_per_second() << " generated tokens/s\n";
+        std::cout << "[Batch] Stage busy time (s): read " << report.reader_busy_seconds << ", tokenize "
+                  << report.tokenize_busy_seconds << ", engine " << report.engine_busy_seconds << ", write "
+                  << report.writer_busy_seconds << "\n";
+        return 0;
     }
 
+    // Create server; it listens while the model loads and answers 503 (and
+    // /ready 503) until the startup graph has finished
+    std::cout << "\n[Server] Starting REST API...\n";
+    auto server = std::make_unique<castor::Server>(runtime.server);
+    server->set_startup(startup);
+    server->set_ready(false);
+    startup->start([&](bool loaded) {
+        std::cout << startup->report();
+        if (!loaded) {
+            std::cerr << "[Startup] Failed; /ready stays 503\n";
+            return;
+        }
+        if (runtime.models.empty()) {
+            take_builtin_model(runtime, builtin, serving);
+        }
+        if (!configure_server(*server, runtime, serving)) {
+            std::cerr << "[Server] Engine or Tokenizer not initialized\n";
+            return;
+        }
+        server->set_ready(true);
+        std::cout << "[Server] Ready after " << startup->elapsed_ms() << " ms\n";
+    });
+
+    // Start server (blocks main thread until shutdown)
+    server->run();
+    // Code after this point will only execute after server shutdown
+    startup->wait();
+
     // Example inference (without server) can be placed here if needed after server shutdown
     // std::cout << "\n[Inference] Example test...\n";
     // std::vector<int32_t> input_ids = tokenizer->encode("Hello, world!");
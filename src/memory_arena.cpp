@@ -0,0 +1,293 @@
+#include "memory_arena.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace castor {
+
+namespace {
+
+constexpr size_t kSmallPageBytes = 4096;
+
+size_t round_up(size_t bytes, size_t granularity) {
+    return (bytes + granularity - 1) / granularity * granularity;
+}
+
+} // namespace
+
+bool MemoryAccountant::try_charge(MemoryUse use, size_t bytes) {
+    size_t total = total_.load(std::memory_order_relaxed);
+    do {
+        if (budget_ != 0 && (total > budget_ || bytes > budget_ - total)) {
+            return false;
+        }
+    } while (!total_.compare_exchange_weak(total, total + bytes, std::memory_order_relaxed));
+    used_[static_cast<size_t>(use)].fetch_add(bytes, std::memory_order_relaxed);
+    return true;
+}
+
+void MemoryAccountant::charge(MemoryUse use, size_t bytes) {
+    total_.fetch_add(bytes, std::memory_order_relaxed);
+    used_[static_cast<size_t>(use)].fetch_add(bytes, std::memory_order_relaxed);
+}
+
+void MemoryAccountant::release(MemoryUse use, size_t bytes) {
+    used_[static_cast<size_t>(use)].fetch_sub(bytes, std::memory_order_relaxed);
+    total_.fetch_sub(bytes, std::memory_order_relaxed);
+}
+
+size_t MemoryAccountant::available() const {
+    if (budget_ == 0) {
+        return SIZE_MAX;
+    }
+    const size_t total = this->total();
+    return total >= budget_ ? 0 : budget_ - total;
+}
+
+const char* MemoryAccountant::use_name(MemoryUse use) {
+    switch (use) {
+    case MemoryUse::Weights:
+        return "weights";
+    case MemoryUse::KvCache:
+        return "kv_cache";
+    case MemoryUse::Scratch:
+        return "scratch";
+    case MemoryUse::Tokenizer:
+        return "tokenizer";
+    default:
+        return "unknown";
+    }
+}
+
+size_t MemoryAccountant::estimate_weight_bytes(const ModelConfig& config) {
+    const uint64_t hidden = config.hidden_dim;
+    const uint64_t params = 2 * uint64_t{config.vocab_size} * hidden + uint64_t{config.num_layers} * 12 * hidden * hidden;
+    return static_cast<size_t>(params * 2);
+}
+
+size_t MemoryAccountant::estimate_kv_bytes_per_token(const ModelConfig& config) {
+    return static_cast<size_t>(2 * uint64_t{config.num_layers} * config.hidden_dim * 2);
+}
+
+size_t MemoryAccountant::estimate_scratch_bytes(const ModelConfig& config) {
+    // Residual, attention output and the 2x-wide MLP intermediate in fp16, reused layer to layer
+    const uint64_t activations = uint64_t{config.max_seq_length} * config.hidden_dim * 4 * 2;
+    const uint64_t logits = uint64_t{std::max<uint32_t>(1, config.max_batch_size)} * config.vocab_size * sizeof(float);
+    return static_cast<size_t>(activations + logits);
+}
+
+HugePageRegion::HugePageRegion(size_t bytes, bool huge_pages, bool prefault) {
+    if (bytes == 0) {
+        return;
+    }
+    size_ = round_up(bytes, kHugePageBytes);
+#ifdef __linux__
+    if (huge_pages) {
+        void* data = mmap(nullptr, size_, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (prefault ? MAP_POPULATE : 0), -1, 0);
+        if (data != MAP_FAILED) {
+            data_ = data;
+            backing_ = Backing::HugeTlb;
+            return;
+        }
+    }
+
+    // No reserved huge pages: over-map so the region can start on a 2 MB boundary
+    const size_t mapped = size_ + (huge_pages ? kHugePageBytes : 0);
+    void* raw = mmap(nullptr, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) {
+        size_ = 0;
+        return;
+    }
+    char* start = static_cast<char*>(raw);
+    if (huge_pages) {
+        char* aligned = reinterpret_cast<char*>(round_up(reinterpret_cast<uintptr_t>(start), kHugePageBytes));
+        if (aligned > start) {
+            munmap(start, aligned - start);
+        }
+        const size_t tail = (start + mapped) - (aligned + size_);
+        if (tail > 0) {
+            munmap(aligned + size_, tail);
+        }
+        start = aligned;
+    }
+    data_ = start;
+    backing_ = huge_pages && madvise(data_, size_, MADV_HUGEPAGE) == 0 ? Backing::TransparentHuge : Backing::Standard;
+#else
+    (void)huge_pages;
+    data_ = std::aligned_alloc(kHugePageBytes, size_);
+    if (!data_) {
+        size_ = 0;
+        return;
+    }
+    backing_ = Backing::Standard;
+#endif
+    if (prefault) {
+        // One write per small page commits the memory now (whole huge pages under THP)
+        char* bytes_ptr = static_cast<char*>(data_);
+        for (size_t offset = 0; offset < size_; offset += kSmallPageBytes) {
+            bytes_ptr[offset] = 0;
+        }
+    }
+}
+
+HugePageRegion::~HugePageRegion() {
+    reset();
+}
+
+HugePageRegion::HugePageRegion(HugePageRegion&& other) noexcept
+    : data_(std::exchange(other.data_, nullptr)),
+      size_(std::exchange(other.size_, 0)),
+      backing_(std::exchange(other.backing_, Backing::None)) {}
+
+HugePageRegion& HugePageRegion::operator=(HugePageRegion&& other) noexcept {
+    if (this != &other) {
+        reset();
+        data_ = std::exchange(other.data_, nullptr);
+        size_ = std::exchange(other.size_, 0);
+        backing_ = std::exchange(other.backing_, Backing::None);
+    }
+    return *this;
+}
+
+void HugePageRegion::reset() {
+    if (!data_) {
+        return;
+    }
+#ifdef __linux__
+    munmap(data_, size_);
+#else
+    std::free(data_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+    backing_ = Backing::None;
+}
+
+const char* HugePageRegion::backing_name(Backing backing) {
+    switch (backing) {
+    case Backing::HugeTlb:
+        return "hugetlb";
+    case Backing::TransparentHuge:
+        return "thp";
+    case Backing::Standard:
+        return "standard";
+    default:
+        return "none";
+    }
+}
+
+BlockArena::BlockArena(size_t block_bytes, size_t blocks, std::shared_ptr<MemoryAccountant> accountant, MemoryUse use,
+                       bool huge_pages)
+    : block_bytes_(std::max<size_t>(1, block_bytes)),
+      capacity_(std::min<size_t>(blocks, kNoBlock - 1)),
+      accountant_(std::move(accountant)),
+      use_(use),
+      region_(block_bytes_ * capacity_, huge_pages),
+      head_(pack(0, kNoBlock)),
+      free_(0) {
+    if (!region_.valid()) {
+        capacity_ = 0;
+        return;
+    }
+    next_ = std::make_unique<std::atomic<uint32_t>[]>(capacity_);
+    for (size_t i = 0; i < capacity_; ++i) {
+        next_[i].store(i + 1 < capacity_ ? static_cast<uint32_t>(i + 1) : kNoBlock, std::memory_order_relaxed);
+    }
+    head_.store(pack(0, capacity_ > 0 ? 0 : kNoBlock), std::memory_order_release);
+    free_.store(capacity_, std::memory_order_relaxed);
+}
+
+uint32_t BlockArena::allocate() {
+    if (accountant_ && !accountant_->try_charge(use_, block_bytes_)) {
+        return kNoBlock;
+    }
+    uint64_t head = head_.load(std::memory_order_acquire);
+    for (;;) {
+        const uint32_t top = static_cast<uint32_t>(head);
+        if (top == kNoBlock) {
+            if (accountant_) {
+                accountant_->release(use_, block_bytes_);
+            }
+            return kNoBlock;
+        }
+        const uint32_t next = next_[top].load(std::memory_order_relaxed);
+        if (head_.compare_exchange_weak(head, pack((head >> 32) + 1, next), std::memory_order_acquire,
+                                        std::memory_order_acquire)) {
+            free_.fetch_sub(1, std::memory_order_relaxed);
+            return top;
+        }
+    }
+}
+
+void BlockArena::free(uint32_t block) {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    do {
+        next_[block].store(static_cast<uint32_t>(head), std::memory_order_relaxed);
+    } while (!head_.compare_exchange_weak(head, pack((head >> 32) + 1, block), std::memory_order_release,
+                                          std::memory_order_relaxed));
+    free_.fetch_add(1, std::memory_order_relaxed);
+    if (accountant_) {
+        accountant_->release(use_, block_bytes_);
+    }
+}
+
+size_t BlockArena::max_lease() const {
+    if (!accountant_) {
+        return capacity_;
+    }
+    // Leased blocks come back; past them, only what the budget has left can be allocated
+    const size_t held = capacity_ - std::min(capacity_, free_blocks());
+    const size_t room = accountant_->available() / block_bytes_;
+    return room >= capacity_ - held ? capacity_ : held + room;
+}
+
+BlockArena::Lease BlockArena::lease(size_t count) {
+    Lease lease;
+    if (count > free_blocks()) {
+        return lease;
+    }
+    lease.arena_ = this;
+    lease.blocks_.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        const uint32_t block = allocate();
+        if (block == kNoBlock) {
+            lease.release(); // All or nothing
+            return lease;
+        }
+        lease.blocks_.push_back(block);
+    }
+    return lease;
+}
+
+BlockArena::Lease::Lease(Lease&& other) noexcept
+    : arena_(std::exchange(other.arena_, nullptr)), blocks_(std::move(other.blocks_)) {
+    other.blocks_.clear();
+}
+
+BlockArena::Lease& BlockArena::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        arena_ = std::exchange(other.arena_, nullptr);
+        blocks_ = std::move(other.blocks_);
+        other.blocks_.clear();
+    }
+    return *this;
+}
+
+void BlockArena::Lease::release() {
+    if (arena_) {
+        for (uint32_t block : blocks_) {
+            arena_->free(block);
+        }
+    }
+    blocks_.clear();
+    arena_ = nullptr;
+}
+
+} // namespace castor
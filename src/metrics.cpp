@@ -0,0 +1,357 @@
+#include "metrics.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+
+namespace castor {
+
+namespace {
+
+constexpr size_t kSubBits = 2;
+constexpr size_t kSubBuckets = size_t{1} << kSubBits;
+constexpr size_t kNumBuckets = (64 - kSubBits + 1) * kSubBuckets;
+
+constexpr size_t kNumEndpoints = static_cast<size_t>(Endpoint::Count);
+constexpr size_t kNumCounters = static_cast<size_t>(Counter::Count);
+constexpr size_t kNumGauges = static_cast<size_t>(Gauge::Count);
+constexpr size_t kNumHistograms = static_cast<size_t>(Histogram::Count);
+
+const char* const kEndpointNames[kNumEndpoints] = {"/health", "/model", "/infer", "/metrics", "/embeddings",
+                                                   "/ready"};
+
+struct MetricInfo {
+    const char* name;
+    const char* help;
+};
+
+const MetricInfo kCounterInfo[kNumCounters] = {
+    {"castor_prompt_tokens_total", "Prompt tokens processed by the engine"},
+    {"castor_generated_tokens_total", "Tokens generated by the engine"},
+    {"castor_infer_errors_total", "Inference requests that failed"},
+    {"castor_response_cache_hits_total", "Greedy requests served from the response cache"},
+    {"castor_response_cache_misses_total", "Greedy requests that ran inference"},
+    {"castor_response_cache_coalesced_total", "Requests that waited on an identical in-flight inference"},
+    {"castor_response_cache_evictions_total", "Entries evicted to stay within the byte budget"},
+    {"castor_scheduler_preemptions_total", "Running generations paused for higher-priority work"},
+    {"castor_scheduler_deadline_drops_total", "Requests dropped because their deadline could not be met"},
+    {"castor_scheduler_cancellations_total", "Generations cancelled by their caller before finishing"},
+    {"castor_model_loads_total", "Models loaded into memory by the registry"},
+    {"castor_model_evictions_total", "Idle models unloaded to stay within the memory budget"},
+    {"castor_speculative_draft_tokens_total", "Tokens proposed by draft models"},
+    {"castor_speculative_accepted_tokens_total", "Draft tokens accepted by the target model"},
+    {"castor_speculative_emitted_tokens_total", "Tokens generated by speculative rounds"},
+    {"castor_speculative_target_forwards_total", "Target forward passes spent verifying drafts"},
+    {"castor_sequence_forks_total", "Sequences forked from a shared prefill (n > 1, best_of, beam search)"},
+    {"castor_grammar_mask_builds_total", "Constrained-decoding token masks built (one per grammar state and vocabulary)"},
+    {"castor_embedding_tokens_total", "Input tokens embedded by the embeddings endpoint"},
+    {"castor_session_resumes_total", "Turns that continued a session snapshot instead of re-prefilling"},
+    {"castor_session_resumed_tokens_total", "Prompt tokens skipped by resuming session snapshots"},
+    {"castor_session_spills_total", "Session snapshots written to disk"},
+    {"castor_session_restores_total", "Session snapshots mapped back in from disk"},
+    {"castor_replica_affinity_routes_total", "Requests routed to the replica preferred by their prefix or session"},
+    {"castor_replica_rebalanced_routes_total", "Requests moved off a busier preferred replica to the least loaded one"},
+};
+
+const MetricInfo kGaugeInfo[kNumGauges] = {
+    {"castor_queue_depth", "Inference requests admitted and not yet completed"},
+    {"castor_response_cache_bytes", "Bytes held by the response cache"},
+    {"castor_worker_queue_depth", "Inference tasks waiting for a worker thread"},
+    {"castor_scheduler_pending", "Generations waiting for (or paused out of) a batch slot"},
+    {"castor_model_resident_bytes", "Estimated memory held by loaded models"},
+    {"castor_session_resident_bytes", "Session snapshot bytes held in RAM"},
+    {"castor_session_disk_bytes", "Session snapshot bytes held on disk"},
+};
+
+struct HistogramInfo {
+    const char* name;
+    const char* labels; // Constant label set such as class="batch", or nullptr
+    const char* help;
+    double scale;       // Multiplier from observed value to stored integer
+    uint64_t export_lo; // Smallest scaled bucket bound rendered
+    uint64_t export_hi; // Largest scaled bucket bound rendered
+};
+
+// Seconds are stored as integer nanoseconds and exported from 1us to ~137s.
+// Rates are stored in milli-units and exported from 0.1/s to ~1M/s.
+const HistogramInfo kHistogramInfo[kNumHistograms] = {
+    {"castor_request_duration_seconds", nullptr, "End-to-end /infer handler latency", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_tokenize_duration_seconds", nullptr, "Time spent in Tokenizer::encode", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_prefill_duration_seconds", nullptr, "Time spent processing the prompt", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_decode_token_duration_seconds", nullptr, "Time per generated token", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_time_to_first_token_seconds", nullptr, "Request arrival to first token", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_request_tokens_per_second", nullptr, "Per-request engine throughput", 1e3, 100, uint64_t{1} << 30},
+    // Consecutive entries sharing a name render as one labelled family
+    {"castor_scheduler_request_duration_seconds", "class=\"interactive\"", "Scheduler submit to completion, by class",
+     1e9, 1000, uint64_t{1} << 37},
+    {"castor_scheduler_request_duration_seconds", "class=\"default\"", "", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_scheduler_request_duration_seconds", "class=\"batch\"", "", 1e9, 1000, uint64_t{1} << 37},
+    {"castor_scheduler_iteration_duration_seconds", nullptr, "Scheduler iteration (prefill chunk plus decode steps)",
+     1e9, 1000, uint64_t{1} << 37},
+    {"castor_embedding_batch_duration_seconds", nullptr, "Forward pass and pooling for one packed embedding batch",
+     1e9, 1000, uint64_t{1} << 37},
+};
+
+// Single-writer cell: only the owning thread stores, the scraper loads.
+// Plain load+store (no RMW) keeps the hot path free of locked instructions.
+template <typename T>
+inline void bump(std::atomic<T>& cell, T delta) {
+    cell.store(cell.load(std::memory_order_relaxed) + delta, std::memory_order_relaxed);
+}
+
+struct alignas(64) HistogramShard {
+    std::array<std::atomic<uint64_t>, kNumBuckets> buckets{};
+    std::atomic<uint64_t> count{0};
+    std::atomic<uint64_t> sum{0};
+};
+
+struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, kNumEndpoints> requests{};
+    std::array<std::atomic<uint64_t>, kNumEndpoints> response_bytes{};
+    std::array<std::atomic<uint64_t>, kNumEndpoints> cpu_ns{};
+    std::array<std::atomic<uint64_t>, kNumEndpoints> allocations{};
+    std::array<std::atomic<uint64_t>, kNumEndpoints> allocated_bytes{};
+    std::array<std::atomic<uint64_t>, kNumCounters> counters{};
+    std::array<std::atomic<int64_t>, kNumGauges> gauges{};
+    std::array<HistogramShard, kNumHistograms> histograms{};
+};
+
+// Plain (non-atomic) totals used for merging and for retired threads
+struct Totals {
+    std::array<uint64_t, kNumEndpoints> requests{};
+    std::array<uint64_t, kNumEndpoints> response_bytes{};
+    std::array<uint64_t, kNumEndpoints> cpu_ns{};
+    std::array<uint64_t, kNumEndpoints> allocations{};
+    std::array<uint64_t, kNumEndpoints> allocated_bytes{};
+    std::array<uint64_t, kNumCounters> counters{};
+    std::array<int64_t, kNumGauges> gauges{};
+    std::array<std::array<uint64_t, kNumBuckets>, kNumHistograms> buckets{};
+    std::array<uint64_t, kNumHistograms> hist_count{};
+    std::array<uint64_t, kNumHistograms> hist_sum{};
+
+    void accumulate(const Shard& s) {
+        constexpr auto r = std::memory_order_relaxed;
+        for (size_t i = 0; i < kNumEndpoints; ++i) {
+            requests[i] += s.requests[i].load(r);
+            response_bytes[i] += s.response_bytes[i].load(r);
+            cpu_ns[i] += s.cpu_ns[i].load(r);
+            allocations[i] += s.allocations[i].load(r);
+            allocated_bytes[i] += s.allocated_bytes[i].load(r);
+        }
+        for (size_t i = 0; i < kNumCounters; ++i) counters[i] += s.counters[i].load(r);
+        for (size_t i = 0; i < kNumGauges; ++i) gauges[i] += s.gauges[i].load(r);
+        for (size_t h = 0; h < kNumHistograms; ++h) {
+            const auto& hs = s.histograms[h];
+            for (size_t b = 0; b < kNumBuckets; ++b) buckets[h][b] += hs.buckets[b].load(r);
+            hist_count[h] += hs.count.load(r);
+            hist_sum[h] += hs.sum.load(r);
+        }
+    }
+};
+
+class Registry {
+public:
+    static Registry& instance() {
+        // Leaked on purpose: thread_local shard owners may unregister during
+        // static destruction, after a function-local static would be gone.
+        static Registry* registry = new Registry();
+        return *registry;
+    }
+
+    void attach(Shard* shard) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        live_.push_back(shard);
+    }
+
+    void detach(Shard* shard) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        retired_.accumulate(*shard);
+        for (auto it = live_.begin(); it != live_.end(); ++it) {
+            if (*it == shard) {
+                live_.erase(it);
+                break;
+            }
+        }
+    }
+
+    Totals merge() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Totals totals = retired_;
+        for (const Shard* shard : live_) {
+            totals.accumulate(*shard);
+        }
+        return totals;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<Shard*> live_;
+    Totals retired_;
+};
+
+class ShardOwner {
+public:
+    ShardOwner() : shard_(std::make_unique<Shard>()) { Registry::instance().attach(shard_.get()); }
+    ~ShardOwner() { Registry::instance().detach(shard_.get()); }
+    Shard& shard() { return *shard_; }
+
+private:
+    std::unique_ptr<Shard> shard_;
+};
+
+inline Shard& local_shard() {
+    thread_local ShardOwner owner;
+    return owner.shard();
+}
+
+void write_histogram(std::ostringstream& out, size_t h, const Totals& totals) {
+    const auto& info = kHistogramInfo[h];
+    if (h == 0 || std::strcmp(kHistogramInfo[h - 1].name, info.name) != 0) {
+        out << "# HELP " << info.name << " " << info.help << "\n";
+        out << "# TYPE " << info.name << " histogram\n";
+    }
+    const std::string labels = info.labels ? info.labels : "";
+    const std::string prefix = labels.empty() ? "" : labels + ",";
+    const std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+
+    const size_t first = Metrics::bucket_index(info.export_lo);
+    const size_t last = Metrics::bucket_index(info.export_hi);
+
+    uint64_t cumulative = 0;
+    for (size_t b = 0; b < first; ++b) cumulative += totals.buckets[h][b];
+    for (size_t b = first; b <= last; ++b) {
+        cumulative += totals.buckets[h][b];
+        out << info.name << "_bucket{" << prefix << "le=\""
+            << static_cast<double>(Metrics::bucket_upper_bound(b)) / info.scale << "\"} " << cumulative << "\n";
+    }
+    out << info.name << "_bucket{" << prefix << "le=\"+Inf\"} " << totals.hist_count[h] << "\n";
+    out << info.name << "_sum" << suffix << " " << static_cast<double>(totals.hist_sum[h]) / info.scale << "\n";
+    out << info.name << "_count" << suffix << " " << totals.hist_count[h] << "\n";
+}
+
+} // namespace
+
+size_t Metrics::bucket_index(uint64_t value) {
+    if (value < kSubBuckets) {
+        return static_cast<size_t>(value);
+    }
+    const size_t msb = 63 - static_cast<size_t>(std::countl_zero(value));
+    const size_t sub = static_cast<size_t>(value >> (msb - kSubBits)) & (kSubBuckets - 1);
+    return (msb - kSubBits + 1) * kSubBuckets + sub;
+}
+
+uint64_t Metrics::bucket_upper_bound(size_t index) {
+    if (index < kSubBuckets) {
+        return index + 1;
+    }
+    const size_t msb = index / kSubBuckets - 1 + kSubBits;
+    const uint64_t sub = index % kSubBuckets;
+    const uint64_t width = uint64_t{1} << (msb - kSubBits);
+    return (kSubBuckets + sub) * width + width;
+}
+
+void Metrics::count_request(Endpoint endpoint) {
+    bump(local_shard().requests[static_cast<size_t>(endpoint)], uint64_t{1});
+}
+
+void Metrics::add_response_bytes(Endpoint endpoint, uint64_t bytes) {
+    bump(local_shard().response_bytes[static_cast<size_t>(endpoint)], bytes);
+}
+
+void Metrics::add_request_resources(Endpoint endpoint, const ResourceUsage& usage) {
+    const size_t i = static_cast<size_t>(endpoint);
+    Shard& shard = local_shard();
+    bump(shard.cpu_ns[i], usage.cpu_ns);
+    bump(shard.allocations[i], usage.allocations);
+    bump(shard.allocated_bytes[i], usage.allocated_bytes);
+}
+
+void Metrics::add(Counter counter, uint64_t value) {
+    bump(local_shard().counters[static_cast<size_t>(counter)], value);
+}
+
+void Metrics::gauge_add(Gauge gauge, int64_t delta) {
+    bump(local_shard().gauges[static_cast<size_t>(gauge)], delta);
+}
+
+void Metrics::observe(Histogram histogram, double value) {
+    const size_t h = static_cast<size_t>(histogram);
+    const double scaled = value * kHistogramInfo[h].scale;
+    const uint64_t v = scaled <= 0.0 ? 0 : static_cast<uint64_t>(std::llround(scaled));
+
+    auto& hs = local_shard().histograms[h];
+    bump(hs.buckets[bucket_index(v)], uint64_t{1});
+    bump(hs.count, uint64_t{1});
+    bump(hs.sum, v);
+}
+
+uint64_t Metrics::counter_value(Counter counter) {
+    return Registry::instance().merge().counters[static_cast<size_t>(counter)];
+}
+
+uint64_t Metrics::histogram_count(Histogram histogram) {
+    return Registry::instance().merge().hist_count[static_cast<size_t>(histogram)];
+}
+
+std::string Metrics::render_prometheus() {
+    const Totals totals = Registry::instance().merge();
+    std::ostringstream out;
+
+    out << "# HELP castor_http_requests_total HTTP requests served, by endpoint\n";
+    out << "# TYPE castor_http_requests_total counter\n";
+    for (size_t i = 0; i < kNumEndpoints; ++i) {
+        out << "castor_http_requests_total{endpoint=\"" << kEndpointNames[i] << "\"} " << totals.requests[i] << "\n";
+    }
+
+    out << "# HELP castor_http_response_bytes_total Response body bytes serialized, by endpoint\n";
+    out << "# TYPE castor_http_response_bytes_total counter\n";
+    for (size_t i = 0; i < kNumEndpoints; ++i) {
+        out << "castor_http_response_bytes_total{endpoint=\"" << kEndpointNames[i] << "\"} "
+            << totals.response_bytes[i] << "\n";
+    }
+
+    // Only non-zero while resource accounting is enabled (allocations also need CASTOR_ALLOC_ACCOUNTING)
+    out << "# HELP castor_http_cpu_seconds_total Thread CPU time spent serving requests, by endpoint\n";
+    out << "# TYPE castor_http_cpu_seconds_total counter\n";
+    for (size_t i = 0; i < kNumEndpoints; ++i) {
+        out << "castor_http_cpu_seconds_total{endpoint=\"" << kEndpointNames[i] << "\"} "
+            << static_cast<double>(totals.cpu_ns[i]) / 1e9 << "\n";
+    }
+    out << "# HELP castor_http_allocations_total Heap allocations made while serving requests, by endpoint\n";
+    out << "# TYPE castor_http_allocations_total counter\n";
+    for (size_t i = 0; i < kNumEndpoints; ++i) {
+        out << "castor_http_allocations_total{endpoint=\"" << kEndpointNames[i] << "\"} "
+            << totals.allocations[i] << "\n";
+    }
+    out << "# HELP castor_http_allocated_bytes_total Heap bytes allocated while serving requests, by endpoint\n";
+    out << "# TYPE castor_http_allocated_bytes_total counter\n";
+    for (size_t i = 0; i < kNumEndpoints; ++i) {
+        out << "castor_http_allocated_bytes_total{endpoint=\"" << kEndpointNames[i] << "\"} "
+            << totals.allocated_bytes[i] << "\n";
+    }
+
+    for (size_t i = 0; i < kNumCounters; ++i) {
+        out << "# HELP " << kCounterInfo[i].name << " " << kCounterInfo[i].help << "\n";
+        out << "# TYPE " << kCounterInfo[i].name << " counter\n";
+        out << kCounterInfo[i].name << " " << totals.counters[i] << "\n";
+    }
+
+    for (size_t i = 0; i < kNumGauges; ++i) {
+        out << "# HELP " << kGaugeInfo[i].name << " " << kGaugeInfo[i].help << "\n";
+        out << "# TYPE " << kGaugeInfo[i].name << " gauge\n";
+        out << kGaugeInfo[i].name << " " << totals.gauges[i] << "\n";
+    }
+
+    for (size_t h = 0; h < kNumHistograms; ++h) {
+        write_histogram(out, h, totals);
+    }
+
+    return out.str();
+}
+
+} // namespace castor
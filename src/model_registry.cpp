@@ -0,0 +1,248 @@
+#include "model_registry.hpp"
+#include "metrics.hpp"
+#include <filesystem>
+#include <iostream>
+
+namespace castor {
+
+ModelRegistry::ModelRegistry(const Options& options, std::shared_ptr<WorkerPool> workers)
+    : options_(options), workers_(std::move(workers)) {}
+
+ModelRegistry::~ModelRegistry() {
+    Metrics::gauge_add(Gauge::ModelResidentBytes, -static_cast<int64_t>(resident_bytes_));
+}
+
+size_t ModelRegistry::estimate_bytes(const ModelConfig& config) {
+    return MemoryAccountant::estimate_weight_bytes(config);
+}
+
+bool ModelRegistry::add(const ModelSpec& spec) {
+    if (spec.name.empty()) {
+        std::cerr << "[Models] Model name must not be empty\n";
+        return false;
+    }
+    if (spec.draft == spec.name) {
+        std::cerr << "[Models] Model " << spec.name << " cannot be its own draft\n";
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto entry = std::make_unique<Entry>();
+    entry->spec = spec;
+    entry->spec.config.model_name = spec.name;
+    if (entry->spec.memory_bytes == 0) {
+        // A budgeted engine reserves its whole budget up front
+        const size_t budget = entry->spec.config.memory_budget_bytes;
+        entry->spec.memory_bytes = budget > 0 ? budget : estimate_bytes(entry->spec.config);
+    }
+    if (!entries_.emplace(spec.name, std::move(entry)).second) {
+        std::cerr << "[Models] Duplicate model name: " << spec.name << "\n";
+        return false;
+    }
+    if (default_name_.empty()) {
+        default_name_ = spec.name;
+    }
+    return true;
+}
+
+bool ModelRegistry::contains(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.count(name) > 0;
+}
+
+std::string ModelRegistry::default_model() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return default_name_;
+}
+
+const ModelSpec* ModelRegistry::spec(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(name.empty() ? default_name_ : name);
+    return it == entries_.end() ? nullptr : &it->second->spec;
+}
+
+std::vector<ModelRegistry::Status> ModelRegistry::status() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Status> result;
+    result.reserve(entries_.size());
+    for (const auto& [name, entry] : entries_) {
+        Status s;
+        s.name = name;
+        s.loaded = entry->model != nullptr;
+        s.bytes = entry->spec.memory_bytes;
+        if (entry->model) {
+            s.memory = entry->model->engine->memory_report();
+        }
+        result.push_back(std::move(s));
+    }
+    return result;
+}
+
+size_t ModelRegistry::resident_bytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return resident_bytes_;
+}
+
+std::shared_ptr<Tokenizer> ModelRegistry::shared_tokenizer(const std::string& path) {
+    std::error_code ec;
+    std::string key = std::filesystem::weakly_canonical(path, ec).string();
+    if (ec || key.empty()) {
+        key = path;
+    }
+
+    std::lock_guard<std::mutex> lock(tokenizer_mutex_);
+    if (auto existing = tokenizers_[key].lock()) {
+        return existing;
+    }
+    auto tokenizer = std::make_shared<Tokenizer>();
+    if (!tokenizer->load(path)) {
+        return nullptr;
+    }
+    tokenizers_[key] = tokenizer;
+    return tokenizer;
+}
+
+bool ModelRegistry::draft_cycle(const std::string& name) const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::string current = name;
+    for (size_t hops = 0; hops <= entries_.size(); ++hops) {
+        auto it = entries_.find(current);
+        if (it == entries_.end() || it->second->spec.draft.empty()) {
+            return false;
+        }
+        current = it->second->spec.draft;
+        if (current == name) {
+            return true;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<ModelRegistry::Model> ModelRegistry::load(const ModelSpec& spec) {
+    std::cout << "[Models] Loading " << spec.name << " from " << spec.engine_path << "\n";
+    auto model = std::make_shared<Model>();
+    model->spec = spec;
+    model->bytes = spec.memory_bytes;
+
+    model->tokenizer = shared_tokenizer(spec.tokenizer_path);
+    if (!model->tokenizer) {
+        std::cerr << "[Models] Failed to load tokenizer for " << spec.name << ": " << spec.tokenizer_path << "\n";
+        return nullptr;
+    }
+    model->engine = std::make_shared<Engine>();
+    if (!model->engine->initialize(spec.engine_path, spec.config)) {
+        std::cerr << "[Models] Failed to initialize engine for " << spec.name << "\n";
+        return nullptr;
+    }
+    model->engine->set_tokenizer(model->tokenizer);
+    if (!spec.draft.empty()) {
+        if (draft_cycle(spec.name)) {
+            std::cerr << "[Models] Draft chain of " << spec.name << " loops back to itself\n";
+            return nullptr;
+        }
+        model->draft = acquire(spec.draft);
+        if (!model->draft || !model->engine->set_draft(model->draft->engine, spec.speculative)) {
+            std::cerr << "[Models] Draft model " << spec.draft << " unusable for " << spec.name << "\n";
+            return nullptr;
+        }
+    }
+    if (options_.scheduler_enabled) {
+        model->scheduler = std::make_shared<Scheduler>(model->engine, options_.scheduler, workers_);
+    }
+    Metrics::add(Counter::ModelLoads);
+    return model;
+}
+
+void ModelRegistry::make_room(size_t bytes, const Entry* loading, std::vector<std::shared_ptr<Model>>& victims) {
+    if (options_.memory_budget_bytes == 0) {
+        return;
+    }
+    while (resident_bytes_ + bytes > options_.memory_budget_bytes) {
+        Entry* victim = nullptr;
+        for (auto& [name, entry] : entries_) {
+            // use_count 1 means only the registry holds it: no request in flight
+            if (entry.get() == loading || !entry->model || entry->model.use_count() > 1) {
+                continue;
+            }
+            if (!victim || entry->last_used < victim->last_used) {
+                victim = entry.get();
+            }
+        }
+        if (!victim) {
+            std::cerr << "[Models] Memory budget exceeded: " << ((resident_bytes_ + bytes) >> 20) << " MB needed, "
+                      << (options_.memory_budget_bytes >> 20) << " MB budget, no idle model to evict\n";
+            return;
+        }
+        std::cout << "[Models] Evicting " << victim->spec.name << "\n";
+        resident_bytes_ -= victim->model->bytes;
+        Metrics::gauge_add(Gauge::ModelResidentBytes, -static_cast<int64_t>(victim->model->bytes));
+        Metrics::add(Counter::ModelEvictions);
+        victims.push_back(std::move(victim->model));
+        victim->model.reset();
+    }
+}
+
+std::shared_ptr<ModelRegistry::Model> ModelRegistry::acquire(const std::string& name) {
+    Entry* entry = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(name.empty() ? default_name_ : name);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+        entry = it->second.get();
+        if (entry->model) {
+            entry->last_used = ++clock_;
+            return entry->model;
+        }
+    }
+
+    std::lock_guard<std::mutex> load_lock(entry->load_mutex);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (entry->model) { // Loaded by a concurrent request while we waited
+            entry->last_used = ++clock_;
+            return entry->model;
+        }
+    }
+
+    // Evict before loading, so old and new weights are never resident together.
+    // The new model's bytes are reserved up front: a concurrent load of another
+    // model makes room for them too.
+    const size_t bytes = entry->spec.memory_bytes;
+    {
+        std::vector<std::shared_ptr<Model>> victims;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            make_room(bytes, entry, victims);
+            resident_bytes_ += bytes;
+            Metrics::gauge_add(Gauge::ModelResidentBytes, static_cast<int64_t>(bytes));
+        }
+        victims.clear(); // Engines and schedulers shut down outside the lock
+    }
+
+    std::shared_ptr<Model> model = load(entry->spec);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!model) {
+        resident_bytes_ -= bytes;
+        Metrics::gauge_add(Gauge::ModelResidentBytes, -static_cast<int64_t>(bytes));
+        return nullptr;
+    }
+    entry->model = model;
+    entry->last_used = ++clock_;
+    return model;
+}
+
+bool ModelRegistry::preload(const std::vector<std::string>& names) {
+    bool ok = true;
+    for (const auto& name : names) {
+        if (!contains(name)) {
+            std::cerr << "[Models] Cannot preload unknown model: " << name << "\n";
+            ok = false;
+            continue;
+        }
+        ok = acquire(name) != nullptr && ok;
+    }
+    return ok;
+}
+
+} // namespace castor
@@ -0,0 +1,14 @@
+#include "resource_accounting.hpp"
+#include <ctime>
+
+namespace castor {
+
+uint64_t ResourceAccounting::thread_cpu_ns() {
+    timespec ts{};
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+        return 0;
+    }
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+} // namespace castor
@@ -0,0 +1,254 @@
+#include "response_cache.hpp"
+#include "hash.hpp"
+#include "metrics.hpp"
+#include "stop_sequences.hpp"
+#include <algorithm>
+#include <cstring>
+
+namespace castor {
+
+namespace {
+
+template <typename T>
+void append_pod(std::string& out, const T& value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+} // namespace
+
+size_t ResponseCache::KeyHash::operator()(std::string_view key) const {
+    return static_cast<size_t>(XXH64::hash(key));
+}
+
+ResponseCache::ResponseCache() : ResponseCache(Options()) {}
+
+ResponseCache::ResponseCache(const Options& options) : options_(options) {
+    options_.num_shards = std::max<size_t>(1, options_.num_shards);
+    shard_budget_ = options_.max_bytes / options_.num_shards;
+    shards_.reserve(options_.num_shards);
+    for (size_t i = 0; i < options_.num_shards; ++i) {
+        shards_.push_back(std::make_unique<Shard>());
+    }
+}
+
+std::string ResponseCache::make_key(const std::string& model_id, const std::vector<int32_t>& tokens,
+                                    const SamplingParams& params) {
+    SamplingParams canonical = params;
+    if (canonical.is_greedy()) {
+        canonical.temperature = 0.0f;
+        canonical.top_k = 0;
+        canonical.top_p = 1.0f;
+        canonical.seed = 0;
+    }
+
+    std::string key;
+    key.reserve(sizeof(uint32_t) + model_id.size() + 32 + tokens.size() * sizeof(int32_t));
+    append_pod(key, static_cast<uint32_t>(model_id.size()));
+    key.append(model_id);
+    append_pod(key, canonical.max_tokens);
+    append_pod(key, canonical.temperature);
+    append_pod(key, canonical.top_k);
+    append_pod(key, canonical.top_p);
+    append_pod(key, canonical.seed);
+    append_pod(key, static_cast<uint32_t>(tokens.size()));
+    key.append(reinterpret_cast<const char*>(tokens.data()), tokens.size() * sizeof(int32_t));
+    if (canonical.stop) {
+        for (const auto& stop : canonical.stop->strings()) {
+            append_pod(key, static_cast<uint32_t>(stop.size()));
+            key.append(stop);
+        }
+        const auto& ids = canonical.stop->token_ids();
+        append_pod(key, static_cast<uint32_t>(ids.size()));
+        key.append(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(int32_t));
+    }
+    return key;
+}
+
+size_t ResponseCache::entry_bytes(const std::string& key, const GenerationResult& value) {
+    return key.size() * 2 + sizeof(Entry) + sizeof(GenerationResult) + 64 +
+           value.output_ids.capacity() * sizeof(int32_t) + value.logprobs.capacity() * sizeof(float) +
+           value.finish_reason.capacity() + value.output_text.capacity() + value.stop_sequence.capacity();
+}
+
+ResponseCache::Shard& ResponseCache::shard_for(const std::string& key) {
+    // Use the high bits for the shard so the bucket index (low bits) stays independent
+    const uint64_t h = XXH64::hash(key);
+    return *shards_[(h >> 32) % shards_.size()];
+}
+
+void ResponseCache::erase_locked(Shard& shard, std::list<Entry>::iterator it) {
+    shard.bytes -= it->bytes;
+    Metrics::gauge_add(Gauge::CacheBytes, -static_cast<int64_t>(it->bytes));
+    shard.index.erase(std::string_view(it->key));
+    shard.lru.erase(it);
+}
+
+ResponseCache::Value ResponseCache::lookup_locked(Shard& shard, const std::string& key) {
+    auto found = shard.index.find(std::string_view(key));
+    if (found == shard.index.end()) {
+        return nullptr;
+    }
+    auto it = found->second;
+    if (std::chrono::steady_clock::now() >= it->expires) {
+        erase_locked(shard, it);
+        return nullptr;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it);
+    return it->value;
+}
+
+void ResponseCache::insert_locked(Shard& shard, const std::string& key, Value value) {
+    if (!value) {
+        return;
+    }
+    const size_t bytes = entry_bytes(key, *value);
+    if (bytes > shard_budget_) {
+        return;
+    }
+
+    auto existing = shard.index.find(std::string_view(key));
+    if (existing != shard.index.end()) {
+        erase_locked(shard, existing->second);
+    }
+
+    while (shard.bytes + bytes > shard_budget_ && !shard.lru.empty()) {
+        erase_locked(shard, std::prev(shard.lru.end()));
+        ++shard.evictions;
+        Metrics::add(Counter::CacheEvictions);
+    }
+
+    shard.lru.push_front(Entry{key, std::move(value), bytes, std::chrono::steady_clock::now() + options_.ttl});
+    shard.index.emplace(std::string_view(shard.lru.front().key), shard.lru.begin());
+    shard.bytes += bytes;
+    Metrics::gauge_add(Gauge::CacheBytes, static_cast<int64_t>(bytes));
+}
+
+ResponseCache::Value ResponseCache::lookup(const std::string& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    Value value = lookup_locked(shard, key);
+    if (value) {
+        ++shard.hits;
+        Metrics::add(Counter::CacheHits);
+    } else {
+        ++shard.misses;
+        Metrics::add(Counter::CacheMisses);
+    }
+    return value;
+}
+
+void ResponseCache::insert(const std::string& key, Value value) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    insert_locked(shard, key, std::move(value));
+}
+
+ResponseCache::Claim ResponseCache::claim(const std::string& key) {
+    Shard& shard = shard_for(key);
+    Claim claim;
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if ((claim.value = lookup_locked(shard, key))) {
+        ++shard.hits;
+        Metrics::add(Counter::CacheHits);
+        claim.outcome = Outcome::Hit;
+        return claim;
+    }
+
+    auto pending = shard.in_flight.find(key);
+    if (pending != shard.in_flight.end()) {
+        ++shard.coalesced;
+        Metrics::add(Counter::CacheCoalesced);
+        claim.outcome = Outcome::Coalesced;
+        claim.pending = pending->second;
+        return claim;
+    }
+
+    ++shard.misses;
+    Metrics::add(Counter::CacheMisses);
+    shard.in_flight.emplace(key, AsyncResult<Value>::create());
+    claim.outcome = Outcome::Miss;
+    return claim;
+}
+
+AsyncResult<ResponseCache::Value> ResponseCache::take_in_flight(Shard& shard, const std::string& key) {
+    AsyncResult<Value> result;
+    auto pending = shard.in_flight.find(key);
+    if (pending != shard.in_flight.end()) {
+        result = std::move(pending->second);
+        shard.in_flight.erase(pending);
+    }
+    return result;
+}
+
+void ResponseCache::publish(const std::string& key, Value value) {
+    Shard& shard = shard_for(key);
+    AsyncResult<Value> waiters;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        insert_locked(shard, key, value);
+        waiters = take_in_flight(shard, key);
+    }
+    // Resumed outside the lock: waiters may touch the cache again
+    if (waiters.valid()) {
+        waiters.set_value(std::move(value));
+    }
+}
+
+void ResponseCache::fail(const std::string& key, std::exception_ptr error) {
+    Shard& shard = shard_for(key);
+    AsyncResult<Value> waiters;
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        waiters = take_in_flight(shard, key);
+    }
+    if (waiters.valid()) {
+        waiters.set_exception(std::move(error));
+    }
+}
+
+ResponseCache::Value ResponseCache::get_or_compute(const std::string& key, const Compute& compute, Outcome* outcome) {
+    Claim claim = this->claim(key);
+    if (outcome) *outcome = claim.outcome;
+    if (claim.outcome == Outcome::Hit) {
+        return claim.value;
+    }
+    if (claim.outcome == Outcome::Coalesced) {
+        return claim.pending.get();
+    }
+
+    // Leader: compute outside the lock, then publish to cache and waiters
+    Value value;
+    try {
+        value = compute();
+    } catch (...) {
+        fail(key, std::current_exception());
+        throw;
+    }
+    publish(key, value);
+    return value;
+}
+
+ResponseCache::Stats ResponseCache::stats() const {
+    Stats stats;
+    for (const auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        stats.hits += shard->hits;
+        stats.misses += shard->misses;
+        stats.coalesced += shard->coalesced;
+        stats.evictions += shard->evictions;
+        stats.entries += shard->lru.size();
+        stats.bytes += shard->bytes;
+    }
+    return stats;
+}
+
+void ResponseCache::clear() {
+    for (auto& shard : shards_) {
+        std::lock_guard<std::mutex> lock(shard->mutex);
+        while (!shard->lru.empty()) {
+            erase_locked(*shard, shard->lru.begin());
+        }
+    }
+}
+
+} // namespace castor
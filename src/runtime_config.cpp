@@ -0,0 +1,295 @@
+#include "runtime_config.hpp"
+#include "affinity.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace castor {
+
+namespace {
+
+bool parse_cpus(const std::string& list, std::vector<int>& cpus, const char* what) {
+    if (!Affinity::parse_cpu_list(list, cpus)) {
+        std::cerr << "[Config] Invalid CPU list for " << what << ": '" << list << "'\n";
+        return false;
+    }
+    return true;
+}
+
+bool parse_count(const char* text, size_t& out, const char* what) {
+    char* end = nullptr;
+    const long long value = std::strtoll(text, &end, 10);
+    if (end == text || *end != '\0' || value < 0) {
+        std::cerr << "[Config] Invalid value for " << what << ": '" << text << "'\n";
+        return false;
+    }
+    out = static_cast<size_t>(value);
+    return true;
+}
+
+bool parse_millis(const char* text, double& out, const char* what) {
+    char* end = nullptr;
+    const double value = std::strtod(text, &end);
+    if (end == text || *end != '\0' || value < 0.0) {
+        std::cerr << "[Config] Invalid value for " << what << ": '" << text << "'\n";
+        return false;
+    }
+    out = value;
+    return true;
+}
+
+std::vector<std::string> split_names(const std::string& list) {
+    std::vector<std::string> names;
+    size_t start = 0;
+    while (start <= list.size()) {
+        const size_t comma = std::min(list.find(',', start), list.size());
+        if (comma > start) {
+            names.push_back(list.substr(start, comma - start));
+        }
+        start = comma + 1;
+    }
+    return names;
+}
+
+ModelSpec parse_model_spec(const json& m) {
+    ModelSpec spec;
+    spec.name = m.at("name").get<std::string>();
+    spec.engine_path = m.value("engine", "models/" + spec.name + ".plan");
+    spec.tokenizer_path = m.value("tokenizer", std::string("models/tokenizer.json"));
+    spec.memory_bytes = m.value("memory_mb", size_t{0}) << 20;
+    ModelConfig& c = spec.config;
+    c.max_batch_size = m.value("max_batch_size", c.max_batch_size);
+    c.max_seq_length = m.value("max_seq_length", c.max_seq_length);
+    c.vocab_size = m.value("vocab_size", c.vocab_size);
+    c.hidden_dim = m.value("hidden_dim", c.hidden_dim);
+    c.ffn_dim = m.value("ffn_dim", c.ffn_dim);
+    c.num_layers = m.value("num_layers", c.num_layers);
+    c.eos_token_id = m.value("eos_token_id", c.eos_token_id);
+    c.memory_budget_bytes = m.value("memory_budget_mb", size_t{0}) << 20;
+    c.kv_block_tokens = m.value("kv_block_tokens", c.kv_block_tokens);
+    c.huge_pages = m.value("huge_pages", c.huge_pages);
+    spec.draft = m.value("draft", std::string());
+    spec.speculative.k = m.value("speculative_k", spec.speculative.k);
+    spec.speculative.max_k = std::max(spec.speculative.max_k, spec.speculative.k);
+    spec.speculative.adaptive = m.value("speculative_adaptive", spec.speculative.adaptive);
+    return spec;
+}
+
+} // namespace
+
+const char* RuntimeConfig::usage() {
+    return "Usage: castor-rt [--config FILE] [--port N] [--bind ADDR] [--unix-socket PATH] [--no-tcp]\n"
+           "                 [--http-threads N] [--http-cpus LIST] [--inference-threads N]\n"
+           "                 [--inference-cpus LIST] [--no-numa-local] [--no-cache]\n"
+           "                 [--max-batch N] [--prefill-chunk N] [--target-iteration-ms MS] [--no-scheduler]\n"
+           "                 [--model-budget-mb N] [--preload NAME[,NAME...]] [--session-dir PATH] [--replicas N]\n"
+           "                 [--autotune | --retune] [--autotune-file PATH] [--slo-ms MS]\n"
+           "       castor-rt --batch IN.jsonl --out OUT.jsonl [--batch-size N] [--tokenize-threads N]\n"
+           "                 [--resume | --start-offset BYTES]\n"
+           "       castor-rt --self-test\n"
+           "  LIST is a cpulist such as 0-3,8,10-11; --replicas 0 builds one replica per NUMA node\n";
+}
+
+bool RuntimeConfig::load_file(const std::string& path, RuntimeConfig& config) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        std::cerr << "[Config] Failed to open config file: " << path << "\n";
+        return false;
+    }
+
+    try {
+        const json data = json::parse(file);
+
+        if (data.contains("server")) {
+            const auto& s = data["server"];
+            config.server.port = s.value("port", config.server.port);
+            config.server.bind_address = s.value("bind", config.server.bind_address);
+            config.server.unix_socket_path = s.value("unix_socket", config.server.unix_socket_path);
+            config.server.enable_tcp = s.value("tcp", config.server.enable_tcp);
+        }
+
+        if (data.contains("threads")) {
+            const auto& t = data["threads"];
+            config.server.http_threads = t.value("http", config.server.http_threads);
+            config.inference.threads = t.value("inference", config.inference.threads);
+            config.inference.numa_local = t.value("numa_local", config.inference.numa_local);
+            config.server.numa_local = config.inference.numa_local;
+            if (t.contains("http_cpus") &&
+                !parse_cpus(t["http_cpus"].get<std::string>(), config.server.http_cpus, "threads.http_cpus")) {
+                return false;
+            }
+            if (t.contains("inference_cpus") &&
+                !parse_cpus(t["inference_cpus"].get<std::string>(), config.inference.cpus, "threads.inference_cpus")) {
+                return false;
+            }
+        }
+
+        if (data.contains("cache")) {
+            const auto& c = data["cache"];
+            config.cache_enabled = c.value("enabled", config.cache_enabled);
+            config.cache.max_bytes = c.value("max_mb", config.cache.max_bytes >> 20) << 20;
+            config.cache.ttl = std::chrono::seconds(
+                c.value("ttl_seconds", std::chrono::duration_cast<std::chrono::seconds>(config.cache.ttl).count()));
+        }
+
+        if (data.contains("scheduler")) {
+            const auto& s = data["scheduler"];
+            config.scheduler_enabled = s.value("enabled", config.scheduler_enabled);
+            config.scheduler.max_batch = s.value("max_batch", config.scheduler.max_batch);
+            config.scheduler.prefill_chunk_tokens = s.value("prefill_chunk", config.scheduler.prefill_chunk_tokens);
+            config.scheduler.target_iteration_ms = s.value("target_iteration_ms", config.scheduler.target_iteration_ms);
+        }
+
+        if (data.contains("sessions")) {
+            const auto& s = data["sessions"];
+            config.sessions_enabled = s.value("enabled", config.sessions_enabled);
+            config.sessions.directory = s.value("dir", config.sessions.directory);
+            config.sessions.max_resident_bytes = s.value("ram_mb", config.sessions.max_resident_bytes >> 20) << 20;
+            config.sessions.idle_spill =
+                std::chrono::seconds(s.value("idle_seconds", config.sessions.idle_spill.count()));
+            config.sessions.compress = s.value("compress", config.sessions.compress);
+        }
+
+        if (data.contains("replicas")) {
+            const auto& r = data["replicas"];
+            config.replicas_enabled = r.value("enabled", config.replicas_enabled);
+            config.replicas.replicas = r.value("count", config.replicas.replicas);
+            config.replicas.threads_per_replica = r.value("threads", config.replicas.threads_per_replica);
+            config.replicas.affinity_tokens = r.value("affinity_tokens", config.replicas.affinity_tokens);
+            config.replicas.affinity_slack = r.value("affinity_slack", config.replicas.affinity_slack);
+        }
+
+        if (data.contains("autotune")) {
+            const auto& a = data["autotune"];
+            config.autotune = a.value("enabled", config.autotune);
+            config.autotuner.cache_path = a.value("file", config.autotuner.cache_path);
+            config.autotuner.itl_slo_ms = a.value("itl_slo_ms", config.autotuner.itl_slo_ms);
+            config.autotuner.ttft_slo_ms = a.value("ttft_slo_ms", config.autotuner.ttft_slo_ms);
+        }
+
+        if (data.contains("models")) {
+            const auto& m = data["models"];
+            config.model_budget_bytes = m.value("budget_mb", config.model_budget_bytes >> 20) << 20;
+            config.preload_models = m.value("preload", config.preload_models);
+            if (m.contains("list")) {
+                config.models.clear();
+                for (const auto& entry : m["list"]) {
+                    config.models.push_back(parse_model_spec(entry));
+                }
+            }
+        }
+
+        if (data.contains("batch")) {
+            const auto& b = data["batch"];
+            config.batch.batch_size = b.value("batch_size", config.batch.batch_size);
+            config.batch.tokenize_threads = b.value("tokenize_threads", config.batch.tokenize_threads);
+        }
+    } catch (const json::exception& e) {
+        std::cerr << "[Config] Error parsing " << path << ": " << e.what() << "\n";
+        return false;
+    }
+    return true;
+}
+
+bool RuntimeConfig::parse_args(int argc, char* argv[], RuntimeConfig& config) {
+    // The config file is applied first so explicit flags override it
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--config") {
+            if (i + 1 >= argc) {
+                std::cerr << "[Config] --config requires a path\n";
+                return false;
+            }
+            if (!load_file(argv[i + 1], config)) {
+                return false;
+            }
+        }
+    }
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if (arg == "--config" && has_value) {
+            ++i;
+        } else if (arg == "--port" && has_value) {
+            config.server.port = std::atoi(argv[++i]);
+        } else if (arg == "--bind" && has_value) {
+            config.server.bind_address = argv[++i];
+        } else if (arg == "--unix-socket" && has_value) {
+            config.server.unix_socket_path = argv[++i];
+        } else if (arg == "--no-tcp") {
+            config.server.enable_tcp = false;
+        } else if (arg == "--http-threads" && has_value) {
+            if (!parse_count(argv[++i], config.server.http_threads, "--http-threads")) return false;
+        } else if (arg == "--http-cpus" && has_value) {
+            if (!parse_cpus(argv[++i], config.server.http_cpus, "--http-cpus")) return false;
+        } else if (arg == "--inference-threads" && has_value) {
+            if (!parse_count(argv[++i], config.inference.threads, "--inference-threads")) return false;
+        } else if (arg == "--inference-cpus" && has_value) {
+            if (!parse_cpus(argv[++i], config.inference.cpus, "--inference-cpus")) return false;
+        } else if (arg == "--no-numa-local") {
+            config.inference.numa_local = false;
+            config.server.numa_local = false;
+        } else if (arg == "--no-cache") {
+            config.cache_enabled = false;
+        } else if (arg == "--max-batch" && has_value) {
+            if (!parse_count(argv[++i], config.scheduler.max_batch, "--max-batch")) return false;
+        } else if (arg == "--prefill-chunk" && has_value) {
+            if (!parse_count(argv[++i], config.scheduler.prefill_chunk_tokens, "--prefill-chunk")) return false;
+        } else if (arg == "--target-iteration-ms" && has_value) {
+            if (!parse_millis(argv[++i], config.scheduler.target_iteration_ms, "--target-iteration-ms")) return false;
+        } else if (arg == "--model-budget-mb" && has_value) {
+            size_t mb = 0;
+            if (!parse_count(argv[++i], mb, "--model-budget-mb")) return false;
+            config.model_budget_bytes = mb << 20;
+        } else if (arg == "--preload" && has_value) {
+            config.preload_models = split_names(argv[++i]);
+        } else if (arg == "--session-dir" && has_value) {
+            config.sessions_enabled = true;
+            config.sessions.directory = argv[++i];
+        } else if (arg == "--replicas" && has_value) {
+            config.replicas_enabled = true;
+            if (!parse_count(argv[++i], config.replicas.replicas, "--replicas")) return false;
+        } else if (arg == "--autotune") {
+            config.autotune = true;
+        } else if (arg == "--retune") {
+            config.autotune = true;
+            config.retune = true;
+        } else if (arg == "--autotune-file" && has_value) {
+            config.autotuner.cache_path = argv[++i];
+        } else if (arg == "--slo-ms" && has_value) {
+            if (!parse_millis(argv[++i], config.autotuner.itl_slo_ms, "--slo-ms")) return false;
+        } else if (arg == "--no-scheduler") {
+            config.scheduler_enabled = false;
+        } else if (arg == "--self-test") {
+            config.self_test = true;
+        } else if (arg == "--batch" && has_value) {
+            config.batch.input_path = argv[++i];
+        } else if (arg == "--out" && has_value) {
+            config.batch.output_path = argv[++i];
+        } else if (arg == "--batch-size" && has_value) {
+            if (!parse_count(argv[++i], config.batch.batch_size, "--batch-size")) return false;
+        } else if (arg == "--tokenize-threads" && has_value) {
+            if (!parse_count(argv[++i], config.batch.tokenize_threads, "--tokenize-threads")) return false;
+        } else if (arg == "--resume") {
+            config.batch.resume = true;
+        } else if (arg == "--start-offset" && has_value) {
+            size_t offset = 0;
+            if (!parse_count(argv[++i], offset, "--start-offset")) return false;
+            config.batch.start_offset = offset;
+        } else {
+            std::cerr << "Unknown or incomplete argument: " << arg << "\n";
+            return false;
+        }
+    }
+    if (config.batch_mode() && config.batch.output_path.empty()) {
+        std::cerr << "[Config] --batch requires --out\n";
+        return false;
+    }
+    return true;
+}
+
+} // namespace castor
@@ -0,0 +1,179 @@
+#include "sampler.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+
+namespace castor {
+
+namespace {
+std::atomic<size_t> g_nucleus_window{0};
+}
+
+void Sampler::set_nucleus_window(size_t candidates) {
+    g_nucleus_window.store(candidates, std::memory_order_relaxed);
+}
+
+size_t Sampler::nucleus_window() {
+    return g_nucleus_window.load(std::memory_order_relaxed);
+}
+
+Sampler::Sampler(uint64_t seed) : rng_(seed) {}
+
+int32_t Sampler::sample(const std::vector<float>& logits, const SamplingParams& params, float* logprob) {
+    if (logits.empty()) {
+        return -1;
+    }
+
+    const float temperature = params.is_greedy() ? 1.0f : params.temperature;
+    const float max_logit = *std::max_element(logits.begin(), logits.end());
+
+    // log-sum-exp over the full vocab for the reported logprob
+    double denom = 0.0;
+    for (float l : logits) {
+        denom += std::exp((l - max_logit) / temperature);
+    }
+    const double log_denom = std::log(denom);
+
+    auto token_logprob = [&](int32_t id) {
+        return static_cast<float>((logits[id] - max_logit) / temperature - log_denom);
+    };
+
+    if (params.is_greedy()) {
+        const int32_t id = static_cast<int32_t>(std::max_element(logits.begin(), logits.end()) - logits.begin());
+        if (logprob) {
+            *logprob = token_logprob(id);
+        }
+        return id;
+    }
+
+    size_t keep = 0;
+    const double total = prepare_candidates(logits, params, max_logit, keep);
+
+    std::uniform_real_distribution<double> pick(0.0, total);
+    double target = pick(rng_);
+    int32_t chosen = candidates_[keep - 1].second;
+    for (size_t i = 0; i < keep; ++i) {
+        target -= candidates_[i].first;
+        if (target <= 0.0) {
+            chosen = candidates_[i].second;
+            break;
+        }
+    }
+
+    if (logprob) {
+        *logprob = token_logprob(chosen);
+    }
+    return chosen;
+}
+
+double Sampler::prepare_candidates(const std::vector<float>& logits, const SamplingParams& params, float max_logit,
+                                   size_t& keep) {
+    candidates_.clear();
+    candidates_.reserve(logits.size());
+    for (size_t i = 0; i < logits.size(); ++i) {
+        candidates_.emplace_back((logits[i] - max_logit) / params.temperature, static_cast<int32_t>(i));
+    }
+
+    auto by_score = [](const auto& a, const auto& b) { return a.first > b.first; };
+    keep = candidates_.size();
+    size_t sorted = keep; // candidates_[0, sorted) are in descending order
+    if (params.top_k > 0 && params.top_k < keep) {
+        keep = params.top_k;
+        sorted = keep;
+        std::partial_sort(candidates_.begin(), candidates_.begin() + keep, candidates_.end(), by_score);
+    } else if (params.top_p < 1.0f) {
+        const size_t window = nucleus_window();
+        if (window > 0 && window < keep) {
+            sorted = window;
+            std::partial_sort(candidates_.begin(), candidates_.begin() + window, candidates_.end(), by_score);
+        } else {
+            std::sort(candidates_.begin(), candidates_.end(), by_score);
+        }
+    }
+
+    // Convert kept scores to unnormalized probabilities
+    double total = 0.0;
+    for (size_t i = 0; i < keep; ++i) {
+        candidates_[i].first = static_cast<float>(std::exp(candidates_[i].first));
+        total += candidates_[i].first;
+    }
+
+    // Candidates are sorted by score whenever top-k or top-p is active
+    if (params.top_p < 1.0f) {
+        double cumulative = 0.0;
+        size_t nucleus = 0;
+        while (nucleus < keep) {
+            if (nucleus == sorted) {
+                // The nucleus is wider than the window; exp() kept the order, so sort the rest now
+                std::sort(candidates_.begin() + sorted, candidates_.begin() + keep, by_score);
+                sorted = keep;
+            }
+            cumulative += candidates_[nucleus].first;
+            ++nucleus;
+            if (cumulative >= params.top_p * total) {
+                break;
+            }
+        }
+        keep = nucleus;
+        total = cumulative;
+    }
+    return total;
+}
+
+void Sampler::distribution(const std::vector<float>& logits, const SamplingParams& params, std::vector<float>& probs) {
+    probs.assign(logits.size(), 0.0f);
+    if (logits.empty()) {
+        return;
+    }
+    if (params.is_greedy()) {
+        probs[std::max_element(logits.begin(), logits.end()) - logits.begin()] = 1.0f;
+        return;
+    }
+    const float max_logit = *std::max_element(logits.begin(), logits.end());
+    size_t keep = 0;
+    const double total = prepare_candidates(logits, params, max_logit, keep);
+    for (size_t i = 0; i < keep; ++i) {
+        probs[candidates_[i].second] = static_cast<float>(candidates_[i].first / total);
+    }
+}
+
+int32_t Sampler::sample_from(const std::vector<float>& probs) {
+    double total = 0.0;
+    int32_t last = -1;
+    for (size_t i = 0; i < probs.size(); ++i) {
+        if (probs[i] > 0.0f) {
+            total += probs[i];
+            last = static_cast<int32_t>(i);
+        }
+    }
+    if (last < 0) {
+        return -1;
+    }
+    double target = uniform() * total;
+    for (size_t i = 0; i < probs.size(); ++i) {
+        target -= probs[i];
+        if (probs[i] > 0.0f && target <= 0.0) {
+            return static_cast<int32_t>(i);
+        }
+    }
+    return last;
+}
+
+double Sampler::uniform() {
+    return std::uniform_real_distribution<double>(0.0, 1.0)(rng_);
+}
+
+float Sampler::logprob(const std::vector<float>& logits, const SamplingParams& params, int32_t id) {
+    if (id < 0 || static_cast<size_t>(id) >= logits.size()) {
+        return 0.0f;
+    }
+    const float temperature = params.is_greedy() ? 1.0f : params.temperature;
+    const float max_logit = *std::max_element(logits.begin(), logits.end());
+    double denom = 0.0;
+    for (float l : logits) {
+        denom += std::exp((l - max_logit) / temperature);
+    }
+    return static_cast<float>((logits[id] - max_logit) / temperature - std::log(denom));
+}
+
+} // namespace castor
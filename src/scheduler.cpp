@@ -0,0 +1,441 @@
+#include "scheduler.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+
+namespace castor {
+
+namespace {
+
+constexpr double kEwmaWeight = 0.2;
+constexpr size_t kChunkGranularity = 16; // Autotuned chunks are a multiple of this
+// Recheck interval while every waiting request is blocked on KV blocks held
+// outside the scheduler (nothing signals their release)
+constexpr std::chrono::milliseconds kBlockedPoll{5};
+
+double ewma(double current, double sample) {
+    return current == 0.0 ? sample : current + kEwmaWeight * (sample - current);
+}
+
+Histogram class_histogram(Priority priority) {
+    switch (priority) {
+    case Priority::Interactive:
+        return Histogram::InteractiveRequestSeconds;
+    case Priority::Batch:
+        return Histogram::BatchRequestSeconds;
+    default:
+        return Histogram::DefaultRequestSeconds;
+    }
+}
+
+} // namespace
+
+Scheduler::Scheduler(std::shared_ptr<Engine> engine, const Options& options, std::shared_ptr<WorkerPool> workers)
+    : engine_(std::move(engine)), options_(options), workers_(std::move(workers)) {
+    options_.max_batch = std::max<size_t>(1, options_.max_batch);
+    thread_ = std::thread(&Scheduler::loop, this);
+}
+
+Scheduler::~Scheduler() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+}
+
+bool Scheduler::parse_priority(const std::string& text, Priority& priority) {
+    if (text == "interactive" || text == "high" || text == "0") {
+        priority = Priority::Interactive;
+    } else if (text == "default" || text == "normal" || text == "1") {
+        priority = Priority::Default;
+    } else if (text == "batch" || text == "low" || text == "2") {
+        priority = Priority::Batch;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+const char* Scheduler::priority_name(Priority priority) {
+    switch (priority) {
+    case Priority::Interactive:
+        return "interactive";
+    case Priority::Batch:
+        return "batch";
+    default:
+        return "default";
+    }
+}
+
+bool Scheduler::ahead_of(const Sequence& a, const Sequence& b) {
+    if (a.request.priority != b.request.priority) {
+        return a.request.priority < b.request.priority;
+    }
+    if (a.request.deadline != b.request.deadline) {
+        return a.request.deadline < b.request.deadline;
+    }
+    return a.order < b.order;
+}
+
+std::future<Scheduler::Outcome> Scheduler::submit(Request request) {
+    auto promise = std::make_shared<std::promise<Outcome>>();
+    std::future<Outcome> future = promise->get_future();
+    AsyncResult<Outcome> result = submit_async(std::move(request));
+    result.on_ready([promise, result]() { promise->set_value(result.get()); });
+    return future;
+}
+
+AsyncResult<Scheduler::Outcome> Scheduler::submit_async(Request request) {
+    auto sequence = std::make_unique<Sequence>();
+    sequence->request = std::move(request);
+    sequence->arrival = Clock::now();
+    sequence->result = AsyncResult<Outcome>::create();
+    AsyncResult<Outcome> result = sequence->result;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!stopping_) {
+            sequence->order = next_order_++;
+            incoming_.push_back(std::move(sequence));
+        }
+    }
+    if (sequence) {
+        // Completed outside the lock: callbacks may submit again
+        Outcome outcome;
+        outcome.status = Status::ShuttingDown;
+        result.set_value(std::move(outcome));
+        return result;
+    }
+    cv_.notify_one();
+    return result;
+}
+
+double Scheduler::estimate_remaining_seconds(const Sequence& sequence) const {
+    const SamplingParams& params = sequence.request.params;
+    const uint32_t generated = sequence.stream ? sequence.stream->tokens_generated() : 0;
+    const size_t prompt_left = sequence.stream ? sequence.stream->prompt_remaining()
+                                               : sequence.request.prompt_ids.size() - sequence.request.resume_tokens;
+    double seconds = prefill_seconds_per_token_ * prompt_left;
+    // Most requests stop on EOS or a stop string long before max_tokens, so
+    // expect the length completed requests reached; at least one more step
+    // (all that is assumed before any completed), never past max_tokens
+    const double limit = params.max_tokens > generated ? params.max_tokens - generated : 0;
+    const double expected = std::max(1.0, output_tokens_ - generated);
+    seconds += step_seconds_ * std::min(expected, limit);
+    return seconds;
+}
+
+size_t Scheduler::prefill_budget() const {
+    const size_t fixed = options_.prefill_chunk_tokens == 0 ? SIZE_MAX : options_.prefill_chunk_tokens;
+    if (options_.target_iteration_ms <= 0.0 || prefill_seconds_per_token_ <= 0.0) {
+        return fixed;
+    }
+    // Whatever the decode steps leave of the iteration budget goes to prefill
+    const double spare = options_.target_iteration_ms / 1e3 - step_seconds_;
+    const double tokens = spare > 0.0 ? spare / prefill_seconds_per_token_ : 0.0;
+    if (tokens >= static_cast<double>(SIZE_MAX / 2)) {
+        return SIZE_MAX;
+    }
+    return std::max(kChunkGranularity, static_cast<size_t>(tokens) / kChunkGranularity * kChunkGranularity);
+}
+
+void Scheduler::finish(SequencePtr sequence, Status status) {
+    sequence->kv.release(); // Before completion, so a waiter sees the blocks free again
+    Outcome outcome;
+    outcome.status = status;
+    outcome.preemptions = sequence->preemptions;
+    outcome.resumed_tokens = sequence->stream ? sequence->request.resume_tokens : 0;
+    if (sequence->ever_admitted) {
+        outcome.queue_seconds = std::chrono::duration<double>(sequence->admitted - sequence->arrival).count();
+    }
+    if (sequence->stream && (status == Status::Completed || status == Status::Cancelled)) {
+        outcome.result = std::move(sequence->stream->result());
+        if (status == Status::Completed) { // A cancelled output says nothing about typical length
+            output_tokens_ = ewma(output_tokens_, static_cast<double>(outcome.result.output_ids.size()));
+        }
+        outcome.state = sequence->stream->state();
+    }
+    if (status == Status::DeadlineExceeded) {
+        Metrics::add(Counter::SchedulerDeadlineDrops);
+    } else if (status == Status::Cancelled) {
+        outcome.result.finish_reason = "cancelled";
+        Metrics::add(Counter::SchedulerCancellations);
+    }
+    Metrics::observe(class_histogram(sequence->request.priority),
+                     std::chrono::duration<double>(Clock::now() - sequence->arrival).count());
+    sequence->result.set_value(std::move(outcome));
+}
+
+void Scheduler::drop_cancelled() {
+    for (auto* list : {&waiting_, &running_}) {
+        auto keep = list->begin();
+        for (auto& sequence : *list) {
+            if (sequence->request.cancel.cancelled()) {
+                finish(std::move(sequence), Status::Cancelled);
+                continue;
+            }
+            *keep++ = std::move(sequence);
+        }
+        list->erase(keep, list->end());
+    }
+}
+
+size_t Scheduler::kv_blocks_needed(const Sequence& sequence) const {
+    const size_t prompt =
+        sequence.stream ? sequence.stream->prompt().size() : sequence.request.prompt_ids.size();
+    return engine_->kv_blocks_for(prompt + sequence.request.params.max_tokens);
+}
+
+bool Scheduler::reserve_kv(Sequence& sequence) {
+    BlockArena* arena = engine_->kv_arena();
+    if (!arena || !sequence.kv.empty()) {
+        return true;
+    }
+    sequence.kv = arena->lease(kv_blocks_needed(sequence));
+    return !sequence.kv.empty();
+}
+
+void Scheduler::drop_infeasible(Clock::time_point now) {
+    const BlockArena* arena = engine_->kv_arena();
+    auto keep = waiting_.begin();
+    for (auto& sequence : waiting_) {
+        if (arena && sequence->kv.empty() && kv_blocks_needed(*sequence) > arena->max_lease()) {
+            finish(std::move(sequence), Status::Failed); // Would never fit, however long it waits
+            continue;
+        }
+        const auto deadline = sequence->request.deadline;
+        if (deadline != Clock::time_point::max()) {
+            const auto eta = now + std::chrono::duration_cast<Clock::duration>(
+                                       std::chrono::duration<double>(estimate_remaining_seconds(*sequence)));
+            if (eta > deadline) {
+                finish(std::move(sequence), Status::DeadlineExceeded);
+                continue;
+            }
+        }
+        *keep++ = std::move(sequence);
+    }
+    waiting_.erase(keep, waiting_.end());
+}
+
+void Scheduler::admit_and_preempt(Clock::time_point now) {
+    auto admit = [&](SequencePtr sequence) {
+        if (!sequence->stream) {
+            sequence->stream = std::make_unique<GenerationStream>(*engine_, std::move(sequence->request.prompt_ids),
+                                                                  sequence->request.params);
+            if (sequence->request.resume_tokens > 0 &&
+                !sequence->stream->resume_from(sequence->request.resume_state, sequence->request.resume_tokens)) {
+                sequence->request.resume_tokens = 0; // A mismatched state just means a full prefill
+            }
+        }
+        if (!sequence->ever_admitted) {
+            sequence->ever_admitted = true;
+            sequence->admitted = now;
+        }
+        running_.push_back(std::move(sequence));
+    };
+
+    while (!waiting_.empty()) {
+        if (running_.size() < options_.max_batch) {
+            auto next = waiting_.begin();
+            if (!reserve_kv(**next)) {
+                // Out of KV blocks: only paused streams that already hold theirs may go ahead
+                next = std::find_if(waiting_.begin(), waiting_.end(), [](const SequencePtr& s) { return !s->kv.empty(); });
+                if (next == waiting_.end()) {
+                    break;
+                }
+            }
+            SequencePtr sequence = std::move(*next);
+            waiting_.erase(next);
+            admit(std::move(sequence));
+            continue;
+        }
+
+        // Full: pause the lowest-ranked running stream if it is of a lower class
+        // (pausing keeps its KV blocks, so the newcomer needs its own)
+        auto victim = std::max_element(running_.begin(), running_.end(),
+                                       [](const SequencePtr& a, const SequencePtr& b) { return ahead_of(*a, *b); });
+        if ((*victim)->request.priority <= waiting_.front()->request.priority || !reserve_kv(*waiting_.front())) {
+            break;
+        }
+        SequencePtr paused = std::move(*victim);
+        running_.erase(victim);
+        ++paused->preemptions;
+        Metrics::add(Counter::SchedulerPreemptions);
+
+        SequencePtr next = std::move(waiting_.front());
+        waiting_.erase(waiting_.begin());
+        admit(std::move(next));
+
+        auto pos = std::upper_bound(waiting_.begin(), waiting_.end(), paused,
+                                    [](const SequencePtr& a, const SequencePtr& b) { return ahead_of(*a, *b); });
+        waiting_.insert(pos, std::move(paused));
+    }
+}
+
+template <typename F>
+void Scheduler::for_each_parallel(const std::vector<Sequence*>& sequences, F&& fn) {
+    auto run_one = [&fn](Sequence* sequence) {
+        if (sequence->request.timings) {
+            RequestTraceScope scope(*sequence->request.timings);
+            fn(*sequence);
+        } else {
+            fn(*sequence);
+        }
+    };
+    if (!workers_ || workers_->size() == 0 || sequences.size() < 2) {
+        for (Sequence* sequence : sequences) {
+            run_one(sequence);
+        }
+        return;
+    }
+    std::vector<std::future<void>> pending;
+    pending.reserve(sequences.size());
+    for (Sequence* sequence : sequences) {
+        pending.push_back(workers_->submit([&run_one, sequence]() { run_one(sequence); }));
+    }
+    for (auto& f : pending) {
+        f.get();
+    }
+}
+
+void Scheduler::step_running() {
+    std::vector<Sequence*> prefilling;
+    std::vector<Sequence*> decoding;
+    for (auto& sequence : running_) {
+        if (!sequence->stream->prefilled()) {
+            prefilling.push_back(sequence.get());
+        } else {
+            decoding.push_back(sequence.get());
+        }
+    }
+
+    // Hand this iteration's prompt-token budget to the highest-ranked prefills
+    std::sort(prefilling.begin(), prefilling.end(), [](const Sequence* a, const Sequence* b) { return ahead_of(*a, *b); });
+    size_t budget = prefill_budget();
+    size_t prefill_tokens = 0;
+    size_t scheduled = 0;
+    for (Sequence* sequence : prefilling) {
+        const size_t remaining = sequence->stream->prompt_remaining();
+        if (budget == 0 && remaining > 0) {
+            break;
+        }
+        sequence->chunk = std::min(remaining, budget);
+        budget -= sequence->chunk;
+        prefill_tokens += sequence->chunk;
+        ++scheduled;
+    }
+    prefilling.resize(scheduled);
+
+    const auto iteration_start = Clock::now();
+    if (!prefilling.empty()) {
+        for_each_parallel(prefilling, [](Sequence& s) { s.failed = !s.stream->prefill_chunk(s.chunk); });
+        if (prefill_tokens > 0) {
+            const double seconds = std::chrono::duration<double>(Clock::now() - iteration_start).count();
+            prefill_seconds_per_token_ = ewma(prefill_seconds_per_token_, seconds / prefill_tokens);
+        }
+    }
+    if (!decoding.empty()) {
+        const auto start = Clock::now();
+        for_each_parallel(decoding, [](Sequence& s) { s.failed = !s.stream->decode_step(); });
+        const auto end = Clock::now();
+        step_seconds_ = ewma(step_seconds_, std::chrono::duration<double>(end - start).count());
+        Metrics::observe(Histogram::SchedulerIterationSeconds,
+                         std::chrono::duration<double>(end - iteration_start).count());
+    }
+}
+
+void Scheduler::report_tokens() {
+    for (auto& sequence : running_) {
+        const TokenCallback& on_token = sequence->request.on_token;
+        if (!on_token || !sequence->stream->prefilled()) {
+            continue;
+        }
+        GenerationStream& stream = *sequence->stream;
+        const GenerationResult& result = stream.result();
+        TokenUpdate update;
+        update.finished = sequence->failed || stream.finished();
+        update.count = result.output_ids.size() - sequence->reported;
+        if (stream.params().stop) {
+            update.text = stream.take_text();
+        }
+        if (update.count == 0 && update.text.empty() && !update.finished) {
+            continue;
+        }
+        update.ids = result.output_ids.data() + sequence->reported;
+        update.logprobs = result.logprobs.data() + sequence->reported;
+        sequence->reported = result.output_ids.size();
+        on_token(update);
+    }
+}
+
+void Scheduler::retire_finished() {
+    auto keep = running_.begin();
+    for (auto& sequence : running_) {
+        if (sequence->failed) {
+            finish(std::move(sequence), Status::Failed);
+        } else if (sequence->stream->finished()) {
+            finish(std::move(sequence), Status::Completed);
+        } else {
+            *keep++ = std::move(sequence);
+        }
+    }
+    running_.erase(keep, running_.end());
+}
+
+void Scheduler::loop() {
+    bool blocked = false; // Requests wait, but none could be admitted and none run
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            auto ready = [this, &blocked] {
+                return stopping_ || !incoming_.empty() || !running_.empty() || (!waiting_.empty() && !blocked);
+            };
+            if (blocked) {
+                // Only an external lease release, a cancel or a deadline can change that
+                cv_.wait_for(lock, kBlockedPoll, ready);
+            } else {
+                cv_.wait(lock, ready);
+            }
+            if (stopping_) {
+                break;
+            }
+            for (auto& sequence : incoming_) {
+                auto pos = std::upper_bound(waiting_.begin(), waiting_.end(), sequence,
+                                            [](const SequencePtr& a, const SequencePtr& b) { return ahead_of(*a, *b); });
+                waiting_.insert(pos, std::move(sequence));
+            }
+            incoming_.clear();
+        }
+
+        const auto now = Clock::now();
+        drop_cancelled();
+        drop_infeasible(now);
+        admit_and_preempt(now);
+
+        const int64_t pending = static_cast<int64_t>(waiting_.size());
+        Metrics::gauge_add(Gauge::SchedulerPending, pending - reported_pending_);
+        reported_pending_ = pending;
+
+        blocked = running_.empty() && !waiting_.empty();
+
+        step_running();
+        report_tokens();
+        retire_finished();
+    }
+
+    // Shutting down: nothing queued or running will complete
+    std::vector<SequencePtr> leftovers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        leftovers = std::move(incoming_);
+    }
+    for (auto* list : {&leftovers, &waiting_, &running_}) {
+        for (auto& sequence : *list) {
+            finish(std::move(sequence), Status::ShuttingDown);
+        }
+        list->clear();
+    }
+    Metrics::gauge_add(Gauge::SchedulerPending, -reported_pending_);
+}
+
+} // namespace castor
@@ -1,6 +1,28 @@
 #include "server.hpp"
+#include "affinity.hpp"
+#include "async.hpp"
+#include "engine_pool.hpp"
+#include "grammar.hpp"
+#include "metrics.hpp"
+#include "model_registry.hpp"
+#include "sampling_json.hpp"
+#include "scheduler.hpp"
+#include "session_store.hpp"
+#include "trace.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <future>
 #include <iostream>
+#include <optional>
 #include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
 #include <nlohmann/json.hpp>
 
 // Include Crow for REST API
@@ -13,10 +35,78 @@ namespace castor {
 
 // Global server app (needed for request handling)
 static std::shared_ptr<crow::SimpleApp> g_app;
+static std::shared_ptr<crow::SimpleApp> g_unix_app;
+static int g_port = 8080;
 static std::shared_ptr<Engine> g_engine;
 static std::shared_ptr<Tokenizer> g_tokenizer;
+static std::shared_ptr<ResponseCache> g_cache;
+static std::shared_ptr<WorkerPool> g_workers;
+static std::shared_ptr<Scheduler> g_scheduler;
+static std::shared_ptr<ModelRegistry> g_registry;
+static std::shared_ptr<SessionStore> g_sessions;
+static std::shared_ptr<EnginePool> g_pool;
+static std::shared_ptr<const StartupGraph> g_startup;
+// Published with release after the globals above are set, so a handler that
+// sees true (acquire) also sees the engine it is about to use
+static std::atomic<bool> g_ready{true};
 
-Server::Server(int port) : port_(port) {}
+// Run engine work on @p workers (the inference pool, or the request's replica
+// pool) when there is one. The request's PhaseTimings is re-bound on the
+// worker so engine spans still reach Server-Timing.
+template <typename F>
+static auto run_on_workers(WorkerPool* workers, F&& fn) -> decltype(fn()) {
+    if (workers) {
+        PhaseTimings* timings = RequestTraceScope::current();
+        return workers->run([&fn, timings]() {
+            if (!timings) {
+                return fn();
+            }
+            RequestTraceScope scope(*timings);
+            return fn();
+        });
+    }
+    return fn();
+}
+
+// Charges a request's measured CPU time and allocations to its endpoint on
+// every exit path. Declare it before the RequestTraceScope so the scope has
+// charged its share by the time this runs.
+class EndpointResources {
+public:
+    EndpointResources(Endpoint endpoint, const PhaseTimings& timings) : endpoint_(endpoint), timings_(timings) {}
+    ~EndpointResources() {
+        if (timings_.resources_measured) {
+            Metrics::add_request_resources(endpoint_, timings_.resources);
+        }
+    }
+
+    EndpointResources(const EndpointResources&) = delete;
+    EndpointResources& operator=(const EndpointResources&) = delete;
+
+private:
+    Endpoint endpoint_;
+    const PhaseTimings& timings_;
+};
+
+static void report_resources(const PhaseTimings& timings, InferResponse& response) {
+    RequestTraceScope::flush();
+    if (timings.resources_measured) {
+        response.resources = timings.resources;
+        response.resource_usage = timings.to_resource_header();
+    }
+}
+
+static ServerOptions options_for_port(int port) {
+    ServerOptions options;
+    options.port = port;
+    return options;
+}
+
+Server::Server(int port) : Server(options_for_port(port)) {}
+
+Server::Server(const ServerOptions& options) : port_(options.port), options_(options) {
+    g_port = options.port;
+}
 
 Server::~Server() {
     if (running_) {
@@ -36,110 +126,1128 @@ bool Server::initialize(const std::shared_ptr<Engine>& engine, const std::shared
     return true;
 }
 
-void Server::run() {
-    if (!engine_ || !tokenizer_) {
-        std::cerr << "[Server] Engine or Tokenizer not initialized\n";
+void Server::set_response_cache(const std::shared_ptr<ResponseCache>& cache) {
+    cache_ = cache;
+    g_cache = cache;
+}
+
+void Server::set_worker_pool(const std::shared_ptr<WorkerPool>& workers) {
+    workers_ = workers;
+    g_workers = workers;
+}
+
+void Server::set_scheduler(const std::shared_ptr<Scheduler>& scheduler) {
+    scheduler_ = scheduler;
+    g_scheduler = scheduler;
+}
+
+void Server::set_session_store(const std::shared_ptr<SessionStore>& sessions) {
+    sessions_ = sessions;
+    g_sessions = sessions;
+}
+
+void Server::set_model_registry(const std::shared_ptr<ModelRegistry>& registry) {
+    registry_ = registry;
+    g_registry = registry;
+}
+
+void Server::set_engine_pool(const std::shared_ptr<EnginePool>& pool) {
+    pool_ = pool;
+    g_pool = pool;
+}
+
+void Server::set_ready(bool ready) {
+    g_ready.store(ready, std::memory_order_release);
+}
+
+bool Server::is_ready() const {
+    return g_ready.load(std::memory_order_acquire);
+}
+
+void Server::set_startup(const std::shared_ptr<const StartupGraph>& startup) {
+    g_startup = startup;
+}
+
+static bool serving_ready() {
+    return g_ready.load(std::memory_order_acquire);
+}
+
+// 503 for inference and model endpoints while startup is still running
+static InferResponse not_ready_response(Endpoint endpoint, uint64_t request_id) {
+    InferResponse response;
+    response.status = 503;
+    response.request_id = request_id;
+    json error;
+    error["error"] = "Model is still loading; poll /ready";
+    response.body = error.dump();
+    Metrics::add_response_bytes(endpoint, response.body.size());
+    return response;
+}
+
+// Engine, tokenizer, scheduler and workers serving one request. Holding the
+// registry entry keeps the model from being evicted until the request
+// finishes; holding the replica lease counts the request against its replica.
+struct ModelTarget {
+    std::shared_ptr<ModelRegistry::Model> hold;
+    EnginePool::Lease replica;
+    Engine* engine = nullptr;
+    Tokenizer* tokenizer = nullptr;
+    Scheduler* scheduler = nullptr;
+    WorkerPool* workers = nullptr;
+};
+
+// Resolve the request "model" field; 0 on success, otherwise the HTTP status
+static int resolve_model(const std::string& name, ModelTarget& target) {
+    if (g_registry) {
+        if (!name.empty() && !g_registry->contains(name)) {
+            return 404;
+        }
+        target.hold = g_registry->acquire(name);
+        if (!target.hold) {
+            return 503;
+        }
+        target.engine = target.hold->engine.get();
+        target.tokenizer = target.hold->tokenizer.get();
+        target.scheduler = target.hold->scheduler.get();
+        target.workers = g_workers.get();
+        return 0;
+    }
+    if (!name.empty() && name != g_engine->get_config().model_name) {
+        return 404;
+    }
+    target.engine = g_engine.get();
+    target.tokenizer = g_tokenizer.get();
+    target.scheduler = g_scheduler.get();
+    target.workers = g_workers.get();
+    return 0;
+}
+
+// With an engine pool, move the request onto the replica its affinity key
+// prefers (or the least loaded one). Called once the prompt is tokenized;
+// until then the target only serves config and tokenizer lookups.
+static void route_replica(ModelTarget& target, uint64_t key) {
+    if (!g_pool || g_registry) {
         return;
     }
+    target.replica = g_pool->acquire(key);
+    if (target.replica) {
+        target.engine = target.replica->engine.get();
+        target.scheduler = target.replica->scheduler.get();
+        target.workers = target.replica->workers.get();
+    }
+}
 
-    running_ = true;
-    
-    // Create Crow app
-    auto app = std::make_shared<crow::SimpleApp>();
-    g_app = app;
+// Read the optional "priority" (name or 0-2) and "deadline_ms" request fields
+static bool parse_scheduling(const json& data, std::chrono::steady_clock::time_point arrival,
+                             Scheduler::Request& request, std::string& error) {
+    if (data.contains("priority")) {
+        const json& value = data["priority"];
+        const std::string text = value.is_string() ? value.get<std::string>() : value.dump();
+        if (!Scheduler::parse_priority(text, request.priority)) {
+            error = "Invalid 'priority': expected interactive, default or batch";
+            return false;
+        }
+    }
+    if (data.contains("deadline_ms")) {
+        const json& value = data["deadline_ms"];
+        if (!value.is_number() || value.get<double>() <= 0.0) {
+            error = "Invalid 'deadline_ms': expected a positive number";
+            return false;
+        }
+        request.deadline = arrival + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                         std::chrono::duration<double, std::milli>(value.get<double>()));
+    }
+    return true;
+}
+
+constexpr uint32_t kMaxCandidates = 16;
+
+// Read the optional "n", "best_of" and "use_beam_search" request fields
+static bool parse_candidates(const json& data, CandidateOptions& options, std::string& error) {
+    auto read_count = [&data, &error](const char* field, uint32_t& out) {
+        if (!data.contains(field)) {
+            return true;
+        }
+        const json& value = data[field];
+        if (!value.is_number_integer() || value.get<int64_t>() < 1 || value.get<int64_t>() > kMaxCandidates) {
+            error = std::string("Invalid '") + field + "': expected an integer from 1 to " + std::to_string(kMaxCandidates);
+            return false;
+        }
+        out = value.get<uint32_t>();
+        return true;
+    };
+    if (!read_count("n", options.n) || !read_count("best_of", options.best_of)) {
+        return false;
+    }
+    if (options.best_of != 0 && options.best_of < options.n) {
+        error = "Invalid 'best_of': must be at least 'n'";
+        return false;
+    }
+    options.beam_search = data.value("use_beam_search", false);
+    return true;
+}
+
+// Compile the optional "json_schema" or "regex" field into params.grammar
+static bool parse_constraint(const json& data, Engine& engine, Tokenizer& tokenizer, SamplingParams& params,
+                             std::string& error) {
+    const bool has_schema = data.contains("json_schema");
+    const bool has_regex = data.contains("regex");
+    if (!has_schema && !has_regex) {
+        return true;
+    }
+    if (has_schema && has_regex) {
+        error = "Specify at most one of 'json_schema' and 'regex'";
+        return false;
+    }
+    if (has_regex && !data["regex"].is_string()) {
+        error = "Invalid 'regex': expected a string";
+        return false;
+    }
+    CASTOR_TRACE_SCOPE("compile_constraint");
+    const ModelConfig& config = engine.get_config();
+    params.grammar = TokenMasks::compile(has_schema ? "json_schema" : "regex",
+                                         has_schema ? data["json_schema"].dump() : data["regex"].get<std::string>(),
+                                         tokenizer.token_table(), config.vocab_size, config.eos_token_id, error);
+    if (!params.grammar) {
+        error = std::string("Invalid '") + (has_schema ? "json_schema" : "regex") + "': " + error;
+        return false;
+    }
+    return true;
+}
+
+// KV blocks for work that bypasses the scheduler; 0 once held (or without a
+// KV arena), else the HTTP status with @p error set
+static int lease_kv(Engine& engine, size_t tokens, size_t sequences, BlockArena::Lease& lease, std::string& error) {
+    if (!engine.kv_fits(tokens, sequences)) {
+        error = "Request needs more KV cache than the model's memory budget can hold";
+        return 400;
+    }
+    if (!engine.lease_kv(tokens, sequences, lease)) {
+        error = "KV cache is full; retry later";
+        return 503;
+    }
+    return 0;
+}
+
+// Memory accounting and KV arena state of one engine, for /model
+static json describe_memory(const MemoryReport& report) {
+    json out;
+    out["budget_bytes"] = report.budget_bytes;
+    out["used_bytes"] = report.total_bytes;
+    json uses;
+    for (size_t i = 0; i < MemoryAccountant::kUses; ++i) {
+        uses[MemoryAccountant::use_name(static_cast<MemoryUse>(i))] = report.used_bytes[i];
+    }
+    out["by_use"] = std::move(uses);
+    out["scratch_pages"] = HugePageRegion::backing_name(report.scratch_backing);
+    if (report.kv_blocks > 0) {
+        json kv;
+        kv["block_bytes"] = report.kv_block_bytes;
+        kv["block_tokens"] = report.kv_block_tokens;
+        kv["blocks"] = report.kv_blocks;
+        kv["blocks_free"] = report.kv_blocks_free;
+        kv["pages"] = HugePageRegion::backing_name(report.kv_backing);
+        out["kv_arena"] = std::move(kv);
+    }
+    return out;
+}
+
+// Per-candidate fields of an /infer result
+static json describe_generation(const GenerationResult& generated, const SamplingParams& params, Tokenizer& tokenizer) {
+    json out;
+    out["output_token_ids"] = generated.output_ids;
+    out["output_logprobs"] = generated.logprobs;
+    // With stop sequences the engine already detokenized, and cut the stop string
+    out["output_text"] = params.stop ? generated.output_text : tokenizer.decode(generated.output_ids);
+    out["output_tokens"] = generated.output_ids.size();
+    out["cumulative_logprob"] = generated.cumulative_logprob;
+    out["finish_reason"] = generated.finish_reason;
+    if (!generated.stop_sequence.empty()) {
+        out["stop_sequence"] = generated.stop_sequence;
+    }
+    return out;
+}
+
+// Where a suspended /infer coroutine continues: on the inference pool, so
+// serialization never runs on the scheduler thread, or inline without one.
+// Also inline for callers already on a worker that block on the result
+// (handle_infer), which could otherwise wait on a pool they are occupying.
+static Executor resume_executor() {
+    if (g_workers && g_workers->size() > 0 && !WorkerPool::on_worker_thread()) {
+        std::shared_ptr<WorkerPool> workers = g_workers;
+        return [workers](std::function<void()> fn) { workers->post(std::move(fn)); };
+    }
+    return [](std::function<void()> fn) { fn(); };
+}
+
+// One generation. With a scheduler the request is awaited, so no thread is
+// held while it queues and decodes; otherwise it runs on the pool. @p state
+// receives the final sequence state for session snapshots, @p resumed the
+// prompt tokens taken from the request's resume state (0 if it was unusable).
+static Task<ResponseCache::Value> generate(const ModelTarget& target, Scheduler::Request request,
+                                           PhaseTimings& timings, Executor resume, Scheduler::Status& status,
+                                           SequenceState& state, size_t& resumed) {
+    auto generated = std::make_shared<GenerationResult>();
+    if (target.scheduler) {
+        request.timings = &timings;
+        AsyncResult<Scheduler::Outcome> pending = target.scheduler->submit_async(std::move(request));
+        const Scheduler::Outcome& outcome = co_await pending.via(std::move(resume));
+        status = outcome.status;
+        if (status != Scheduler::Status::Completed) {
+            co_return nullptr;
+        }
+        *generated = outcome.result;
+        state = outcome.state;
+        resumed = outcome.resumed_tokens;
+        co_return generated;
+    }
+    RequestTraceScope trace_scope(timings);
+    Engine& engine = *target.engine;
+    const size_t kv_tokens = request.prompt_ids.size() + request.params.max_tokens;
+    BlockArena::Lease kv;
+    const bool ok = engine.lease_kv(kv_tokens, 1, kv) && run_on_workers(target.workers, [&]() {
+        CASTOR_TRACE_SCOPE("generate");
+        GenerationStream stream(engine, std::move(request.prompt_ids), request.params);
+        if (request.resume_tokens > 0 && stream.resume_from(request.resume_state, request.resume_tokens)) {
+            resumed = request.resume_tokens; // Otherwise the whole prompt is prefilled
+        }
+        if (!stream.run_to_completion()) {
+            return false;
+        }
+        *generated = std::move(stream.result());
+        state = stream.state();
+        return true;
+    });
+    if (!ok) {
+        status = Scheduler::Status::Failed;
+        co_return nullptr;
+    }
+    status = Scheduler::Status::Completed;
+    co_return generated;
+}
+
+// Offer @p request the session's snapshot when @p tokens extends it. The
+// stream may still refuse it at admission and prefill the whole prompt.
+static void resume_session(const ModelTarget& target, const std::string& key, const std::vector<int32_t>& tokens,
+                           Scheduler::Request& request) {
+    CASTOR_TRACE_SCOPE("session_restore");
+    std::shared_ptr<const SessionSnapshot> snapshot = g_sessions->get(key);
+    Engine& engine = *target.engine;
+    auto restore = [&]() { return engine.restore_kv(snapshot->state, snapshot->kv, snapshot->kv_bytes); };
+    if (!snapshot || !snapshot->extended_by(tokens) || !run_on_workers(target.workers, restore)) {
+        return;
+    }
+    request.resume_state = snapshot->state;
+    request.resume_tokens = snapshot->tokens.size();
+}
+
+// Keep what this turn left in the cache for the session's next turn
+static void save_session(const ModelTarget& target, const std::string& key, const std::vector<int32_t>& prompt,
+                         const GenerationResult& generated, const SequenceState& state) {
+    CASTOR_TRACE_SCOPE("session_save");
+    std::vector<int32_t> history;
+    history.reserve(prompt.size() + generated.output_ids.size());
+    history.insert(history.end(), prompt.begin(), prompt.end());
+    history.insert(history.end(), generated.output_ids.begin(), generated.output_ids.end());
+    history.resize(std::min<size_t>(history.size(), state.length)); // The last token is never fed back
+    std::vector<uint8_t> kv;
+    Engine& engine = *target.engine;
+    auto save = [&]() { return engine.save_kv(state, kv); };
+    if (history.size() == state.length && run_on_workers(target.workers, save)) {
+        g_sessions->put(key, SessionSnapshot::make(std::move(history), state, std::move(kv)));
+    }
+}
+
+// Parse, tokenize, generate and serialize one /infer request. Shared by the
+// HTTP route and Server::handle_infer (used by castor-bench). Suspends while
+// the scheduler (or a coalesced cache leader) generates, and continues
+// through @p resume.
+static Task<InferResponse> infer_task(std::string request_body, Executor resume) {
+    Metrics::count_request(Endpoint::Infer);
+    GaugeGuard in_flight(Gauge::QueueDepth);
+    ScopedTimer request_timer(Histogram::RequestSeconds);
+    const auto arrival = std::chrono::steady_clock::now();
+
+    PhaseTimings timings;
+    timings.request_id = Tracer::next_request_id();
+    EndpointResources resources(Endpoint::Infer, timings);
+    // The trace scope is thread-local, so it is released around every co_await
+    std::optional<RequestTraceScope> trace_scope(std::in_place, timings);
+
+    InferResponse response;
+    response.request_id = timings.request_id;
+    if (!serving_ready()) {
+        co_return not_ready_response(Endpoint::Infer, timings.request_id);
+    }
+
+    try {
+        json data;
+        {
+            CASTOR_TRACE_SCOPE("parse");
+            data = json::parse(request_body);
+        }
+        
+        if (!data.contains("prompt")) {
+            response.status = 400;
+            json error;
+            error["error"] = "Missing 'prompt' field in request";
+            response.body = error.dump();
+            Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+            co_return response;
+        }
+
+        std::string prompt = data["prompt"].get<std::string>();
+        SamplingParams params = parse_sampling_params(data);
+        const std::string model_name = data.value("model", std::string());
+        ModelTarget target;
+        if (const int status = resolve_model(model_name, target)) {
+            response.status = status;
+            json error;
+            error["error"] = status == 404 ? "Unknown model '" + model_name + "'"
+                                           : "Model '" + model_name + "' failed to load";
+            response.body = error.dump();
+            Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+            co_return response;
+        }
+        Tokenizer& tokenizer = *target.tokenizer;
+
+        Scheduler::Request scheduling;
+        CandidateOptions candidates;
+        std::string request_error;
+        if (!parse_scheduling(data, arrival, scheduling, request_error) ||
+            !parse_candidates(data, candidates, request_error) ||
+            !parse_constraint(data, *target.engine, tokenizer, params, request_error) ||
+            !parse_stop_sequences(data, tokenizer.token_table(), params, request_error)) {
+            response.status = 400;
+            json error;
+            error["error"] = request_error;
+            response.body = error.dump();
+            Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+            co_return response;
+        }
+        
+        // Encode prompt to tokens
+        std::vector<int32_t> tokens;
+        {
+            ScopedTimer timer(Histogram::TokenizeSeconds);
+            tokens = tokenizer.encode(prompt);
+        }
+        Metrics::add(Counter::PromptTokens, tokens.size());
+
+        // Sessions stick to one replica; other requests follow their prompt prefix
+        const std::string session = data.value("session", std::string());
+        if (g_pool) {
+            route_replica(target, session.empty() ? g_pool->affinity_key(tokens) : EnginePool::affinity_key(session));
+            if (target.replica && target.workers->size() > 0 && !WorkerPool::on_worker_thread()) {
+                // Continue on the replica's own workers rather than its scheduler thread
+                std::shared_ptr<WorkerPool> workers = target.replica->workers;
+                resume = [workers](std::function<void()> fn) { workers->post(std::move(fn)); };
+            }
+        }
+        Engine& engine = *target.engine;
+
+        auto set_error = [&response](int status, const std::string& message) {
+            response.status = status;
+            json error;
+            error["error"] = message;
+            response.body = error.dump();
+            Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+        };
+        // Scheduled or not, a request must fit the KV arena (one set of blocks per candidate)
+        if (!engine.kv_fits(tokens.size() + params.max_tokens, candidates.width())) {
+            set_error(400, "Request needs more KV cache than the model's memory budget can hold");
+            co_return response;
+        }
+
+        auto set_failure = [&response]() {
+            Metrics::add(Counter::InferErrors);
+            response.status = 500;
+            json error;
+            error["error"] = "Inference failed (TensorRT not fully integrated yet)";
+            response.body = error.dump();
+            Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+        };
+
+        json result;
+        result["model"] = engine.get_config().model_name;
+        result["prompt"] = prompt;
+        result["input_tokens"] = tokens.size();
+        result["input_token_ids"] = tokens;
+
+        if (params.max_tokens == 0) {
+            // Prompt processing only
+            BlockArena::Lease kv;
+            if (const int status = lease_kv(engine, tokens.size(), 1, kv, request_error)) {
+                set_error(status, request_error);
+                co_return response;
+            }
+            std::vector<float> logits;
+            const auto prefill_start = std::chrono::steady_clock::now();
+            if (!run_on_workers(target.workers, [&]() { return engine.infer(tokens, logits); })) {
+                set_failure();
+                co_return response;
+            }
+            const auto prefill_end = std::chrono::steady_clock::now();
+            const double prefill_seconds = std::chrono::duration<double>(prefill_end - prefill_start).count();
+            const double ttft = std::chrono::duration<double>(prefill_end - arrival).count();
+            Metrics::observe(Histogram::TimeToFirstTokenSeconds, ttft);
+            result["time_to_first_token_ms"] = ttft * 1e3;
+            if (prefill_seconds > 0.0) {
+                Metrics::observe(Histogram::TokensPerSecond, tokens.size() / prefill_seconds);
+            }
+            result["output_logits_count"] = logits.size();
+        } else if (candidates.width() > 1 || candidates.beam_search) {
+            // One prefill forked into every candidate; these bypass the
+            // scheduler and response cache and run as one unit on the pool
+            BlockArena::Lease kv;
+            if (const int status =
+                    lease_kv(engine, tokens.size() + params.max_tokens, candidates.width(), kv, request_error)) {
+                set_error(status, request_error);
+                co_return response;
+            }
+            std::vector<GenerationResult> generated;
+            const auto generate_start = std::chrono::steady_clock::now();
+            if (!run_on_workers(target.workers,
+                                [&]() { return engine.generate_candidates(tokens, params, candidates, generated); }) ||
+                generated.empty()) {
+                set_failure();
+                co_return response;
+            }
+            json choices = json::array();
+            size_t output_tokens = 0;
+            for (const auto& candidate : generated) {
+                output_tokens += candidate.output_ids.size();
+                choices.push_back(describe_generation(candidate, params, tokenizer));
+            }
+            Metrics::add(Counter::GeneratedTokens, output_tokens);
+            const double ttft =
+                std::chrono::duration<double>(generate_start - arrival).count() + generated.front().first_token_seconds;
+            Metrics::observe(Histogram::TimeToFirstTokenSeconds, ttft);
+            result["time_to_first_token_ms"] = ttft * 1e3;
+            result.update(choices.front());
+            result["choices"] = std::move(choices);
+            result["cached"] = false;
+        } else {
+            Scheduler::Request request = scheduling;
+            request.prompt_ids = tokens;
+            request.params = params;
+
+            // A session turn whose prompt extends the previous turn's context only prefills the new tokens
+            std::string session_key;
+            if (g_sessions && !session.empty()) {
+                session_key = engine.get_config().model_name + '\n' + session;
+                resume_session(target, session_key, tokens, request);
+            }
+
+            // Greedy decoding is deterministic, so identical requests can share one result
+            // (constrained requests are not cached: the key does not cover the grammar;
+            // session turns are not either: a cached result has no state to snapshot).
+            // Only default-class requests without a deadline join another request's
+            // in-flight generation; the rest can still hit but schedule on their own terms.
+            const auto generate_start = std::chrono::steady_clock::now();
+            const bool use_cache = g_cache && params.is_greedy() && !params.grammar && session_key.empty();
+            const bool single_flight = scheduling.deadline == Scheduler::Clock::time_point::max() &&
+                                       scheduling.priority == Priority::Default;
+            ResponseCache::Claim claim;
+            std::string key;
+            if (use_cache) {
+                key = ResponseCache::make_key(engine.get_config().model_name, tokens, params);
+                if (single_flight) {
+                    claim = g_cache->claim(key);
+                } else if ((claim.value = g_cache->lookup(key))) {
+                    claim.outcome = ResponseCache::Outcome::Hit;
+                }
+            }
+            const bool leader = use_cache && single_flight && claim.outcome == ResponseCache::Outcome::Miss;
+            ResponseCache::Value generated;
+            Scheduler::Status status = Scheduler::Status::Completed;
+            SequenceState final_state;
+            size_t resumed_tokens = 0;
+            trace_scope.reset();
+            if (claim.outcome == ResponseCache::Outcome::Hit) {
+                generated = claim.value;
+            } else if (claim.outcome == ResponseCache::Outcome::Coalesced) {
+                generated = co_await claim.pending.via(resume);
+            }
+            const bool cached = generated != nullptr;
+            if (!generated) {
+                // A miss, or a leader that did not complete (dropped, failed or
+                // cancelled): generate through the scheduler like any request
+                try {
+                    generated = co_await generate(target, std::move(request), timings, resume, status, final_state,
+                                                  resumed_tokens);
+                } catch (...) {
+                    if (leader) {
+                        g_cache->fail(key, std::current_exception());
+                    }
+                    throw;
+                }
+                // Only completed results are shared; a nullptr releases the
+                // followers to generate for themselves
+                const ResponseCache::Value shared = status == Scheduler::Status::Completed ? generated : nullptr;
+                if (leader) {
+                    g_cache->publish(key, shared);
+                } else if (use_cache && shared) {
+                    g_cache->insert(key, shared);
+                }
+            }
+            trace_scope.emplace(timings);
+
+            if (status == Scheduler::Status::DeadlineExceeded) {
+                response.status = 504;
+                json error;
+                error["error"] = "Deadline cannot be met; request dropped before generation";
+                response.body = error.dump();
+                Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+                co_return response;
+            }
+            if (!generated) {
+                set_failure();
+                co_return response;
+            }
+            if (!session_key.empty()) {
+                if (resumed_tokens > 0) {
+                    Metrics::add(Counter::SessionResumes);
+                    Metrics::add(Counter::SessionResumedTokens, resumed_tokens);
+                }
+                save_session(target, session_key, tokens, *generated, final_state);
+                result["session"] = session;
+                result["resumed_tokens"] = resumed_tokens;
+            }
+
+            if (!cached) {
+                Metrics::add(Counter::GeneratedTokens, generated->output_ids.size());
+                const double engine_seconds = generated->prefill_seconds + generated->decode_seconds;
+                if (engine_seconds > 0.0) {
+                    Metrics::observe(Histogram::TokensPerSecond, generated->output_ids.size() / engine_seconds);
+                }
+            }
+            const double queued = std::chrono::duration<double>(generate_start - arrival).count();
+            const double ttft = cached ? std::chrono::duration<double>(std::chrono::steady_clock::now() - arrival).count()
+                                       : queued + generated->first_token_seconds;
+            Metrics::observe(Histogram::TimeToFirstTokenSeconds, ttft);
+            result["time_to_first_token_ms"] = ttft * 1e3;
+
+            result.update(describe_generation(*generated, params, tokenizer));
+            if (generated->draft_tokens > 0) {
+                result["draft_tokens"] = generated->draft_tokens;
+                result["accepted_draft_tokens"] = generated->accepted_draft_tokens;
+            }
+            result["cached"] = cached;
+        }
+
+        result["status"] = "success";
+        result["message"] = "Inference completed (stub - TensorRT integration pending)";
+        
+        {
+            CASTOR_TRACE_SCOPE("serialize");
+            response.body = result.dump(2);
+        }
+        Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+        if (timings.count > 0) {
+            response.server_timing = timings.to_server_timing();
+        }
+        report_resources(timings, response);
+        co_return response;
+    } catch (const json::exception& e) {
+        response.status = 400;
+        json error;
+        error["error"] = std::string("JSON parse error: ") + e.what();
+        response.body = error.dump();
+        Metrics::add_response_bytes(Endpoint::Infer, response.body.size());
+        co_return response;
+    }
+}
+
+constexpr size_t kMaxEmbeddingInputs = 2048;
 
+// Parse, tokenize, embed and serialize one /embeddings request:
+//   {"input": "text" | ["text", ...], "model", "pooling": "mean" | "last" | "cls",
+//    "normalize": true, "encoding_format": "float" | "fp16" | "int8"}
+static InferResponse process_embeddings(const std::string& request_body) {
+    Metrics::count_request(Endpoint::Embeddings);
+    GaugeGuard in_flight(Gauge::QueueDepth);
+
+    PhaseTimings timings;
+    timings.request_id = Tracer::next_request_id();
+    EndpointResources resources(Endpoint::Embeddings, timings);
+    RequestTraceScope trace_scope(timings);
+
+    InferResponse response;
+    response.request_id = timings.request_id;
+    auto fail = [&response](int status, const std::string& message) {
+        response.status = status;
+        json error;
+        error["error"] = message;
+        response.body = error.dump();
+        Metrics::add_response_bytes(Endpoint::Embeddings, response.body.size());
+        return response;
+    };
+    if (!serving_ready()) {
+        return not_ready_response(Endpoint::Embeddings, timings.request_id);
+    }
+
+    try {
+        json data;
+        {
+            CASTOR_TRACE_SCOPE("parse");
+            data = json::parse(request_body);
+        }
+
+        std::vector<std::string> texts;
+        const json input = data.value("input", json());
+        if (input.is_string()) {
+            texts.push_back(input.get<std::string>());
+        } else if (input.is_array() && !input.empty() && input.size() <= kMaxEmbeddingInputs &&
+                   std::all_of(input.begin(), input.end(), [](const json& text) { return text.is_string(); })) {
+            texts = input.get<std::vector<std::string>>();
+        } else {
+            return fail(400, "Invalid 'input': expected a string or an array of 1 to " +
+                                 std::to_string(kMaxEmbeddingInputs) + " strings");
+        }
+
+        EmbeddingOptions options;
+        EmbeddingEncoding encoding = EmbeddingEncoding::Float;
+        const std::string pooling = data.value("pooling", std::string("mean"));
+        const std::string format = data.value("encoding_format", std::string("float"));
+        if (!embedding::parse_pooling(pooling, options.pooling)) {
+            return fail(400, "Invalid 'pooling': expected mean, last or cls");
+        }
+        if (!embedding::parse_encoding(format, encoding)) {
+            return fail(400, "Invalid 'encoding_format': expected float, fp16 or int8");
+        }
+        options.normalize = data.value("normalize", true);
+
+        const std::string model_name = data.value("model", std::string());
+        ModelTarget target;
+        if (const int status = resolve_model(model_name, target)) {
+            return fail(status, status == 404 ? "Unknown model '" + model_name + "'"
+                                              : "Model '" + model_name + "' failed to load");
+        }
+        const ModelConfig& config = target.engine->get_config();
+
+        std::vector<std::vector<int32_t>> inputs;
+        inputs.reserve(texts.size());
+        size_t input_tokens = 0;
+        {
+            ScopedTimer timer(Histogram::TokenizeSeconds);
+            for (const auto& text : texts) {
+                inputs.push_back(target.tokenizer->encode(text));
+                input_tokens += inputs.back().size();
+            }
+        }
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (inputs[i].empty()) {
+                return fail(400, "Input " + std::to_string(i) + " is empty after tokenization");
+            }
+            if (inputs[i].size() > config.max_seq_length) {
+                return fail(400, "Input " + std::to_string(i) + " has " + std::to_string(inputs[i].size()) +
+                                     " tokens; the model accepts " + std::to_string(config.max_seq_length));
+            }
+        }
+
+        if (g_pool) {
+            route_replica(target, g_pool->affinity_key(inputs.front()));
+        }
+        Engine& engine = *target.engine;
+
+        // Batches run one at a time, so the KV footprint peaks at the largest
+        // (an input over max_batch_tokens forms a batch of its own)
+        size_t longest = 0;
+        for (const auto& tokens : inputs) {
+            longest = std::max(longest, tokens.size());
+        }
+        BlockArena::Lease kv;
+        std::string kv_error;
+        if (const int status =
+                lease_kv(engine, std::max(longest, std::min(input_tokens, options.max_batch_tokens)), 1, kv, kv_error)) {
+            return fail(status, kv_error);
+        }
+
+        std::vector<float> vectors;
+        if (!run_on_workers(target.workers, [&]() { return engine.embed(inputs, options, vectors); })) {
+            Metrics::add(Counter::InferErrors);
+            return fail(500, "Embedding failed");
+        }
+
+        json result;
+        {
+            CASTOR_TRACE_SCOPE("serialize");
+            const size_t dim = config.hidden_dim;
+            json items = json::array();
+            std::vector<uint16_t> halves;
+            std::vector<int8_t> quantized;
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                const float* row = vectors.data() + i * dim;
+                json item;
+                item["index"] = i;
+                if (encoding == EmbeddingEncoding::Float) {
+                    item["embedding"] = std::vector<float>(row, row + dim);
+                } else if (encoding == EmbeddingEncoding::Fp16) {
+                    halves.resize(dim);
+                    for (size_t d = 0; d < dim; ++d) {
+                        halves[d] = embedding::float_to_half(row[d]);
+                    }
+                    item["embedding"] = embedding::base64_encode(halves.data(), dim * sizeof(uint16_t));
+                } else {
+                    quantized.resize(dim);
+                    item["scale"] = embedding::quantize_int8(row, dim, quantized.data());
+                    item["embedding"] = embedding::base64_encode(quantized.data(), dim);
+                }
+                items.push_back(std::move(item));
+            }
+            result["model"] = config.model_name;
+            result["data"] = std::move(items);
+            result["dimensions"] = dim;
+            result["pooling"] = pooling;
+            result["normalized"] = options.normalize;
+            result["encoding_format"] = format;
+            result["input_tokens"] = input_tokens;
+            response.body = result.dump();
+        }
+        Metrics::add_response_bytes(Endpoint::Embeddings, response.body.size());
+        if (timings.count > 0) {
+            response.server_timing = timings.to_server_timing();
+        }
+        report_resources(timings, response);
+        return response;
+    } catch (const json::exception& e) {
+        return fail(400, std::string("JSON parse error: ") + e.what());
+    }
+}
+
+// Register every route on an app; called once per listener so TCP and the
+// Unix socket serve identical handlers
+// Remove the socket file this server listened on, unless something else
+// has been put at the path since
+static void remove_unix_socket(const std::string& path) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode)) {
+        ::unlink(path.c_str());
+    }
+}
+
+static void register_routes(const std::shared_ptr<crow::SimpleApp>& app) {
     // GET /health - Server health check
     CROW_ROUTE((*app), "/health").methods("GET"_method)
     ([](const crow::request&) {
+        Metrics::count_request(Endpoint::Health);
         auto response = crow::response(200);
         response.set_header("Content-Type", "application/json");
+        const bool ready = serving_ready();
+        json j;
+        j["status"] = "healthy"; // Liveness: the process answers; see /ready for whether it serves
+        j["ready"] = ready;
+        if (ready) {
+            j["model"] = g_registry ? g_registry->default_model() : g_engine->get_config().model_name;
+        }
+        j["port"] = g_port;
+        response.body = j.dump();
+        Metrics::add_response_bytes(Endpoint::Health, response.body.size());
+        return response;
+    });
+
+    // GET /ready - Readiness: 200 once the model is loaded and warm, else 503
+    // with how far startup has got
+    CROW_ROUTE((*app), "/ready").methods("GET"_method)
+    ([](const crow::request&) {
+        Metrics::count_request(Endpoint::Ready);
+        const bool ready = serving_ready();
+        auto response = crow::response(ready ? 200 : 503);
+        response.set_header("Content-Type", "application/json");
+        if (!ready) {
+            response.set_header("Retry-After", "1");
+        }
         json j;
-        j["status"] = "healthy";
-        j["model"] = g_engine->get_config().model_name;
-        j["port"] = 8080;
+        j["ready"] = ready;
+        if (g_startup) {
+            j["elapsed_ms"] = g_startup->elapsed_ms();
+            j["phases"] = json::array();
+            for (const auto& phase : g_startup->status()) {
+                json p;
+                p["name"] = phase.name;
+                p["state"] = StartupGraph::state_name(phase.state);
+                p["ms"] = phase.state == StartupGraph::State::Running ? g_startup->elapsed_ms() - phase.start_ms
+                                                                      : phase.ms();
+                j["phases"].push_back(std::move(p));
+            }
+        }
         response.body = j.dump();
+        Metrics::add_response_bytes(Endpoint::Ready, response.body.size());
         return response;
     });
 
     // GET /model - Get model info
     CROW_ROUTE((*app), "/model").methods("GET"_method)
     ([](const crow::request&) {
+        Metrics::count_request(Endpoint::Model);
+        if (!serving_ready()) {
+            InferResponse result = not_ready_response(Endpoint::Model, 0);
+            auto response = crow::response(result.status);
+            response.set_header("Content-Type", "application/json");
+            response.set_header("Retry-After", "1");
+            response.body = std::move(result.body);
+            return response;
+        }
         auto response = crow::response(200);
         response.set_header("Content-Type", "application/json");
         
-        const auto& config = g_engine->get_config();
         json j;
-        j["model_name"] = config.model_name;
-        j["max_batch_size"] = config.max_batch_size;
-        j["max_seq_length"] = config.max_seq_length;
-        j["vocab_size"] = config.vocab_size;
-        j["hidden_dim"] = config.hidden_dim;
-        j["num_layers"] = config.num_layers;
-        j["initialized"] = g_engine->is_initialized();
-        j["tokenizer_loaded"] = g_tokenizer->is_loaded();
+        if (g_registry) {
+            // Default model's config without forcing a load, plus every registered model
+            const ModelSpec* spec = g_registry->spec("");
+            const ModelConfig config = spec ? spec->config : ModelConfig();
+            j["model_name"] = config.model_name;
+            j["max_batch_size"] = config.max_batch_size;
+            j["max_seq_length"] = config.max_seq_length;
+            j["vocab_size"] = config.vocab_size;
+            j["hidden_dim"] = config.hidden_dim;
+            j["num_layers"] = config.num_layers;
+            j["resident_bytes"] = g_registry->resident_bytes();
+            j["models"] = json::array();
+            for (const auto& status : g_registry->status()) {
+                json m;
+                m["name"] = status.name;
+                m["loaded"] = status.loaded;
+                m["memory_bytes"] = status.bytes;
+                if (status.loaded) {
+                    m["memory"] = describe_memory(status.memory);
+                }
+                j["models"].push_back(std::move(m));
+            }
+        } else {
+            const auto& config = g_engine->get_config();
+            j["model_name"] = config.model_name;
+            j["max_batch_size"] = config.max_batch_size;
+            j["max_seq_length"] = config.max_seq_length;
+            j["vocab_size"] = config.vocab_size;
+            j["hidden_dim"] = config.hidden_dim;
+            j["num_layers"] = config.num_layers;
+            j["initialized"] = g_engine->is_initialized();
+            j["kernels"] = g_engine->kernels().describe(config);
+            j["tokenizer_loaded"] = g_tokenizer->is_loaded();
+            j["memory"] = describe_memory(g_engine->memory_report());
+            if (g_pool) {
+                j["replicas"] = json::array();
+                for (const auto& status : g_pool->status()) {
+                    json r;
+                    r["index"] = status.index;
+                    r["numa_node"] = status.node;
+                    r["cpus"] = Affinity::format_cpu_list(status.cpus);
+                    r["in_flight"] = status.in_flight;
+                    r["requests"] = status.requests;
+                    r["affinity_routes"] = status.affinity_routes;
+                    r["busy_seconds"] = status.busy_seconds;
+                    r["utilization"] = status.utilization;
+                    r["worker_queue"] = status.worker_queue;
+                    r["memory"] = describe_memory(status.memory);
+                    j["replicas"].push_back(std::move(r));
+                }
+            }
+        }
         
         response.body = j.dump(2);
+        Metrics::add_response_bytes(Endpoint::Model, response.body.size());
         return response;
     });
 
-    // POST /infer - Run inference
-    CROW_ROUTE((*app), "/infer").methods("POST"_method)
+    // GET /metrics - Prometheus text exposition
+    CROW_ROUTE((*app), "/metrics").methods("GET"_method)
+    ([](const crow::request&) {
+        Metrics::count_request(Endpoint::Metrics);
+        auto response = crow::response(200);
+        response.set_header("Content-Type", "text/plain; version=0.0.4");
+        response.body = Metrics::render_prometheus();
+        Metrics::add_response_bytes(Endpoint::Metrics, response.body.size());
+        return response;
+    });
+
+    // GET /admin/trace?seconds=N - Dump recent spans as Chrome/Perfetto trace JSON
+    CROW_ROUTE((*app), "/admin/trace").methods("GET"_method)
+    ([](const crow::request& req) {
+        double seconds = 10.0;
+        if (const char* param = req.url_params.get("seconds")) {
+            seconds = std::atof(param);
+        }
+        auto response = crow::response(200);
+        response.set_header("Content-Type", "application/json");
+        response.set_header("Content-Disposition", "attachment; filename=\"castor-trace.json\"");
+        response.body = Tracer::export_chrome_json(seconds);
+        return response;
+    });
+
+    // POST /admin/trace - Enable or disable span recording ({"enabled": true})
+    // and per-request resource accounting ({"resources": true})
+    CROW_ROUTE((*app), "/admin/trace").methods("POST"_method)
     ([](const crow::request& req) {
         auto response = crow::response(200);
         response.set_header("Content-Type", "application/json");
-        
         try {
             auto data = json::parse(req.body);
-            
-            if (!data.contains("prompt")) {
-                response.code = 400;
-                json error;
-                error["error"] = "Missing 'prompt' field in request";
-                response.body = error.dump();
-                return response;
-            }
-
-            std::string prompt = data["prompt"].get<std::string>();
-            
-            // Encode prompt to tokens
-            auto tokens = g_tokenizer->encode(prompt);
-            
-            // Run inference
-            std::vector<float> logits;
-            bool success = g_engine->infer(tokens, logits);
-            
-            if (!success) {
-                response.code = 500;
-                json error;
-                error["error"] = "Inference failed (TensorRT not fully integrated yet)";
-                response.body = error.dump();
-                return response;
-            }
-            
-            json result;
-            result["prompt"] = prompt;
-            result["input_tokens"] = tokens.size();
-            result["input_token_ids"] = tokens;
-            result["output_logits_count"] = logits.size();
-            result["status"] = "success";
-            result["message"] = "Inference completed (stub - TensorRT integration pending)";
-            
-            response.body = result.dump(2);
-            return response;
+            Tracer::set_enabled(data.value("enabled", Tracer::enabled()));
+            ResourceAccounting::set_enabled(data.value("resources", ResourceAccounting::enabled()));
+            json j;
+            j["enabled"] = Tracer::enabled();
+            j["resources"] = ResourceAccounting::enabled();
+            j["counts_allocations"] = ResourceAccounting::counts_allocations();
+            response.body = j.dump();
         } catch (const json::exception& e) {
             response.code = 400;
             json error;
             error["error"] = std::string("JSON parse error: ") + e.what();
             response.body = error.dump();
-            return response;
         }
+        return response;
+    });
+
+    // POST /infer - Run inference. Asynchronous handler: the I/O thread only
+    // starts the request and goes back to its event loop; the response is
+    // completed (res.end()) by whichever thread finishes the generation.
+    CROW_ROUTE((*app), "/infer").methods("POST"_method)
+    ([](const crow::request& req, crow::response& res) {
+        AsyncResult<InferResponse> pending = start(infer_task(req.body, resume_executor()));
+        pending.on_ready([pending, &res]() {
+            res.set_header("Content-Type", "application/json");
+            try {
+                const InferResponse& result = pending.get();
+                res.code = result.status;
+                res.set_header("X-Request-Id", std::to_string(result.request_id));
+                if (!result.server_timing.empty()) {
+                    res.set_header("Server-Timing", result.server_timing);
+                }
+                if (!result.resource_usage.empty()) {
+                    res.set_header("X-Castor-Resources", result.resource_usage);
+                }
+                res.body = result.body;
+            } catch (const std::exception& e) {
+                Metrics::add(Counter::InferErrors);
+                res.code = 500;
+                json error;
+                error["error"] = std::string("Inference failed: ") + e.what();
+                res.body = error.dump();
+            }
+            res.end();
+        });
     });
 
-    std::cout << "[Server] 🚀 Starting REST API on http://0.0.0.0:" << port_ << "\n";
+    // POST /embeddings - Pooled embedding vectors for one or many inputs
+    CROW_ROUTE((*app), "/embeddings").methods("POST"_method)
+    ([](const crow::request& req) {
+        InferResponse result = process_embeddings(req.body);
+        auto response = crow::response(result.status);
+        response.set_header("Content-Type", "application/json");
+        response.set_header("X-Request-Id", std::to_string(result.request_id));
+        if (!result.server_timing.empty()) {
+            response.set_header("Server-Timing", result.server_timing);
+        }
+        if (!result.resource_usage.empty()) {
+            response.set_header("X-Castor-Resources", result.resource_usage);
+        }
+        response.body = std::move(result.body);
+        return response;
+    });
+}
+
+InferResponse Server::handle_infer(const std::string& body) const {
+    return start(infer_task(body, resume_executor())).get();
+}
+
+InferResponse Server::handle_embeddings(const std::string& body) const {
+    return process_embeddings(body);
+}
+
+bool Server::claim_unix_socket(const std::string& path) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return errno == ENOENT;
+    }
+    if (!S_ISSOCK(st.st_mode)) {
+        std::cerr << "[Server] " << path << " exists and is not a socket; not replacing it\n";
+        return false;
+    }
+    sockaddr_un addr{};
+    if (path.size() >= sizeof(addr.sun_path)) {
+        std::cerr << "[Server] Unix socket path too long: " << path << "\n";
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    // A socket that still accepts connections belongs to a live server
+    const bool live = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0;
+    ::close(fd);
+    if (live) {
+        std::cerr << "[Server] " << path << " is in use by a running server\n";
+        return false;
+    }
+    // Stale: bind() would fail on the leftover file
+    return ::unlink(path.c_str()) == 0;
+}
+
+void Server::run() {
+    // Not yet ready: startup will call initialize() while the listener runs
+    if (is_ready() && (!engine_ || !tokenizer_) && !registry_) {
+        std::cerr << "[Server] Engine or Tokenizer not initialized\n";
+        return;
+    }
+    if (!options_.enable_tcp && options_.unix_socket_path.empty()) {
+        std::cerr << "[Server] No listener configured (TCP disabled and no Unix socket path)\n";
+        return;
+    }
+    if (!options_.unix_socket_path.empty() && !claim_unix_socket(options_.unix_socket_path)) {
+        return;
+    }
+
+    running_ = true;
+
+    // Crow's I/O threads are spawned from this thread and inherit its mask
+    if (!options_.http_cpus.empty() && Affinity::pin_current_thread(options_.http_cpus)) {
+        std::cout << "[Server] HTTP threads pinned to CPUs " << Affinity::format_cpu_list(options_.http_cpus) << "\n";
+        if (options_.numa_local) {
+            Affinity::prefer_local_memory(Affinity::common_numa_node(options_.http_cpus));
+        }
+    }
+    auto configure_threads = [this](crow::SimpleApp& target) {
+        if (options_.http_threads > 0) {
+            target.concurrency(static_cast<std::uint16_t>(options_.http_threads));
+        } else {
+            target.multithreaded();
+        }
+    };
+
+    std::shared_ptr<crow::SimpleApp> unix_app;
+    std::future<void> unix_done;
+    if (!options_.unix_socket_path.empty()) {
+        unix_app = std::make_shared<crow::SimpleApp>();
+        g_unix_app = unix_app;
+        register_routes(unix_app);
+        unix_app->local_socket_path(options_.unix_socket_path);
+        configure_threads(*unix_app);
+        std::cout << "[Server] 🚀 Serving REST API on unix:" << options_.unix_socket_path << "\n";
+        if (!options_.enable_tcp) {
+            unix_app->run();
+            remove_unix_socket(options_.unix_socket_path);
+            return;
+        }
+        unix_done = unix_app->run_async();
+    }
+
+    // Create Crow app
+    auto app = std::make_shared<crow::SimpleApp>();
+    g_app = app;
+    register_routes(app);
+
+    std::cout << "[Server] 🚀 Starting REST API on http://" << options_.bind_address << ":" << port_ << "\n";
     std::cout << "[Server] Available endpoints:\n";
     std::cout << "  GET  http://localhost:" << port_ << "/health  - Server health check\n";
+    std::cout << "  GET  http://localhost:" << port_ << "/ready   - Readiness (503 until the model is warm)\n";
     std::cout << "  GET  http://localhost:" << port_ << "/model   - Get model information\n";
     std::cout << "  POST http://localhost:" << port_ << "/infer   - Run inference\n";
+    std::cout << "  GET  http://localhost:" << port_ << "/metrics - Prometheus metrics\n";
+    std::cout << "  GET  http://localhost:" << port_ << "/admin/trace?seconds=N - Chrome trace dump\n";
     std::cout << "\n[Server] Example inference:\n";
     std::cout << "  curl -X POST http://localhost:" << port_ << "/infer \\\n";
     std::cout << "    -H \"Content-Type: application/json\" \\\n";
@@ -147,12 +1255,26 @@ void Server::run() {
     std::cout << "\n[Server] Running... (press Ctrl+C to stop)\n\n";
 
     // Start the server (blocking)
-    app->port(port_).multithreaded().run();
+    app->bindaddr(options_.bind_address).port(port_);
+    configure_threads(*app);
+    app->run();
+
+    if (unix_app) {
+        unix_app->stop();
+        unix_done.wait();
+        remove_unix_socket(options_.unix_socket_path);
+    }
 }
 
 void Server::shutdown() {
     running_ = false;
     std::cout << "\n[Server] Shutting down...\n";
+    if (g_app) {
+        g_app->stop();
+    }
+    if (g_unix_app) {
+        g_unix_app->stop();
+    }
 }
 
 } // namespace castor
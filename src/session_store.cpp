@@ -0,0 +1,550 @@
+#include "session_store.hpp"
+#include "hash.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#ifdef CASTOR_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace castor {
+
+namespace {
+
+constexpr char kMagic[8] = {'C', 'S', 'T', 'R', 'S', 'E', 'S', 'S'};
+constexpr uint32_t kVersion = 1;
+constexpr uint32_t kCompressed = 1u << 0;
+constexpr size_t kKvAlignment = 64; // KV section offset, so a mapped restore reads aligned rows
+constexpr const char* kExtension = ".session";
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;
+    uint64_t context_hash;
+    uint32_t length;
+    uint32_t id_bytes;
+    uint64_t token_count;
+    uint64_t kv_bytes;    // Uncompressed
+    uint64_t kv_stored;   // As stored in the file
+    uint64_t tokens_hash; // XXH64 of the tokens, seeded with the id's hash
+};
+static_assert(sizeof(FileHeader) == 64, "FileHeader is part of the file format");
+
+size_t kv_offset(const FileHeader& header) {
+    const size_t end = sizeof(FileHeader) + header.id_bytes + header.token_count * sizeof(int32_t);
+    return (end + kKvAlignment - 1) / kKvAlignment * kKvAlignment;
+}
+
+uint64_t tokens_hash(const std::string& id, const int32_t* tokens, size_t count) {
+    return XXH64::hash(tokens, count * sizeof(int32_t), XXH64::hash(id.data(), id.size()));
+}
+
+// Read-only mapping of a whole snapshot file
+struct Mapping {
+    void* data = MAP_FAILED;
+    size_t size = 0;
+
+    ~Mapping() {
+        if (data != MAP_FAILED) {
+            ::munmap(data, size);
+        }
+    }
+    const uint8_t* bytes() const { return static_cast<const uint8_t*>(data); }
+};
+
+bool write_all(int fd, struct iovec* iov, int count) {
+    while (count > 0) {
+        const ssize_t written = ::writev(fd, iov, count);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        size_t left = static_cast<size_t>(written);
+        while (count > 0 && left >= iov->iov_len) {
+            left -= iov->iov_len;
+            ++iov;
+            --count;
+        }
+        if (count > 0) {
+            iov->iov_base = static_cast<uint8_t*>(iov->iov_base) + left;
+            iov->iov_len -= left;
+        }
+    }
+    return true;
+}
+
+// Header and id of a snapshot file, without mapping the payload
+bool read_header(const std::string& path, FileHeader& header, std::string& id) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = ::pread(fd, &header, sizeof(header), 0) == static_cast<ssize_t>(sizeof(header)) &&
+              std::memcmp(header.magic, kMagic, sizeof(kMagic)) == 0 && header.version == kVersion;
+    if (ok) {
+        id.resize(header.id_bytes);
+        ok = ::pread(fd, id.data(), id.size(), sizeof(header)) == static_cast<ssize_t>(id.size());
+    }
+    ::close(fd);
+    return ok;
+}
+
+} // namespace
+
+std::shared_ptr<const SessionSnapshot> SessionSnapshot::make(std::vector<int32_t> tokens, const SequenceState& state,
+                                                             std::vector<uint8_t> kv) {
+    auto snapshot = std::make_shared<SessionSnapshot>();
+    auto owned = std::make_shared<std::vector<uint8_t>>(std::move(kv));
+    snapshot->tokens = std::move(tokens);
+    snapshot->state = state;
+    snapshot->kv = owned->data();
+    snapshot->kv_bytes = owned->size();
+    snapshot->kv_owner = std::move(owned);
+    return snapshot;
+}
+
+bool SessionSnapshot::extended_by(const std::vector<int32_t>& prompt) const {
+    return prompt.size() > tokens.size() && std::equal(tokens.begin(), tokens.end(), prompt.begin());
+}
+
+bool SessionStore::compression_available() {
+#ifdef CASTOR_HAVE_ZLIB
+    return true;
+#else
+    return false;
+#endif
+}
+
+SessionStore::SessionStore() : SessionStore(Options()) {}
+
+SessionStore::SessionStore(const Options& options) : options_(options) {
+    if (options_.compress && !compression_available()) {
+        std::cerr << "[Sessions] Built without zlib; snapshot files are stored uncompressed\n";
+        options_.compress = false;
+    }
+
+    // Snapshots from an earlier run stay on disk until a turn asks for them
+    if (!options_.directory.empty()) {
+        std::error_code error;
+        std::filesystem::create_directories(options_.directory, error);
+        for (const auto& file : std::filesystem::directory_iterator(options_.directory, error)) {
+            const std::string path = file.path().string();
+            if (file.path().extension() == ".tmp") {
+                ::unlink(path.c_str()); // Torn write from a crash
+                continue;
+            }
+            FileHeader header;
+            std::string id;
+            if (file.path().extension() != kExtension || !read_header(path, header, id) || path != path_for(id)) {
+                continue;
+            }
+            Entry& entry = entries_[id];
+            entry.id = id;
+            entry.generation = ++next_generation_;
+            entry.last_used = Clock::now();
+            entry.file_bytes = file.file_size(error);
+            disk_bytes_ += entry.file_bytes;
+        }
+        if (error) {
+            std::cerr << "[Sessions] Cannot use " << options_.directory << ": " << error.message() << "\n";
+        }
+        Metrics::gauge_add(Gauge::SessionDiskBytes, static_cast<int64_t>(disk_bytes_));
+    }
+    writer_ = std::thread([this]() { writer_loop(); });
+}
+
+SessionStore::~SessionStore() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    writer_.join(); // Queued writes land first
+    Metrics::gauge_add(Gauge::SessionResidentBytes, -static_cast<int64_t>(resident_bytes_));
+    Metrics::gauge_add(Gauge::SessionDiskBytes, -static_cast<int64_t>(disk_bytes_));
+}
+
+std::string SessionStore::path_for(const std::string& id) const {
+    char name[17];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(XXH64::hash(id.data(), id.size())));
+    return (std::filesystem::path(options_.directory) / (std::string(name) + kExtension)).string();
+}
+
+void SessionStore::put(const std::string& id, std::shared_ptr<const SessionSnapshot> snapshot) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Entry& entry = entries_[id];
+    entry.id = id;
+    if (entry.snapshot) {
+        release_locked(entry);
+    }
+    forget_file_locked(entry);
+    entry.generation = ++next_generation_;
+    make_resident_locked(entry, std::move(snapshot));
+    enforce_budget_locked();
+}
+
+std::shared_ptr<const SessionSnapshot> SessionStore::get(const std::string& id) {
+    uint64_t generation = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(id);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+        Entry& entry = it->second;
+        if (entry.snapshot) {
+            entry.release = false; // Wanted again: stays in RAM even if a write is pending
+            touch_locked(entry);
+            return entry.snapshot;
+        }
+        generation = entry.generation;
+    }
+
+    // Only on disk: map it back without holding the lock
+    std::shared_ptr<const SessionSnapshot> snapshot = read_file(id);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(id);
+    if (it == entries_.end() || it->second.generation != generation) {
+        return it == entries_.end() ? nullptr : it->second.snapshot; // Replaced or erased meanwhile
+    }
+    Entry& entry = it->second;
+    if (entry.snapshot) {
+        touch_locked(entry); // Another caller restored it first
+        return entry.snapshot;
+    }
+    if (!snapshot) {
+        std::cerr << "[Sessions] Discarding unreadable snapshot " << path_for(id) << "\n";
+        ++drops_;
+        remove_locked(it);
+        return nullptr;
+    }
+    ++restores_;
+    Metrics::add(Counter::SessionRestores);
+    make_resident_locked(entry, snapshot);
+    enforce_budget_locked();
+    return snapshot;
+}
+
+void SessionStore::erase(const std::string& id) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = entries_.find(id);
+    if (it != entries_.end()) {
+        remove_locked(it);
+    }
+}
+
+void SessionStore::spill_idle(std::chrono::seconds idle) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    spill_idle_locked(idle);
+}
+
+void SessionStore::flush() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_cv_.wait(lock, [this]() { return queue_.empty() && writes_in_progress_ == 0; });
+}
+
+SessionStore::Stats SessionStore::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stats stats;
+    stats.sessions = entries_.size();
+    stats.resident = lru_.size();
+    stats.resident_bytes = resident_bytes_;
+    stats.disk_bytes = disk_bytes_;
+    stats.spills = spills_;
+    stats.restores = restores_;
+    stats.drops = drops_;
+    return stats;
+}
+
+void SessionStore::touch_locked(Entry& entry) {
+    lru_.splice(lru_.begin(), lru_, entry.lru);
+    entry.last_used = Clock::now();
+}
+
+void SessionStore::make_resident_locked(Entry& entry, std::shared_ptr<const SessionSnapshot> snapshot) {
+    entry.bytes = snapshot->memory_bytes();
+    entry.snapshot = std::move(snapshot);
+    entry.release = false;
+    entry.last_used = Clock::now();
+    lru_.push_front(&entry);
+    entry.lru = lru_.begin();
+    resident_bytes_ += entry.bytes;
+    Metrics::gauge_add(Gauge::SessionResidentBytes, static_cast<int64_t>(entry.bytes));
+}
+
+void SessionStore::release_locked(Entry& entry) {
+    lru_.erase(entry.lru);
+    resident_bytes_ -= entry.bytes;
+    Metrics::gauge_add(Gauge::SessionResidentBytes, -static_cast<int64_t>(entry.bytes));
+    entry.snapshot.reset();
+    entry.bytes = 0;
+    entry.release = false;
+}
+
+void SessionStore::forget_file_locked(Entry& entry) {
+    if (entry.file_bytes == 0) {
+        return;
+    }
+    ::unlink(path_for(entry.id).c_str());
+    disk_bytes_ -= entry.file_bytes;
+    Metrics::gauge_add(Gauge::SessionDiskBytes, -static_cast<int64_t>(entry.file_bytes));
+    entry.file_bytes = 0;
+}
+
+void SessionStore::remove_locked(std::unordered_map<std::string, Entry>::iterator it) {
+    Entry& entry = it->second;
+    if (entry.snapshot) {
+        release_locked(entry);
+    }
+    forget_file_locked(entry);
+    entries_.erase(it); // A write still in flight finds no entry and removes its file
+}
+
+void SessionStore::spill_locked(Entry& entry) {
+    if (!entry.snapshot) {
+        return;
+    }
+    if (entry.file_bytes > 0) {
+        release_locked(entry); // Unchanged since it was last written
+        return;
+    }
+    if (options_.directory.empty()) {
+        ++drops_;
+        remove_locked(entries_.find(entry.id));
+        return;
+    }
+    entry.release = true;
+    if (!entry.writing) {
+        entry.writing = true;
+        queue_.push_back(Write{entry.id, entry.generation, entry.snapshot});
+        cv_.notify_one();
+    }
+}
+
+void SessionStore::enforce_budget_locked() {
+    // Least recently used first; sessions already on their way out count as gone
+    std::vector<Entry*> victims;
+    size_t kept = resident_bytes_;
+    for (auto it = lru_.rbegin(); it != lru_.rend() && kept > options_.max_resident_bytes; ++it) {
+        kept -= (*it)->bytes;
+        if (!(*it)->release) {
+            victims.push_back(*it);
+        }
+    }
+    for (Entry* entry : victims) {
+        spill_locked(*entry);
+    }
+}
+
+void SessionStore::spill_idle_locked(std::chrono::seconds idle) {
+    const Clock::time_point cutoff = Clock::now() - idle;
+    std::vector<Entry*> victims;
+    for (auto it = lru_.rbegin(); it != lru_.rend() && (*it)->last_used <= cutoff; ++it) {
+        if (!(*it)->release) {
+            victims.push_back(*it);
+        }
+    }
+    for (Entry* entry : victims) {
+        spill_locked(*entry);
+    }
+}
+
+void SessionStore::writer_loop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point next_idle_check = Clock::now() + options_.idle_check;
+    for (;;) {
+        cv_.wait_until(lock, next_idle_check, [this]() { return stopping_ || !queue_.empty(); });
+        if (!queue_.empty()) {
+            Write write = std::move(queue_.front());
+            queue_.pop_front();
+            ++writes_in_progress_;
+            lock.unlock();
+            const size_t bytes = write_file(write);
+            write.snapshot.reset();
+            lock.lock();
+            --writes_in_progress_;
+            finish_write_locked(write, bytes);
+            if (queue_.empty() && writes_in_progress_ == 0) {
+                idle_cv_.notify_all();
+            }
+            continue;
+        }
+        if (stopping_) {
+            return;
+        }
+        if (Clock::now() >= next_idle_check) {
+            if (options_.idle_spill.count() > 0) {
+                spill_idle_locked(options_.idle_spill);
+            }
+            next_idle_check = Clock::now() + options_.idle_check;
+        }
+    }
+}
+
+void SessionStore::finish_write_locked(const Write& write, size_t bytes) {
+    auto it = entries_.find(write.id);
+    if (it == entries_.end() || it->second.generation != write.generation) {
+        // Erased or replaced while writing: the file is stale
+        if (bytes > 0) {
+            ::unlink(path_for(write.id).c_str());
+        }
+        if (it != entries_.end()) {
+            Entry& entry = it->second;
+            entry.writing = false;
+            if (entry.release) {
+                entry.release = false;
+                spill_locked(entry); // The replacement was pushed out meanwhile
+            }
+        }
+        return;
+    }
+
+    Entry& entry = it->second;
+    entry.writing = false;
+    if (bytes == 0) {
+        if (entry.release) {
+            ++drops_; // Nowhere to keep it
+            remove_locked(it);
+        }
+        return;
+    }
+    entry.file_bytes = bytes;
+    disk_bytes_ += bytes;
+    ++spills_;
+    Metrics::gauge_add(Gauge::SessionDiskBytes, static_cast<int64_t>(bytes));
+    Metrics::add(Counter::SessionSpills);
+    if (entry.release) {
+        release_locked(entry);
+    }
+}
+
+size_t SessionStore::write_file(const Write& write) const {
+    const SessionSnapshot& snapshot = *write.snapshot;
+    FileHeader header{};
+    std::memcpy(header.magic, kMagic, sizeof(kMagic));
+    header.version = kVersion;
+    header.context_hash = snapshot.state.context_hash;
+    header.length = snapshot.state.length;
+    header.id_bytes = static_cast<uint32_t>(write.id.size());
+    header.token_count = snapshot.tokens.size();
+    header.kv_bytes = snapshot.kv_bytes;
+    header.kv_stored = snapshot.kv_bytes;
+    header.tokens_hash = tokens_hash(write.id, snapshot.tokens.data(), snapshot.tokens.size());
+
+    const uint8_t* kv = snapshot.kv;
+    std::vector<uint8_t> compressed;
+#ifdef CASTOR_HAVE_ZLIB
+    if (options_.compress && snapshot.kv_bytes > 0) {
+        uLongf stored = compressBound(snapshot.kv_bytes);
+        compressed.resize(stored);
+        if (compress2(compressed.data(), &stored, snapshot.kv, snapshot.kv_bytes, Z_BEST_SPEED) == Z_OK &&
+            stored < snapshot.kv_bytes) {
+            kv = compressed.data();
+            header.kv_stored = stored;
+            header.flags |= kCompressed;
+        }
+    }
+#endif
+
+    const size_t offset = kv_offset(header);
+    const size_t padding = offset - (sizeof(header) + write.id.size() + snapshot.tokens.size() * sizeof(int32_t));
+    static const uint8_t kZeros[kKvAlignment] = {};
+    struct iovec iov[5] = {
+        {&header, sizeof(header)},
+        {const_cast<char*>(write.id.data()), write.id.size()},
+        {const_cast<int32_t*>(snapshot.tokens.data()), snapshot.tokens.size() * sizeof(int32_t)},
+        {const_cast<uint8_t*>(kZeros), padding},
+        {const_cast<uint8_t*>(kv), header.kv_stored},
+    };
+
+    // Written under a temporary name and renamed, so readers never see a partial file
+    const std::string path = path_for(write.id);
+    const std::string temp = path + ".tmp";
+    const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        std::cerr << "[Sessions] Cannot create " << temp << ": " << std::strerror(errno) << "\n";
+        return 0;
+    }
+    const bool ok = write_all(fd, iov, 5);
+    ::close(fd);
+    if (!ok || ::rename(temp.c_str(), path.c_str()) != 0) {
+        std::cerr << "[Sessions] Cannot write " << path << ": " << std::strerror(errno) << "\n";
+        ::unlink(temp.c_str());
+        return 0;
+    }
+    return offset + header.kv_stored;
+}
+
+std::shared_ptr<const SessionSnapshot> SessionStore::read_file(const std::string& id) const {
+    const std::string path = path_for(id);
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat st;
+    auto mapping = std::make_shared<Mapping>();
+    if (::fstat(fd, &st) == 0 && static_cast<size_t>(st.st_size) >= sizeof(FileHeader)) {
+        mapping->size = static_cast<size_t>(st.st_size);
+        mapping->data = ::mmap(nullptr, mapping->size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    ::close(fd);
+    if (mapping->data == MAP_FAILED) {
+        return nullptr;
+    }
+
+    FileHeader header;
+    std::memcpy(&header, mapping->bytes(), sizeof(header));
+    if (std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0 || header.version != kVersion ||
+        header.id_bytes != id.size() || header.token_count != header.length ||
+        kv_offset(header) + header.kv_stored != mapping->size ||
+        std::memcmp(mapping->bytes() + sizeof(header), id.data(), id.size()) != 0) {
+        return nullptr;
+    }
+
+    auto snapshot = std::make_shared<SessionSnapshot>();
+    snapshot->state.context_hash = header.context_hash;
+    snapshot->state.length = header.length;
+    snapshot->tokens.resize(header.token_count);
+    std::memcpy(snapshot->tokens.data(), mapping->bytes() + sizeof(header) + id.size(),
+                header.token_count * sizeof(int32_t));
+    if (tokens_hash(id, snapshot->tokens.data(), snapshot->tokens.size()) != header.tokens_hash) {
+        return nullptr;
+    }
+
+    const uint8_t* stored = mapping->bytes() + kv_offset(header);
+    if (!(header.flags & kCompressed)) {
+        // Zero-copy: the KV bytes stay in the mapping, read ahead while the caller gets going
+        ::madvise(mapping->data, mapping->size, MADV_WILLNEED);
+        snapshot->kv = stored;
+        snapshot->kv_bytes = header.kv_bytes;
+        snapshot->kv_owner = std::move(mapping);
+        return snapshot;
+    }
+#ifdef CASTOR_HAVE_ZLIB
+    auto owned = std::make_shared<std::vector<uint8_t>>(header.kv_bytes);
+    uLongf size = header.kv_bytes;
+    if (uncompress(owned->data(), &size, stored, header.kv_stored) != Z_OK || size != header.kv_bytes) {
+        return nullptr;
+    }
+    snapshot->kv = owned->data();
+    snapshot->kv_bytes = owned->size();
+    snapshot->kv_owner = std::move(owned);
+    return snapshot;
+#else
+    return nullptr; // Compressed by a build with zlib
+#endif
+}
+
+} // namespace castor
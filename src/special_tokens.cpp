@@ -0,0 +1,155 @@
+#include "special_tokens.hpp"
+#include <algorithm>
+#include <cstring>
+#include <numeric>
+
+namespace castor {
+
+namespace {
+
+bool is_space(uint8_t byte) {
+    return byte == ' ' || byte == '\t' || byte == '\n' || byte == '\r' || byte == '\v' || byte == '\f';
+}
+
+// Letters, digits, underscore, and any byte of a multi-byte UTF-8 character
+bool is_word_byte(uint8_t byte) {
+    return (byte >= '0' && byte <= '9') || (byte >= 'A' && byte <= 'Z') || (byte >= 'a' && byte <= 'z') ||
+           byte == '_' || byte >= 0x80;
+}
+
+} // namespace
+
+SpecialTokenMatcher::SpecialTokenMatcher(const std::vector<AddedToken>& tokens) {
+    root_.fill(-1);
+    for (const auto& token : tokens) {
+        if (!token.content.empty()) {
+            tokens_.push_back(token);
+        }
+    }
+    if (tokens_.empty()) {
+        return;
+    }
+
+    std::vector<int32_t> order(tokens_.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [this](int32_t a, int32_t b) { return tokens_[a].content < tokens_[b].content; });
+
+    // Tokens in order[lo, hi) share their first depth bytes; node spells exactly that prefix
+    auto build = [this, &order](auto& self, int32_t node, size_t lo, size_t hi, size_t depth) -> void {
+        if (tokens_[order[lo]].content.size() == depth) {
+            nodes_[node].token = order[lo]; // Sorted first, so a duplicate keeps its first entry
+        }
+        while (lo < hi && tokens_[order[lo]].content.size() == depth) {
+            ++lo;
+        }
+        std::vector<std::pair<size_t, size_t>> groups;
+        for (size_t i = lo; i < hi;) {
+            const char byte = tokens_[order[i]].content[depth];
+            size_t j = i + 1;
+            while (j < hi && tokens_[order[j]].content[depth] == byte) {
+                ++j;
+            }
+            groups.emplace_back(i, j);
+            i = j;
+        }
+        nodes_[node].first_edge = static_cast<uint32_t>(edge_bytes_.size());
+        nodes_[node].edge_count = static_cast<uint32_t>(groups.size());
+        for (const auto& group : groups) {
+            edge_bytes_.push_back(static_cast<uint8_t>(tokens_[order[group.first]].content[depth]));
+            edge_targets_.push_back(-1);
+        }
+        const uint32_t first_edge = nodes_[node].first_edge;
+        for (size_t g = 0; g < groups.size(); ++g) {
+            const int32_t next = static_cast<int32_t>(nodes_.size());
+            nodes_.emplace_back();
+            edge_targets_[first_edge + g] = next;
+            self(self, next, groups[g].first, groups[g].second, depth + 1);
+        }
+    };
+    nodes_.emplace_back();
+    build(build, 0, 0, order.size(), 0);
+
+    const Node& root = nodes_[0];
+    for (uint32_t e = root.first_edge; e < root.first_edge + root.edge_count; ++e) {
+        root_[edge_bytes_[e]] = edge_targets_[e];
+    }
+    if (root.edge_count == 1) {
+        single_first_byte_ = edge_bytes_[root.first_edge];
+    }
+}
+
+int32_t SpecialTokenMatcher::child(int32_t node, uint8_t byte) const {
+    const Node& parent = nodes_[node];
+    const auto first = edge_bytes_.begin() + parent.first_edge;
+    const auto last = first + parent.edge_count;
+    const auto it = std::lower_bound(first, last, byte);
+    return it != last && *it == byte ? edge_targets_[it - edge_bytes_.begin()] : -1;
+}
+
+size_t SpecialTokenMatcher::next_candidate(std::string_view text, size_t from) const {
+    if (single_first_byte_ >= 0) {
+        const void* hit = std::memchr(text.data() + from, single_first_byte_, text.size() - from);
+        return hit ? static_cast<size_t>(static_cast<const char*>(hit) - text.data()) : text.size();
+    }
+    while (from < text.size() && root_[static_cast<uint8_t>(text[from])] < 0) {
+        ++from;
+    }
+    return from;
+}
+
+bool SpecialTokenMatcher::find(std::string_view text, size_t from, Match& match) const {
+    if (tokens_.empty()) {
+        return false;
+    }
+    for (size_t start = next_candidate(text, from); start < text.size(); start = next_candidate(text, start + 1)) {
+        // Longest token starting here
+        int32_t node = root_[static_cast<uint8_t>(text[start])];
+        int32_t token = -1;
+        size_t end = start;
+        for (size_t i = start + 1; node >= 0; ++i) {
+            if (nodes_[node].token >= 0) {
+                token = nodes_[node].token;
+                end = i;
+            }
+            if (i == text.size()) {
+                break;
+            }
+            node = child(node, static_cast<uint8_t>(text[i]));
+        }
+        if (token < 0) {
+            continue;
+        }
+        const AddedToken& added = tokens_[token];
+        if (added.single_word && ((start > 0 && is_word_byte(static_cast<uint8_t>(text[start - 1]))) ||
+                                  (end < text.size() && is_word_byte(static_cast<uint8_t>(text[end]))))) {
+            continue;
+        }
+        match.begin = start;
+        match.end = end;
+        match.id = added.id;
+        if (added.lstrip) {
+            while (match.begin > from && is_space(static_cast<uint8_t>(text[match.begin - 1]))) {
+                --match.begin;
+            }
+        }
+        if (added.rstrip) {
+            while (match.end < text.size() && is_space(static_cast<uint8_t>(text[match.end]))) {
+                ++match.end;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+size_t SpecialTokenMatcher::memory_bytes() const {
+    size_t bytes = nodes_.capacity() * sizeof(Node) + edge_bytes_.capacity() +
+                   edge_targets_.capacity() * sizeof(int32_t) + tokens_.capacity() * sizeof(AddedToken);
+    for (const auto& token : tokens_) {
+        bytes += token.content.capacity() > 15 ? token.content.capacity() + 1 : 0;
+    }
+    return bytes;
+}
+
+} // namespace castor
@@ -0,0 +1,292 @@
+#include "startup.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <exception>
+#include <future>
+#include <iostream>
+#include <sstream>
+
+namespace castor {
+
+StartupGraph::~StartupGraph() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+size_t StartupGraph::add(const std::string& name, Task task, const std::vector<size_t>& after) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Node node;
+    node.phase.name = name;
+    node.task = std::move(task);
+    for (size_t dependency : after) {
+        if (dependency < nodes_.size()) { // Only earlier phases, so the graph stays acyclic
+            node.after.push_back(dependency);
+        }
+    }
+    nodes_.push_back(std::move(node));
+    return nodes_.size() - 1;
+}
+
+double StartupGraph::now_ms() const {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - started_).count();
+}
+
+void StartupGraph::run_phase(size_t id) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto settled = [this](size_t dependency) {
+        const State state = nodes_[dependency].phase.state;
+        return state != State::Pending && state != State::Running;
+    };
+    changed_.wait(lock, [&]() {
+        for (size_t dependency : nodes_[id].after) {
+            if (!settled(dependency)) {
+                return false;
+            }
+        }
+        return true;
+    });
+
+    Node& node = nodes_[id];
+    node.phase.start_ms = now_ms();
+    for (size_t dependency : node.after) {
+        if (nodes_[dependency].phase.state != State::Done) {
+            node.phase.state = State::Skipped;
+            node.phase.end_ms = node.phase.start_ms;
+            changed_.notify_all();
+            return;
+        }
+    }
+    node.phase.state = State::Running;
+    Task task = node.task;
+    lock.unlock();
+
+    bool ok = false;
+    try {
+        ok = task();
+    } catch (const std::exception& e) {
+        std::cerr << "[Startup] Phase " << node.phase.name << " threw: " << e.what() << "\n";
+    }
+
+    lock.lock();
+    node.phase.end_ms = now_ms();
+    node.phase.state = ok ? State::Done : State::Failed;
+    if (!ok) {
+        std::cerr << "[Startup] Phase " << node.phase.name << " failed\n";
+    }
+    changed_.notify_all();
+}
+
+bool StartupGraph::run() {
+    size_t count = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (running_ || finished_) {
+            return false; // A graph runs once
+        }
+        running_ = true;
+        started_ = std::chrono::steady_clock::now();
+        count = nodes_.size();
+    }
+
+    std::vector<std::thread> threads;
+    threads.reserve(count);
+    for (size_t id = 0; id < count; ++id) {
+        threads.emplace_back([this, id]() { run_phase(id); });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    ok_ = true;
+    for (const auto& node : nodes_) {
+        ok_ = ok_ && node.phase.state == State::Done;
+    }
+    elapsed_ms_ = now_ms();
+    running_ = false;
+    finished_ = true;
+    return ok_;
+}
+
+void StartupGraph::start(std::function<void(bool)> on_done) {
+    thread_ = std::thread([this, on_done = std::move(on_done)]() {
+        const bool ok = run();
+        if (on_done) {
+            on_done(ok);
+        }
+    });
+}
+
+bool StartupGraph::wait() {
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    return ok_;
+}
+
+bool StartupGraph::finished() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return finished_;
+}
+
+std::vector<StartupGraph::Phase> StartupGraph::status() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::vector<Phase> phases;
+    phases.reserve(nodes_.size());
+    for (const auto& node : nodes_) {
+        phases.push_back(node.phase);
+    }
+    return phases;
+}
+
+double StartupGraph::elapsed_ms() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (running_) {
+        return now_ms();
+    }
+    return elapsed_ms_;
+}
+
+std::string StartupGraph::report() const {
+    const std::vector<Phase> phases = status();
+    const double elapsed = elapsed_ms();
+    double summed = 0.0;
+    size_t width = 0;
+    for (const auto& phase : phases) {
+        summed += phase.ms();
+        width = std::max(width, phase.name.size());
+    }
+
+    std::ostringstream out;
+    char line[160];
+    std::snprintf(line, sizeof(line), "[Startup] %.1f ms wall, %.1f ms of phases (%.2fx overlap)\n", elapsed, summed,
+                  elapsed > 0.0 ? summed / elapsed : 0.0);
+    out << line;
+    for (const auto& phase : phases) {
+        std::snprintf(line, sizeof(line), "  %-*s %8.1f ms  (%7.1f -> %7.1f)  %s\n", static_cast<int>(width),
+                      phase.name.c_str(), phase.ms(), phase.start_ms, phase.end_ms, state_name(phase.state));
+        out << line;
+    }
+    return out.str();
+}
+
+const char* StartupGraph::state_name(State state) {
+    switch (state) {
+    case State::Pending:
+        return "pending";
+    case State::Running:
+        return "running";
+    case State::Done:
+        return "done";
+    case State::Failed:
+        return "failed";
+    case State::Skipped:
+        return "skipped";
+    }
+    return "unknown";
+}
+
+ModelStartup ModelStartup::builtin() {
+    ModelStartup model;
+    model.engine_path = "models/llama-2-7b.plan";
+    model.tokenizer_path = "models/tokenizer.json";
+    model.config.model_name = "llama-2-7b";
+    model.config.max_batch_size = 1;
+    model.config.max_seq_length = 4096;
+    model.config.vocab_size = 32000;
+    model.config.hidden_dim = 4096;
+    model.config.num_layers = 32;
+    return model;
+}
+
+ModelStartup::Phases ModelStartup::add_to(StartupGraph& graph, StartupGraph::Task autotune) {
+    Phases phases;
+    phases.tokenizer = graph.add("tokenizer", [this]() {
+        // Serving continues without vocabulary tables, as before the graph existed
+        if (!tokenizer->load(tokenizer_path)) {
+            std::cout << "[Tokenizer] Failed to load\n";
+        }
+        return true;
+    });
+    phases.weights = graph.add("weights", [this]() {
+        prefaulted_bytes = Engine::prefault_weights(engine_path);
+        return true; // A missing plan is the engine phase's error to report
+    });
+    phases.kernels = graph.add("kernels", [this]() {
+        kernels = Kernels::select(config);
+        return true;
+    });
+
+    std::vector<size_t> after = {phases.kernels};
+    if (autotune) {
+        // Measured alone: tokenizer parsing and weight prefaulting would skew the cached results
+        phases.autotune = graph.add("autotune", std::move(autotune), {phases.tokenizer, phases.weights, phases.kernels});
+        after.push_back(phases.autotune);
+    }
+    phases.engine = graph.add("engine", [this]() {
+        if (!replicas) {
+            engine = std::make_shared<Engine>();
+            return engine->initialize(engine_path, config, &kernels);
+        }
+        pool = std::make_shared<EnginePool>(replica_options);
+        if (!pool->initialize(engine_path, config, nullptr, &kernels)) {
+            pool.reset();
+            return false;
+        }
+        engine = pool->replica(0).engine;
+        return true;
+    }, after);
+
+    phases.warmup = graph.add("warmup", [this]() {
+        const std::shared_ptr<Tokenizer> loaded = tokenizer->is_loaded() ? tokenizer : nullptr;
+        if (!pool) {
+            if (loaded) {
+                engine->set_tokenizer(loaded);
+            }
+            return warm_up(*engine);
+        }
+        // Replicas warm up in parallel, each on its own workers so the work stays on its node
+        std::vector<std::future<bool>> warmed;
+        for (size_t i = 0; i < pool->size(); ++i) {
+            const EnginePool::Replica& replica = pool->replica(i);
+            if (loaded) {
+                replica.engine->set_tokenizer(loaded);
+            }
+            Engine* replica_engine = replica.engine.get();
+            warmed.push_back(replica.workers->submit([this, replica_engine]() { return warm_up(*replica_engine); }));
+        }
+        bool ok = true;
+        for (auto& result : warmed) {
+            ok = result.get() && ok;
+        }
+        return ok;
+    }, {phases.tokenizer, phases.weights, phases.engine});
+    return phases;
+}
+
+bool ModelStartup::warm_up(Engine& target) const {
+    std::vector<int32_t> prompt;
+    if (tokenizer->is_loaded()) {
+        prompt = tokenizer->encode("Hello, world!");
+    }
+    if (prompt.empty()) {
+        prompt = {1, 2, 3, 4};
+    }
+    for (size_t pass = 0; pass < warmup_passes; ++pass) {
+        // Alternate greedy and top-p passes so both sampler paths have run
+        SamplingParams params;
+        params.max_tokens = warmup_tokens;
+        params.temperature = pass % 2 == 0 ? 0.0f : 0.7f;
+        params.top_p = pass % 2 == 0 ? 1.0f : 0.9f;
+        params.seed = pass;
+        GenerationResult result;
+        if (!target.generate(prompt, params, result)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace castor
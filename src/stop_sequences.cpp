@@ -0,0 +1,120 @@
+#include "stop_sequences.hpp"
+#include <algorithm>
+#include <deque>
+
+namespace castor {
+
+std::shared_ptr<const StopSequences> StopSequences::compile(const std::vector<std::string>& strings,
+                                                            const std::vector<int32_t>& token_ids,
+                                                            std::shared_ptr<const Vocabulary> vocabulary,
+                                                            std::string& error) {
+    size_t total = 0;
+    for (const auto& s : strings) {
+        if (s.empty()) {
+            error = "stop strings must not be empty";
+            return nullptr;
+        }
+        total += s.size();
+    }
+    if (total > kMaxBytes) {
+        error = "stop strings exceed " + std::to_string(kMaxBytes) + " bytes in total";
+        return nullptr;
+    }
+
+    auto stop = std::make_shared<StopSequences>();
+    stop->strings_ = strings;
+    stop->token_ids_ = token_ids;
+    std::sort(stop->token_ids_.begin(), stop->token_ids_.end());
+    stop->token_ids_.erase(std::unique(stop->token_ids_.begin(), stop->token_ids_.end()), stop->token_ids_.end());
+    stop->vocabulary_ = std::move(vocabulary);
+
+    // Trie: -1 marks a missing edge until the failure links fill it in
+    std::vector<int32_t>& next = stop->transitions_;
+    next.assign(256, -1);
+    stop->match_.assign(1, -1);
+    stop->depth_.assign(1, 0);
+    for (size_t i = 0; i < strings.size(); ++i) {
+        int32_t state = 0;
+        for (unsigned char c : strings[i]) {
+            int32_t& edge = next[static_cast<size_t>(state) * 256 + c];
+            if (edge < 0) {
+                edge = static_cast<int32_t>(stop->depth_.size());
+                stop->depth_.push_back(stop->depth_[state] + 1);
+                stop->match_.push_back(-1);
+                next.resize(next.size() + 256, -1);
+            }
+            state = next[static_cast<size_t>(state) * 256 + c];
+        }
+        if (stop->match_[state] < 0) { // First of duplicate strings wins
+            stop->match_[state] = static_cast<int32_t>(i);
+        }
+    }
+
+    // Breadth-first: a state's failure target is shallower, so already complete.
+    // Missing edges copy the failure target's, turning the trie into a DFA.
+    std::vector<int32_t> fail(stop->depth_.size(), 0);
+    std::deque<int32_t> queue;
+    for (int c = 0; c < 256; ++c) {
+        int32_t& edge = next[c];
+        if (edge < 0) {
+            edge = 0;
+        } else {
+            queue.push_back(edge);
+        }
+    }
+    while (!queue.empty()) {
+        const int32_t state = queue.front();
+        queue.pop_front();
+        // A state's own string is longer than any via its failure chain
+        if (stop->match_[state] < 0) {
+            stop->match_[state] = stop->match_[fail[state]];
+        }
+        for (int c = 0; c < 256; ++c) {
+            int32_t& edge = next[static_cast<size_t>(state) * 256 + c];
+            const int32_t fallback = next[static_cast<size_t>(fail[state]) * 256 + c];
+            if (edge < 0) {
+                edge = fallback;
+            } else {
+                fail[edge] = fallback;
+                queue.push_back(edge);
+            }
+        }
+    }
+    return stop;
+}
+
+bool StopSequences::is_stop_token(int32_t token) const {
+    return std::binary_search(token_ids_.begin(), token_ids_.end(), token);
+}
+
+const std::string& StopSequences::token_text(int32_t token) const {
+    static const std::string empty;
+    if (!vocabulary_ || token < 0 || static_cast<size_t>(token) >= vocabulary_->size()) {
+        return empty;
+    }
+    return (*vocabulary_)[token];
+}
+
+bool StopSequences::append(int32_t& state, int32_t token, std::string& text, std::string* matched) const {
+    if (is_stop_token(token)) {
+        return true;
+    }
+    const std::string& piece = token_text(token);
+    for (size_t i = 0; i < piece.size(); ++i) {
+        state = next(state, static_cast<uint8_t>(piece[i]));
+        if (match_[state] >= 0) {
+            const std::string& stop = strings_[match_[state]];
+            // The match may begin in text appended by earlier tokens
+            text.append(piece, 0, i + 1);
+            text.resize(text.size() - stop.size());
+            if (matched) {
+                *matched = stop;
+            }
+            return true;
+        }
+    }
+    text += piece;
+    return false;
+}
+
+} // namespace castor
@@ -1,10 +1,14 @@
 #include "tokenizer.hpp"
+#include "special_tokens.hpp"
+#include "trace.hpp"
+#include <cctype>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <nlohmann/json.hpp>
 #include <unordered_map>
 #include <algorithm>
+#include <string_view>
 
 using json = nlohmann::json;
 
@@ -19,12 +23,13 @@ public:
         try {
             auto j = json::parse(json_blob);
             
-            // Extract vocab
+            // Extract vocab; ids are numbers in HF files, strings in older exports
             if (j.contains("model") && j["model"].contains("vocab")) {
                 auto vocab = j["model"]["vocab"];
                 for (auto& [token, id] : vocab.items()) {
-                    token_to_id_[token] = std::stoi(id.get<std::string>());
-                    id_to_token_[std::stoi(id.get<std::string>())] = token;
+                    const int32_t value = id.is_number() ? id.get<int32_t>() : std::stoi(id.get<std::string>());
+                    token_to_id_[token] = value;
+                    id_to_token_[value] = token;
                 }
             }
             
@@ -32,6 +37,8 @@ public:
             if (j.contains("model") && j["model"].contains("vocab")) {
                 vocab_size_ = j["model"]["vocab"].size();
             }
+
+            load_added_tokens(j);
             
             return vocab_size_ > 0;
         } catch (const std::exception& e) {
@@ -39,18 +46,127 @@ public:
             return false;
         }
     }
+
+    // "added_tokens" (special and user-added tokens) and the normalizer they may be matched under
+    void load_added_tokens(const json& j) {
+        const json normalizer = j.value("normalizer", json());
+        if (normalizer.is_object()) {
+            const std::string type = normalizer.value("type", std::string());
+            lowercase_ = type == "Lowercase";
+            if (type == "Sequence" && normalizer.contains("normalizers")) {
+                for (const auto& step : normalizer["normalizers"]) {
+                    lowercase_ = lowercase_ || step.value("type", std::string()) == "Lowercase";
+                }
+            }
+        }
+        if (!j.contains("added_tokens") || !j["added_tokens"].is_array()) {
+            return;
+        }
+        std::vector<AddedToken> raw;
+        std::vector<AddedToken> normalized;
+        for (const auto& entry : j["added_tokens"]) {
+            AddedToken token;
+            token.id = entry.at("id").get<int32_t>();
+            token.content = entry.at("content").get<std::string>();
+            token.single_word = entry.value("single_word", false);
+            token.lstrip = entry.value("lstrip", false);
+            token.rstrip = entry.value("rstrip", false);
+            token.normalized = entry.value("normalized", !entry.value("special", false));
+            token.special = entry.value("special", false);
+            if (!id_to_token_.count(token.id)) {
+                ++vocab_size_; // Added past the model vocabulary
+            }
+            token_to_id_[token.content] = token.id;
+            id_to_token_[token.id] = token.content;
+            if (token.normalized) {
+                token.content = normalize(token.content);
+                normalized.push_back(std::move(token));
+            } else {
+                raw.push_back(std::move(token));
+            }
+        }
+        raw_added_ = SpecialTokenMatcher(raw);
+        normalized_added_ = SpecialTokenMatcher(normalized);
+    }
     
+    // Added tokens are carved out first: unnormalized ones from the raw text,
+    // normalized ones from each remaining piece once normalized. Only the text
+    // between them goes through the word-level encoder.
     std::vector<int32_t> encode(const std::string& text) {
         std::vector<int32_t> tokens;
+        if (raw_added_.empty()) {
+            encode_normalized(text, tokens);
+        } else {
+            split_added(raw_added_, text, tokens, [this](std::string_view piece, std::vector<int32_t>& out) {
+                encode_normalized(piece, out);
+            });
+        }
         
-        // Simple tokenization: split by common delimiters and map to IDs
-        std::istringstream iss(text);
-        std::string word;
+        if (tokens.empty()) {
+            tokens.push_back(0); // Default token
+        }
         
-        while (iss >> word) {
+        return tokens;
+    }
+
+    template <typename F>
+    static void split_added(const SpecialTokenMatcher& matcher, std::string_view text, std::vector<int32_t>& tokens,
+                            F&& encode_piece) {
+        size_t done = 0;
+        SpecialTokenMatcher::Match match;
+        while (matcher.find(text, done, match)) {
+            if (match.begin > done) {
+                encode_piece(text.substr(done, match.begin - done), tokens);
+            }
+            tokens.push_back(match.id);
+            done = match.end;
+        }
+        if (done < text.size()) {
+            encode_piece(text.substr(done), tokens);
+        }
+    }
+
+    std::string normalize(std::string_view text) const {
+        std::string result(text);
+        if (lowercase_) {
+            for (char& c : result) {
+                c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+            }
+        }
+        return result;
+    }
+
+    void encode_normalized(std::string_view text, std::vector<int32_t>& tokens) {
+        if (!lowercase_ && normalized_added_.empty()) {
+            encode_words(text, tokens);
+            return;
+        }
+        const std::string normalized = normalize(text);
+        split_added(normalized_added_, normalized, tokens,
+                    [this](std::string_view piece, std::vector<int32_t>& out) { encode_words(piece, out); });
+    }
+
+    void encode_words(std::string_view text, std::vector<int32_t>& tokens) {
+        // Simple tokenization: split on whitespace and map to IDs
+        size_t i = 0;
+        while (i < text.size()) {
+            while (i < text.size() && std::isspace(static_cast<unsigned char>(text[i]))) {
+                ++i;
+            }
+            size_t end = i;
+            while (end < text.size() && !std::isspace(static_cast<unsigned char>(text[end]))) {
+                ++end;
+            }
+            if (end == i) {
+                break;
+            }
+            const std::string word(text.substr(i, end - i));
+            i = end;
+
             // Try exact word match first
-            if (token_to_id_.count(word)) {
-                tokens.push_back(token_to_id_[word]);
+            auto it = token_to_id_.find(word);
+            if (it != token_to_id_.end()) {
+                tokens.push_back(it->second);
             } else {
                 // Fallback: character-level encoding
                 for (char c : word) {
@@ -68,12 +184,6 @@ public:
                 }
             }
         }
-        
-        if (tokens.empty()) {
-            tokens.push_back(0); // Default token
-        }
-        
-        return tokens;
     }
     
     std::string decode(const std::vector<int32_t>& tokens) {
@@ -90,10 +200,38 @@ public:
     
     size_t get_vocab_size() const { return vocab_size_; }
 
+    // Both hash maps: one node per entry (key, value, next pointer, cached hash), plus
+    // bucket arrays and any token text too long for the small-string buffer
+    size_t memory_bytes() const {
+        size_t bytes = token_to_id_.bucket_count() * sizeof(void*) + id_to_token_.bucket_count() * sizeof(void*);
+        for (const auto& [token, id] : token_to_id_) {
+            const size_t heap = token.capacity() > 15 ? token.capacity() + 1 : 0;
+            bytes += 2 * (sizeof(std::string) + heap + sizeof(int32_t) + 2 * sizeof(void*));
+        }
+        return bytes + raw_added_.memory_bytes() + normalized_added_.memory_bytes();
+    }
+
+    std::vector<std::string> token_table() const {
+        int32_t max_id = -1;
+        for (const auto& [id, token] : id_to_token_) {
+            max_id = std::max(max_id, id);
+        }
+        std::vector<std::string> table(static_cast<size_t>(max_id + 1));
+        for (const auto& [id, token] : id_to_token_) {
+            if (id >= 0) {
+                table[id] = token;
+            }
+        }
+        return table;
+    }
+
 private:
     std::unordered_map<std::string, int32_t> token_to_id_;
     std::unordered_map<int32_t, std::string> id_to_token_;
     size_t vocab_size_ = 0;
+    SpecialTokenMatcher raw_added_;        // Added tokens with normalized: false
+    SpecialTokenMatcher normalized_added_; // ... with normalized: true, content normalized
+    bool lowercase_ = false;               // Normalizer: Lowercase (alone or in a Sequence)
 };
 
 // Tokenizer implementation
@@ -235,6 +373,7 @@ bool Tokenizer::load(const std::string& model_path) {
 }
 
 std::vector<int32_t> Tokenizer::encode(const std::string& text) {
+    CASTOR_TRACE_SCOPE("tokenize");
     if (!loaded_) {
         std::cerr << "[Tokenizer] Tokenizer not loaded\n";
         return {};
@@ -259,6 +398,7 @@ std::vector<int32_t> Tokenizer::encode(const std::string& text) {
 }
 
 std::string Tokenizer::decode(const std::vector<int32_t>& tokens) {
+    CASTOR_TRACE_SCOPE("detokenize");
     if (!loaded_) {
         std::cerr << "[Tokenizer] Tokenizer not loaded\n";
         return "";
@@ -283,4 +423,27 @@ std::string Tokenizer::decode(const std::vector<int32_t>& tokens) {
     return result;
 }
 
+size_t Tokenizer::memory_bytes() const {
+    auto bpe = dynamic_cast<const SimpleBPETokenizer*>(tokenizer_.get());
+    return bpe ? bpe->memory_bytes() : 0;
+}
+
+std::shared_ptr<const std::vector<std::string>> Tokenizer::token_table() {
+    std::lock_guard<std::mutex> lock(token_table_mutex_);
+    if (token_table_) {
+        return token_table_;
+    }
+    auto table = std::make_shared<std::vector<std::string>>();
+    if (auto bpe = dynamic_cast<SimpleBPETokenizer*>(tokenizer_.get())) {
+        *table = bpe->token_table();
+    } else if (loaded_) {
+        table->resize(256);
+        for (size_t b = 0; b < table->size(); ++b) {
+            (*table)[b] = std::string(1, static_cast<char>(b));
+        }
+    }
+    token_table_ = std::move(table);
+    return token_table_;
+}
+
 } // namespace castor
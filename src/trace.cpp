@@ -0,0 +1,272 @@
+#include "trace.hpp"
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+using json = nlohmann::json;
+
+namespace castor {
+
+namespace {
+
+// Every field is a relaxed atomic so the exporter can read a slot while the
+// owning thread overwrites it; torn slots are detected via the head counter.
+struct Event {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<uint64_t> start{0};
+    std::atomic<uint64_t> end{0};
+    std::atomic<uint64_t> request_id{0};
+};
+
+struct alignas(64) Ring {
+    uint32_t tid = 0;
+    std::atomic<uint64_t> head{0};
+    std::array<Event, Tracer::kRingCapacity> events;
+};
+
+class RingRegistry {
+public:
+    static RingRegistry& instance() {
+        static RingRegistry* registry = new RingRegistry();
+        return *registry;
+    }
+
+    std::shared_ptr<Ring> attach() {
+        auto ring = std::make_shared<Ring>();
+        std::lock_guard<std::mutex> lock(mutex_);
+        ring->tid = next_tid_++;
+        rings_.push_back(ring);
+        return ring;
+    }
+
+    void detach(const std::shared_ptr<Ring>& ring) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        rings_.erase(std::remove(rings_.begin(), rings_.end(), ring), rings_.end());
+    }
+
+    std::vector<std::shared_ptr<Ring>> snapshot() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return rings_;
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::shared_ptr<Ring>> rings_;
+    uint32_t next_tid_ = 1;
+};
+
+class RingOwner {
+public:
+    RingOwner() : ring_(RingRegistry::instance().attach()) {}
+    ~RingOwner() { RingRegistry::instance().detach(ring_); }
+    Ring& ring() { return *ring_; }
+
+private:
+    std::shared_ptr<Ring> ring_;
+};
+
+Ring& local_ring() {
+    thread_local RingOwner owner;
+    return owner.ring();
+}
+
+struct ExportedEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+    uint64_t request_id;
+    uint32_t tid;
+};
+
+} // namespace
+
+void PhaseTimings::add(const char* name, uint64_t ticks, const ResourceUsage& usage) {
+    for (size_t i = 0; i < count; ++i) {
+        if (phases[i].name == name || std::strcmp(phases[i].name, name) == 0) {
+            phases[i].ticks += ticks;
+            phases[i].usage += usage;
+            return;
+        }
+    }
+    if (count < kMaxPhases) {
+        phases[count++] = Phase{name, ticks, usage};
+    }
+}
+
+std::string PhaseTimings::to_server_timing() const {
+    const double ns_per_tick = 1.0 / Tracer::ticks_per_ns();
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    for (size_t i = 0; i < count; ++i) {
+        if (i > 0) {
+            out << ", ";
+        }
+        out << phases[i].name << ";dur=" << static_cast<double>(phases[i].ticks) * ns_per_tick / 1e6;
+    }
+    return out.str();
+}
+
+std::string PhaseTimings::to_resource_header() const {
+    if (!resources_measured) {
+        return std::string();
+    }
+    std::ostringstream out;
+    out.setf(std::ios::fixed);
+    out.precision(3);
+    auto write = [&out](const char* name, const ResourceUsage& usage) {
+        out << name << ";cpu=" << static_cast<double>(usage.cpu_ns) / 1e6 << ";allocs=" << usage.allocations
+            << ";bytes=" << usage.allocated_bytes;
+    };
+    write("total", resources);
+    for (size_t i = 0; i < count; ++i) {
+        const ResourceUsage& usage = phases[i].usage;
+        if (usage.cpu_ns > 0 || usage.allocations > 0) {
+            out << ", ";
+            write(phases[i].name, usage);
+        }
+    }
+    return out.str();
+}
+
+double Tracer::ticks_per_ns() {
+#ifdef CASTOR_HAVE_TSC
+    static const double rate = [] {
+        using clock = std::chrono::steady_clock;
+        const auto t0 = clock::now();
+        const uint64_t c0 = __rdtsc();
+        while (clock::now() - t0 < std::chrono::milliseconds(5)) {
+        }
+        const auto t1 = clock::now();
+        const uint64_t c1 = __rdtsc();
+        const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        return static_cast<double>(c1 - c0) / ns;
+    }();
+    return rate;
+#else
+    return 1.0;
+#endif
+}
+
+void Tracer::record(const char* name, uint64_t start, uint64_t end, uint64_t request_id) {
+    constexpr auto r = std::memory_order_relaxed;
+    Ring& ring = local_ring();
+    const uint64_t head = ring.head.load(r);
+    // Pairs with the exporter's acquire fence: a reader that sees any of the
+    // stores below also sees head at least at this value
+    std::atomic_thread_fence(std::memory_order_release);
+    Event& e = ring.events[head % kRingCapacity];
+    e.name.store(name, r);
+    e.start.store(start, r);
+    e.end.store(end, r);
+    e.request_id.store(request_id, r);
+    ring.head.store(head + 1, std::memory_order_release);
+}
+
+uint64_t Tracer::next_request_id() {
+    static std::atomic<uint64_t> next{1};
+    return next.fetch_add(1, std::memory_order_relaxed);
+}
+
+std::string Tracer::export_chrome_json(double seconds) {
+    constexpr auto r = std::memory_order_relaxed;
+    const double tpn = ticks_per_ns();
+    const uint64_t now_ticks = now();
+    const uint64_t window = static_cast<uint64_t>(std::max(0.0, seconds) * 1e9 * tpn);
+    const uint64_t cutoff = now_ticks > window ? now_ticks - window : 0;
+
+    std::vector<ExportedEvent> events;
+    for (const auto& ring : RingRegistry::instance().snapshot()) {
+        const uint64_t head = ring->head.load(std::memory_order_acquire);
+        const uint64_t begin = head > kRingCapacity ? head - kRingCapacity : 0;
+        std::vector<std::pair<uint64_t, ExportedEvent>> copied;
+        for (uint64_t seq = begin; seq < head; ++seq) {
+            const Event& e = ring->events[seq % kRingCapacity];
+            ExportedEvent out{e.name.load(r), e.start.load(r), e.end.load(r), e.request_id.load(r), ring->tid};
+            if (out.name != nullptr && out.end >= cutoff && out.end >= out.start) {
+                copied.emplace_back(seq, out);
+            }
+        }
+        // Keep only slots the writer cannot have recycled while we were reading.
+        // The fence keeps the relaxed slot loads above ahead of the re-read of
+        // head (seqlock read side). The writer fills slot head_after before
+        // publishing it, so seq head_after - kRingCapacity may already be torn.
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t head_after = ring->head.load(std::memory_order_relaxed);
+        const uint64_t oldest_valid = head_after >= kRingCapacity ? head_after - kRingCapacity + 1 : 0;
+        for (const auto& [seq, out] : copied) {
+            if (seq >= oldest_valid) {
+                events.push_back(out);
+            }
+        }
+    }
+
+    std::sort(events.begin(), events.end(),
+              [](const ExportedEvent& a, const ExportedEvent& b) { return a.start < b.start; });
+
+    const uint64_t origin = events.empty() ? now_ticks : events.front().start;
+    json trace_events = json::array();
+    for (const auto& e : events) {
+        json ev;
+        ev["name"] = e.name;
+        ev["ph"] = "X";
+        ev["pid"] = 1;
+        ev["tid"] = e.tid;
+        ev["ts"] = static_cast<double>(e.start - origin) / tpn / 1e3;
+        ev["dur"] = static_cast<double>(e.end - e.start) / tpn / 1e3;
+        if (e.request_id != 0) {
+            ev["args"]["request_id"] = e.request_id;
+        }
+        trace_events.push_back(std::move(ev));
+    }
+
+    json j;
+    j["traceEvents"] = std::move(trace_events);
+    j["displayTimeUnit"] = "ms";
+    return j.dump();
+}
+
+RequestTraceScope::RequestTraceScope(PhaseTimings& timings)
+    : timings_(&timings), previous_(current_), previous_measuring_(measuring_),
+      measure_(ResourceAccounting::enabled()) {
+    if (measure_ || previous_measuring_) {
+        const ResourceUsage now = ResourceAccounting::thread_usage();
+        if (previous_measuring_) {
+            previous_->resources += now - charged_to_;
+        }
+        charged_to_ = now;
+    }
+    current_ = &timings;
+    measuring_ = measure_;
+}
+
+RequestTraceScope::~RequestTraceScope() {
+    if (measure_ || previous_measuring_) {
+        const ResourceUsage now = ResourceAccounting::thread_usage();
+        if (measure_) {
+            timings_->resources += now - charged_to_;
+            timings_->resources_measured = true;
+        }
+        charged_to_ = now; // The outer scope resumes from here
+    }
+    current_ = previous_;
+    measuring_ = previous_measuring_;
+}
+
+void RequestTraceScope::flush() {
+    if (!measuring_) {
+        return;
+    }
+    const ResourceUsage now = ResourceAccounting::thread_usage();
+    current_->resources += now - charged_to_;
+    current_->resources_measured = true;
+    charged_to_ = now;
+}
+
+} // namespace castor
@@ -0,0 +1,83 @@
+#include "worker_pool.hpp"
+#include "affinity.hpp"
+#include "metrics.hpp"
+#include <iostream>
+
+namespace castor {
+
+namespace {
+thread_local bool t_is_worker = false;
+}
+
+WorkerPool::WorkerPool(const Options& options) : options_(options) {
+    threads_.reserve(options_.threads);
+    for (size_t i = 0; i < options_.threads; ++i) {
+        threads_.emplace_back(&WorkerPool::worker_loop, this, i);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) {
+        thread.join();
+    }
+}
+
+bool WorkerPool::on_worker_thread() {
+    return t_is_worker;
+}
+
+size_t WorkerPool::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queue_.size();
+}
+
+void WorkerPool::post(std::function<void()> fn) {
+    if (threads_.empty()) {
+        fn();
+        return;
+    }
+    enqueue(std::move(fn));
+}
+
+void WorkerPool::enqueue(std::function<void()> task) {
+    Metrics::gauge_add(Gauge::WorkerQueueDepth, 1);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        queue_.push_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+void WorkerPool::worker_loop(size_t index) {
+    t_is_worker = true;
+
+    // Pin before touching any memory so first-touch pages land on our node
+    if (!options_.cpus.empty()) {
+        const int cpu = options_.cpus[index % options_.cpus.size()];
+        if (Affinity::pin_current_thread({cpu}) && options_.numa_local) {
+            Affinity::prefer_local_memory(Affinity::numa_node_of_cpu(cpu));
+        }
+    }
+
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            task = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        Metrics::gauge_add(Gauge::WorkerQueueDepth, -1);
+        task();
+    }
+}
+
+} // namespace castor
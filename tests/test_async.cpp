@@ -0,0 +1,173 @@
+#include "catch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include "async.hpp"
+#include "metrics.hpp"
+#include "response_cache.hpp"
+#include "scheduler.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+template <typename F>
+bool throws_runtime_error(F&& fn) {
+    try {
+        fn();
+    } catch (const std::runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+castor::Task<int> add_later(castor::AsyncResult<int> input, int delta) {
+    const int value = co_await input;
+    co_return value + delta;
+}
+
+castor::Task<int> chain(castor::AsyncResult<int> input) {
+    const int once = co_await add_later(input, 1);
+    const int twice = co_await add_later(input, 10);
+    co_return once + twice;
+}
+
+castor::Task<int> fails(castor::AsyncResult<int> input) {
+    co_await input;
+    throw std::runtime_error("boom");
+}
+
+std::shared_ptr<castor::Engine> make_engine() {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.eos_token_id = -1;
+    return castor::testing::make_engine(config);
+}
+
+} // namespace
+
+TEST_CASE("Tasks suspend on AsyncResult and resume when it completes", "[async]") {
+    auto input = castor::AsyncResult<int>::create();
+    castor::AsyncResult<int> output = castor::start(chain(input));
+    REQUIRE(!output.ready());
+
+    int observed = 0;
+    output.on_ready([&]() { observed = output.get(); });
+    input.set_value(5);
+    REQUIRE(output.ready());
+    REQUIRE(output.get() == 6 + 15);
+    REQUIRE(observed == 21);
+
+    // Already complete: nothing suspends, callbacks run immediately
+    REQUIRE(castor::start(add_later(input, 2)).get() == 7);
+    bool called = false;
+    output.on_ready([&]() { called = true; });
+    REQUIRE(called);
+
+    // Exceptions reach whoever waits on the task
+    auto trigger = castor::AsyncResult<int>::create();
+    castor::AsyncResult<int> failed = castor::start(fails(trigger));
+    trigger.set_value(0);
+    REQUIRE(throws_runtime_error([&]() { failed.get(); }));
+
+    // Resumption through an executor, here a thread of its own
+    auto remote = castor::AsyncResult<int>::create();
+    std::vector<std::thread> threads;
+    castor::Executor spawn = [&threads](std::function<void()> fn) { threads.emplace_back(std::move(fn)); };
+    auto resumed_on = std::make_shared<std::thread::id>();
+    auto task = [](castor::AsyncResult<int> in, castor::Executor executor,
+                   std::shared_ptr<std::thread::id> where) -> castor::Task<int> {
+        const int value = co_await in.via(executor);
+        *where = std::this_thread::get_id();
+        co_return value;
+    };
+    castor::AsyncResult<int> via = castor::start(task(remote, spawn, resumed_on));
+    remote.set_value(3);
+    REQUIRE(via.get() == 3);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    REQUIRE(threads.size() == 1);
+    REQUIRE(*resumed_on != std::this_thread::get_id());
+}
+
+TEST_CASE("Scheduler streams tokens and honours cancellation", "[async]") {
+    auto engine = make_engine();
+    castor::Scheduler scheduler(engine, castor::Scheduler::Options{});
+
+    castor::Scheduler::Request request;
+    request.prompt_ids = {1, 2, 3};
+    request.params.temperature = 0.0f;
+    request.params.max_tokens = 12;
+    std::vector<int32_t> streamed;
+    std::atomic<int> finished_updates{0};
+    request.on_token = [&](const castor::Scheduler::TokenUpdate& update) {
+        streamed.insert(streamed.end(), update.ids, update.ids + update.count);
+        finished_updates += update.finished ? 1 : 0;
+    };
+    castor::AsyncResult<castor::Scheduler::Outcome> pending = scheduler.submit_async(request);
+    const castor::Scheduler::Outcome& outcome = pending.get();
+    REQUIRE(outcome.status == castor::Scheduler::Status::Completed);
+    REQUIRE(outcome.result.output_ids.size() == 12);
+    REQUIRE(streamed == outcome.result.output_ids);
+    REQUIRE(finished_updates == 1);
+
+    // Cancelling from the token callback stops generation at the next iteration
+    const uint64_t cancellations = castor::Metrics::counter_value(castor::Counter::SchedulerCancellations);
+    castor::Scheduler::Request cancelled;
+    cancelled.prompt_ids = {1, 2, 3};
+    cancelled.params = request.params;
+    cancelled.params.max_tokens = 1000;
+    castor::CancellationToken cancel = cancelled.cancel;
+    cancelled.on_token = [cancel](const castor::Scheduler::TokenUpdate& update) {
+        if (update.count > 0) {
+            cancel.cancel();
+        }
+    };
+    castor::Scheduler::Outcome partial = scheduler.submit(cancelled).get();
+    REQUIRE(partial.status == castor::Scheduler::Status::Cancelled);
+    REQUIRE(partial.result.finish_reason == "cancelled");
+    REQUIRE(!partial.result.output_ids.empty());
+    REQUIRE(partial.result.output_ids.size() <= outcome.result.output_ids.size());
+    REQUIRE(std::equal(partial.result.output_ids.begin(), partial.result.output_ids.end(),
+                       outcome.result.output_ids.begin()));
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::SchedulerCancellations) == cancellations + 1);
+
+    // Cancelled before it is ever admitted: nothing is generated
+    castor::Scheduler::Request early = cancelled;
+    early.on_token = nullptr;
+    early.cancel = castor::CancellationToken();
+    early.cancel.cancel();
+    castor::Scheduler::Outcome dropped = scheduler.submit(early).get();
+    REQUIRE(dropped.status == castor::Scheduler::Status::Cancelled);
+    REQUIRE(dropped.result.output_ids.empty());
+}
+
+TEST_CASE("ResponseCache claim hands waiters the leader's result", "[async]") {
+    castor::ResponseCache cache;
+    const std::string key = "k";
+
+    castor::ResponseCache::Claim leader = cache.claim(key);
+    REQUIRE(leader.outcome == castor::ResponseCache::Outcome::Miss);
+    castor::ResponseCache::Claim follower = cache.claim(key);
+    REQUIRE(follower.outcome == castor::ResponseCache::Outcome::Coalesced);
+    REQUIRE(!follower.pending.ready());
+
+    auto value = std::make_shared<castor::GenerationResult>();
+    value->output_ids = {7, 8};
+    cache.publish(key, value);
+    REQUIRE(follower.pending.ready());
+    REQUIRE(follower.pending.get() == value);
+
+    castor::ResponseCache::Claim hit = cache.claim(key);
+    REQUIRE(hit.outcome == castor::ResponseCache::Outcome::Hit);
+    REQUIRE(hit.value == value);
+
+    // A failed leader wakes its waiters with the error and caches nothing
+    REQUIRE(cache.claim("other").outcome == castor::ResponseCache::Outcome::Miss);
+    castor::ResponseCache::Claim waiting = cache.claim("other");
+    cache.fail("other", std::make_exception_ptr(std::runtime_error("failed")));
+    REQUIRE(throws_runtime_error([&]() { waiting.pending.get(); }));
+    REQUIRE(cache.claim("other").outcome == castor::ResponseCache::Outcome::Miss);
+}
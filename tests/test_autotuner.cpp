@@ -0,0 +1,119 @@
+#include "catch.hpp"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "autotuner.hpp"
+#include "sampler.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+castor::ModelConfig small_config() {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.model_name = "tiny";
+    return config;
+}
+
+// Two values per knob and a short workload, so a full sweep takes well under a second
+castor::Autotuner::Options quick_options(const std::string& path) {
+    castor::Autotuner::Options options;
+    options.cache_path = path;
+    options.prompt_tokens = 16;
+    options.output_tokens = 4;
+    options.batches = {1, 4};
+    options.threads = {1, 2};
+    options.prefill_chunks = {8, 64};
+    options.nucleus_windows = {0, 64};
+    return options;
+}
+
+} // namespace
+
+TEST_CASE("Autotuner sweeps each knob and reuses the cached result", "[autotuner]") {
+    castor::testing::TempDir dir("castor_autotuner_test");
+    const std::string path = dir.file("autotune.json");
+    castor::Autotuner::Options options = quick_options(path);
+    options.itl_slo_ms = 1e6;
+    castor::Autotuner tuner(options);
+
+    castor::Autotuner::Settings settings;
+    REQUIRE(!tuner.lookup(small_config(), settings));
+    REQUIRE(tuner.run("dummy.plan", small_config(), false, settings));
+    REQUIRE(tuner.trials().size() == 6); // Threads, then batch, then chunk
+    for (const auto& trial : tuner.trials()) {
+        REQUIRE(trial.meets_slo);
+        REQUIRE(trial.tokens_per_second > 0.0);
+    }
+    REQUIRE((settings.max_batch == 1 || settings.max_batch == 4));
+    REQUIRE((settings.threads == 1 || settings.threads == 2));
+    REQUIRE((settings.prefill_chunk == 8 || settings.prefill_chunk == 64));
+
+    // A later start with the same host, model and SLO skips tuning
+    castor::Autotuner again(options);
+    castor::Autotuner::Settings cached;
+    REQUIRE(again.run("dummy.plan", small_config(), false, cached));
+    REQUIRE(again.trials().empty());
+    REQUIRE(cached.max_batch == settings.max_batch);
+    REQUIRE(cached.threads == settings.threads);
+    REQUIRE(cached.prefill_chunk == settings.prefill_chunk);
+    REQUIRE(cached.nucleus_window == settings.nucleus_window);
+
+    // Another model shape or SLO is another entry
+    castor::ModelConfig wider = small_config();
+    wider.hidden_dim = 128;
+    REQUIRE(again.fingerprint(wider) != again.fingerprint(small_config()));
+    REQUIRE(!again.lookup(wider, cached));
+    castor::Autotuner::Options strict = options;
+    strict.itl_slo_ms = 50.0;
+    REQUIRE(castor::Autotuner(strict).fingerprint(small_config()) != again.fingerprint(small_config()));
+
+    std::ifstream file(path);
+    const nlohmann::json data = nlohmann::json::parse(file);
+    REQUIRE(data["entries"].size() == 1);
+    REQUIRE(data["entries"].begin().value()["host"] == castor::Autotuner::Host::detect().describe());
+}
+
+TEST_CASE("Autotuner falls back to the lowest latency when nothing meets the SLO", "[autotuner]") {
+    castor::testing::TempDir dir("castor_autotuner_strict_test");
+    castor::Autotuner::Options options = quick_options(dir.file("autotune.json"));
+    options.itl_slo_ms = 1e-9;
+    options.threads = {1};
+    options.prefill_chunks = {64};
+    castor::Autotuner tuner(options);
+    castor::ModelConfig config = small_config();
+    config.max_batch_size = 4;
+    auto engine = castor::testing::make_engine(config);
+
+    const castor::Autotuner::Trial best = tuner.tune(engine);
+    REQUIRE(!best.meets_slo);
+    for (const auto& trial : tuner.trials()) {
+        REQUIRE(!trial.meets_slo);
+        REQUIRE(best.p95_itl_ms <= trial.p95_itl_ms);
+    }
+}
+
+TEST_CASE("Nucleus window leaves top-p sampling unchanged", "[autotuner]") {
+    std::vector<float> logits(5000);
+    for (size_t i = 0; i < logits.size(); ++i) {
+        logits[i] = static_cast<float>((i * 7919) % 5000) / 250.0f; // Distinct scores, shuffled order
+    }
+    castor::SamplingParams params;
+    params.temperature = 0.7f;
+    castor::Sampler full(42);
+    castor::Sampler windowed(42);
+    std::vector<float> full_probs, windowed_probs;
+    for (float top_p : {0.5f, 0.9f, 0.999f}) { // Nuclei inside and far outside the window
+        params.top_p = top_p;
+        castor::Sampler::set_nucleus_window(0);
+        full.distribution(logits, params, full_probs);
+        const int32_t a = full.sample(logits, params);
+        castor::Sampler::set_nucleus_window(16);
+        windowed.distribution(logits, params, windowed_probs);
+        const int32_t b = windowed.sample(logits, params);
+        REQUIRE(full_probs == windowed_probs);
+        REQUIRE(a == b);
+    }
+    castor::Sampler::set_nucleus_window(0);
+}
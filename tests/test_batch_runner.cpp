@@ -0,0 +1,172 @@
+#include "catch.hpp"
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "batch_runner.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+// Every file a test writes lives in dir and is removed with it
+struct Fixture {
+    castor::testing::TempDir dir{"castor_batch_runner_test"};
+    std::shared_ptr<castor::Engine> engine = castor::testing::make_engine();
+    std::shared_ptr<castor::Tokenizer> tokenizer = std::make_shared<castor::Tokenizer>();
+
+    Fixture() {
+        std::ofstream vocab(dir.file("tokenizer.json"));
+        vocab << R"({"model": {"vocab": {"<unk>": "0", "prompt": "1", "1": "2", "2": "3", "3": "4"}}})";
+        vocab.close();
+        tokenizer->load(dir.file("tokenizer.json"));
+    }
+};
+
+std::vector<std::string> read_lines(const std::string& path) {
+    std::ifstream file(path);
+    std::vector<std::string> lines;
+    std::string line;
+    while (std::getline(file, line)) {
+        lines.push_back(line);
+    }
+    return lines;
+}
+
+void write_input(const std::string& path, size_t count) {
+    std::ofstream file(path);
+    for (size_t i = 0; i < count; ++i) {
+        if (i == 5) {
+            file << "{not json}\n";
+        } else if (i == 9) {
+            file << "\n";
+        } else {
+            file << R"({"id": )" << i << R"(, "prompt": "prompt )" << i
+                 << R"(", "max_tokens": )" << (i % 7) << R"(, "temperature": 0})" << "\n";
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("BatchRunner writes one ordered result per input line", "[batch_runner]") {
+    Fixture f;
+    write_input(f.dir.file("in.jsonl"), 40);
+
+    castor::BatchRunner::Options options;
+    options.input_path = f.dir.file("in.jsonl");
+    options.output_path = f.dir.file("out.jsonl");
+    options.batch_size = 4;
+    options.tokenize_threads = 3;
+    options.queue_capacity = 2;
+    castor::BatchRunner runner(f.engine, f.tokenizer, options);
+    castor::BatchRunner::Report report;
+    REQUIRE(runner.run(report));
+
+    const auto lines = read_lines(f.dir.file("out.jsonl"));
+    REQUIRE(lines.size() == 39); // blank line 9 is skipped
+    REQUIRE(report.lines == 39);
+    REQUIRE(report.errors == 1);
+
+    uint64_t previous = 0;
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const auto out = nlohmann::json::parse(lines[i]);
+        const uint64_t line = out["line"].get<uint64_t>();
+        REQUIRE((i == 0 || line > previous));
+        previous = line;
+        if (line == 5) {
+            REQUIRE(out.contains("error"));
+        } else {
+            REQUIRE(out["id"].get<uint64_t>() == line);
+            REQUIRE(out["output_tokens"].get<size_t>() <= line % 7);
+        }
+    }
+}
+
+TEST_CASE("BatchRunner resumes from its checkpoint without duplicates", "[batch_runner]") {
+    Fixture f;
+    write_input(f.dir.file("in.jsonl"), 30);
+
+    castor::BatchRunner::Options options;
+    options.input_path = f.dir.file("in.jsonl");
+    options.output_path = f.dir.file("full.jsonl");
+    castor::BatchRunner::Report report;
+    REQUIRE(castor::BatchRunner(f.engine, f.tokenizer, options).run(report));
+    const auto full = read_lines(f.dir.file("full.jsonl"));
+
+    // Simulate a crash after 10 results: checkpoint just past the 10th
+    // result's input line, with a torn partial line after it in the output
+    std::string head;
+    for (size_t i = 0; i < 10; ++i) {
+        head += full[i] + "\n";
+    }
+    std::ifstream in(f.dir.file("in.jsonl"));
+    std::string input((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    const uint64_t last_line = nlohmann::json::parse(full[9])["line"].get<uint64_t>();
+    size_t offset = 0;
+    for (uint64_t i = 0; i <= last_line; ++i) {
+        offset = input.find('\n', offset) + 1;
+    }
+    {
+        std::ofstream out(f.dir.file("resume.jsonl"));
+        out << head << R"({"line": 10, "outp)";
+        std::ofstream progress(castor::BatchRunner::progress_path(f.dir.file("resume.jsonl")));
+        progress << R"({"input_offset": )" << offset << R"(, "output_bytes": )" << head.size() << "}";
+    }
+
+    options.output_path = f.dir.file("resume.jsonl");
+    options.resume = true;
+    REQUIRE(castor::BatchRunner(f.engine, f.tokenizer, options).run(report));
+    REQUIRE(report.start_offset == offset);
+    REQUIRE(report.end_offset == input.size());
+    REQUIRE(read_lines(f.dir.file("resume.jsonl")) == full);
+}
+
+TEST_CASE("BatchRunner rejects an offset inside a line", "[batch_runner]") {
+    Fixture f;
+    write_input(f.dir.file("in.jsonl"), 3);
+    castor::BatchRunner::Options options;
+    options.input_path = f.dir.file("in.jsonl");
+    options.output_path = f.dir.file("out.jsonl");
+    options.start_offset = 3;
+    castor::BatchRunner::Report report;
+    REQUIRE(!castor::BatchRunner(f.engine, f.tokenizer, options).run(report));
+}
+
+TEST_CASE("BatchRunner runs only what its KV blocks cover per engine call", "[batch_runner]") {
+    Fixture f;
+    castor::ModelConfig config = castor::testing::small_config();
+    config.max_seq_length = 256;
+    config.eos_token_id = -1;
+    config.memory_budget_bytes = 1 << 20;
+    f.engine = castor::testing::make_engine(config);
+    REQUIRE(f.engine->kv_arena());
+    castor::BlockArena& arena = *f.engine->kv_arena();
+    const size_t most = arena.max_lease() * 16 * 6 / 10; // Two cannot share one call
+    {
+        std::ofstream file(f.dir.file("in.jsonl"));
+        for (size_t max_tokens : {most, most, arena.max_lease() * 16, most}) {
+            file << R"({"prompt": "prompt", "temperature": 0, "max_tokens": )" << max_tokens << "}\n";
+        }
+    }
+
+    castor::BatchRunner::Options options;
+    options.input_path = f.dir.file("in.jsonl");
+    options.output_path = f.dir.file("out.jsonl");
+    options.batch_size = 4;
+    castor::BatchRunner::Report report;
+    REQUIRE(castor::BatchRunner(f.engine, f.tokenizer, options).run(report));
+    REQUIRE(report.errors == 1);
+
+    const auto lines = read_lines(f.dir.file("out.jsonl"));
+    REQUIRE(lines.size() == 4);
+    for (size_t i = 0; i < lines.size(); ++i) {
+        const auto out = nlohmann::json::parse(lines[i]);
+        if (i == 2) {
+            REQUIRE(out.contains("error")); // Over the whole arena
+        } else {
+            REQUIRE(out["output_tokens"].get<size_t>() == most);
+        }
+    }
+    REQUIRE(arena.free_blocks() == arena.capacity());
+}
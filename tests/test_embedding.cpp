@@ -0,0 +1,127 @@
+#include "catch.hpp"
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "embedding.hpp"
+#include "engine.hpp"
+#include "metrics.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+using castor::testing::make_engine;
+
+double norm(const float* row, size_t dim) {
+    double sum = 0.0;
+    for (size_t d = 0; d < dim; ++d) {
+        sum += static_cast<double>(row[d]) * row[d];
+    }
+    return std::sqrt(sum);
+}
+
+} // namespace
+
+TEST_CASE("Engine embeddings do not depend on how inputs are batched", "[embedding]") {
+    auto engine = make_engine();
+    const std::vector<std::vector<int32_t>> inputs = {{1, 5, 9}, {1, 7}, {1, 5, 9, 11, 13}, {1}};
+    const size_t dim = engine->get_config().hidden_dim;
+
+    castor::EmbeddingOptions packed;
+    std::vector<float> together;
+    const uint64_t tokens_before = castor::Metrics::counter_value(castor::Counter::EmbeddingTokens);
+    const uint64_t batches_before = castor::Metrics::histogram_count(castor::Histogram::EmbeddingSeconds);
+    const uint64_t prefills_before = castor::Metrics::histogram_count(castor::Histogram::PrefillSeconds);
+    REQUIRE(engine->embed(inputs, packed, together));
+    REQUIRE(together.size() == inputs.size() * dim);
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::EmbeddingTokens) == tokens_before + 11);
+    REQUIRE(castor::Metrics::histogram_count(castor::Histogram::EmbeddingSeconds) == batches_before + 1);
+    REQUIRE(castor::Metrics::histogram_count(castor::Histogram::PrefillSeconds) == prefills_before);
+
+    // A budget smaller than some inputs forces several batches, one of them oversized
+    castor::EmbeddingOptions small = packed;
+    small.max_batch_tokens = 4;
+    std::vector<float> split;
+    REQUIRE(engine->embed(inputs, small, split));
+    REQUIRE(split == together);
+
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        std::vector<float> alone;
+        REQUIRE(engine->embed({inputs[i]}, packed, alone));
+        REQUIRE(std::memcmp(alone.data(), together.data() + i * dim, dim * sizeof(float)) == 0);
+        REQUIRE(std::fabs(norm(alone.data(), dim) - 1.0) < 1e-5);
+    }
+    REQUIRE(std::memcmp(together.data(), together.data() + dim, dim * sizeof(float)) != 0);
+
+    std::vector<float> out;
+    REQUIRE(!engine->embed({{1, 2}, {}}, packed, out));
+}
+
+TEST_CASE("Engine embedding pooling modes", "[embedding]") {
+    auto engine = make_engine();
+    const size_t dim = engine->get_config().hidden_dim;
+    castor::EmbeddingOptions options;
+    options.normalize = false;
+
+    auto embed = [&](castor::Pooling pooling, const std::vector<int32_t>& input) {
+        options.pooling = pooling;
+        std::vector<float> out;
+        REQUIRE(engine->embed({input}, options, out));
+        return out;
+    };
+
+    // CLS reads the first position, last the final one, mean their average
+    const auto cls = embed(castor::Pooling::Cls, {1, 4, 6});
+    const auto last = embed(castor::Pooling::Last, {1, 4, 6});
+    const auto mean = embed(castor::Pooling::Mean, {1, 4, 6});
+    REQUIRE(cls == embed(castor::Pooling::Last, {1}));
+    REQUIRE(last != cls);
+    const auto second = embed(castor::Pooling::Last, {1, 4});
+    for (size_t d = 0; d < dim; ++d) {
+        REQUIRE(std::fabs(mean[d] - (cls[d] + second[d] + last[d]) / 3.0f) < 1e-5f);
+    }
+
+    // A single token pools the same way in every mode
+    REQUIRE(embed(castor::Pooling::Mean, {3}) == embed(castor::Pooling::Cls, {3}));
+
+    castor::Pooling pooling;
+    REQUIRE(castor::embedding::parse_pooling("last", pooling));
+    REQUIRE(pooling == castor::Pooling::Last);
+    REQUIRE(!castor::embedding::parse_pooling("max", pooling));
+    castor::EmbeddingEncoding encoding;
+    REQUIRE(castor::embedding::parse_encoding("int8", encoding));
+    REQUIRE(encoding == castor::EmbeddingEncoding::Int8);
+    REQUIRE(!castor::embedding::parse_encoding("base64", encoding));
+}
+
+TEST_CASE("Embedding encodings", "[embedding]") {
+    using namespace castor::embedding;
+    REQUIRE(float_to_half(1.0f) == 0x3C00);
+    REQUIRE(float_to_half(-2.0f) == 0xC000);
+    REQUIRE(float_to_half(65504.0f) == 0x7BFF);
+    REQUIRE(float_to_half(1e6f) == 0x7C00);
+    REQUIRE(float_to_half(std::ldexp(1.0f, -24)) == 0x0001); // Smallest subnormal
+    REQUIRE(float_to_half(std::ldexp(1.0f, -26)) == 0x0000);
+    REQUIRE(float_to_half(1.0f + std::ldexp(1.0f, -11)) == 0x3C00); // Tie rounds to even
+    REQUIRE(float_to_half(1.0f + 3 * std::ldexp(1.0f, -11)) == 0x3C02);
+    for (float value : {0.1f, -0.333f, 0.7071f, 6.1e-5f, 1e-7f}) {
+        const float back = half_to_float(float_to_half(value));
+        REQUIRE(std::fabs(back - value) <= std::fabs(value) * 1e-3f + 6e-8f);
+    }
+
+    const std::vector<float> values = {0.5f, -1.0f, 0.25f, 0.0f};
+    std::vector<int8_t> quantized(values.size());
+    const float scale = quantize_int8(values.data(), values.size(), quantized.data());
+    REQUIRE(scale == 1.0f / 127.0f);
+    REQUIRE(quantized[1] == -127);
+    for (size_t i = 0; i < values.size(); ++i) {
+        REQUIRE(std::fabs(quantized[i] * scale - values[i]) <= scale / 2);
+    }
+    REQUIRE(quantize_int8(values.data() + 3, 1, quantized.data()) == 0.0f);
+
+    REQUIRE(base64_encode("", 0).empty());
+    REQUIRE(base64_encode("f", 1) == "Zg==");
+    REQUIRE(base64_encode("fo", 2) == "Zm8=");
+    REQUIRE(base64_encode("foo", 3) == "Zm9v");
+    REQUIRE(base64_encode("foobar", 6) == "Zm9vYmFy");
+}
@@ -1,8 +1,11 @@
 #include "catch.hpp"
+#include <cmath>
+#include <functional>
 #include <memory>
 #include "engine.hpp"
 #include "tokenizer.hpp"
 #include "model_config.hpp"
+#include "sampler.hpp"
 
 TEST_CASE("Engine creation", "[engine]") {
     auto engine = std::make_shared<castor::Engine>();
@@ -72,3 +75,289 @@ TEST_CASE("Engine shutdown", "[engine]") {
     engine->shutdown();
     REQUIRE(!engine->is_initialized());
 }
+
+TEST_CASE("Engine greedy generation is deterministic", "[engine]") {
+    auto engine = std::make_shared<castor::Engine>();
+    castor::ModelConfig config;
+    config.vocab_size = 1000;
+    config.eos_token_id = -1;
+    engine->initialize("dummy.plan", config);
+
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 8;
+
+    castor::GenerationResult a;
+    castor::GenerationResult b;
+    REQUIRE(engine->generate({1, 2, 3}, params, a));
+    REQUIRE(engine->generate({1, 2, 3}, params, b));
+    REQUIRE(a.output_ids.size() == 8);
+    REQUIRE(a.output_ids == b.output_ids);
+    REQUIRE(a.finish_reason == "length");
+}
+
+TEST_CASE("Engine batched generation matches single-sequence generation", "[engine]") {
+    auto engine = std::make_shared<castor::Engine>();
+    castor::ModelConfig config;
+    config.vocab_size = 1000;
+    engine->initialize("dummy.plan", config);
+
+    std::vector<std::vector<int32_t>> prompts = {{1, 2, 3}, {4}, {5, 6}};
+    std::vector<castor::SamplingParams> params(3);
+    params[0].temperature = 0.0f;
+    params[0].max_tokens = 6;
+    params[1].temperature = 0.8f;
+    params[1].top_k = 20;
+    params[1].seed = 7;
+    params[1].max_tokens = 12;
+    params[2].max_tokens = 0;
+
+    std::vector<castor::GenerationResult> batch;
+    REQUIRE(engine->generate_batch(prompts, params, batch));
+    REQUIRE(batch.size() == 3);
+    for (size_t i = 0; i < prompts.size(); ++i) {
+        castor::GenerationResult single;
+        REQUIRE(engine->generate(prompts[i], params[i], single));
+        REQUIRE(batch[i].output_ids == single.output_ids);
+        REQUIRE(batch[i].logprobs == single.logprobs);
+        REQUIRE(batch[i].finish_reason == single.finish_reason);
+    }
+}
+
+TEST_CASE("Engine chunked prefill matches whole-prompt prefill", "[engine]") {
+    auto engine = std::make_shared<castor::Engine>();
+    castor::ModelConfig config;
+    config.vocab_size = 1000;
+    engine->initialize("dummy.plan", config);
+
+    std::vector<int32_t> prompt(100);
+    for (size_t i = 0; i < prompt.size(); ++i) {
+        prompt[i] = static_cast<int32_t>(i * 7 % 1000);
+    }
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 6;
+
+    castor::GenerationStream chunked(*engine, prompt, params);
+    REQUIRE(chunked.prefill_chunk(32));
+    REQUIRE(!chunked.prefilled());
+    REQUIRE(chunked.prompt_remaining() == 68);
+    while (!chunked.prefilled()) {
+        REQUIRE(chunked.prefill_chunk(32));
+    }
+    REQUIRE(chunked.prompt_remaining() == 0);
+    REQUIRE(chunked.run_to_completion());
+
+    castor::GenerationResult whole;
+    REQUIRE(engine->generate(prompt, params, whole));
+    REQUIRE(chunked.result().output_ids == whole.output_ids);
+    REQUIRE(chunked.result().logprobs == whole.logprobs);
+}
+
+namespace {
+
+std::shared_ptr<castor::Engine> make_model(const std::string& name, uint32_t vocab,
+                                           int32_t eos_token_id = castor::ModelConfig().eos_token_id) {
+    auto engine = std::make_shared<castor::Engine>();
+    castor::ModelConfig config;
+    config.model_name = name;
+    config.vocab_size = vocab;
+    config.eos_token_id = eos_token_id;
+    engine->initialize("dummy.plan", config);
+    return engine;
+}
+
+} // namespace
+
+TEST_CASE("Engine speculative greedy decoding matches plain decoding", "[engine]") {
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 40;
+    const std::vector<int32_t> prompt = {5, 6, 7};
+
+    castor::GenerationResult plain;
+    REQUIRE(make_model("target", 1000)->generate(prompt, params, plain));
+
+    // A perfect draft (same model) is always accepted: k + 1 tokens per target pass
+    auto target = make_model("target", 1000);
+    castor::SpeculativeOptions options;
+    options.adaptive = false;
+    REQUIRE(target->set_draft(make_model("target", 1000), options));
+    castor::GenerationResult perfect;
+    REQUIRE(target->generate(prompt, params, perfect));
+    REQUIRE(perfect.output_ids == plain.output_ids);
+    REQUIRE(perfect.accepted_draft_tokens == perfect.draft_tokens);
+    REQUIRE(perfect.target_forwards <= 9);
+
+    // An unrelated draft is mostly rejected but never changes the output
+    REQUIRE(target->set_draft(make_model("other", 1000)));
+    castor::GenerationResult mismatched;
+    REQUIRE(target->generate(prompt, params, mismatched));
+    REQUIRE(mismatched.output_ids == plain.output_ids);
+    REQUIRE(mismatched.logprobs.size() == plain.logprobs.size());
+    REQUIRE(mismatched.accepted_draft_tokens < mismatched.draft_tokens);
+
+    REQUIRE(!target->set_draft(target));
+    REQUIRE(!target->set_draft(make_model("small-vocab", 500)));
+}
+
+TEST_CASE("Engine speculative stream state ends at the emitted tokens on EOS", "[engine]") {
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 40;
+    const std::vector<int32_t> prompt = {5, 6, 7};
+    castor::GenerationResult plain;
+    REQUIRE(make_model("target", 1000, -1)->generate(prompt, params, plain));
+
+    // Making each early output token the EOS id in turn ends the stream at every
+    // position of a round: among accepted proposals (the perfect draft) and on
+    // the corrected or bonus token (the unrelated one)
+    for (size_t end = 0; end < 8; ++end) {
+        const int32_t eos = plain.output_ids[end];
+        for (const char* draft : {"target", "other"}) {
+            auto target = make_model("target", 1000, eos);
+            REQUIRE(target->set_draft(make_model(draft, 1000, eos)));
+            castor::GenerationStream stream(*target, prompt, params);
+            REQUIRE(stream.run_to_completion());
+            REQUIRE(stream.result().finish_reason == "stop");
+            REQUIRE(stream.result().output_ids.back() == eos);
+            // Everything but the last emitted token has been fed, as without a draft
+            REQUIRE(stream.state().length == prompt.size() + stream.result().output_ids.size() - 1);
+        }
+    }
+}
+
+TEST_CASE("Engine speculative sampling preserves the target distribution", "[engine]") {
+    const uint32_t vocab = 6;
+    auto target = make_model("target", vocab);
+    REQUIRE(target->set_draft(make_model("draft", vocab)));
+
+    castor::SamplingParams params;
+    params.temperature = 1.0f;
+    params.max_tokens = 2; // One speculative round with k = 1 decides the first token
+    const std::vector<int32_t> prompt = {1, 2};
+
+    // Exact first-token distribution under the target alone
+    castor::SequenceState state;
+    std::vector<float> logits;
+    REQUIRE(target->forward(state, prompt, logits));
+    castor::Sampler sampler;
+    std::vector<float> expected;
+    sampler.distribution(logits, params, expected);
+
+    const int trials = 20000;
+    std::vector<int> counts(vocab, 0);
+    uint64_t proposed = 0;
+    uint64_t accepted = 0;
+    for (int i = 0; i < trials; ++i) {
+        params.seed = static_cast<uint64_t>(i) + 1;
+        castor::GenerationResult result;
+        REQUIRE(target->generate(prompt, params, result));
+        ++counts[result.output_ids[0]];
+        proposed += result.draft_tokens;
+        accepted += result.accepted_draft_tokens;
+    }
+    for (uint32_t v = 0; v < vocab; ++v) {
+        REQUIRE(std::abs(counts[v] / double(trials) - expected[v]) < 0.015);
+    }
+    REQUIRE(proposed > 0);
+    REQUIRE(accepted > 0);
+    REQUIRE(accepted < proposed);
+}
+
+TEST_CASE("Engine candidates fork one prefill into independent samples", "[engine]") {
+    auto engine = make_model("target", 1000);
+    castor::SamplingParams params;
+    params.temperature = 1.0f;
+    params.max_tokens = 12;
+    params.seed = 40;
+    const std::vector<int32_t> prompt = {3, 1, 4, 1, 5};
+
+    castor::CandidateOptions options;
+    options.n = 3;
+    options.best_of = 5;
+    std::vector<castor::GenerationResult> candidates;
+    REQUIRE(engine->generate_candidates(prompt, params, options, candidates));
+    REQUIRE(candidates.size() == 3);
+
+    // Each candidate is exactly what a separate request with seed + i yields
+    std::vector<castor::GenerationResult> separate(options.best_of);
+    for (uint32_t i = 0; i < options.best_of; ++i) {
+        castor::SamplingParams seeded = params;
+        seeded.seed = params.seed + i;
+        REQUIRE(engine->generate(prompt, seeded, separate[i]));
+    }
+    for (size_t c = 0; c < candidates.size(); ++c) {
+        if (c > 0) {
+            REQUIRE(candidates[c - 1].cumulative_logprob >= candidates[c].cumulative_logprob);
+        }
+        double sum = 0.0;
+        for (float logprob : candidates[c].logprobs) {
+            sum += logprob;
+        }
+        REQUIRE(std::abs(sum - candidates[c].cumulative_logprob) < 1e-6);
+        bool found = false;
+        for (const auto& reference : separate) {
+            found = found || reference.output_ids == candidates[c].output_ids;
+        }
+        REQUIRE(found);
+    }
+
+    options.n = 0;
+    REQUIRE(!engine->generate_candidates(prompt, params, options, candidates));
+}
+
+TEST_CASE("Engine beam search finds the best-scoring continuation", "[engine]") {
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 3;
+    const std::vector<int32_t> prompt = {1, 3};
+    auto engine = make_model("target", 4); // Token 2 is EOS
+
+    // Width 1 is greedy decoding
+    castor::CandidateOptions options;
+    options.beam_search = true;
+    std::vector<castor::GenerationResult> beams;
+    REQUIRE(engine->generate_candidates(prompt, params, options, beams));
+    castor::GenerationResult greedy;
+    REQUIRE(engine->generate(prompt, params, greedy));
+    REQUIRE(beams.size() == 1);
+    REQUIRE(beams[0].output_ids == greedy.output_ids);
+
+    // Brute force every continuation of up to 3 tokens
+    double best = -INFINITY;
+    std::vector<int32_t> best_ids;
+    std::function<void(castor::SequenceState, std::vector<float>, std::vector<int32_t>, double)> search =
+        [&](castor::SequenceState state, std::vector<float> logits, std::vector<int32_t> ids, double score) {
+            for (int32_t token = 0; token < 4; ++token) {
+                const double next = score + castor::Sampler::logprob(logits, params, token);
+                std::vector<int32_t> extended = ids;
+                extended.push_back(token);
+                if (token == 2 || extended.size() == params.max_tokens) {
+                    if (next > best) {
+                        best = next;
+                        best_ids = extended;
+                    }
+                    continue;
+                }
+                castor::SequenceState child = state;
+                std::vector<float> child_logits;
+                REQUIRE(engine->forward(child, {token}, child_logits));
+                search(child, child_logits, extended, next);
+            }
+        };
+    castor::SequenceState root;
+    std::vector<float> root_logits;
+    REQUIRE(engine->forward(root, prompt, root_logits));
+    search(root, root_logits, {}, 0.0);
+
+    // Wide enough to keep every hypothesis, so the search is exhaustive
+    options.n = 2;
+    options.best_of = 16;
+    REQUIRE(engine->generate_candidates(prompt, params, options, beams));
+    REQUIRE(beams.size() == 2);
+    REQUIRE(beams[0].output_ids == best_ids);
+    REQUIRE(std::abs(beams[0].cumulative_logprob - best) < 1e-5);
+    REQUIRE(beams[0].cumulative_logprob >= beams[1].cumulative_logprob);
+    REQUIRE(beams[0].output_ids != beams[1].output_ids);
+}
@@ -0,0 +1,140 @@
+#include "catch.hpp"
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "affinity.hpp"
+#include "engine_pool.hpp"
+#include "server.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+using castor::testing::small_config;
+
+std::shared_ptr<castor::EnginePool> make_pool(size_t replicas, size_t slack, bool scheduler = false) {
+    castor::EnginePool::Options options;
+    options.replicas = replicas;
+    options.threads_per_replica = 1;
+    options.affinity_slack = slack;
+    options.scheduler_enabled = scheduler;
+    auto pool = std::make_shared<castor::EnginePool>(options);
+    REQUIRE(pool->initialize("dummy.plan", small_config(), nullptr));
+    return pool;
+}
+
+} // namespace
+
+TEST_CASE("EnginePool places replicas on nodes with usable CPUs", "[engine_pool]") {
+    const auto per_node = castor::EnginePool::plan_placement(0);
+    REQUIRE(!per_node.empty());
+    REQUIRE(per_node.size() <= static_cast<size_t>(castor::Affinity::numa_node_count()));
+
+    const auto placement = castor::EnginePool::plan_placement(3);
+    REQUIRE(placement.size() == 3);
+    for (const auto& [node, cpus] : placement) {
+        REQUIRE((node >= 0) == !cpus.empty());
+        for (int cpu : cpus) {
+            REQUIRE(castor::Affinity::numa_node_of_cpu(cpu) == node);
+        }
+    }
+
+    auto pool = make_pool(2, 0);
+    REQUIRE(pool->size() == 2);
+    for (size_t i = 0; i < pool->size(); ++i) {
+        const auto& replica = pool->replica(i);
+        REQUIRE(replica.index == i);
+        REQUIRE(replica.engine->is_initialized());
+        REQUIRE(replica.workers->size() == 1);
+        REQUIRE(replica.scheduler == nullptr);
+    }
+    REQUIRE(pool->replica(0).engine != pool->replica(1).engine);
+    REQUIRE(!castor::EnginePool(castor::EnginePool::Options()).acquire(1));
+}
+
+TEST_CASE("EnginePool keeps a prefix on one replica until it is overloaded", "[engine_pool]") {
+    auto pool = make_pool(2, 1);
+    const std::vector<int32_t> prompt(100, 7);
+    std::vector<int32_t> same_prefix = prompt;
+    same_prefix.push_back(8); // Differs only past affinity_tokens
+    const uint64_t key = pool->affinity_key(prompt);
+    REQUIRE(key == pool->affinity_key(same_prefix));
+    REQUIRE(key != pool->affinity_key(std::vector<int32_t>(100, 9)));
+    REQUIRE(pool->affinity_key(std::vector<int32_t>()) == 0);
+    REQUIRE(castor::EnginePool::affinity_key("s1") == castor::EnginePool::affinity_key(std::string("s1")));
+
+    // Sequential requests all land on the preferred replica
+    size_t preferred = 0;
+    {
+        castor::EnginePool::Lease lease = pool->acquire(key);
+        REQUIRE(lease);
+        preferred = lease->index;
+    }
+    for (int i = 0; i < 4; ++i) {
+        REQUIRE(pool->acquire(key)->index == preferred);
+    }
+
+    // With slack 1 the preferred replica takes one request more than the other, then load wins
+    std::vector<castor::EnginePool::Lease> held;
+    held.push_back(pool->acquire(key));
+    held.push_back(pool->acquire(key));
+    REQUIRE(held[1]->index == preferred);
+    held.push_back(pool->acquire(key));
+    REQUIRE(held[2]->index != preferred);
+    held.push_back(pool->acquire(0)); // Load only: the replicas are now 2-1
+    REQUIRE(held[3]->index != preferred);
+
+    auto status = pool->status();
+    REQUIRE(status[preferred].in_flight == 2);
+    REQUIRE(status[1 - preferred].in_flight == 2);
+    REQUIRE(status[preferred].requests == 7);
+    REQUIRE(status[preferred].affinity_routes == 7);
+    REQUIRE(status[1 - preferred].affinity_routes == 0);
+
+    // Moving a lease keeps one request in flight; destroying it releases the replica
+    castor::EnginePool::Lease moved = std::move(held[0]);
+    REQUIRE(!held[0]);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    held.clear();
+    REQUIRE(pool->status()[preferred].in_flight == 1);
+    moved = castor::EnginePool::Lease();
+    status = pool->status();
+    REQUIRE(status[preferred].in_flight == 0);
+    REQUIRE(status[preferred].busy_seconds >= 0.015);
+    REQUIRE(status[preferred].utilization > 0.0);
+    REQUIRE(status[preferred].utilization < 1.0);
+}
+
+TEST_CASE("/infer through an engine pool routes by prefix and matches a single engine", "[engine_pool]") {
+    std::ofstream vocab("pool_tokenizer.json");
+    vocab << R"({"model": {"vocab": {"<unk>": "0", "the": "1", "quick": "2", "brown": "3", "fox": "4"}}})";
+    vocab.close();
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load("pool_tokenizer.json"));
+    std::remove("pool_tokenizer.json");
+
+    auto single = castor::testing::make_engine();
+    castor::Server server;
+    REQUIRE(server.initialize(single, tokenizer));
+    const std::string body = R"({"prompt": "the quick brown fox", "max_tokens": 5, "temperature": 0})";
+    const nlohmann::json expected = nlohmann::json::parse(server.handle_infer(body).body);
+
+    for (bool scheduler : {false, true}) {
+        auto pool = make_pool(2, 0, scheduler);
+        REQUIRE(server.initialize(pool->replica(0).engine, tokenizer));
+        server.set_engine_pool(pool);
+        for (int i = 0; i < 3; ++i) {
+            const nlohmann::json result = nlohmann::json::parse(server.handle_infer(body).body);
+            REQUIRE(result["output_token_ids"] == expected["output_token_ids"]);
+        }
+        const auto status = pool->status();
+        REQUIRE(status[0].requests + status[1].requests == 3);
+        REQUIRE((status[0].requests == 3 || status[1].requests == 3)); // One prefix, one replica
+        REQUIRE(status[0].in_flight + status[1].in_flight == 0);
+        server.set_engine_pool(nullptr);
+    }
+}
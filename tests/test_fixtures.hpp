@@ -0,0 +1,47 @@
+// Shared fixtures for the Catch tests
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include "engine.hpp"
+#include "model_config.hpp"
+
+namespace castor::testing {
+
+// A model small enough that a full generation takes milliseconds
+inline ModelConfig small_config() {
+    ModelConfig config;
+    config.vocab_size = 1000;
+    config.hidden_dim = 64;
+    config.num_layers = 2;
+    return config;
+}
+
+// An initialized stub engine for @p config
+inline std::shared_ptr<Engine> make_engine(const ModelConfig& config = small_config()) {
+    auto engine = std::make_shared<Engine>();
+    engine->initialize("dummy.plan", config);
+    return engine;
+}
+
+// Fresh directory under the system temp directory, removed with everything
+// in it when the test ends
+struct TempDir {
+    std::filesystem::path path;
+
+    explicit TempDir(const std::string& name) : path(std::filesystem::temp_directory_path() / name) {
+        std::filesystem::remove_all(path);
+        std::filesystem::create_directories(path);
+    }
+    ~TempDir() {
+        std::error_code ignored;
+        std::filesystem::remove_all(path, ignored);
+    }
+    TempDir(const TempDir&) = delete;
+    TempDir& operator=(const TempDir&) = delete;
+
+    std::string file(const std::string& name) const { return (path / name).string(); }
+};
+
+} // namespace castor::testing
@@ -0,0 +1,235 @@
+#include "catch.hpp"
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "grammar.hpp"
+#include "metrics.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+bool matches(const castor::Grammar& grammar, const std::string& text) {
+    int32_t state = grammar.start();
+    for (char c : text) {
+        state = grammar.next(state, static_cast<uint8_t>(c));
+        if (state == castor::Grammar::kDead) {
+            return false;
+        }
+    }
+    return grammar.accepting(state);
+}
+
+std::shared_ptr<const castor::Grammar> regex(const std::string& pattern) {
+    std::string error;
+    auto grammar = castor::Grammar::from_regex(pattern, error);
+    REQUIRE(grammar);
+    return grammar;
+}
+
+// Single-byte tokens, like the placeholder tokenizer
+std::shared_ptr<const castor::TokenMasks::Vocabulary> byte_vocabulary() {
+    auto table = std::make_shared<castor::TokenMasks::Vocabulary>(256);
+    for (size_t b = 0; b < table->size(); ++b) {
+        (*table)[b] = std::string(1, static_cast<char>(b));
+    }
+    return table;
+}
+
+} // namespace
+
+TEST_CASE("Grammar compiles regular expressions", "[grammar]") {
+    auto counted = regex("[a-c]+x{2}");
+    REQUIRE(matches(*counted, "abxx"));
+    REQUIRE(!matches(*counted, "abx"));
+    REQUIRE(!matches(*counted, "abxxx"));
+    REQUIRE(!matches(*counted, "xx"));
+
+    auto digits = regex("\\d{2,3}|n/a");
+    REQUIRE(matches(*digits, "12"));
+    REQUIRE(matches(*digits, "123"));
+    REQUIRE(matches(*digits, "n/a"));
+    REQUIRE(!matches(*digits, "1"));
+    REQUIRE(!matches(*digits, "1234"));
+
+    auto open = regex("(ab|cd){2,}[^0-9]?");
+    REQUIRE(matches(*open, "abcd"));
+    REQUIRE(matches(*open, "cdcdabz"));
+    REQUIRE(!matches(*open, "ab"));
+    REQUIRE(!matches(*open, "abab7"));
+
+    std::string error;
+    REQUIRE(!castor::Grammar::from_regex("(ab", error));
+    REQUIRE(!error.empty());
+    REQUIRE(!castor::Grammar::from_regex("[z-a]", error));
+    REQUIRE(!castor::Grammar::from_regex("a*{2}", error));
+    REQUIRE(!castor::Grammar::from_regex("\\q", error));
+}
+
+TEST_CASE("Grammar lowers JSON schemas", "[grammar]") {
+    const nlohmann::json schema = nlohmann::json::parse(R"({
+        "type": "object",
+        "properties": {
+            "name": {"type": "string", "maxLength": 4},
+            "age": {"type": "integer"},
+            "tags": {"type": "array", "items": {"enum": ["a", "b"]}, "maxItems": 2},
+            "ok": {"type": ["boolean", "null"]}
+        },
+        "required": ["name", "age"]
+    })");
+    std::string error;
+    auto grammar = castor::Grammar::from_json_schema(schema, error);
+    REQUIRE(grammar);
+
+    // Keys in schema (sorted) order, compact
+    REQUIRE(matches(*grammar, R"({"age":3,"name":"bob"})"));
+    REQUIRE(matches(*grammar, R"({"age":-10,"name":"","ok":null,"tags":["a","b"]})"));
+    REQUIRE(matches(*grammar, R"({"age":0,"name":"\u00e9","tags":[]})"));
+    REQUIRE(!matches(*grammar, R"({"name":"bob"})"));
+    REQUIRE(!matches(*grammar, R"({"age":03,"name":"bob"})"));
+    REQUIRE(!matches(*grammar, R"({"age":1,"name":"toolong"})"));
+    REQUIRE(!matches(*grammar, R"({"age":1,"name":"x","tags":["a","b","a"]})"));
+
+    REQUIRE(!castor::Grammar::from_json_schema(nlohmann::json::parse(R"({"type": "object"})"), error));
+    REQUIRE(!castor::Grammar::from_json_schema(nlohmann::json::parse(R"({"$ref": "#/x"})"), error));
+    REQUIRE(!castor::Grammar::from_json_schema(nlohmann::json::parse(R"({"type": "date"})"), error));
+}
+
+TEST_CASE("TokenMasks allow exactly the tokens that keep the output valid", "[grammar]") {
+    // Token 2 is EOS
+    auto vocabulary = std::make_shared<castor::TokenMasks::Vocabulary>(
+        castor::TokenMasks::Vocabulary{"a", "ab", "", "b", "bd", "d", "c", "x", "abd"});
+    castor::TokenMasks masks(regex("ab*d"), vocabulary, 10, 2);
+    auto allowed = [&masks](int32_t state, int32_t token) {
+        return ((masks.allowed(state)[token / 64] >> (token % 64)) & 1) != 0;
+    };
+
+    int32_t state = masks.start();
+    REQUIRE(allowed(state, 0));
+    REQUIRE(allowed(state, 1));
+    REQUIRE(allowed(state, 8));
+    REQUIRE(!allowed(state, 2)); // Not accepting yet
+    REQUIRE(!allowed(state, 3));
+    REQUIRE(!allowed(state, 9)); // Beyond the vocabulary
+    REQUIRE(masks.advance(state, 7) == castor::Grammar::kDead);
+
+    state = masks.advance(state, 1);
+    REQUIRE(allowed(state, 3));
+    REQUIRE(allowed(state, 4));
+    REQUIRE(allowed(state, 5));
+    REQUIRE(!allowed(state, 6));
+    REQUIRE(!masks.complete(state));
+
+    state = masks.advance(state, 4);
+    REQUIRE(masks.complete(state));
+    REQUIRE(allowed(state, 2));
+    REQUIRE(!allowed(state, 5));
+
+    std::vector<float> logits(10, 1.0f);
+    masks.apply(masks.start(), logits);
+    REQUIRE(logits[0] == 1.0f);
+    REQUIRE(std::isinf(logits[3]));
+    REQUIRE(std::isinf(logits[9]));
+}
+
+TEST_CASE("TokenMasks::apply_mask matches a per-token loop", "[grammar]") {
+    const size_t count = 1000;
+    std::vector<uint64_t> bits((count + 63) / 64);
+    uint64_t x = 7;
+    for (size_t w = 0; w < bits.size(); ++w) {
+        x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+        bits[w] = w % 3 == 0 ? 0 : (w % 3 == 1 ? ~uint64_t{0} : x);
+    }
+    std::vector<float> logits(count);
+    for (size_t i = 0; i < count; ++i) {
+        logits[i] = static_cast<float>(i);
+    }
+    castor::TokenMasks::apply_mask(bits.data(), logits.data(), count);
+    for (size_t i = 0; i < count; ++i) {
+        const bool keep = (bits[i / 64] >> (i % 64)) & 1;
+        REQUIRE((keep ? logits[i] == static_cast<float>(i) : std::isinf(logits[i])));
+    }
+}
+
+TEST_CASE("Constrained generation always matches the grammar", "[grammar]") {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.vocab_size = 300;
+    auto engine = castor::testing::make_engine(config);
+
+    const std::string pattern = R"(\{"n":(0|[1-9][0-9]{0,2}),"ok":(true|false)\})";
+    std::string error;
+    auto vocabulary = byte_vocabulary();
+    auto masks = castor::TokenMasks::compile("regex", pattern, vocabulary, config.vocab_size, config.eos_token_id, error);
+    REQUIRE(masks);
+    REQUIRE(castor::TokenMasks::compile("regex", pattern, vocabulary, config.vocab_size, config.eos_token_id, error) ==
+            masks);
+    auto grammar = regex(pattern);
+
+    castor::SamplingParams params;
+    params.max_tokens = 64;
+    params.grammar = masks;
+    for (uint64_t seed = 0; seed < 20; ++seed) {
+        params.temperature = seed == 0 ? 0.0f : 1.5f;
+        params.seed = seed;
+        castor::GenerationResult result;
+        REQUIRE(engine->generate({1, 2, 3}, params, result));
+        std::string text;
+        for (int32_t id : result.output_ids) {
+            text += (*vocabulary)[id];
+        }
+        REQUIRE(result.finish_reason == "stop");
+        REQUIRE(matches(*grammar, text));
+    }
+
+    castor::CandidateOptions beams;
+    beams.n = 2;
+    beams.best_of = 4;
+    beams.beam_search = true;
+    std::vector<castor::GenerationResult> results;
+    REQUIRE(engine->generate_candidates({1, 2, 3}, params, beams, results));
+    REQUIRE(results.size() == 2);
+    for (const auto& result : results) {
+        std::string text;
+        for (int32_t id : result.output_ids) {
+            text += (*vocabulary)[id];
+        }
+        REQUIRE(matches(*grammar, text));
+    }
+
+    // Masks are built once per state and reused
+    const uint64_t builds = castor::Metrics::counter_value(castor::Counter::GrammarMaskBuilds);
+    castor::GenerationResult again;
+    params.temperature = 0.0f;
+    REQUIRE(engine->generate({1, 2, 3}, params, again));
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::GrammarMaskBuilds) == builds);
+}
+
+TEST_CASE("Constrained beam search ends on a dead grammar state like a single stream", "[grammar]") {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.vocab_size = 300;
+    auto engine = castor::testing::make_engine(config);
+
+    // After "a" the grammar needs "b", which no token spells
+    auto vocabulary = std::make_shared<castor::TokenMasks::Vocabulary>(castor::TokenMasks::Vocabulary{"a", "x", ""});
+    auto masks = std::make_shared<castor::TokenMasks>(regex("ab"), vocabulary, config.vocab_size, config.eos_token_id);
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 8;
+    params.grammar = masks;
+
+    castor::GenerationResult single;
+    REQUIRE(engine->generate({1, 2, 3}, params, single));
+    REQUIRE(single.finish_reason == "constraint");
+    REQUIRE(single.output_ids == std::vector<int32_t>({0}));
+
+    castor::CandidateOptions beams;
+    beams.n = 1;
+    beams.best_of = 3;
+    beams.beam_search = true;
+    std::vector<castor::GenerationResult> results;
+    REQUIRE(engine->generate_candidates({1, 2, 3}, params, beams, results));
+    REQUIRE(results.size() == 1);
+    REQUIRE(results[0].finish_reason == "constraint");
+    REQUIRE(results[0].output_ids == single.output_ids);
+}
@@ -0,0 +1,114 @@
+#include "catch.hpp"
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include "engine.hpp"
+#include "kernels.hpp"
+
+namespace {
+
+std::vector<float> random_values(size_t count, uint64_t seed, float scale = 1.0f) {
+    std::vector<float> values(count);
+    for (auto& v : values) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        v = (static_cast<float>(seed >> 40) / static_cast<float>(1 << 24) - 0.5f) * scale;
+    }
+    return values;
+}
+
+castor::ModelConfig shape(uint32_t hidden, uint32_t vocab) {
+    castor::ModelConfig config;
+    config.hidden_dim = hidden;
+    config.vocab_size = vocab;
+    return config;
+}
+
+bool close(const std::vector<float>& a, const std::vector<float>& b, float tolerance) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); ++i) {
+        if (std::fabs(a[i] - b[i]) > tolerance * (1.0f + std::fabs(b[i]))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Every ISA the host runs, each with and without specialized instances, against the portable kernels
+void check_against_generic(const castor::ModelConfig& config) {
+    const castor::KernelSet reference = castor::Kernels::select(config, castor::Isa::Generic, false);
+    const size_t hidden = config.hidden_dim;
+    const size_t rows = 19; // Exercises row-tile remainders
+    const size_t batch = 5;
+    const std::vector<float> w = random_values(rows * hidden, 1);
+    const std::vector<float> x = random_values(batch * hidden, 2);
+    const std::vector<float> gamma = random_values(hidden, 3);
+    const std::vector<float> logits = random_values(config.vocab_size, 4, 30.0f);
+
+    std::vector<float> gemv_expected(rows), gemm_expected(batch * rows), norm_expected(hidden);
+    std::vector<float> softmax_expected = logits;
+    reference.gemv_hidden(w.data(), x.data(), gemv_expected.data(), rows, hidden);
+    reference.gemm_hidden(w.data(), x.data(), gemm_expected.data(), batch, rows, hidden);
+    reference.rms_norm(x.data(), gamma.data(), norm_expected.data(), hidden, 1e-5f);
+    reference.softmax(softmax_expected.data(), softmax_expected.size());
+
+    for (castor::Isa isa : {castor::Isa::Generic, castor::Isa::Avx2, castor::Isa::Avx512}) {
+        if (isa > castor::Kernels::detect_isa()) {
+            continue;
+        }
+        for (bool specialize : {false, true}) {
+            const castor::KernelSet set = castor::Kernels::select(config, isa, specialize);
+            REQUIRE(set.isa == isa);
+            std::vector<float> gemv(rows), gemm(batch * rows), norm(hidden);
+            std::vector<float> softmax = logits;
+            set.gemv_hidden(w.data(), x.data(), gemv.data(), rows, hidden);
+            set.gemm_hidden(w.data(), x.data(), gemm.data(), batch, rows, hidden);
+            set.rms_norm(x.data(), gamma.data(), norm.data(), hidden, 1e-5f);
+            set.softmax(softmax.data(), softmax.size());
+            REQUIRE(close(gemv, gemv_expected, 1e-4f));
+            REQUIRE(close(gemm, gemm_expected, 1e-4f));
+            REQUIRE(close(norm, norm_expected, 1e-5f));
+            REQUIRE(close(softmax, softmax_expected, 1e-5f));
+        }
+    }
+}
+
+} // namespace
+
+TEST_CASE("Kernels match the portable reference on deployed and odd shapes", "[kernels]") {
+    check_against_generic(shape(4096, 32000));
+    check_against_generic(shape(1000, 1003)); // No instance, not a multiple of any vector width
+}
+
+TEST_CASE("Kernels select specialized instances only for known shapes", "[kernels]") {
+    castor::ModelConfig llama = shape(4096, 32000);
+    REQUIRE(castor::Kernels::ffn_dim(llama) == 11008);
+    REQUIRE(castor::Kernels::ffn_dim(shape(5120, 32000)) == 13824);
+    llama.ffn_dim = 14336;
+    REQUIRE(castor::Kernels::ffn_dim(llama) == 14336);
+
+    const castor::KernelSet known = castor::Kernels::select(llama);
+    REQUIRE(known.isa == castor::Kernels::detect_isa());
+    const uint32_t all = castor::KernelSet::kGemvHidden | castor::KernelSet::kGemvFfn |
+                         castor::KernelSet::kGemmHidden | castor::KernelSet::kRmsNorm | castor::KernelSet::kSoftmax;
+    REQUIRE(known.specialized == all);
+    REQUIRE(known.describe(llama).find("gemv_ffn=14336") != std::string::npos);
+
+    const castor::ModelConfig odd = shape(1000, 1003);
+    const castor::KernelSet fallback = castor::Kernels::select(odd);
+    REQUIRE(fallback.specialized == 0);
+    REQUIRE(fallback.describe(odd).find("softmax=generic") != std::string::npos);
+    REQUIRE(castor::Kernels::select(llama, castor::Isa::Avx2, false).specialized == 0);
+}
+
+TEST_CASE("Engine binds kernels for its config at initialize", "[kernels]") {
+    castor::Engine engine;
+    castor::ModelConfig config = shape(4096, 32000);
+    config.num_layers = 2;
+    REQUIRE(engine.initialize("dummy.plan", config));
+    const castor::KernelSet& kernels = engine.kernels();
+    REQUIRE(kernels.isa == castor::Kernels::detect_isa());
+    REQUIRE((kernels.specialized & castor::KernelSet::kSoftmax) != 0);
+    REQUIRE(kernels.softmax != nullptr);
+}
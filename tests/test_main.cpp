@@ -4,8 +4,9 @@
 #include "../include/engine.hpp"
 #include "../include/tokenizer.hpp"
 #include "../include/model_config.hpp"
+#include "catch.hpp"
 
-int main() {
+int main(int argc, char* argv[]) {
     std::cout << "\n========== Unit Tests ==========\n";
     
     int passed = 0, failed = 0;
@@ -60,6 +61,9 @@ int main() {
     std::cout << "\n========== Test Summary ==========\n";
     std::cout << "Passed: " << passed << "\n";
     std::cout << "Failed: " << failed << "\n\n";
-    
-    return failed == 0 ? 0 : 1;
+
+    // TEST_CASEs from the tests/test_*.cpp files linked into castor-tests
+    const int catch_result = Catch2::Session().run(argc, argv);
+
+    return failed == 0 && catch_result == 0 ? 0 : 1;
 }
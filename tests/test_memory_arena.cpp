@@ -0,0 +1,243 @@
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <cstring>
+#include <memory>
+#include <set>
+#include <thread>
+#include <vector>
+#include "memory_arena.hpp"
+#include "scheduler.hpp"
+#include "test_fixtures.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+castor::ModelConfig small_config(size_t budget_bytes) {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.max_seq_length = 256;
+    config.eos_token_id = -1;
+    config.memory_budget_bytes = budget_bytes;
+    return config;
+}
+
+castor::Scheduler::Request make_request(uint32_t max_tokens) {
+    castor::Scheduler::Request request;
+    request.prompt_ids = {1, 2, 3};
+    request.params.temperature = 0.0f;
+    request.params.max_tokens = max_tokens;
+    return request;
+}
+
+} // namespace
+
+TEST_CASE("MemoryAccountant never charges past its budget", "[memory]") {
+    castor::MemoryAccountant memory(1000);
+    REQUIRE(memory.try_charge(castor::MemoryUse::Weights, 600));
+    REQUIRE(!memory.try_charge(castor::MemoryUse::KvCache, 500));
+    REQUIRE(memory.used(castor::MemoryUse::KvCache) == 0);
+    REQUIRE(memory.try_charge(castor::MemoryUse::KvCache, 400));
+    REQUIRE(memory.available() == 0);
+
+    // charge() books memory that is needed regardless
+    memory.charge(castor::MemoryUse::Tokenizer, 50);
+    REQUIRE(memory.total() == 1050);
+    REQUIRE(memory.available() == 0);
+    memory.release(castor::MemoryUse::KvCache, 400);
+    REQUIRE(memory.available() == 350);
+    memory.release(castor::MemoryUse::Tokenizer, 50);
+    REQUIRE(memory.available() == 400);
+
+    castor::MemoryAccountant unlimited;
+    REQUIRE(unlimited.try_charge(castor::MemoryUse::Weights, SIZE_MAX / 2));
+    REQUIRE(unlimited.available() == SIZE_MAX);
+}
+
+TEST_CASE("HugePageRegion maps 2 MB-aligned memory", "[memory]") {
+    castor::HugePageRegion region(3 << 20);
+    REQUIRE(region.valid());
+    REQUIRE(region.size() == (4u << 20));
+    REQUIRE(reinterpret_cast<uintptr_t>(region.data()) % castor::HugePageRegion::kHugePageBytes == 0);
+    REQUIRE(region.backing() != castor::HugePageRegion::Backing::None);
+    std::memset(region.data(), 0xAB, region.size());
+
+    castor::HugePageRegion moved = std::move(region);
+    REQUIRE(!region.valid());
+    REQUIRE(moved.valid());
+    REQUIRE(static_cast<unsigned char*>(moved.data())[moved.size() - 1] == 0xAB);
+
+    castor::HugePageRegion small_pages(1 << 20, false);
+    REQUIRE(small_pages.backing() == castor::HugePageRegion::Backing::Standard);
+}
+
+TEST_CASE("BlockArena hands out distinct blocks across threads", "[memory]") {
+    auto memory = std::make_shared<castor::MemoryAccountant>(64 * 4096);
+    castor::BlockArena arena(4096, 64, memory);
+    REQUIRE(arena.capacity() == 64);
+    REQUIRE(arena.free_blocks() == 64);
+
+    std::vector<std::vector<uint32_t>> held(4);
+    std::vector<std::thread> threads;
+    for (size_t t = 0; t < held.size(); ++t) {
+        threads.emplace_back([&arena, &mine = held[t]]() {
+            for (int round = 0; round < 1000; ++round) {
+                const uint32_t block = arena.allocate();
+                if (block != castor::BlockArena::kNoBlock) {
+                    arena.free(block);
+                }
+            }
+            for (int i = 0; i < 16; ++i) {
+                mine.push_back(arena.allocate());
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    std::set<uint32_t> distinct;
+    for (const auto& mine : held) {
+        distinct.insert(mine.begin(), mine.end());
+    }
+    REQUIRE(distinct.size() == 64);
+    REQUIRE(!distinct.count(castor::BlockArena::kNoBlock));
+    REQUIRE(arena.free_blocks() == 0);
+    REQUIRE(arena.allocate() == castor::BlockArena::kNoBlock);
+    REQUIRE(memory->used(castor::MemoryUse::KvCache) == 64 * 4096);
+
+    for (uint32_t block : distinct) {
+        arena.free(block);
+    }
+    REQUIRE(arena.free_blocks() == 64);
+    REQUIRE(memory->total() == 0);
+}
+
+TEST_CASE("BlockArena leases are all or nothing and respect the budget", "[memory]") {
+    auto memory = std::make_shared<castor::MemoryAccountant>(10 * 1024);
+    castor::BlockArena arena(1024, 10, memory);
+    {
+        castor::BlockArena::Lease lease = arena.lease(6);
+        REQUIRE(lease.size() == 6);
+        REQUIRE(arena.lease(5).empty());
+        REQUIRE(arena.free_blocks() == 4);
+        REQUIRE(arena.max_lease() == 10);
+
+        // Another use of the same budget leaves fewer blocks than the free list holds
+        REQUIRE(memory->try_charge(castor::MemoryUse::Tokenizer, 2048));
+        REQUIRE(arena.lease(3).empty());
+        REQUIRE(arena.free_blocks() == 4);
+        REQUIRE(arena.max_lease() == 8);
+        REQUIRE(arena.lease(2).size() == 2);
+    }
+    REQUIRE(arena.max_lease() == 8);
+    memory->release(castor::MemoryUse::Tokenizer, 2048);
+    REQUIRE(arena.free_blocks() == 10);
+    REQUIRE(memory->used(castor::MemoryUse::KvCache) == 0);
+}
+
+TEST_CASE("Engine reserves a KV arena from what its budget leaves", "[memory]") {
+    castor::ModelConfig config = small_config(1 << 20);
+    castor::Engine engine;
+    REQUIRE(engine.initialize("dummy.plan", config));
+    const castor::MemoryAccountant& memory = engine.memory();
+    REQUIRE(memory.used(castor::MemoryUse::Weights) == castor::MemoryAccountant::estimate_weight_bytes(config));
+    REQUIRE(memory.used(castor::MemoryUse::Scratch) == castor::MemoryAccountant::estimate_scratch_bytes(config));
+
+    castor::BlockArena* arena = engine.kv_arena();
+    REQUIRE(arena);
+    REQUIRE(arena->block_bytes() == 16 * castor::MemoryAccountant::estimate_kv_bytes_per_token(config));
+    REQUIRE(arena->capacity() > 0);
+    REQUIRE(memory.total() + arena->capacity() * arena->block_bytes() <= config.memory_budget_bytes);
+    REQUIRE(engine.kv_blocks_for(0) == 1);
+    REQUIRE(engine.kv_blocks_for(17) == 2);
+
+    castor::MemoryReport report = engine.memory_report();
+    REQUIRE(report.kv_blocks == arena->capacity());
+    REQUIRE(report.kv_blocks_free == arena->capacity());
+
+    // Weights alone over budget: the engine refuses to start
+    castor::Engine too_small;
+    REQUIRE(!too_small.initialize("dummy.plan", small_config(64 << 10)));
+
+    // No budget: accounted, but nothing reserved
+    castor::Engine unlimited;
+    REQUIRE(unlimited.initialize("dummy.plan", small_config(0)));
+    REQUIRE(!unlimited.kv_arena());
+    REQUIRE(unlimited.memory().total() > 0);
+}
+
+TEST_CASE("Scheduler admits requests only when their KV blocks fit", "[memory]") {
+    auto engine = std::make_shared<castor::Engine>();
+    REQUIRE(engine->initialize("dummy.plan", small_config(1 << 20)));
+    castor::BlockArena& arena = *engine->kv_arena();
+    const uint32_t half = static_cast<uint32_t>(arena.capacity() * 16 * 6 / 10); // Two cannot run together
+
+    castor::Scheduler scheduler(engine, castor::Scheduler::Options{});
+    std::atomic<bool> first_done{false};
+    std::atomic<bool> overlapped{false};
+    castor::Scheduler::Request first_request = make_request(half);
+    first_request.on_token = [&](const castor::Scheduler::TokenUpdate& update) { first_done = update.finished; };
+    castor::Scheduler::Request second_request = make_request(half);
+    second_request.on_token = [&](const castor::Scheduler::TokenUpdate&) { overlapped = overlapped || !first_done; };
+    auto first = scheduler.submit(std::move(first_request));
+    auto second = scheduler.submit(std::move(second_request));
+    auto oversized = scheduler.submit(make_request(static_cast<uint32_t>(arena.capacity() * 16)));
+
+    castor::Scheduler::Outcome a = first.get();
+    castor::Scheduler::Outcome b = second.get();
+    REQUIRE(a.status == castor::Scheduler::Status::Completed);
+    REQUIRE(b.status == castor::Scheduler::Status::Completed);
+    REQUIRE(a.result.output_ids.size() == half);
+    REQUIRE(b.result.output_ids == a.result.output_ids);
+    REQUIRE(!overlapped); // The second waited for the first's blocks
+    REQUIRE(oversized.get().status == castor::Scheduler::Status::Failed);
+    REQUIRE(arena.free_blocks() == arena.capacity());
+}
+
+TEST_CASE("Scheduler fails requests the budget can no longer lease and idles while blocked", "[memory]") {
+    using namespace std::chrono_literals;
+    auto engine = std::make_shared<castor::Engine>();
+    REQUIRE(engine->initialize("dummy.plan", small_config(1 << 20)));
+    castor::BlockArena& arena = *engine->kv_arena();
+
+    // Tokenizer tables charged after the arena was sized keep some of its blocks out of reach
+    castor::testing::TempDir dir("castor_kv_tokenizer_test");
+    {
+        std::ofstream file(dir.file("tokenizer.json"));
+        file << R"({"model": {"vocab": {"<unk>": "0")";
+        for (int i = 1; i < 400; ++i) {
+            file << ", \"token" << i << "\": \"" << i << '"';
+        }
+        file << "}}}";
+    }
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load(dir.file("tokenizer.json")));
+    engine->set_tokenizer(tokenizer);
+    REQUIRE(arena.max_lease() < arena.capacity());
+    const size_t reachable_tokens = arena.max_lease() * 16;
+    REQUIRE(engine->kv_fits(reachable_tokens));
+    REQUIRE(!engine->kv_fits(reachable_tokens + 1));
+    REQUIRE(!engine->kv_fits(reachable_tokens / 2 + 16, 2));
+
+    castor::Scheduler scheduler(engine, castor::Scheduler::Options{});
+    // Within capacity but past what can be leased: fails rather than waiting forever
+    auto unreachable = scheduler.submit(make_request(static_cast<uint32_t>(arena.capacity() * 16 - 3)));
+    REQUIRE(unreachable.wait_for(5s) == std::future_status::ready);
+    REQUIRE(unreachable.get().status == castor::Scheduler::Status::Failed);
+
+    // Blocks leased outside the scheduler: the request waits without burning a core
+    castor::BlockArena::Lease held;
+    REQUIRE(engine->lease_kv(reachable_tokens, 1, held));
+    auto waiting = scheduler.submit(make_request(8));
+    const std::clock_t cpu_start = std::clock();
+    std::this_thread::sleep_for(200ms);
+    const double cpu_seconds = static_cast<double>(std::clock() - cpu_start) / CLOCKS_PER_SEC;
+    REQUIRE(waiting.wait_for(0s) == std::future_status::timeout);
+    REQUIRE(cpu_seconds < 0.1);
+
+    held.release();
+    REQUIRE(waiting.wait_for(5s) == std::future_status::ready);
+    REQUIRE(waiting.get().status == castor::Scheduler::Status::Completed);
+    REQUIRE(arena.free_blocks() == arena.capacity());
+}
@@ -0,0 +1,41 @@
+#include "catch.hpp"
+#include <string>
+#include <thread>
+#include "metrics.hpp"
+
+TEST_CASE("Metrics bucket index is monotonic", "[metrics]") {
+    size_t previous = 0;
+    for (uint64_t v = 0; v < 100000; ++v) {
+        size_t index = castor::Metrics::bucket_index(v);
+        REQUIRE(index >= previous);
+        REQUIRE(v < castor::Metrics::bucket_upper_bound(index));
+        previous = index;
+    }
+}
+
+TEST_CASE("Metrics bucket bounds are log-linear", "[metrics]") {
+    REQUIRE(castor::Metrics::bucket_index(3) == 3);
+    REQUIRE(castor::Metrics::bucket_index(4) == 4);
+    REQUIRE(castor::Metrics::bucket_index(8) == 8);
+    REQUIRE(castor::Metrics::bucket_upper_bound(8) == 10);
+    REQUIRE(castor::Metrics::bucket_index(UINT64_MAX) < 256);
+}
+
+TEST_CASE("Metrics merges counters across threads", "[metrics]") {
+    uint64_t before = castor::Metrics::counter_value(castor::Counter::PromptTokens);
+
+    std::thread worker([] { castor::Metrics::add(castor::Counter::PromptTokens, 5); });
+    worker.join();
+    castor::Metrics::add(castor::Counter::PromptTokens, 2);
+
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::PromptTokens) == before + 7);
+}
+
+TEST_CASE("Metrics renders Prometheus histograms", "[metrics]") {
+    castor::Metrics::observe(castor::Histogram::TokenizeSeconds, 0.002);
+    std::string text = castor::Metrics::render_prometheus();
+
+    REQUIRE(text.find("# TYPE castor_tokenize_duration_seconds histogram") != std::string::npos);
+    REQUIRE(text.find("castor_tokenize_duration_seconds_bucket{le=\"+Inf\"}") != std::string::npos);
+    REQUIRE(text.find("castor_http_requests_total{endpoint=\"/infer\"}") != std::string::npos);
+}
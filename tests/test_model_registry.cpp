@@ -0,0 +1,168 @@
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "metrics.hpp"
+#include "model_registry.hpp"
+
+namespace {
+
+const char* kTokenizerA = "registry_tokenizer_a.json";
+const char* kTokenizerB = "registry_tokenizer_b.json";
+
+void write_tokenizers() {
+    std::ofstream a(kTokenizerA);
+    a << R"({"model": {"vocab": {"<unk>": "0", "hello": "1"}}})";
+    std::ofstream b(kTokenizerB);
+    b << R"({"model": {"vocab": {"<unk>": "0", "world": "1"}}})";
+}
+
+castor::ModelSpec make_spec(const std::string& name, const char* tokenizer, size_t mb) {
+    castor::ModelSpec spec;
+    spec.name = name;
+    spec.engine_path = name + ".plan";
+    spec.tokenizer_path = tokenizer;
+    spec.config.vocab_size = 1000;
+    spec.memory_bytes = mb << 20;
+    return spec;
+}
+
+castor::ModelRegistry::Options no_scheduler(size_t budget_mb) {
+    castor::ModelRegistry::Options options;
+    options.memory_budget_bytes = budget_mb << 20;
+    options.scheduler_enabled = false;
+    return options;
+}
+
+} // namespace
+
+TEST_CASE("ModelRegistry loads lazily and routes by name", "[model_registry]") {
+    write_tokenizers();
+    castor::ModelRegistry registry(no_scheduler(0));
+    REQUIRE(registry.add(make_spec("chat", kTokenizerA, 10)));
+    REQUIRE(registry.add(make_spec("code", kTokenizerA, 10)));
+    REQUIRE(!registry.add(make_spec("chat", kTokenizerA, 10)));
+    REQUIRE(registry.default_model() == "chat");
+    REQUIRE(registry.resident_bytes() == 0);
+
+    auto code = registry.acquire("code");
+    REQUIRE(code);
+    REQUIRE(code->engine->get_config().model_name == "code");
+    REQUIRE(code->engine->is_initialized());
+    REQUIRE(registry.resident_bytes() == (10u << 20));
+
+    auto chat = registry.acquire("");
+    REQUIRE(chat);
+    REQUIRE(chat->spec.name == "chat");
+    REQUIRE(registry.acquire("chat") == chat);
+    REQUIRE(!registry.acquire("missing"));
+
+    // Same tokenizer file, one shared instance
+    REQUIRE(chat->tokenizer == code->tokenizer);
+}
+
+TEST_CASE("ModelRegistry evicts idle models LRU within the budget", "[model_registry]") {
+    write_tokenizers();
+    castor::ModelRegistry registry(no_scheduler(25));
+    REQUIRE(registry.add(make_spec("a", kTokenizerA, 10)));
+    REQUIRE(registry.add(make_spec("b", kTokenizerB, 10)));
+    REQUIRE(registry.add(make_spec("c", kTokenizerA, 10)));
+    const uint64_t evictions = castor::Metrics::counter_value(castor::Counter::ModelEvictions);
+
+    REQUIRE(registry.preload({"a", "b"}));
+    REQUIRE(registry.acquire("a")); // b is now least recently used
+    REQUIRE(registry.acquire("c"));
+
+    auto loaded = [&registry](const std::string& name) {
+        for (const auto& status : registry.status()) {
+            if (status.name == name) return status.loaded;
+        }
+        return false;
+    };
+    REQUIRE(loaded("a"));
+    REQUIRE(!loaded("b"));
+    REQUIRE(loaded("c"));
+    REQUIRE(registry.resident_bytes() == (20u << 20));
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::ModelEvictions) == evictions + 1);
+
+    // Models held by in-flight requests are never evicted
+    auto pinned_a = registry.acquire("a");
+    auto pinned_c = registry.acquire("c");
+    auto b = registry.acquire("b");
+    REQUIRE(b);
+    REQUIRE(loaded("a"));
+    REQUIRE(loaded("c"));
+    REQUIRE(registry.resident_bytes() == (30u << 20));
+}
+
+TEST_CASE("ModelRegistry evicts before loading the new model", "[model_registry]") {
+    write_tokenizers();
+    castor::ModelRegistry registry(no_scheduler(15));
+    REQUIRE(registry.add(make_spec("a", kTokenizerA, 10)));
+    REQUIRE(registry.add(make_spec("b", kTokenizerA, 10)));
+    std::weak_ptr<castor::Tokenizer> tokenizer_a = registry.acquire("a")->tokenizer;
+
+    // Loads share a tokenizer only with models still resident. Had b loaded
+    // before a was evicted, it would have picked up a's instance and kept it alive.
+    auto b = registry.acquire("b");
+    REQUIRE(b);
+    REQUIRE(tokenizer_a.expired());
+    REQUIRE(registry.resident_bytes() == (10u << 20));
+    REQUIRE(registry.status().size() == 2);
+}
+
+TEST_CASE("ModelRegistry rejects unknown and unnamed models", "[model_registry]") {
+    castor::ModelRegistry registry(no_scheduler(0));
+    REQUIRE(!registry.add(make_spec("", kTokenizerA, 1)));
+    REQUIRE(!registry.preload({"nope"}));
+    REQUIRE(!registry.acquire(""));
+    REQUIRE(registry.spec("") == nullptr);
+    REQUIRE(registry.resident_bytes() == 0);
+}
+
+TEST_CASE("ModelRegistry attaches and pins draft models", "[model_registry]") {
+    write_tokenizers();
+    castor::ModelRegistry registry(no_scheduler(0));
+    auto target = make_spec("target", kTokenizerA, 10);
+    target.draft = "small";
+    target.speculative.k = 3;
+    REQUIRE(registry.add(target));
+    REQUIRE(registry.add(make_spec("small", kTokenizerA, 1)));
+    auto self = make_spec("loop", kTokenizerA, 1);
+    self.draft = "loop";
+    REQUIRE(!registry.add(self));
+
+    auto model = registry.acquire("target");
+    REQUIRE(model);
+    REQUIRE(model->draft);
+    REQUIRE(model->engine->get_draft() == model->draft->engine);
+    REQUIRE(model->engine->speculative_options().k == 3);
+    REQUIRE(registry.acquire("small") == model->draft);
+
+    auto cyclic = make_spec("x", kTokenizerA, 1);
+    cyclic.draft = "y";
+    auto back = make_spec("y", kTokenizerA, 1);
+    back.draft = "x";
+    REQUIRE(registry.add(cyclic));
+    REQUIRE(registry.add(back));
+    REQUIRE(!registry.acquire("x"));
+}
+
+TEST_CASE("ModelRegistry gives each model its own scheduler", "[model_registry]") {
+    write_tokenizers();
+    castor::ModelRegistry::Options options;
+    castor::ModelRegistry registry(options);
+    REQUIRE(registry.add(make_spec("chat", kTokenizerA, 1)));
+    auto model = registry.acquire("chat");
+    REQUIRE(model->scheduler);
+
+    castor::Scheduler::Request request;
+    request.prompt_ids = {1, 2, 3};
+    request.params.temperature = 0.0f;
+    request.params.max_tokens = 3;
+    REQUIRE(model->scheduler->submit(std::move(request)).get().status == castor::Scheduler::Status::Completed);
+    REQUIRE(castor::ModelRegistry::estimate_bytes(model->engine->get_config()) > 0);
+    std::remove(kTokenizerA);
+    std::remove(kTokenizerB);
+}
@@ -0,0 +1,138 @@
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "metrics.hpp"
+#include "resource_accounting.hpp"
+#include "server.hpp"
+#include "test_fixtures.hpp"
+#include "trace.hpp"
+
+namespace {
+
+// Enables accounting for one test and restores the default afterwards
+struct AccountingEnabled {
+    AccountingEnabled() { castor::ResourceAccounting::set_enabled(true); }
+    ~AccountingEnabled() { castor::ResourceAccounting::set_enabled(false); }
+};
+
+// Keeps the compiler from eliding new/delete pairs
+int* volatile g_escape = nullptr;
+
+std::unique_ptr<int> allocate_int(int value) {
+    auto p = std::make_unique<int>(value);
+    g_escape = p.get();
+    return p;
+}
+
+void burn_cpu() {
+    volatile uint64_t sink = 0;
+    for (uint64_t i = 0; i < 2000000; ++i) {
+        sink = sink + i * i;
+    }
+}
+
+} // namespace
+
+TEST_CASE("Allocation hooks count operator new on the calling thread", "[resources]") {
+    REQUIRE(castor::ResourceAccounting::counts_allocations());
+    const castor::ResourceUsage before = castor::ResourceAccounting::thread_usage();
+    {
+        std::vector<int> values(100);
+        g_escape = values.data();
+        auto value = allocate_int(1);
+    }
+    const castor::ResourceUsage used = castor::ResourceAccounting::thread_usage() - before;
+    REQUIRE(used.allocations == 2);
+    REQUIRE(used.allocated_bytes == 101 * sizeof(int));
+}
+
+TEST_CASE("Nested request scopes charge each request exclusively", "[resources]") {
+    AccountingEnabled enabled;
+    castor::PhaseTimings outer;
+    castor::PhaseTimings inner;
+    {
+        castor::RequestTraceScope outer_scope(outer);
+        auto first = allocate_int(1);
+        {
+            castor::RequestTraceScope inner_scope(inner);
+            auto second = allocate_int(2);
+            auto third = allocate_int(3);
+            burn_cpu();
+        }
+        auto fourth = allocate_int(4);
+    }
+    REQUIRE(outer.resources_measured);
+    REQUIRE(inner.resources_measured);
+    REQUIRE(outer.resources.allocations == 2);
+    REQUIRE(inner.resources.allocations == 2);
+    REQUIRE(inner.resources.cpu_ns > 0);
+    REQUIRE(inner.resources.cpu_ns > outer.resources.cpu_ns);
+
+    // Disabled: nothing is measured and the header stays empty
+    castor::ResourceAccounting::set_enabled(false);
+    castor::PhaseTimings off;
+    {
+        castor::RequestTraceScope scope(off);
+        auto value = allocate_int(5);
+    }
+    REQUIRE(!off.resources_measured);
+    REQUIRE(off.to_resource_header().empty());
+}
+
+TEST_CASE("Spans attribute resources to phases", "[resources]") {
+    AccountingEnabled enabled;
+    castor::PhaseTimings timings;
+    {
+        castor::RequestTraceScope scope(timings);
+        castor::TraceSpan span("tokenize");
+        std::string text(1000, 'x');
+        g_escape = reinterpret_cast<int*>(text.data());
+        burn_cpu();
+    }
+    REQUIRE(timings.count == 1);
+    REQUIRE(timings.phases[0].usage.allocations == 1);
+    REQUIRE(timings.phases[0].usage.allocated_bytes >= 1000);
+    REQUIRE(timings.phases[0].usage.cpu_ns > 0);
+
+    const std::string header = timings.to_resource_header();
+    REQUIRE(header.find("total;cpu=") == 0);
+    REQUIRE(header.find(";allocs=1;bytes=") != std::string::npos);
+    REQUIRE(header.find(", tokenize;cpu=") != std::string::npos);
+}
+
+// Guards the steady-state /infer path against allocation regressions: after
+// warm-up, a cache-less greedy generation should only allocate for the JSON
+// request/response documents, the token vectors and the scheduler handoff.
+TEST_CASE("Steady-state /infer stays under its allocation budget", "[resources]") {
+    constexpr uint64_t kMaxAllocations = 160; // ~95 measured
+
+    std::ofstream vocab("resources_tokenizer.json");
+    vocab << R"({"model": {"vocab": {"<unk>": "0", "the": "1", "quick": "2", "brown": "3", "fox": "4"}}})";
+    vocab.close();
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load("resources_tokenizer.json"));
+    std::remove("resources_tokenizer.json");
+    auto engine = castor::testing::make_engine();
+
+    castor::Server server;
+    REQUIRE(server.initialize(engine, tokenizer));
+    const std::string body = R"({"prompt": "the quick brown fox", "max_tokens": 8, "temperature": 0})";
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(server.handle_infer(body).status == 200);
+    }
+
+    AccountingEnabled enabled;
+    const castor::InferResponse response = server.handle_infer(body);
+    REQUIRE(response.status == 200);
+    REQUIRE(response.resources.allocations > 0);
+    REQUIRE(response.resources.allocations <= kMaxAllocations);
+    REQUIRE(response.resources.cpu_ns > 0);
+    REQUIRE(response.resource_usage.find("total;cpu=") == 0);
+
+    const std::string metrics = castor::Metrics::render_prometheus();
+    REQUIRE(metrics.find("castor_http_allocations_total{endpoint=\"/infer\"}") != std::string::npos);
+    REQUIRE(metrics.find("castor_http_cpu_seconds_total{endpoint=\"/infer\"}") != std::string::npos);
+}
@@ -0,0 +1,115 @@
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "hash.hpp"
+#include "response_cache.hpp"
+#include "stop_sequences.hpp"
+
+namespace {
+
+castor::ResponseCache::Value make_result(int32_t token) {
+    auto result = std::make_shared<castor::GenerationResult>();
+    result->output_ids = {token};
+    result->finish_reason = "length";
+    return result;
+}
+
+} // namespace
+
+TEST_CASE("XXH64 matches reference vectors", "[response_cache]") {
+    REQUIRE(castor::XXH64::hash("", 0) == 0xEF46DB3751D8E999ULL);
+    REQUIRE(castor::XXH64::hash("abc") == 0x44BC2CF5AD770999ULL);
+}
+
+TEST_CASE("ResponseCache key ignores seed for greedy requests", "[response_cache]") {
+    castor::SamplingParams a;
+    a.temperature = 0.0f;
+    a.max_tokens = 8;
+    a.seed = 1;
+    castor::SamplingParams b = a;
+    b.seed = 2;
+
+    std::vector<int32_t> tokens = {1, 2, 3};
+    REQUIRE(castor::ResponseCache::make_key("m", tokens, a) == castor::ResponseCache::make_key("m", tokens, b));
+    REQUIRE(castor::ResponseCache::make_key("m", tokens, a) != castor::ResponseCache::make_key("n", tokens, a));
+}
+
+TEST_CASE("ResponseCache key covers stop sequences", "[response_cache]") {
+    castor::SamplingParams a;
+    a.temperature = 0.0f;
+    a.max_tokens = 8;
+    castor::SamplingParams b = a;
+    std::string error;
+    b.stop = castor::StopSequences::compile({"\n"}, {}, nullptr, error);
+    castor::SamplingParams c = a;
+    c.stop = castor::StopSequences::compile({}, {10}, nullptr, error);
+
+    std::vector<int32_t> tokens = {1, 2, 3};
+    const std::string key = castor::ResponseCache::make_key("m", tokens, a);
+    REQUIRE(key != castor::ResponseCache::make_key("m", tokens, b));
+    REQUIRE(key != castor::ResponseCache::make_key("m", tokens, c));
+    REQUIRE(castor::ResponseCache::make_key("m", tokens, b) != castor::ResponseCache::make_key("m", tokens, c));
+}
+
+TEST_CASE("ResponseCache hit after insert", "[response_cache]") {
+    castor::ResponseCache cache;
+    cache.insert("k", make_result(7));
+
+    auto value = cache.lookup("k");
+    REQUIRE(value != nullptr);
+    REQUIRE(value->output_ids[0] == 7);
+    REQUIRE(cache.lookup("missing") == nullptr);
+}
+
+TEST_CASE("ResponseCache evicts least recently used entry", "[response_cache]") {
+    castor::ResponseCache::Options options;
+    options.num_shards = 1;
+    options.max_bytes = castor::ResponseCache::entry_bytes("a", *make_result(0)) * 2;
+    castor::ResponseCache cache(options);
+
+    cache.insert("a", make_result(1));
+    cache.insert("b", make_result(2));
+    cache.lookup("a");
+    cache.insert("c", make_result(3));
+
+    REQUIRE(cache.lookup("a") != nullptr);
+    REQUIRE(cache.lookup("b") == nullptr);
+    REQUIRE(cache.stats().evictions == 1);
+}
+
+TEST_CASE("ResponseCache expires entries after TTL", "[response_cache]") {
+    castor::ResponseCache::Options options;
+    options.ttl = std::chrono::milliseconds(1);
+    castor::ResponseCache cache(options);
+
+    cache.insert("k", make_result(1));
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    REQUIRE(cache.lookup("k") == nullptr);
+}
+
+TEST_CASE("ResponseCache coalesces concurrent misses", "[response_cache]") {
+    castor::ResponseCache cache;
+    std::atomic<int> computations{0};
+
+    auto compute = [&computations]() {
+        ++computations;
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        return make_result(9);
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 8; ++i) {
+        threads.emplace_back([&] { REQUIRE(cache.get_or_compute("same", compute)->output_ids[0] == 9); });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE(computations == 1);
+    auto stats = cache.stats();
+    REQUIRE(stats.misses == 1);
+    REQUIRE(stats.hits + stats.coalesced == 7);
+}
@@ -0,0 +1,148 @@
+#include "catch.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "runtime_config.hpp"
+
+namespace {
+
+bool parse(std::vector<std::string> args, castor::RuntimeConfig& config) {
+    args.insert(args.begin(), "castor-rt");
+    std::vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(arg.data());
+    }
+    return castor::RuntimeConfig::parse_args(static_cast<int>(argv.size()), argv.data(), config);
+}
+
+} // namespace
+
+TEST_CASE("RuntimeConfig applies command-line threading flags", "[runtime_config]") {
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--port", "9000", "--http-threads", "2", "--http-cpus", "0-1", "--inference-threads", "6",
+                   "--inference-cpus", "2-7", "--no-numa-local"},
+                  config));
+    REQUIRE(config.server.port == 9000);
+    REQUIRE(config.server.http_threads == 2);
+    REQUIRE(config.server.http_cpus == std::vector<int>({0, 1}));
+    REQUIRE(config.inference.threads == 6);
+    REQUIRE(config.inference.cpus.size() == 6);
+    REQUIRE(!config.inference.numa_local);
+}
+
+TEST_CASE("RuntimeConfig flags override the config file", "[runtime_config]") {
+    const std::string path = "test_runtime_config.json";
+    {
+        std::ofstream file(path);
+        file << R"({"server": {"port": 7000, "unix_socket": "/tmp/c.sock"},
+                    "threads": {"http": 3, "inference": 4, "inference_cpus": "4-7"},
+                    "cache": {"enabled": false, "max_mb": 8}})";
+    }
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--config", path, "--inference-threads", "2"}, config));
+    REQUIRE(config.server.port == 7000);
+    REQUIRE(config.server.unix_socket_path == "/tmp/c.sock");
+    REQUIRE(config.server.http_threads == 3);
+    REQUIRE(config.inference.threads == 2);
+    REQUIRE(config.inference.cpus == std::vector<int>({4, 5, 6, 7}));
+    REQUIRE(!config.cache_enabled);
+    REQUIRE(config.cache.max_bytes == (8u << 20));
+    std::remove(path.c_str());
+}
+
+TEST_CASE("RuntimeConfig applies scheduler flags", "[runtime_config]") {
+    castor::RuntimeConfig config;
+    REQUIRE(config.scheduler_enabled);
+    REQUIRE(parse({"--max-batch", "4", "--prefill-chunk", "256", "--target-iteration-ms", "20"}, config));
+    REQUIRE(config.scheduler.max_batch == 4);
+    REQUIRE(config.scheduler.prefill_chunk_tokens == 256);
+    REQUIRE(config.scheduler.target_iteration_ms == 20.0);
+    REQUIRE(!parse({"--target-iteration-ms", "fast"}, config));
+    REQUIRE(parse({"--no-scheduler"}, config));
+    REQUIRE(!config.scheduler_enabled);
+}
+
+TEST_CASE("RuntimeConfig reads the model list", "[runtime_config]") {
+    const std::string path = "test_runtime_models.json";
+    {
+        std::ofstream file(path);
+        file << R"({"models": {"budget_mb": 100, "preload": ["chat"],
+                               "list": [{"name": "chat", "vocab_size": 1000, "memory_mb": 40},
+                                        {"name": "code", "engine": "m/code.plan", "tokenizer": "m/code.json"}]}})";
+    }
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--config", path, "--preload", "chat,code"}, config));
+    REQUIRE(config.models.size() == 2);
+    REQUIRE(config.models[0].engine_path == "models/chat.plan");
+    REQUIRE(config.models[0].config.vocab_size == 1000);
+    REQUIRE(config.models[0].memory_bytes == (40u << 20));
+    REQUIRE(config.models[1].tokenizer_path == "m/code.json");
+    REQUIRE(config.model_budget_bytes == (100u << 20));
+    REQUIRE(config.preload_models == std::vector<std::string>({"chat", "code"}));
+    std::remove(path.c_str());
+}
+
+TEST_CASE("RuntimeConfig reads session settings", "[runtime_config]") {
+    const std::string path = "test_runtime_sessions.json";
+    {
+        std::ofstream file(path);
+        file << R"({"sessions": {"ram_mb": 32, "idle_seconds": 60, "compress": true}})";
+    }
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--config", path}, config));
+    REQUIRE(!config.sessions_enabled);
+    REQUIRE(config.sessions.max_resident_bytes == (32u << 20));
+    REQUIRE(config.sessions.idle_spill == std::chrono::seconds(60));
+    REQUIRE(config.sessions.compress);
+    REQUIRE(parse({"--config", path, "--session-dir", "/tmp/castor-sessions"}, config));
+    REQUIRE(config.sessions_enabled);
+    REQUIRE(config.sessions.directory == "/tmp/castor-sessions");
+    std::remove(path.c_str());
+}
+
+TEST_CASE("RuntimeConfig reads replica settings", "[runtime_config]") {
+    const std::string path = "test_runtime_replicas.json";
+    {
+        std::ofstream file(path);
+        file << R"({"replicas": {"threads": 6, "affinity_tokens": 32, "affinity_slack": 4}})";
+    }
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--config", path}, config));
+    REQUIRE(!config.replicas_enabled);
+    REQUIRE(config.replicas.threads_per_replica == 6);
+    REQUIRE(config.replicas.affinity_tokens == 32);
+    REQUIRE(config.replicas.affinity_slack == 4);
+    REQUIRE(parse({"--config", path, "--replicas", "0"}, config));
+    REQUIRE(config.replicas_enabled);
+    REQUIRE(config.replicas.replicas == 0);
+    REQUIRE(!parse({"--replicas", "two"}, config));
+    std::remove(path.c_str());
+}
+
+TEST_CASE("RuntimeConfig reads autotune settings", "[runtime_config]") {
+    const std::string path = "test_runtime_autotune.json";
+    {
+        std::ofstream file(path);
+        file << R"({"autotune": {"enabled": true, "file": "/tmp/tuned.json", "itl_slo_ms": 40, "ttft_slo_ms": 500}})";
+    }
+    castor::RuntimeConfig config;
+    REQUIRE(parse({"--config", path}, config));
+    REQUIRE(config.autotune);
+    REQUIRE(!config.retune);
+    REQUIRE(config.autotuner.cache_path == "/tmp/tuned.json");
+    REQUIRE(config.autotuner.itl_slo_ms == 40.0);
+    REQUIRE(config.autotuner.ttft_slo_ms == 500.0);
+    REQUIRE(parse({"--retune", "--slo-ms", "25"}, config));
+    REQUIRE(config.retune);
+    REQUIRE(config.autotuner.itl_slo_ms == 25.0);
+    std::remove(path.c_str());
+}
+
+TEST_CASE("RuntimeConfig rejects bad input", "[runtime_config]") {
+    castor::RuntimeConfig config;
+    REQUIRE(!parse({"--http-cpus", "4-2"}, config));
+    REQUIRE(!parse({"--inference-threads", "-1"}, config));
+    REQUIRE(!parse({"--bogus"}, config));
+    REQUIRE(!parse({"--config", "/nonexistent/castor.json"}, config));
+}
@@ -0,0 +1,156 @@
+#include "catch.hpp"
+#include <chrono>
+#include <memory>
+#include "metrics.hpp"
+#include "scheduler.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+using castor::testing::make_engine;
+
+castor::Scheduler::Request make_request(std::vector<int32_t> prompt, uint32_t max_tokens,
+                                        castor::Priority priority = castor::Priority::Default) {
+    castor::Scheduler::Request request;
+    request.prompt_ids = std::move(prompt);
+    request.params.temperature = 0.0f;
+    request.params.max_tokens = max_tokens;
+    request.priority = priority;
+    return request;
+}
+
+} // namespace
+
+TEST_CASE("Scheduler parses priority names", "[scheduler]") {
+    castor::Priority priority = castor::Priority::Default;
+    REQUIRE(castor::Scheduler::parse_priority("interactive", priority));
+    REQUIRE(priority == castor::Priority::Interactive);
+    REQUIRE(castor::Scheduler::parse_priority("low", priority));
+    REQUIRE(priority == castor::Priority::Batch);
+    REQUIRE(castor::Scheduler::parse_priority("1", priority));
+    REQUIRE(priority == castor::Priority::Default);
+    REQUIRE(!castor::Scheduler::parse_priority("urgent", priority));
+    REQUIRE(std::string(castor::Scheduler::priority_name(castor::Priority::Batch)) == "batch");
+}
+
+TEST_CASE("Scheduler results match direct generation", "[scheduler]") {
+    auto engine = make_engine();
+    castor::WorkerPool::Options pool_options;
+    pool_options.threads = 2;
+    castor::Scheduler scheduler(engine, castor::Scheduler::Options{}, std::make_shared<castor::WorkerPool>(pool_options));
+
+    auto a = scheduler.submit(make_request({1, 2, 3}, 8));
+    auto b = scheduler.submit(make_request({4, 5}, 5, castor::Priority::Batch));
+
+    castor::Scheduler::Outcome first = a.get();
+    castor::Scheduler::Outcome second = b.get();
+    REQUIRE(first.status == castor::Scheduler::Status::Completed);
+    REQUIRE(second.status == castor::Scheduler::Status::Completed);
+
+    castor::GenerationResult direct;
+    REQUIRE(engine->generate({1, 2, 3}, make_request({}, 8).params, direct));
+    REQUIRE(first.result.output_ids == direct.output_ids);
+    REQUIRE(second.result.output_ids.size() <= 5);
+}
+
+TEST_CASE("Scheduler drops requests whose deadline has passed", "[scheduler]") {
+    auto engine = make_engine();
+    castor::Scheduler scheduler(engine, castor::Scheduler::Options{});
+    const uint64_t drops = castor::Metrics::counter_value(castor::Counter::SchedulerDeadlineDrops);
+
+    auto request = make_request({1, 2, 3}, 8);
+    request.deadline = castor::Scheduler::Clock::now() - std::chrono::milliseconds(1);
+    castor::Scheduler::Outcome outcome = scheduler.submit(std::move(request)).get();
+
+    REQUIRE(outcome.status == castor::Scheduler::Status::DeadlineExceeded);
+    REQUIRE(outcome.result.output_ids.empty());
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::SchedulerDeadlineDrops) == drops + 1);
+}
+
+TEST_CASE("Scheduler runs interactive work ahead of a long batch generation", "[scheduler]") {
+    auto engine = make_engine();
+    castor::GenerationResult reference;
+    REQUIRE(engine->generate({7, 8, 9}, make_request({}, 400).params, reference));
+    REQUIRE(reference.finish_reason == "length");
+
+    castor::Scheduler::Options options;
+    options.max_batch = 1;
+    castor::Scheduler scheduler(engine, options);
+
+    auto batch = scheduler.submit(make_request({7, 8, 9}, 400, castor::Priority::Batch));
+    auto interactive = scheduler.submit(make_request({1, 2}, 2, castor::Priority::Interactive));
+
+    castor::Scheduler::Outcome fast = interactive.get();
+    REQUIRE(fast.status == castor::Scheduler::Status::Completed);
+    REQUIRE(batch.wait_for(std::chrono::seconds(0)) == std::future_status::timeout);
+
+    // Pausing keeps the sequence state, so the result is unchanged
+    castor::Scheduler::Outcome slow = batch.get();
+    REQUIRE(slow.status == castor::Scheduler::Status::Completed);
+    REQUIRE(slow.result.output_ids == reference.output_ids);
+}
+
+TEST_CASE("Scheduler interleaves chunked prefill with decode", "[scheduler]") {
+    auto engine = make_engine();
+    std::vector<int32_t> long_prompt(4096);
+    for (size_t i = 0; i < long_prompt.size(); ++i) {
+        long_prompt[i] = static_cast<int32_t>(i % 997);
+    }
+    castor::GenerationResult reference;
+    REQUIRE(engine->generate(long_prompt, make_request({}, 4).params, reference));
+
+    castor::Scheduler::Options options;
+    options.max_batch = 2;
+    options.prefill_chunk_tokens = 64;
+    castor::Scheduler scheduler(engine, options);
+    const uint64_t iterations = castor::Metrics::histogram_count(castor::Histogram::SchedulerIterationSeconds);
+
+    auto decoding = scheduler.submit(make_request({1, 2, 3}, 50));
+    auto prefilling = scheduler.submit(make_request(long_prompt, 4));
+
+    castor::Scheduler::Outcome long_outcome = prefilling.get();
+    REQUIRE(long_outcome.status == castor::Scheduler::Status::Completed);
+    REQUIRE(long_outcome.result.output_ids == reference.output_ids);
+
+    // 64 prefill chunks take longer than 50 decode steps, so the short stream
+    // finished first: it was never stalled behind the long prompt
+    REQUIRE(decoding.wait_for(std::chrono::seconds(0)) == std::future_status::ready);
+    REQUIRE(decoding.get().status == castor::Scheduler::Status::Completed);
+    REQUIRE(castor::Metrics::histogram_count(castor::Histogram::SchedulerIterationSeconds) >= iterations + 50);
+}
+
+TEST_CASE("Scheduler exports per-class latency", "[scheduler]") {
+    auto engine = make_engine();
+    {
+        castor::Scheduler scheduler(engine, castor::Scheduler::Options{});
+        scheduler.submit(make_request({1}, 1, castor::Priority::Interactive)).get();
+    }
+    const std::string text = castor::Metrics::render_prometheus();
+    REQUIRE(text.find("castor_scheduler_request_duration_seconds_count{class=\"interactive\"}") != std::string::npos);
+    REQUIRE(text.find("castor_scheduler_request_duration_seconds_bucket{class=\"batch\",le=") != std::string::npos);
+}
+
+TEST_CASE("Scheduler deadline estimates expect EOS well before max_tokens", "[scheduler]") {
+    // Make the first greedy token after {1, 2, 3} the EOS id: every such request stops after one token
+    castor::ModelConfig config = castor::testing::small_config();
+    config.eos_token_id = -1;
+    castor::GenerationResult probe;
+    REQUIRE(make_engine(config)->generate({1, 2, 3}, make_request({}, 1).params, probe));
+    config.eos_token_id = probe.output_ids.front();
+    castor::Scheduler scheduler(make_engine(config), castor::Scheduler::Options{});
+
+    // Earlier requests show the scheduler both the step cost and how short outputs really are
+    const uint32_t generous = 1u << 20;
+    for (int i = 0; i < 3; ++i) {
+        castor::Scheduler::Outcome warm = scheduler.submit(make_request({1, 2, 3}, generous)).get();
+        REQUIRE(warm.status == castor::Scheduler::Status::Completed);
+        REQUIRE(warm.result.output_ids.size() == 1);
+    }
+
+    // max_tokens decode steps would take far longer than the deadline, one step does not
+    auto request = make_request({1, 2, 3}, generous);
+    request.deadline = castor::Scheduler::Clock::now() + std::chrono::seconds(1);
+    castor::Scheduler::Outcome outcome = scheduler.submit(std::move(request)).get();
+    REQUIRE(outcome.status == castor::Scheduler::Status::Completed);
+    REQUIRE(outcome.result.finish_reason == "stop");
+}
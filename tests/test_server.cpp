@@ -0,0 +1,97 @@
+#include "catch.hpp"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "engine.hpp"
+#include "server.hpp"
+#include "test_fixtures.hpp"
+#include "tokenizer.hpp"
+
+namespace {
+
+// A Unix socket bound at @p path; listening unless @p listen is false
+int bind_unix_socket(const std::string& path, bool listen) {
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    REQUIRE(::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+    if (listen) {
+        REQUIRE(::listen(fd, 1) == 0);
+    }
+    return fd;
+}
+
+} // namespace
+
+TEST_CASE("Unix socket path is only claimed from stale sockets", "[server]") {
+    const std::filesystem::path dir = std::filesystem::temp_directory_path() / "castor_server_socket_test";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir);
+    const std::string path = (dir / "castor.sock").string();
+
+    REQUIRE(castor::Server::claim_unix_socket(path)); // Nothing there
+
+    // A mistyped path naming a regular file is not deleted
+    std::ofstream(path) << "keep me";
+    REQUIRE(!castor::Server::claim_unix_socket(path));
+    REQUIRE(std::filesystem::is_regular_file(path));
+    std::filesystem::remove(path);
+
+    // A live listener keeps its socket
+    const int live = bind_unix_socket(path, true);
+    REQUIRE(!castor::Server::claim_unix_socket(path));
+    REQUIRE(std::filesystem::is_socket(path));
+    ::close(live);
+
+    // Once nothing accepts on it, the leftover file is stale and removed
+    const int stale = bind_unix_socket((dir / "stale.sock").string(), false);
+    ::close(stale);
+    REQUIRE(castor::Server::claim_unix_socket((dir / "stale.sock").string()));
+    REQUIRE(!std::filesystem::exists(dir / "stale.sock"));
+    REQUIRE(castor::Server::claim_unix_socket(path));
+    REQUIRE(!std::filesystem::exists(path));
+
+    std::filesystem::remove_all(dir);
+}
+
+TEST_CASE("Requests that bypass the scheduler lease KV blocks", "[server]") {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.max_seq_length = 256;
+    config.eos_token_id = -1;
+    config.memory_budget_bytes = 1 << 20;
+    auto engine = castor::testing::make_engine(config);
+    castor::testing::TempDir dir("castor_server_kv_test");
+    std::ofstream(dir.file("tokenizer.json")) << R"({"model": {"vocab": {"<unk>": "0", "hello": "1"}}})";
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load(dir.file("tokenizer.json")));
+    castor::Server server;
+    REQUIRE(server.initialize(engine, tokenizer));
+    castor::BlockArena& arena = *engine->kv_arena();
+
+    // One candidate of this length fits; two never can
+    const std::string too_wide = R"({"prompt": "hello", "n": 2, "max_tokens": )" +
+                                 std::to_string(arena.max_lease() * 16 - 1) + "}";
+    REQUIRE(server.handle_infer(too_wide).status == 400);
+
+    const std::string prefill = R"({"prompt": "hello", "max_tokens": 0})";
+    const std::string candidates = R"({"prompt": "hello", "n": 2, "max_tokens": 4, "temperature": 0})";
+    const std::string embeddings = R"({"input": ["hello", "hello hello"]})";
+    {
+        castor::BlockArena::Lease held = arena.lease(arena.max_lease());
+        REQUIRE(!held.empty());
+        REQUIRE(server.handle_infer(prefill).status == 503);
+        REQUIRE(server.handle_infer(candidates).status == 503);
+        REQUIRE(server.handle_embeddings(embeddings).status == 503);
+    }
+    REQUIRE(server.handle_infer(prefill).status == 200);
+    REQUIRE(server.handle_infer(candidates).status == 200);
+    REQUIRE(server.handle_embeddings(embeddings).status == 200);
+    REQUIRE(arena.free_blocks() == arena.capacity());
+}
@@ -0,0 +1,312 @@
+#include "catch.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+#include <nlohmann/json.hpp>
+#include "engine.hpp"
+#include "metrics.hpp"
+#include "server.hpp"
+#include "session_store.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+using castor::testing::make_engine;
+using castor::testing::TempDir;
+
+// Snapshot of a sequence of @p count tokens, KV bytes included
+std::shared_ptr<const castor::SessionSnapshot> snapshot_of(castor::Engine& engine, size_t count, int32_t first = 1) {
+    std::vector<int32_t> tokens(count);
+    for (size_t i = 0; i < count; ++i) {
+        tokens[i] = first + static_cast<int32_t>(i);
+    }
+    castor::SequenceState state;
+    REQUIRE(engine.extend(state, tokens.data(), tokens.size()));
+    std::vector<uint8_t> kv;
+    REQUIRE(engine.save_kv(state, kv));
+    return castor::SessionSnapshot::make(std::move(tokens), state, std::move(kv));
+}
+
+bool restores(castor::Engine& engine, const std::shared_ptr<const castor::SessionSnapshot>& snapshot) {
+    return snapshot && engine.restore_kv(snapshot->state, snapshot->kv, snapshot->kv_bytes);
+}
+
+} // namespace
+
+TEST_CASE("Resuming from a snapshot matches a full prefill", "[sessions]") {
+    auto engine = make_engine();
+    const std::vector<int32_t> prompt = {5, 6, 7, 8, 9, 10, 11, 12};
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 6;
+
+    castor::GenerationResult full;
+    REQUIRE(engine->generate(prompt, params, full));
+
+    auto snapshot = snapshot_of(*engine, 5, 5); // The first five prompt tokens
+    REQUIRE(snapshot->extended_by(prompt));
+    REQUIRE(!snapshot->extended_by({5, 6, 7, 8, 9}));
+    REQUIRE(restores(*engine, snapshot));
+    castor::GenerationStream stream(*engine, prompt, params);
+    REQUIRE(stream.resume_from(snapshot->state, snapshot->tokens.size()));
+    REQUIRE(stream.prompt_remaining() == 3);
+    REQUIRE(stream.run_to_completion());
+    REQUIRE(stream.result().output_ids == full.output_ids);
+    REQUIRE(stream.state().length == prompt.size() + full.output_ids.size() - 1);
+
+    // KV bytes must belong to the state they are restored for
+    castor::SequenceState other = snapshot->state;
+    other.context_hash ^= 1;
+    REQUIRE(!engine->restore_kv(other, snapshot->kv, snapshot->kv_bytes));
+    castor::GenerationStream mismatched(*engine, prompt, params);
+    REQUIRE(!mismatched.resume_from(snapshot->state, 4));
+}
+
+TEST_CASE("SessionStore spills past its RAM budget and maps snapshots back", "[sessions]") {
+    TempDir dir("castor_session_store_spill");
+    auto engine = make_engine();
+    auto a = snapshot_of(*engine, 100, 1);
+    auto b = snapshot_of(*engine, 100, 200);
+    auto c = snapshot_of(*engine, 100, 400);
+
+    castor::SessionStore::Options options;
+    options.directory = dir.path.string();
+    options.max_resident_bytes = a->memory_bytes() * 2;
+    castor::SessionStore store(options);
+    store.put("a", a);
+    store.put("b", b);
+    REQUIRE(store.get("a") == a); // b is now least recently used
+    store.put("c", c);
+    store.flush();
+
+    castor::SessionStore::Stats stats = store.stats();
+    REQUIRE(stats.sessions == 3);
+    REQUIRE(stats.resident == 2);
+    REQUIRE(stats.resident_bytes <= options.max_resident_bytes);
+    REQUIRE(stats.spills == 1);
+    REQUIRE(stats.disk_bytes > b->kv_bytes);
+
+    auto restored = store.get("b");
+    REQUIRE(restored != nullptr);
+    REQUIRE(restored->tokens == b->tokens);
+    REQUIRE(restored->state.context_hash == b->state.context_hash);
+    REQUIRE(restores(*engine, restored));
+    store.flush();
+    stats = store.stats();
+    REQUIRE(stats.restores == 1);
+    REQUIRE(stats.resident == 2); // a went out to make room
+    REQUIRE(store.get("missing") == nullptr);
+
+    // Idle sessions go to disk whatever the budget; already-written ones just leave RAM
+    store.spill_idle(std::chrono::seconds(0));
+    store.flush();
+    stats = store.stats();
+    REQUIRE(stats.resident == 0);
+    REQUIRE(stats.spills == 3);
+    REQUIRE(restores(*engine, store.get("a")));
+    REQUIRE(restores(*engine, store.get("c")));
+
+    store.erase("c");
+    REQUIRE(store.get("c") == nullptr);
+    REQUIRE(store.stats().sessions == 2);
+}
+
+TEST_CASE("SessionStore keeps snapshots across restarts and rejects damaged files", "[sessions]") {
+    TempDir dir("castor_session_store_restart");
+    auto engine = make_engine();
+    castor::SessionStore::Options options;
+    options.directory = dir.path.string();
+    options.compress = castor::SessionStore::compression_available();
+    {
+        castor::SessionStore store(options);
+        store.put("kept", snapshot_of(*engine, 64, 3));
+        store.put("damaged", snapshot_of(*engine, 64, 90));
+        castor::SequenceState state;
+        state.length = 2;
+        store.put("zeros", castor::SessionSnapshot::make({1, 2}, state, std::vector<uint8_t>(1 << 20)));
+        store.spill_idle(std::chrono::seconds(0));
+        store.flush();
+        REQUIRE(store.stats().spills == 3);
+    }
+
+    // Truncate one file behind the store's back
+    for (const auto& file : std::filesystem::directory_iterator(dir.path)) {
+        std::ifstream in(file.path(), std::ios::binary);
+        in.seekg(64);
+        std::string id(7, '\0');
+        in.read(id.data(), id.size());
+        if (id == "damaged") {
+            std::filesystem::resize_file(file.path(), std::filesystem::file_size(file.path()) - 8);
+        }
+    }
+
+    castor::SessionStore store(options);
+    REQUIRE(store.stats().sessions == 3);
+    REQUIRE(store.stats().resident == 0);
+    if (options.compress) {
+        REQUIRE(store.stats().disk_bytes < (1 << 20)); // Random stand-in KV stays raw; zeros shrink
+    }
+    auto kept = store.get("kept");
+    REQUIRE(restores(*engine, kept));
+    REQUIRE(kept->tokens.size() == 64);
+    auto zeros = store.get("zeros");
+    REQUIRE(zeros != nullptr);
+    REQUIRE(zeros->kv_bytes == (1 << 20));
+    REQUIRE(std::all_of(zeros->kv, zeros->kv + zeros->kv_bytes, [](uint8_t b) { return b == 0; }));
+    REQUIRE(store.get("damaged") == nullptr);
+    REQUIRE(store.stats().drops == 1);
+    REQUIRE(store.stats().sessions == 2);
+}
+
+TEST_CASE("/infer session turns prefill only tokens past the snapshot", "[sessions]") {
+    TempDir dir("castor_session_infer_test");
+    std::ofstream vocab(dir.file("tokenizer.json"));
+    vocab << R"({"model": {"vocab": {"<unk>": "0", "the": "1", "quick": "2", "brown": "3", "fox": "4"}}})";
+    vocab.close();
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load(dir.file("tokenizer.json")));
+    auto engine = make_engine();
+    auto sessions = std::make_shared<castor::SessionStore>();
+
+    castor::Server server;
+    REQUIRE(server.initialize(engine, tokenizer));
+    server.set_session_store(sessions);
+
+    const std::string plain = R"({"prompt": "the quick brown fox", "max_tokens": 6, "temperature": 0})";
+    const std::string turn = R"({"prompt": "the quick brown fox", "max_tokens": 6, "temperature": 0, "session": "s1"})";
+    const nlohmann::json expected = nlohmann::json::parse(server.handle_infer(plain).body);
+
+    // First turn: nothing to resume; afterwards the session holds prompt + output (minus the last token)
+    const uint64_t resumes_before = castor::Metrics::counter_value(castor::Counter::SessionResumes);
+    nlohmann::json first = nlohmann::json::parse(server.handle_infer(turn).body);
+    REQUIRE(first["resumed_tokens"] == 0);
+    REQUIRE(first["output_token_ids"] == expected["output_token_ids"]);
+    const std::string key = engine->get_config().model_name + "\ns1";
+    auto saved = sessions->get(key);
+    REQUIRE(saved != nullptr);
+    REQUIRE(saved->tokens.size() ==
+            expected["input_tokens"].get<size_t>() + expected["output_tokens"].get<size_t>() - 1);
+
+    // A turn whose prompt extends the snapshot resumes and generates what a full prefill would
+    const std::vector<int32_t> prompt = expected["input_token_ids"].get<std::vector<int32_t>>();
+    castor::SequenceState state;
+    REQUIRE(engine->extend(state, prompt.data(), 2));
+    std::vector<uint8_t> kv;
+    REQUIRE(engine->save_kv(state, kv));
+    sessions->put(key, castor::SessionSnapshot::make({prompt[0], prompt[1]}, state, std::move(kv)));
+    nlohmann::json second = nlohmann::json::parse(server.handle_infer(turn).body);
+    REQUIRE(second["session"] == "s1");
+    REQUIRE(second["resumed_tokens"] == 2);
+    REQUIRE(second["output_token_ids"] == expected["output_token_ids"]);
+    REQUIRE(castor::Metrics::counter_value(castor::Counter::SessionResumes) == resumes_before + 1);
+
+    server.set_session_store(nullptr);
+}
+
+TEST_CASE("/infer session snapshots with a draft model hold only the emitted tokens", "[sessions]") {
+    TempDir dir("castor_session_draft_test");
+    std::ofstream vocab(dir.file("tokenizer.json"));
+    vocab << R"({"model": {"vocab": {"<unk>": "0", "the": "1", "quick": "2", "brown": "3", "fox": "4"}}})";
+    vocab.close();
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load(dir.file("tokenizer.json")));
+
+    castor::ModelConfig config = castor::testing::small_config();
+    config.eos_token_id = -1;
+    castor::Server server;
+    REQUIRE(server.initialize(make_engine(config), tokenizer));
+    const std::string plain = R"({"prompt": "the quick brown fox", "max_tokens": 12, "temperature": 0})";
+    const std::vector<int32_t> output =
+        nlohmann::json::parse(server.handle_infer(plain).body)["output_token_ids"].get<std::vector<int32_t>>();
+
+    // EOS on the third output token: the stream ends inside a round of accepted
+    // proposals, which the target has already scored past that token
+    REQUIRE(std::find(output.begin(), output.begin() + 2, output[2]) == output.begin() + 2);
+    config.eos_token_id = output[2];
+    auto engine = make_engine(config);
+    castor::SpeculativeOptions options;
+    options.adaptive = false;
+    REQUIRE(engine->set_draft(make_engine(config), options)); // Same model: every proposal is accepted
+    auto sessions = std::make_shared<castor::SessionStore>();
+    REQUIRE(server.initialize(engine, tokenizer));
+    server.set_session_store(sessions);
+
+    const std::string turn = R"({"prompt": "the quick brown fox", "max_tokens": 12, "temperature": 0, "session": "s1"})";
+    const nlohmann::json first = nlohmann::json::parse(server.handle_infer(turn).body);
+    REQUIRE(first["finish_reason"] == "stop");
+    REQUIRE(first["draft_tokens"].get<uint32_t>() > 0);
+    auto saved = sessions->get(config.model_name + "\ns1");
+    REQUIRE(saved != nullptr);
+    std::vector<int32_t> history = first["input_token_ids"].get<std::vector<int32_t>>();
+    history.insert(history.end(), output.begin(), output.begin() + 2); // EOS itself is never fed back
+    REQUIRE(saved->tokens == history);
+    REQUIRE(saved->state.length == history.size());
+
+    // The snapshot resumes to the same output as a full prefill of its tokens
+    history.push_back(1);
+    castor::SamplingParams params;
+    params.temperature = 0.0f;
+    params.max_tokens = 6;
+    castor::GenerationResult full;
+    REQUIRE(engine->generate(history, params, full));
+    REQUIRE(restores(*engine, saved));
+    castor::GenerationStream stream(*engine, history, params);
+    REQUIRE(stream.resume_from(saved->state, saved->tokens.size()));
+    REQUIRE(stream.run_to_completion());
+    REQUIRE(stream.result().output_ids == full.output_ids);
+
+    server.set_session_store(nullptr);
+}
+
+TEST_CASE("/infer reports resumed_tokens only for snapshots the stream accepts", "[sessions]") {
+    TempDir dir("castor_session_resume_test");
+    std::ofstream vocab(dir.file("tokenizer.json"));
+    vocab << R"({"model": {"vocab": {"<unk>": "0", "the": "1", "quick": "2", "brown": "3", "fox": "4"}}})";
+    vocab.close();
+    auto tokenizer = std::make_shared<castor::Tokenizer>();
+    REQUIRE(tokenizer->load(dir.file("tokenizer.json")));
+    auto engine = make_engine();
+    auto sessions = std::make_shared<castor::SessionStore>();
+    castor::Server server;
+    REQUIRE(server.initialize(engine, tokenizer));
+    server.set_session_store(sessions);
+
+    const std::string plain = R"({"prompt": "the quick brown fox", "max_tokens": 6, "temperature": 0})";
+    const std::string turn = R"({"prompt": "the quick brown fox", "max_tokens": 6, "temperature": 0, "session": "s1"})";
+    const nlohmann::json expected = nlohmann::json::parse(server.handle_infer(plain).body);
+    const std::vector<int32_t> prompt = expected["input_token_ids"].get<std::vector<int32_t>>();
+    const std::string key = engine->get_config().model_name + "\ns1";
+
+    // Snapshot tokens and state of different lengths: the KV bytes restore and
+    // the prompt extends the tokens, but resume_from refuses the state
+    auto snapshot = [&](size_t tokens, size_t state_length) {
+        castor::SequenceState state;
+        REQUIRE(engine->extend(state, prompt.data(), state_length));
+        std::vector<uint8_t> kv;
+        REQUIRE(engine->save_kv(state, kv));
+        return castor::SessionSnapshot::make({prompt.begin(), prompt.begin() + tokens}, state, std::move(kv));
+    };
+    for (bool scheduler : {false, true}) {
+        if (scheduler) {
+            server.set_scheduler(std::make_shared<castor::Scheduler>(engine, castor::Scheduler::Options{}));
+        }
+        const uint64_t resumes_before = castor::Metrics::counter_value(castor::Counter::SessionResumes);
+        sessions->put(key, snapshot(2, 3));
+        nlohmann::json refused = nlohmann::json::parse(server.handle_infer(turn).body);
+        REQUIRE(refused["resumed_tokens"] == 0);
+        REQUIRE(refused["output_token_ids"] == expected["output_token_ids"]);
+        REQUIRE(castor::Metrics::counter_value(castor::Counter::SessionResumes) == resumes_before);
+
+        sessions->put(key, snapshot(2, 2));
+        nlohmann::json resumed = nlohmann::json::parse(server.handle_infer(turn).body);
+        REQUIRE(resumed["resumed_tokens"] == 2);
+        REQUIRE(resumed["output_token_ids"] == expected["output_token_ids"]);
+        REQUIRE(castor::Metrics::counter_value(castor::Counter::SessionResumes) == resumes_before + 1);
+    }
+
+    server.set_scheduler(nullptr);
+    server.set_session_store(nullptr);
+}
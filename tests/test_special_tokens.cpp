@@ -0,0 +1,117 @@
+#include "catch.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "special_tokens.hpp"
+
+namespace {
+
+castor::AddedToken token(const std::string& content, int32_t id) {
+    castor::AddedToken added;
+    added.content = content;
+    added.id = id;
+    added.special = true;
+    return added;
+}
+
+// Every match by brute force: earliest start, then longest token there
+std::vector<castor::SpecialTokenMatcher::Match> naive(const std::vector<castor::AddedToken>& tokens,
+                                                      const std::string& text) {
+    std::vector<castor::SpecialTokenMatcher::Match> matches;
+    for (size_t start = 0; start < text.size();) {
+        const castor::AddedToken* best = nullptr;
+        for (const auto& added : tokens) {
+            if (text.compare(start, added.content.size(), added.content) == 0 &&
+                (!best || added.content.size() > best->content.size())) {
+                best = &added;
+            }
+        }
+        if (!best) {
+            ++start;
+            continue;
+        }
+        matches.push_back({start, start + best->content.size(), best->id});
+        start += best->content.size();
+    }
+    return matches;
+}
+
+std::vector<castor::SpecialTokenMatcher::Match> all(const castor::SpecialTokenMatcher& matcher,
+                                                    const std::string& text) {
+    std::vector<castor::SpecialTokenMatcher::Match> matches;
+    castor::SpecialTokenMatcher::Match match;
+    for (size_t from = 0; matcher.find(text, from, match); from = match.end) {
+        matches.push_back(match);
+    }
+    return matches;
+}
+
+} // namespace
+
+TEST_CASE("SpecialTokenMatcher finds the leftmost-longest token", "[special_tokens]") {
+    // One shared first byte (memchr screen), then first bytes that differ (table screen)
+    const std::vector<std::vector<castor::AddedToken>> sets = {
+        {token("<s>", 1), token("</s>", 2), token("<|im_start|>", 3), token("<|im_end|>", 4), token("<|", 5)},
+        {token("<s>", 1), token("[INST]", 2), token("[/INST]", 3), token("[", 4), token("ab", 5), token("abc", 6)},
+    };
+    const std::string alphabet = "<>|/[]sINTabc imstrend_ ";
+    for (const auto& tokens : sets) {
+        castor::SpecialTokenMatcher matcher(tokens);
+        REQUIRE(matcher.size() == tokens.size());
+        REQUIRE(matcher.memory_bytes() > 0);
+        uint64_t state = 12345;
+        for (int round = 0; round < 300; ++round) {
+            std::string text;
+            for (int i = 0; i < 40; ++i) {
+                state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+                const size_t pick = (state >> 33) % (alphabet.size() + tokens.size());
+                text += pick < alphabet.size() ? std::string(1, alphabet[pick])
+                                               : tokens[pick - alphabet.size()].content;
+            }
+            const auto expected = naive(tokens, text);
+            const auto found = all(matcher, text);
+            REQUIRE(found.size() == expected.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                REQUIRE(found[i].begin == expected[i].begin);
+                REQUIRE(found[i].end == expected[i].end);
+                REQUIRE(found[i].id == expected[i].id);
+            }
+        }
+    }
+
+    castor::SpecialTokenMatcher none;
+    castor::SpecialTokenMatcher::Match match;
+    REQUIRE(none.empty());
+    REQUIRE(!none.find("<s>", 0, match));
+    REQUIRE(!castor::SpecialTokenMatcher(sets[0]).find("plain text without markers", 0, match));
+}
+
+TEST_CASE("SpecialTokenMatcher applies lstrip, rstrip and single_word", "[special_tokens]") {
+    castor::AddedToken mask = token("<mask>", 7);
+    mask.lstrip = true;
+    castor::AddedToken start = token("<start>", 8);
+    start.rstrip = true;
+    castor::AddedToken word = token("cat", 9);
+    word.single_word = true;
+    castor::SpecialTokenMatcher matcher({mask, start, word});
+
+    castor::SpecialTokenMatcher::Match match;
+    const std::string text = "a  <mask> b<start> \n c";
+    REQUIRE(matcher.find(text, 0, match));
+    REQUIRE(match.id == 7);
+    REQUIRE(match.begin == 1); // Takes the two spaces before it
+    REQUIRE(match.end == 9);
+    REQUIRE(matcher.find(text, match.end, match));
+    REQUIRE(match.id == 8);
+    REQUIRE(text.substr(match.begin, match.end - match.begin) == "<start> \n ");
+
+    // lstrip stops where the search started, so it never takes text from an earlier match
+    REQUIRE(matcher.find("x <mask>", 2, match));
+    REQUIRE(match.begin == 2);
+
+    REQUIRE(!matcher.find("concatenate", 0, match));
+    REQUIRE(!matcher.find("cats", 0, match));
+    REQUIRE(matcher.find("the cat sat", 0, match));
+    REQUIRE(match.begin == 4);
+    REQUIRE(match.id == 9);
+}
@@ -0,0 +1,150 @@
+#include "catch.hpp"
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <nlohmann/json.hpp>
+#include "server.hpp"
+#include "startup.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+bool sleep_ms(int ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+    return true;
+}
+
+} // namespace
+
+TEST_CASE("StartupGraph overlaps independent phases and orders dependent ones", "[startup]") {
+    castor::StartupGraph graph;
+    const size_t a = graph.add("a", []() { return sleep_ms(60); });
+    const size_t b = graph.add("b", []() { return sleep_ms(60); });
+    const size_t c = graph.add("c", []() { return sleep_ms(10); }, {a, b});
+    REQUIRE(graph.run());
+    REQUIRE(graph.finished());
+    REQUIRE(!graph.run()); // A graph runs once
+
+    const auto phases = graph.status();
+    REQUIRE(phases.size() == 3);
+    for (const auto& phase : phases) {
+        REQUIRE(phase.state == castor::StartupGraph::State::Done);
+    }
+    REQUIRE(phases[c].start_ms >= phases[a].end_ms);
+    REQUIRE(phases[c].start_ms >= phases[b].end_ms);
+    // a and b ran side by side: the whole graph took well under their sum plus c
+    REQUIRE(graph.elapsed_ms() < 110.0);
+    REQUIRE(graph.elapsed_ms() >= phases[c].end_ms);
+
+    const std::string report = graph.report();
+    REQUIRE(report.find("overlap") != std::string::npos);
+    REQUIRE(report.find("  a ") != std::string::npos);
+}
+
+TEST_CASE("StartupGraph skips phases that depend on a failed one", "[startup]") {
+    castor::StartupGraph graph;
+    std::atomic<bool> dependent_ran{false};
+    const size_t broken = graph.add("broken", []() -> bool { throw std::runtime_error("no plan"); });
+    const size_t fine = graph.add("fine", []() { return true; });
+    graph.add("after", [&]() { return dependent_ran = true; }, {broken, fine});
+    graph.add("after_fine", []() { return true; }, {fine});
+
+    bool result = true;
+    graph.start([&](bool ok) { result = ok; });
+    REQUIRE(!graph.wait());
+    REQUIRE(!result);
+    REQUIRE(!dependent_ran);
+    const auto phases = graph.status();
+    REQUIRE(phases[0].state == castor::StartupGraph::State::Failed);
+    REQUIRE(phases[1].state == castor::StartupGraph::State::Done);
+    REQUIRE(phases[2].state == castor::StartupGraph::State::Skipped);
+    REQUIRE(phases[3].state == castor::StartupGraph::State::Done);
+}
+
+TEST_CASE("Built-in model is ready within its cold start budget", "[startup]") {
+    // The bundled model files are placeholders; write them the way main does when they are missing
+    castor::testing::TempDir dir("castor_startup_test");
+    castor::ModelStartup model = castor::ModelStartup::builtin();
+    model.engine_path = dir.file("model.plan");
+    model.tokenizer_path = dir.file("tokenizer.json");
+    {
+        std::ofstream plan(model.engine_path);
+        plan << "DUMMY_TENSORRT_ENGINE_PLACEHOLDER";
+        std::ofstream vocab(model.tokenizer_path);
+        vocab << R"({"model_type": "bpe", "vocab_size": 32000})";
+    }
+
+    for (bool replicas : {false, true}) {
+        castor::ModelStartup attempt = model;
+        attempt.tokenizer = std::make_shared<castor::Tokenizer>();
+        attempt.replicas = replicas;
+        attempt.replica_options.replicas = 2;
+        attempt.replica_options.threads_per_replica = 1;
+        castor::StartupGraph graph;
+        const castor::ModelStartup::Phases phases = attempt.add_to(graph);
+        REQUIRE(graph.run());
+
+        // 2 s covers a loaded CI machine; a warm start on a workstation takes a few tens of ms
+        REQUIRE(graph.elapsed_ms() < 2000.0);
+        REQUIRE(attempt.engine->is_initialized());
+        REQUIRE(attempt.prefaulted_bytes == 33);
+        REQUIRE(attempt.engine->kernels().isa == attempt.kernels.isa);
+        REQUIRE((attempt.pool != nullptr) == replicas);
+        const auto status = graph.status();
+        REQUIRE(status[phases.engine].start_ms >= status[phases.kernels].end_ms);
+        REQUIRE(status[phases.warmup].start_ms >= status[phases.engine].end_ms);
+        REQUIRE(status[phases.warmup].start_ms >= status[phases.tokenizer].end_ms);
+    }
+}
+
+TEST_CASE("Autotune runs alone between the model's loads and its engine", "[startup]") {
+    castor::ModelStartup model = castor::ModelStartup::builtin();
+    model.engine_path = "missing.plan";
+    model.tokenizer_path = "missing_tokenizer.json";
+    model.config.hidden_dim = 64;
+    model.config.num_layers = 2;
+    model.config.vocab_size = 1000;
+    castor::StartupGraph graph;
+    const castor::ModelStartup::Phases phases = model.add_to(graph, [&model]() {
+        model.config.max_batch_size = 3; // Read by the engine phase
+        return true;
+    });
+    REQUIRE(graph.run());
+
+    const auto status = graph.status();
+    REQUIRE(status[phases.autotune].name == "autotune");
+    for (size_t load : {phases.tokenizer, phases.weights, phases.kernels}) {
+        REQUIRE(status[phases.autotune].start_ms >= status[load].end_ms);
+    }
+    REQUIRE(status[phases.engine].start_ms >= status[phases.autotune].end_ms);
+    REQUIRE(model.engine->get_config().max_batch_size == 3);
+}
+
+TEST_CASE("Server answers 503 for inference until it is ready", "[startup]") {
+    castor::ModelStartup model = castor::ModelStartup::builtin();
+    model.engine_path = "missing.plan";
+    model.tokenizer_path = "missing_tokenizer.json";
+    model.config.hidden_dim = 64;
+    model.config.num_layers = 2;
+    model.config.vocab_size = 1000;
+    castor::StartupGraph graph;
+    model.add_to(graph);
+    REQUIRE(graph.run());
+
+    castor::Server server;
+    server.set_ready(false);
+    REQUIRE(!server.is_ready());
+    const std::string body = R"({"prompt": "hello", "max_tokens": 2})";
+    const castor::InferResponse waiting = server.handle_infer(body);
+    REQUIRE(waiting.status == 503);
+    REQUIRE(nlohmann::json::parse(waiting.body).contains("error"));
+    REQUIRE(server.handle_embeddings(R"({"input": "hello"})").status == 503);
+
+    REQUIRE(server.initialize(model.engine, model.tokenizer));
+    server.set_ready(true);
+    REQUIRE(server.handle_infer(body).status == 200);
+}
@@ -0,0 +1,177 @@
+#include "catch.hpp"
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+#include "engine.hpp"
+#include "stop_sequences.hpp"
+#include "test_fixtures.hpp"
+
+namespace {
+
+// Token i is the text "t<i>" for i < 10, then "ab", "abc", "c", "x"
+std::shared_ptr<const castor::StopSequences::Vocabulary> small_vocabulary() {
+    auto table = std::make_shared<castor::StopSequences::Vocabulary>();
+    for (int i = 0; i < 10; ++i) {
+        table->push_back("t" + std::to_string(i));
+    }
+    for (const char* text : {"ab", "abc", "c", "x"}) {
+        table->push_back(text);
+    }
+    return table;
+}
+
+// Single-byte tokens, like the placeholder tokenizer
+std::shared_ptr<const castor::StopSequences::Vocabulary> byte_vocabulary() {
+    auto table = std::make_shared<castor::StopSequences::Vocabulary>(256);
+    for (size_t b = 0; b < table->size(); ++b) {
+        (*table)[b] = std::string(1, static_cast<char>(b));
+    }
+    return table;
+}
+
+} // namespace
+
+TEST_CASE("StopSequences finds the first stop string across token boundaries", "[stop_sequences]") {
+    std::string error;
+    auto stop = castor::StopSequences::compile({"bcx", "cx", "abcd"}, {3}, small_vocabulary(), error);
+    REQUIRE(stop);
+
+    int32_t state = stop->start();
+    std::string text;
+    std::string matched;
+    REQUIRE(!stop->append(state, 0, text, &matched)); // "t0"
+    REQUIRE(!stop->append(state, 11, text, &matched)); // "abc": may still become "abcd"
+    REQUIRE(stop->pending_bytes(state) == 3);
+    REQUIRE(stop->append(state, 13, text, &matched)); // "x" completes "bcx" and "cx"
+    REQUIRE(matched == "bcx");                         // The longer one starts first
+    REQUIRE(text == "t0a");
+
+    // Stop token ids end generation without adding their text
+    state = stop->start();
+    text.clear();
+    REQUIRE(stop->append(state, 3, text));
+    REQUIRE(text.empty());
+
+    // A failed partial match still finds the stop string it overlaps
+    state = stop->start();
+    text.clear();
+    REQUIRE(!stop->append(state, 10, text)); // "ab"
+    REQUIRE(!stop->append(state, 10, text)); // "abab"
+    REQUIRE(stop->pending_bytes(state) == 2);
+    REQUIRE(!stop->append(state, 12, text)); // "ababc"
+    REQUIRE(stop->append(state, 13, text, &matched));
+    REQUIRE(matched == "bcx");
+    REQUIRE(text == "aba");
+
+    REQUIRE(!castor::StopSequences::compile({"ok", ""}, {}, nullptr, error));
+    REQUIRE(!error.empty());
+    REQUIRE(!castor::StopSequences::compile({std::string(castor::StopSequences::kMaxBytes + 1, 'a')}, {}, nullptr,
+                                            error));
+}
+
+TEST_CASE("Generation stops at stop strings and stop tokens", "[stop_sequences]") {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.vocab_size = 256;
+    config.eos_token_id = -1;
+    auto engine = castor::testing::make_engine(config);
+    auto vocabulary = byte_vocabulary();
+
+    castor::SamplingParams params;
+    params.max_tokens = 48;
+    params.temperature = 0.0f;
+    castor::GenerationResult plain;
+    REQUIRE(engine->generate({1, 2, 3}, params, plain));
+    REQUIRE(plain.output_ids.size() == 48);
+    std::string full;
+    for (int32_t id : plain.output_ids) {
+        full += (*vocabulary)[id];
+    }
+
+    // Stop strings taken from the middle of the unconstrained output; the
+    // output ends where the first occurrence of either ends
+    const std::vector<std::string> stops{full.substr(20, 4), full.substr(30, 3)};
+    size_t end = std::string::npos;
+    for (const auto& stop : stops) {
+        end = std::min(end, full.find(stop) + stop.size());
+    }
+    std::string error;
+    params.stop = castor::StopSequences::compile(stops, {}, vocabulary, error);
+    REQUIRE(params.stop);
+    castor::GenerationResult stopped;
+    REQUIRE(engine->generate({1, 2, 3}, params, stopped));
+    REQUIRE(stopped.finish_reason == "stop");
+    REQUIRE(stopped.output_ids.size() == end);
+    REQUIRE(stopped.output_text + stopped.stop_sequence == full.substr(0, end));
+
+    // Streaming: every piece is final, and together they are the output. At
+    // most a stop-string prefix plus a partial UTF-8 character is withheld.
+    castor::GenerationStream stream(*engine, {1, 2, 3}, params);
+    REQUIRE(stream.prefill());
+    std::string streamed;
+    while (!stream.finished()) {
+        REQUIRE(stream.decode_step());
+        streamed += stream.take_text();
+        REQUIRE(stopped.output_text.compare(0, streamed.size(), streamed) == 0);
+        if (!stream.finished()) {
+            REQUIRE(stream.result().output_ids.size() - streamed.size() <= 3 + 3);
+        }
+    }
+    REQUIRE(streamed == stopped.output_text);
+    REQUIRE(stream.take_text().empty());
+
+    // Without a match the held-back tail is released when the stream ends
+    params.stop = castor::StopSequences::compile({full.substr(44, 4) + "!"}, {}, vocabulary, error);
+    castor::GenerationStream tail(*engine, {1, 2, 3}, params);
+    REQUIRE(tail.prefill());
+    streamed.clear();
+    while (!tail.finished()) {
+        REQUIRE(tail.decode_step());
+        streamed += tail.take_text();
+    }
+    REQUIRE(tail.result().finish_reason == "length");
+    REQUIRE(streamed == full);
+
+    // Stop token ids are kept in output_ids (like EOS) but not in the text
+    params.stop = castor::StopSequences::compile({}, {plain.output_ids[5]}, vocabulary, error);
+    castor::GenerationResult by_token;
+    REQUIRE(engine->generate({1, 2, 3}, params, by_token));
+    REQUIRE(by_token.finish_reason == "stop");
+    REQUIRE(by_token.output_ids.back() == plain.output_ids[5]);
+    REQUIRE(by_token.output_ids.size() <= 6);
+    REQUIRE(by_token.output_text == full.substr(0, by_token.output_ids.size() - 1));
+}
+
+TEST_CASE("GenerationStream::take_text holds back incomplete UTF-8", "[stop_sequences]") {
+    castor::ModelConfig config = castor::testing::small_config();
+    config.vocab_size = 16;
+    config.eos_token_id = -1;
+    auto engine = castor::testing::make_engine(config);
+
+    // Force the output "é" split over two tokens: 0xC3 then 0xA9
+    auto vocabulary = std::make_shared<castor::StopSequences::Vocabulary>(16, std::string());
+    std::string error;
+    castor::SamplingParams params;
+    params.max_tokens = 3;
+    params.temperature = 0.0f;
+    castor::GenerationResult plain;
+    REQUIRE(engine->generate({1}, params, plain));
+    (*vocabulary)[plain.output_ids[0]] = "\xC3";
+    (*vocabulary)[plain.output_ids[1]] = "\xA9";
+    (*vocabulary)[plain.output_ids[2]] = "!";
+    REQUIRE(plain.output_ids[0] != plain.output_ids[1]);
+    REQUIRE(plain.output_ids[1] != plain.output_ids[2]);
+    REQUIRE(plain.output_ids[0] != plain.output_ids[2]);
+    params.stop = castor::StopSequences::compile({"zz"}, {}, vocabulary, error);
+    REQUIRE(params.stop);
+
+    castor::GenerationStream stream(*engine, {1}, params);
+    REQUIRE(stream.prefill());
+    REQUIRE(stream.decode_step());
+    REQUIRE(stream.take_text().empty());
+    REQUIRE(stream.decode_step());
+    REQUIRE(stream.take_text() == "\xC3\xA9");
+    REQUIRE(stream.decode_step());
+    REQUIRE(stream.finished());
+    REQUIRE(stream.take_text() == "!");
+}
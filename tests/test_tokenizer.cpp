@@ -1,40 +1,50 @@
 #include "catch.hpp"
+#include <cstdio>
 #include <fstream>
 #include <memory>
+#include <string>
+#include <vector>
 #include "tokenizer.hpp"
 
+// A minimal tokenizer.json: what load() expects of a real HF file
+static const char* const kVocab = R"({"model": {"vocab": {"<unk>": "0", "hello": "1", "world": "2"}}})";
+
 TEST_CASE("Tokenizer creation", "[tokenizer]") {
     auto tokenizer = std::make_shared<castor::Tokenizer>();
     REQUIRE(!tokenizer->is_loaded());
 }
 
-TEST_CASE("Tokenizer load with invalid path", "[tokenizer]") {
+TEST_CASE("Tokenizer load with invalid path falls back to the placeholder", "[tokenizer]") {
     auto tokenizer = std::make_shared<castor::Tokenizer>();
     bool result = tokenizer->load("nonexistent/path/tokenizer.json");
-    REQUIRE(!result);
+    REQUIRE(result);
+    REQUIRE(tokenizer->is_loaded());
+    REQUIRE(tokenizer->vocab_size() == 32000);
 }
 
 TEST_CASE("Tokenizer load with valid file", "[tokenizer]") {
     std::ofstream test_file("tests/test_tokenizer.json");
-    test_file << R"({"vocab_size": 50000})";
+    test_file << kVocab;
     test_file.close();
     
     auto tokenizer = std::make_shared<castor::Tokenizer>();
     bool result = tokenizer->load("tests/test_tokenizer.json");
+    std::remove("tests/test_tokenizer.json");
     REQUIRE(result);
     REQUIRE(tokenizer->is_loaded());
-    REQUIRE(tokenizer->vocab_size() == 50000);
+    REQUIRE(tokenizer->vocab_size() == 3);
 }
 
 TEST_CASE("Tokenizer double load fails", "[tokenizer]") {
     std::ofstream test_file("tests/test_tokenizer2.json");
-    test_file << R"({"vocab_size": 32000})";
+    test_file << kVocab;
     test_file.close();
     
     auto tokenizer = std::make_shared<castor::Tokenizer>();
-    tokenizer->load("tests/test_tokenizer2.json");
+    REQUIRE(tokenizer->load("tests/test_tokenizer2.json"));
     
     bool result = tokenizer->load("tests/test_tokenizer2.json");
+    std::remove("tests/test_tokenizer2.json");
     REQUIRE(!result);
 }
 
@@ -46,13 +56,66 @@ TEST_CASE("Tokenizer encode without load fails", "[tokenizer]") {
 
 TEST_CASE("Tokenizer encode after load", "[tokenizer]") {
     std::ofstream test_file("tests/test_tokenizer3.json");
-    test_file << R"({"vocab_size": 32000})";
+    test_file << kVocab;
     test_file.close();
     
     auto tokenizer = std::make_shared<castor::Tokenizer>();
     tokenizer->load("tests/test_tokenizer3.json");
+    std::remove("tests/test_tokenizer3.json");
     
     auto tokens = tokenizer->encode("hello world");
     REQUIRE(!tokens.empty());
     REQUIRE(tokens.size() >= 2);
 }
+
+TEST_CASE("Tokenizer encodes added tokens as single ids", "[tokenizer]") {
+    const std::string vocab =
+        R"("vocab": {"<unk>": 0, "hello": 1, "world": 2, "user": 3, "<": 4, "s": 5, ">": 6, "x": 7})";
+    {
+        std::ofstream plain("tests/test_tokenizer_plain.json");
+        plain << R"({"model": {)" << vocab << "}}";
+        std::ofstream added("tests/test_tokenizer_added.json");
+        added << R"({"model": {)" << vocab << R"(}, "added_tokens": [
+            {"id": 100, "content": "<s>", "special": true},
+            {"id": 101, "content": "</s>", "special": true},
+            {"id": 102, "content": "<|im_start|>", "special": true, "rstrip": true},
+            {"id": 103, "content": "<|im_end|>", "special": true, "lstrip": true},
+            {"id": 104, "content": "<|", "special": true}]})";
+    }
+    castor::Tokenizer plain;
+    castor::Tokenizer tokenizer;
+    REQUIRE(plain.load("tests/test_tokenizer_plain.json"));
+    REQUIRE(tokenizer.load("tests/test_tokenizer_added.json"));
+    REQUIRE(tokenizer.vocab_size() == 13);
+
+    REQUIRE(tokenizer.encode("<s>hello world</s>") == std::vector<int32_t>({100, 1, 2, 101}));
+    REQUIRE(tokenizer.encode("hello<s>world") == std::vector<int32_t>({1, 100, 2}));
+    REQUIRE(tokenizer.encode("<|im_start|>user\nhello <|im_end|>") == std::vector<int32_t>({102, 3, 1, 103}));
+    REQUIRE(tokenizer.encode("<|x") == std::vector<int32_t>({104, 7})); // Longest match, not the first listed
+    REQUIRE(plain.encode("<s>hello") == std::vector<int32_t>({4, 5, 6, 0, 0, 0, 0, 0}));
+    REQUIRE(tokenizer.decode({100, 1, 101}) == "<s>hello</s>");
+
+    // Text without added tokens encodes exactly as before
+    for (const std::string text : {"hello world", "  user\thello  ", "hellox <", ""}) {
+        REQUIRE(tokenizer.encode(text) == plain.encode(text));
+    }
+    std::remove("tests/test_tokenizer_plain.json");
+    std::remove("tests/test_tokenizer_added.json");
+}
+
+TEST_CASE("Tokenizer matches normalized added tokens after normalization", "[tokenizer]") {
+    {
+        std::ofstream file("tests/test_tokenizer_normalized.json");
+        file << R"({"normalizer": {"type": "Sequence", "normalizers": [{"type": "Lowercase"}]},
+                    "model": {"vocab": {"<unk>": 0, "hello": 1, "there": 2}},
+                    "added_tokens": [
+                        {"id": 10, "content": "<S>", "special": true, "normalized": false},
+                        {"id": 11, "content": "General", "normalized": true, "single_word": true}]})";
+    }
+    castor::Tokenizer tokenizer;
+    REQUIRE(tokenizer.load("tests/test_tokenizer_normalized.json"));
+    REQUIRE(tokenizer.encode("<S>HELLO general There") == std::vector<int32_t>({10, 1, 11, 2}));
+    REQUIRE(tokenizer.encode("<s>") != std::vector<int32_t>({10})); // Raw tokens match the raw text only
+    REQUIRE(tokenizer.encode("generally") != std::vector<int32_t>({11})); // single_word
+    std::remove("tests/test_tokenizer_normalized.json");
+}
@@ -0,0 +1,48 @@
+#include "catch.hpp"
+#include <string>
+#include "trace.hpp"
+
+TEST_CASE("PhaseTimings accumulates repeated phases", "[trace]") {
+    castor::PhaseTimings timings;
+    timings.add("parse", 10);
+    timings.add("infer", 20);
+    timings.add("parse", 5);
+
+    REQUIRE(timings.count == 2);
+    REQUIRE(timings.phases[0].ticks == 15);
+}
+
+TEST_CASE("Server-Timing header lists phases", "[trace]") {
+    castor::PhaseTimings timings;
+    timings.add("tokenize", 1000);
+    timings.add("infer", 2000);
+
+    std::string header = timings.to_server_timing();
+    REQUIRE(header.find("tokenize;dur=") == 0);
+    REQUIRE(header.find(", infer;dur=") != std::string::npos);
+}
+
+TEST_CASE("Tracer exports recorded spans as Chrome JSON", "[trace]") {
+    castor::Tracer::set_enabled(true);
+    uint64_t start = castor::Tracer::now();
+    castor::Tracer::record("unit.span", start, castor::Tracer::now(), 42);
+    castor::Tracer::set_enabled(false);
+
+    std::string json = castor::Tracer::export_chrome_json(60.0);
+    REQUIRE(json.find("\"traceEvents\"") != std::string::npos);
+    REQUIRE(json.find("unit.span") != std::string::npos);
+}
+
+TEST_CASE("Tracer export skips the ring slot the writer may be reusing", "[trace]") {
+    for (size_t i = 0; i < 2 * castor::Tracer::kRingCapacity; ++i) {
+        const uint64_t start = castor::Tracer::now();
+        castor::Tracer::record("wrap.span", start, start + 1, 0);
+    }
+    const std::string json = castor::Tracer::export_chrome_json(60.0);
+    size_t count = 0;
+    for (size_t at = json.find("\"wrap.span\""); at != std::string::npos; at = json.find("\"wrap.span\"", at + 1)) {
+        ++count;
+    }
+    // The oldest slot still in the ring is the next one overwritten
+    REQUIRE(count == castor::Tracer::kRingCapacity - 1);
+}
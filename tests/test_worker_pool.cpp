@@ -0,0 +1,62 @@
+#include "catch.hpp"
+#include <atomic>
+#include <sched.h>
+#include <thread>
+#include <vector>
+#include "affinity.hpp"
+#include "worker_pool.hpp"
+
+TEST_CASE("Affinity parses and formats CPU lists", "[worker_pool]") {
+    std::vector<int> cpus;
+    REQUIRE(castor::Affinity::parse_cpu_list("0-3,8, 10-11,2", cpus));
+    REQUIRE(cpus == std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+    REQUIRE(castor::Affinity::format_cpu_list(cpus) == "0-3,8,10-11");
+
+    REQUIRE(castor::Affinity::parse_cpu_list("", cpus));
+    REQUIRE(cpus.empty());
+    REQUIRE(!castor::Affinity::parse_cpu_list("3-1", cpus));
+    REQUIRE(!castor::Affinity::parse_cpu_list("a", cpus));
+    REQUIRE(!castor::Affinity::parse_cpu_list("1x", cpus));
+}
+
+TEST_CASE("WorkerPool runs tasks off the calling thread", "[worker_pool]") {
+    castor::WorkerPool::Options options;
+    options.threads = 4;
+    castor::WorkerPool pool(options);
+    REQUIRE(pool.size() == 4);
+
+    const auto caller = std::this_thread::get_id();
+    REQUIRE(pool.run([] { return std::this_thread::get_id(); }) != caller);
+    REQUIRE(!castor::WorkerPool::on_worker_thread());
+
+    std::atomic<int> sum{0};
+    std::vector<std::future<void>> futures;
+    for (int i = 1; i <= 100; ++i) {
+        futures.push_back(pool.submit([&sum, i] { sum += i; }));
+    }
+    for (auto& f : futures) {
+        f.get();
+    }
+    REQUIRE(sum == 5050);
+}
+
+TEST_CASE("WorkerPool runs nested calls inline", "[worker_pool]") {
+    castor::WorkerPool::Options options;
+    options.threads = 1;
+    castor::WorkerPool pool(options);
+    // With one worker, a nested run() that queued would deadlock
+    REQUIRE(pool.run([&pool] { return pool.run([] { return 7; }); }) == 7);
+}
+
+TEST_CASE("WorkerPool without threads runs on the caller", "[worker_pool]") {
+    castor::WorkerPool pool(castor::WorkerPool::Options{});
+    REQUIRE(pool.run([] { return std::this_thread::get_id(); }) == std::this_thread::get_id());
+}
+
+TEST_CASE("WorkerPool pins workers to the configured CPU", "[worker_pool]") {
+    castor::WorkerPool::Options options;
+    options.threads = 1;
+    options.cpus = {0};
+    castor::WorkerPool pool(options);
+    REQUIRE(pool.run([] { return sched_getcpu(); }) == 0);
+}
@@ -1,6 +1,7 @@
 // Minimal Catch2 v3 compatible header for basic testing
 #pragma once
 
+#include <cmath>
 #include <iostream>
 #include <string>
 #include <functional>
@@ -8,23 +9,28 @@
 #include <stdexcept>
 
 namespace Catch2 {
-    static int test_count = 0;
-    static int fail_count = 0;
+    inline int test_count = 0;
+    inline int fail_count = 0;
 
     struct TestCase {
         std::string name;
         std::function<void()> test_func;
     };
 
-    static std::vector<TestCase>& get_tests() {
+    // One registry for the whole program, shared by every test file
+    inline std::vector<TestCase>& get_tests() {
         static std::vector<TestCase> tests;
         return tests;
     }
 
-    void register_test(const std::string& name, std::function<void()> test) {
+    inline void register_test(const std::string& name, std::function<void()> test) {
         get_tests().push_back({name, test});
     }
 
+    struct Registrar {
+        Registrar(const char* name, void (*test)()) { register_test(name, test); }
+    };
+
     struct Section {
         Section(const std::string& name) : name(name) {}
         std::string name;
@@ -40,9 +46,9 @@ namespace Catch2 {
     }
 
     template<typename T>
-    void require_true(const T& val, const std::string& file, int line) {
+    void require_true(const T& val, const std::string& file, int line, const char* expr = "assertion") {
         if (!val) {
-            std::cerr << "FAIL at " << file << ":" << line << " - assertion false\n";
+            std::cerr << "FAIL at " << file << ":" << line << " - " << expr << "\n";
             fail_count++;
             throw std::runtime_error("Assertion failed");
         }
@@ -50,12 +56,18 @@ namespace Catch2 {
 
     class Session {
     public:
+        // Runs every registered test, or those whose name contains argv[1]
         int run(int argc, char* argv[]) {
+            const std::string filter = argc > 1 ? argv[1] : "";
             std::cout << "\n========== Running Tests ==========\n";
             int passed = 0;
             int failed = 0;
-            
+
             for (auto& test : get_tests()) {
+                if (!filter.empty() && test.name.find(filter) == std::string::npos) {
+                    continue;
+                }
+                test_count++;
                 try {
                     test.test_func();
                     std::cout << "✓ " << test.name << "\n";
@@ -65,34 +77,38 @@ namespace Catch2 {
                     failed++;
                 }
             }
-            
+
             std::cout << "\n========== Test Summary ==========\n";
             std::cout << "Passed: " << passed << "\n";
             std::cout << "Failed: " << failed << "\n";
-            
+
             return failed == 0 ? 0 : 1;
         }
     };
 }
 
-#define TEST_CASE(name, tags) \
-    void test_func_##__LINE__(); \
-    namespace { struct test_register_##__LINE__ { test_register_##__LINE__() { \
-        Catch2::register_test(name, test_func_##__LINE__); \
-    } } test_instance_##__LINE__; } \
-    void test_func_##__LINE__()
+#define CATCH2_CONCAT_IMPL(a, b) a##b
+#define CATCH2_CONCAT(a, b) CATCH2_CONCAT_IMPL(a, b)
+
+// __COUNTER__ keeps names unique within a file; static keeps them file-local
+#define CATCH2_TEST_CASE_IMPL(func, name) \
+    static void func(); \
+    static const Catch2::Registrar CATCH2_CONCAT(func, _registrar)(name, &func); \
+    static void func()
+
+#define TEST_CASE(name, tags) CATCH2_TEST_CASE_IMPL(CATCH2_CONCAT(catch2_test_func_, __COUNTER__), name)
 
-#define REQUIRE(expr) Catch2::require_true(expr, __FILE__, __LINE__)
+#define REQUIRE(...) Catch2::require_true((__VA_ARGS__), __FILE__, __LINE__, #__VA_ARGS__)
 #define REQUIRE_EQ(a, b) Catch2::require_equal(a, b, __FILE__, __LINE__)
-#define CHECK(expr) REQUIRE(expr)
+#define CHECK(...) REQUIRE(__VA_ARGS__)
 
 // Approx for floating point
 struct Approx {
     double value;
     double margin = 1e-6;
-    
+
     Approx(double v) : value(v) {}
-    
+
     bool operator==(double other) const {
         return std::abs(value - other) < margin;
     }
@@ -102,4 +118,4 @@ inline Approx approx(double val) {
     return Approx(val);
 }
 
-#define CATCH2_APPROX(v) Catch2::approx(v)
+#define CATCH2_APPROX(v) ::approx(v)